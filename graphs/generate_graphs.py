@@ -1,6 +1,10 @@
+import argparse
+import json
+import sys
+from pathlib import Path
+
 import matplotlib.pyplot as plt
 import numpy as np
-from pathlib import Path
 
 plt.style.use('seaborn-v0_8-darkgrid')
 plt.rcParams['figure.figsize'] = (12, 7)
@@ -8,120 +12,73 @@ plt.rcParams['font.size'] = 11
 plt.rcParams['axes.titlesize'] = 14
 plt.rcParams['axes.labelsize'] = 12
 
-output_dir = Path('images')
+IMPLEMENTATIONS = ('serial', 'data_parallel', 'pipeline_parallel')
+
+
+def parse_args():
+    default_results = Path(__file__).resolve().parent.parent / 'results'
+    parser = argparse.ArgumentParser(
+        description='Plot the serial/data-parallel/pipeline records written by the '
+                    'inference binaries\' --json option.')
+    parser.add_argument('results', nargs='*', type=Path,
+                        help=f'JSON Lines files (default: {default_results}/*.jsonl)')
+    parser.add_argument('--tag', default=None,
+                        help='Only use records with this tag (default: untagged records)')
+    parser.add_argument('--output', type=Path, default=Path('images'),
+                        help='Directory for the PNG files (default: ./images)')
+    args = parser.parse_args()
+    if not args.results:
+        args.results = sorted(default_results.glob('*.jsonl'))
+    return args
+
+
+def load_records(paths, tag):
+    """Latest record for each (implementation, processes) pair, in file order."""
+    latest = {}
+    for path in paths:
+        with open(path, 'r') as f:
+            for line in f:
+                line = line.strip()
+                if not line:
+                    continue
+                record = json.loads(line)
+                config = record.get('config', {})
+                if config.get('implementation') not in IMPLEMENTATIONS:
+                    continue
+                if config.get('tag') != tag:
+                    continue
+                latest[(config['implementation'], config['num_processes'])] = record['metrics']
+    return latest
+
+
+args = parse_args()
+output_dir = args.output
 output_dir.mkdir(exist_ok=True)
 
-processes = [1, 2, 3, 4, 5, 6, 7, 8]
-serial_time = 5.276
-
-execution_times = {
-    1: 5.269,
-    2: 2.767,
-    3: 1.912,
-    4: 1.440,
-    5: 1.296,
-    6: 1.164,
-    7: 1.064,
-    8: 0.975
-}
-
-throughput = {
-    1: 1898.05,
-    2: 3613.99,
-    3: 5230.17,
-    4: 6942.93,
-    5: 7716.50,
-    6: 8590.98,
-    7: 9394.28,
-    8: 10252.38
-}
-
-speedup = {
-    1: 1.00,
-    2: 1.91,
-    3: 2.76,
-    4: 3.66,
-    5: 4.07,
-    6: 4.53,
-    7: 4.96,
-    8: 5.41
-}
-
-efficiency = {
-    1: 100.0,
-    2: 95.3,
-    3: 92.0,
-    4: 91.6,
-    5: 81.4,
-    6: 75.5,
-    7: 70.8,
-    8: 67.6
-}
-
-memory_usage = {
-    1: 21.95,
-    2: 22.39,
-    3: 22.56,
-    4: 22.59,
-    5: 22.58,
-    6: 22.53,
-    7: 22.67,
-    8: 22.69
-}
-
-communication_overhead = {
-    2: 0.0,
-    3: 0.0,
-    4: 0.3,
-    5: 4.7,
-    6: 3.6,
-    7: 1.9,
-    8: 2.3
-}
-
-load_imbalance = {
-    1: 0.00,
-    2: 0.08,
-    3: 0.09,
-    4: 0.31,
-    5: 4.51,
-    6: 3.65,
-    7: 6.87,
-    8: 4.93
-}
-
-latency_avg = {
-    1: 0.527,
-    2: 0.277,
-    3: 0.191,
-    4: 0.144,
-    5: 0.130,
-    6: 0.116,
-    7: 0.106,
-    8: 0.098
-}
-
-latency_min = {
-    1: 0.520,
-    2: 0.548,
-    3: 0.569,
-    4: 0.569,
-    5: 0.569,
-    6: 0.569,
-    7: 0.569,
-    8: 0.569
-}
-
-latency_max = {
-    1: 0.816,
-    2: 0.977,
-    3: 1.121,
-    4: 1.678,
-    5: 4.138,
-    6: 6.324,
-    7: 5.330,
-    8: 16.672
-}
+records = load_records(args.results, args.tag)
+data_parallel = {p: m for (impl, p), m in records.items() if impl == 'data_parallel'}
+if not data_parallel:
+    sys.exit('No data_parallel records found; run make benchmark first')
+serial = records.get(('serial', 1), data_parallel.get(1))
+if serial is None:
+    sys.exit('No serial (or 1-process data_parallel) record found')
+pipelines = sorted((p, m) for (impl, p), m in records.items() if impl == 'pipeline_parallel')
+
+processes = sorted(data_parallel)
+serial_time = serial['inference_time']
+
+execution_times = {p: m['inference_time'] for p, m in data_parallel.items()}
+throughput = {p: m['throughput_images_per_sec'] for p, m in data_parallel.items()}
+speedup = {p: serial_time / execution_times[p] for p in processes}
+efficiency = {p: speedup[p] / p * 100.0 for p in processes}
+memory_usage = {p: m['peak_memory_bytes'] / (1024.0 * 1024.0) for p, m in data_parallel.items()}
+communication_overhead = {p: m['communication_time'] / m['inference_time'] * 100.0
+                          for p, m in data_parallel.items() if p > 1 and m['inference_time'] > 0}
+load_imbalance = {p: m['load_imbalance'] * 100.0 for p, m in data_parallel.items()}
+latency_avg = {p: m['avg_latency_per_image_ms'] for p, m in data_parallel.items()}
+latency_min = {p: m['min_latency_ms'] for p, m in data_parallel.items()}
+latency_max = {p: m['max_latency_ms'] for p, m in data_parallel.items()}
+serial_memory = serial['peak_memory_bytes'] / (1024.0 * 1024.0)
 
 fig, ax = plt.subplots(figsize=(12, 7))
 ax.plot(processes, [execution_times[p] for p in processes], 'o-', linewidth=2.5, markersize=10, label='Actual', color='#2E86AB')
@@ -237,7 +194,7 @@ plt.savefig(output_dir / '05_latency.png', dpi=300, bbox_inches='tight')
 plt.close()
 
 fig, ax = plt.subplots(figsize=(12, 7))
-proc_list = [2, 3, 4, 5, 6, 7, 8]
+proc_list = sorted(communication_overhead)
 comm_values = [communication_overhead[p] for p in proc_list]
 comp_values = [100 - communication_overhead[p] for p in proc_list]
 width = 0.6
@@ -281,7 +238,8 @@ plt.close()
 
 fig, ax = plt.subplots(figsize=(12, 7))
 ax.plot(processes, [memory_usage[p] for p in processes], 'o-', linewidth=2.5, markersize=10, color='#F72585')
-ax.axhline(y=11.77, color='#4CC9F0', linestyle='--', linewidth=2, label='Serial Baseline (11.77 MB)', alpha=0.8)
+ax.axhline(y=serial_memory, color='#4CC9F0', linestyle='--', linewidth=2,
+           label=f'Serial Baseline ({serial_memory:.2f} MB)', alpha=0.8)
 ax.set_xlabel('Number of Processes', fontweight='bold')
 ax.set_ylabel('Peak Memory Usage (MB)', fontweight='bold')
 ax.set_title('Memory Usage vs Number of Processes', fontweight='bold', pad=20)
@@ -350,12 +308,19 @@ plt.close()
 
 fig, ax = plt.subplots(figsize=(12, 7))
 
-implementations = ['Serial\n(1P)', 'Data Parallel\n(2P)', 'Data Parallel\n(3P)', 
-                   'Data Parallel\n(4P)', 'Data Parallel\n(5P)', 'Data Parallel\n(6P)',
-                   'Data Parallel\n(7P)', 'Data Parallel\n(8P)', 'Pipeline\n(5P)']
-times = [5.276, 2.767, 1.912, 1.440, 1.296, 1.164, 1.064, 0.975, 3.368]
-speedups = [1.0, 1.91, 2.76, 3.66, 4.07, 4.53, 4.96, 5.41, 1.57]
-colors_impl = ['#F18F01', '#06A77D', '#06A77D', '#06A77D', '#06A77D', '#06A77D', '#06A77D', '#06A77D', '#3A86FF']
+implementations = ['Serial\n(1P)']
+times = [serial_time]
+colors_impl = ['#F18F01']
+for p in processes:
+    if p > 1:
+        implementations.append(f'Data Parallel\n({p}P)')
+        times.append(execution_times[p])
+        colors_impl.append('#06A77D')
+for p, m in pipelines:
+    implementations.append(f'Pipeline\n({p}P)')
+    times.append(m['inference_time'])
+    colors_impl.append('#3A86FF')
+speedups = [serial_time / t for t in times]
 
 x_pos = np.arange(len(implementations))
 bars = ax.bar(x_pos, times, color=colors_impl, alpha=0.7, edgecolor='black', linewidth=1.5)
@@ -410,7 +375,7 @@ ax4.set_ylabel('Images/sec')
 ax4.grid(True, alpha=0.3)
 
 ax5 = plt.subplot(2, 3, 5)
-proc_comm = [2, 3, 4, 5, 6, 7, 8]
+proc_comm = proc_list
 ax5.plot(proc_comm, [communication_overhead[p] for p in proc_comm], 'o-', linewidth=2, markersize=8, color='#D62246')
 ax5.set_title('Communication Overhead', fontweight='bold')
 ax5.set_xlabel('Processes')
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import json
 import re
 import sys
 from pathlib import Path
@@ -37,6 +38,9 @@ class PerformanceAnalyzer:
             self.pipeline_metrics['type'] = 'Pipeline'
             self.pipeline_metrics['processes'] = 5
         
+        self._compute_relative_metrics()
+    
+    def _compute_relative_metrics(self):
         # Recalculate speedup and efficiency based on serial baseline
         if self.serial_metrics and 'inference_time' in self.serial_metrics:
             serial_time = self.serial_metrics['inference_time']
@@ -50,6 +54,58 @@ class PerformanceAnalyzer:
                 self.pipeline_metrics['speedup'] = serial_time / self.pipeline_metrics['inference_time']
                 self.pipeline_metrics['efficiency'] = (self.pipeline_metrics['speedup'] / self.pipeline_metrics['processes']) * 100.0
     
+    def parse_json_results(self):
+        """Loads records appended by the binaries' --json option.
+
+        The latest record for each (implementation, processes) pair wins.
+        """
+        latest = {}
+        with open(self.results_file, 'r') as f:
+            for line in f:
+                line = line.strip()
+                if not line:
+                    continue
+                record = json.loads(line)
+                config = record['config']
+                latest[(config['implementation'], config['num_processes'])] = record
+        
+        for (implementation, processes), record in sorted(latest.items(), key=lambda kv: kv[0][1]):
+            metrics = self._metrics_from_record(record)
+            metrics['processes'] = processes
+            if implementation == 'serial':
+                metrics['type'] = 'Serial'
+                self.serial_metrics = metrics
+            elif implementation == 'data_parallel':
+                metrics['type'] = 'Data Parallel'
+                self.data_parallel_metrics.append(metrics)
+            elif implementation == 'pipeline_parallel':
+                metrics['type'] = 'Pipeline'
+                self.pipeline_metrics = metrics
+        
+        self._compute_relative_metrics()
+    
+    def _metrics_from_record(self, record):
+        m = record['metrics']
+        metrics = {
+            'total_time': m['total_time'],
+            'inference_time': m['inference_time'],
+            'load_model_time': m['load_model_time'],
+            'load_data_time': m['load_data_time'],
+            'communication_time': m['communication_time'],
+            'throughput': m['throughput_images_per_sec'],
+            'avg_latency': m['avg_latency_per_image_ms'],
+            'min_latency': m['min_latency_ms'],
+            'max_latency': m['max_latency_ms'],
+            'peak_memory_mb': m['peak_memory_bytes'] / (1024.0 * 1024.0),
+            'load_imbalance': m['load_imbalance'] * 100.0,
+            'accuracy': m['accuracy'],
+        }
+        for layer in ['conv1_time', 'conv2_time', 'fc1_time', 'fc2_time', 'output_time']:
+            if m.get(layer, 0) > 0:
+                metrics[layer] = m[layer]
+        # Latencies are null for binaries that do not measure them (pipeline).
+        return {k: v for k, v in metrics.items() if v is not None}
+    
     def _extract_metrics(self, section):
         metrics = {}
         
@@ -285,7 +341,9 @@ class PerformanceAnalyzer:
 
 def main():
     if len(sys.argv) < 2:
-        results_file = Path("results/benchmark_results_detailed.txt")
+        results_file = Path("results/benchmark_results.jsonl")
+        if not results_file.exists():
+            results_file = Path("results/benchmark_results_detailed.txt")
     else:
         results_file = Path(sys.argv[1])
     
@@ -295,7 +353,10 @@ def main():
         sys.exit(1)
     
     analyzer = PerformanceAnalyzer(results_file)
-    analyzer.parse_results()
+    if results_file.suffix == '.jsonl':
+        analyzer.parse_json_results()
+    else:
+        analyzer.parse_results()
     analyzer.print_summary_table()
     analyzer.print_detailed_analysis()
     analyzer.generate_recommendations()
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+################################################################################
+# Input Size Regression Check
+#
+# The network's input layer is 1x28x28 and every binary copies images into
+# 784-byte buffers. idx_generate can write other sizes (--rows/--cols), so
+# this writes a small 40x40 set and checks that each consumer refuses it
+# with an error instead of running on overflowed buffers.
+#
+# Environment overrides:
+#   MPIRUN_ARGS="--oversubscribe"  extra mpirun arguments
+################################################################################
+
+MPIRUN_ARGS=${MPIRUN_ARGS:-""}
+MODEL="./models/cnn_model.bin"
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+if [ ! -f "$MODEL" ]; then
+    echo -e "${RED}✗ $MODEL not found; run 'make train' first${NC}"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+IMAGES="$WORK_DIR/images-40x40-idx3-ubyte"
+LABELS="$WORK_DIR/labels-40x40-idx1-ubyte"
+
+./idx_generate --mode random --count 50 --rows 40 --cols 40 \
+               --out-images "$IMAGES" --out-labels "$LABELS" > /dev/null || exit 1
+
+FAILURES=0
+
+# expect_rejected <name> <command...>: the command must exit non-zero and
+# name the image size in its error output.
+expect_rejected() {
+    local name=$1
+    shift
+    local output
+    output=$("$@" 2>&1)
+    local rc=$?
+    if [ $rc -ne 0 ] && echo "$output" | grep -q "28x28"; then
+        echo -e "${GREEN}✓ $name rejects 40x40 images${NC}"
+    else
+        echo -e "${RED}✗ $name accepted 40x40 images (exit $rc)${NC}"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+expect_rejected serial_inference ./serial_inference "$IMAGES" "$LABELS"
+expect_rejected data_parallel_inference \
+    mpirun $MPIRUN_ARGS -np 2 ./data_parallel_inference "$IMAGES" "$LABELS"
+expect_rejected pipeline_parallel_inference \
+    mpirun $MPIRUN_ARGS -np 5 ./pipeline_parallel_inference "$IMAGES" "$LABELS"
+expect_rejected train_cnn ./train_cnn "$IMAGES" "$LABELS" "$IMAGES" "$LABELS" --output "$WORK_DIR/model.bin"
+
+if [ $FAILURES -ne 0 ]; then
+    echo -e "${RED}✗ $FAILURES binaries accepted images that are not 28x28${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ All binaries reject images that are not 28x28${NC}"
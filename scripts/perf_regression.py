@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""Performance regression gate for the inference binaries.
+
+Runs the serial, data-parallel and pipeline binaries a configurable number
+of times, collects throughput and p99 latency from their --json records and
+compares them with a stored baseline keyed by host fingerprint. A one-sided
+Mann-Whitney U test decides whether a slowdown is statistically significant;
+the script exits non-zero when one is found.
+
+Usage:
+  scripts/perf_regression.py --update-baseline   # record a baseline
+  scripts/perf_regression.py                      # gate against it
+"""
+
+import argparse
+import hashlib
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+from datetime import datetime, timezone
+from pathlib import Path
+
+# (name, command prefix, binary) for each configuration under test.
+def build_configs(args):
+    configs = []
+    if 'serial' in args.configs:
+        configs.append(('serial/1', [], './serial_inference'))
+    if 'data_parallel' in args.configs:
+        configs.append((f'data_parallel/{args.np_data_parallel}',
+                        ['mpirun', '-np', str(args.np_data_parallel)] + args.mpirun_args,
+                        './data_parallel_inference'))
+    if 'pipeline' in args.configs:
+        configs.append((f'pipeline_parallel/{args.np_pipeline}',
+                        ['mpirun', '-np', str(args.np_pipeline)] + args.mpirun_args,
+                        './pipeline_parallel_inference'))
+    return configs
+
+
+def host_fingerprint(host):
+    key = '|'.join(str(host.get(k, '')) for k in
+                   ('hostname', 'cpu_model', 'cpu_cores', 'os', 'arch'))
+    return hashlib.sha256(key.encode()).hexdigest()[:16]
+
+
+def run_once(prefix, binary, args):
+    with tempfile.NamedTemporaryFile(suffix='.jsonl', delete=False) as tmp:
+        json_path = tmp.name
+    try:
+        cmd = prefix + [binary, args.images, args.labels, '--json', json_path]
+        result = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        if result.returncode != 0:
+            raise RuntimeError(f"{' '.join(cmd)} failed:\n{result.stderr}")
+        with open(json_path) as f:
+            lines = [line for line in f if line.strip()]
+        if not lines:
+            raise RuntimeError(f"{binary} did not write a JSON record")
+        return json.loads(lines[-1])
+    finally:
+        os.unlink(json_path)
+
+
+def median(values):
+    s = sorted(values)
+    n = len(s)
+    return s[n // 2] if n % 2 else 0.5 * (s[n // 2 - 1] + s[n // 2])
+
+
+def _ranks(values):
+    order = sorted(range(len(values)), key=lambda i: values[i])
+    ranks = [0.0] * len(values)
+    i = 0
+    while i < len(order):
+        j = i
+        while j + 1 < len(order) and values[order[j + 1]] == values[order[i]]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[order[k]] = (i + j) / 2.0 + 1.0
+        i = j + 1
+    return ranks
+
+
+def _exact_cdf(u, n1, n2):
+    """P(U <= u) under H0 for samples without ties (counts arrangements)."""
+    max_u = n1 * n2
+    # counts[m][n] is the distribution of U for sizes m, n.
+    counts = [[None] * (n2 + 1) for _ in range(n1 + 1)]
+    for m in range(n1 + 1):
+        for n in range(n2 + 1):
+            if m == 0 or n == 0:
+                counts[m][n] = [1] + [0] * max_u
+                continue
+            dist = [0] * (max_u + 1)
+            a = counts[m - 1][n]
+            b = counts[m][n - 1]
+            for v in range(max_u + 1):
+                dist[v] = (a[v - n] if v >= n else 0) + b[v]
+            counts[m][n] = dist
+    dist = counts[n1][n2]
+    return sum(dist[:int(math.floor(u)) + 1]) / float(sum(dist))
+
+
+def mann_whitney_less(x, y):
+    """One-sided Mann-Whitney U test p-value for H1: x tends to be smaller than y."""
+    n1, n2 = len(x), len(y)
+    ranks = _ranks(list(x) + list(y))
+    u = sum(ranks[:n1]) - n1 * (n1 + 1) / 2.0
+    has_ties = len(set(list(x) + list(y))) < n1 + n2
+    if not has_ties and n1 + n2 <= 40:
+        return _exact_cdf(u, n1, n2)
+    # Normal approximation with tie and continuity correction.
+    n = n1 + n2
+    counts = {}
+    for v in list(x) + list(y):
+        counts[v] = counts.get(v, 0) + 1
+    tie_term = sum(t ** 3 - t for t in counts.values()) / float(n * (n - 1))
+    sigma = math.sqrt(n1 * n2 / 12.0 * ((n + 1) - tie_term))
+    if sigma == 0:
+        return 1.0
+    z = (u - n1 * n2 / 2.0 + 0.5) / sigma
+    return 0.5 * math.erfc(-z / math.sqrt(2))
+
+
+def collect(configs, args):
+    samples = {}
+    host = None
+    for name, prefix, binary in configs:
+        throughput, p99 = [], []
+        for i in range(args.runs):
+            print(f"  {name:<24} run {i + 1}/{args.runs}", flush=True)
+            record = run_once(prefix, binary, args)
+            host = record['host']
+            throughput.append(record['metrics']['throughput_images_per_sec'])
+            # null when the binary does not measure per-image latency (pipeline)
+            p99.append(record['metrics'].get('p99_latency_ms'))
+        samples[name] = {'throughput': throughput, 'p99_latency_ms': p99}
+    return host, samples
+
+
+def compare(baseline, current, args):
+    """Returns a list of (config, metric, base_median, cur_median, change, p, regressed)."""
+    rows = []
+    for name, cur in current.items():
+        base = baseline.get(name)
+        if base is None:
+            print(f"  ⚠ No baseline for {name}; skipping")
+            continue
+        # Lower throughput and higher p99 latency are regressions.
+        for metric, worse_is_lower in (('throughput', True), ('p99_latency_ms', False)):
+            x, y = cur[metric], base.get(metric)
+            if (not x or not y or None in x or None in y
+                    or median(y) <= 0 or median(x) <= 0):
+                if metric == 'p99_latency_ms':
+                    print(f"  ⚠ {name} does not measure per-image latency; p99 not checked")
+                continue
+            if worse_is_lower:
+                p = mann_whitney_less(x, y)
+                change = median(x) / median(y) - 1.0
+                regressed = p < args.alpha and -change > args.tolerance
+            else:
+                p = mann_whitney_less(y, x)
+                change = median(x) / median(y) - 1.0
+                regressed = p < args.alpha and change > args.tolerance
+            rows.append((name, metric, median(y), median(x), change, p, regressed))
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--runs', type=int, default=7, help='runs per configuration')
+    parser.add_argument('--baseline', default='results/perf_baseline.json')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='record the current runs as the baseline for this host')
+    parser.add_argument('--images', default='./data/t10k-images-idx3-ubyte')
+    parser.add_argument('--labels', default='./data/t10k-labels-idx1-ubyte')
+    parser.add_argument('--configs', default='serial,data_parallel,pipeline',
+                        help='comma-separated subset of serial,data_parallel,pipeline')
+    parser.add_argument('--np-data-parallel', type=int, default=4)
+    parser.add_argument('--np-pipeline', type=int, default=5)
+    parser.add_argument('--mpirun-args', default='', help='extra arguments for mpirun')
+    parser.add_argument('--alpha', type=float, default=0.01,
+                        help='significance level of the Mann-Whitney test')
+    parser.add_argument('--tolerance', type=float, default=0.03,
+                        help='ignore median changes smaller than this fraction')
+    args = parser.parse_args()
+    args.configs = [c.strip() for c in args.configs.split(',') if c.strip()]
+    args.mpirun_args = args.mpirun_args.split()
+
+    configs = build_configs(args)
+    if not configs:
+        print("Error: no configurations selected")
+        return 2
+
+    print("=" * 80)
+    print("  PERFORMANCE REGRESSION GATE")
+    print("=" * 80)
+    try:
+        host, samples = collect(configs, args)
+    except RuntimeError as e:
+        print(f"Error: {e}")
+        return 2
+
+    fingerprint = host_fingerprint(host)
+    baseline_path = Path(args.baseline)
+    db = {}
+    if baseline_path.exists():
+        with open(baseline_path) as f:
+            db = json.load(f)
+
+    print(f"\n  Host fingerprint: {fingerprint} ({host['hostname']}, {host['cpu_model']})")
+
+    if args.update_baseline:
+        entry = db.setdefault(fingerprint, {'host': host, 'configs': {}})
+        entry['host'] = host
+        for name, values in samples.items():
+            values = dict(values)
+            values['recorded'] = datetime.now(timezone.utc).strftime('%Y-%m-%dT%H:%M:%SZ')
+            entry['configs'][name] = values
+        baseline_path.parent.mkdir(parents=True, exist_ok=True)
+        with open(baseline_path, 'w') as f:
+            json.dump(db, f, indent=2, sort_keys=True)
+        print(f"  ✓ Baseline updated: {baseline_path}")
+        return 0
+
+    if fingerprint not in db:
+        print(f"Error: no baseline for this host in {baseline_path}")
+        print("Record one with: scripts/perf_regression.py --update-baseline")
+        return 2
+
+    rows = compare(db[fingerprint]['configs'], samples, args)
+    print()
+    print(f"  {'Configuration':<24} {'Metric':<16} {'Baseline':>12} {'Current':>12} {'Change':>9} {'p-value':>9}")
+    print("  " + "-" * 86)
+    regressions = 0
+    for name, metric, base, cur, change, p, regressed in rows:
+        mark = '✗ REGRESSION' if regressed else '✓'
+        print(f"  {name:<24} {metric:<16} {base:>12.3f} {cur:>12.3f} {change * 100:>8.1f}% {p:>9.4f}  {mark}")
+        regressions += regressed
+    print()
+    if regressions:
+        print(f"  ✗ {regressions} significant regression(s) (alpha={args.alpha}, tolerance={args.tolerance * 100:.0f}%)")
+        return 1
+    print("  ✓ No significant regressions")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -7,6 +7,7 @@
 
 RESULTS_DIR="results"
 RESULTS_FILE="$RESULTS_DIR/benchmark_results.txt"
+RESULTS_DB="$RESULTS_DIR/benchmark_results.jsonl"
 TIMESTAMP=$(date '+%Y-%m-%d %H:%M:%S')
 
 GREEN='\033[0;32m'
@@ -73,7 +74,7 @@ echo "==========================================================================
 
 echo -e "\nSERIAL EXECUTION (BASELINE)\n" >> $RESULTS_FILE
 echo "----------------------------" >> $RESULTS_FILE
-./serial_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte | tee -a $RESULTS_FILE
+./serial_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB | tee -a $RESULTS_FILE
 SERIAL_EXIT_CODE=${PIPESTATUS[0]}
 
 if [ $SERIAL_EXIT_CODE -ne 0 ]; then
@@ -97,7 +98,7 @@ for NP in "${DATA_PARALLEL_PROCS[@]}"; do
     echo -e "\nDATA PARALLEL EXECUTION ($NP processes)\n" >> $RESULTS_FILE
     echo "----------------------------" >> $RESULTS_FILE
     
-    mpirun -np $NP ./data_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte 2>&1 | tee -a $RESULTS_FILE
+    mpirun -np $NP ./data_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB 2>&1 | tee -a $RESULTS_FILE
     
     if [ ${PIPESTATUS[0]} -eq 0 ]; then
         echo -e "${GREEN}✓ Data parallel with $NP processes completed${NC}"
@@ -120,7 +121,7 @@ for NP in "${PIPELINE_COUNTS[@]}"; do
     echo -e "\nPIPELINE PARALLEL EXECUTION ($NP processes)\n" >> $RESULTS_FILE
     echo "----------------------------" >> $RESULTS_FILE
     
-    mpirun -np $NP ./pipeline_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte 2>&1 | tee -a $RESULTS_FILE
+    mpirun -np $NP ./pipeline_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB 2>&1 | tee -a $RESULTS_FILE
     
     if [ ${PIPESTATUS[0]} -eq 0 ]; then
         echo -e "${GREEN}✓ Pipeline parallel with $NP processes completed${NC}"
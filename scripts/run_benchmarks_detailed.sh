@@ -7,6 +7,7 @@
 
 RESULTS_DIR="results"
 RESULTS_FILE="$RESULTS_DIR/benchmark_results_detailed.txt"
+RESULTS_DB="$RESULTS_DIR/benchmark_results.jsonl"
 TIMESTAMP=$(date '+%Y-%m-%d %H:%M:%S')
 
 GREEN='\033[0;32m'
@@ -87,7 +88,7 @@ echo -e "${BLUE}[Step 2/5] Running Serial Inference (Baseline)...${NC}"
 echo "=================================================================================="
 
 echo -e "\n==================== SERIAL EXECUTION (BASELINE) ====================\n" >> $RESULTS_FILE
-./serial_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte | tee -a $RESULTS_FILE
+./serial_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB | tee -a $RESULTS_FILE
 SERIAL_EXIT_CODE=${PIPESTATUS[0]}
 
 if [ $SERIAL_EXIT_CODE -ne 0 ]; then
@@ -113,7 +114,7 @@ for NP in "${DATA_PARALLEL_PROCS[@]}"; do
     echo -e "\n${YELLOW}Testing with $NP processes...${NC}"
     echo -e "\n==================== DATA PARALLEL EXECUTION ($NP processes) ====================\n" >> $RESULTS_FILE
     
-    mpirun -np $NP ./data_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte 2>&1 | tee -a $RESULTS_FILE
+    mpirun -np $NP ./data_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB 2>&1 | tee -a $RESULTS_FILE
     
     if [ ${PIPESTATUS[0]} -eq 0 ]; then
         echo -e "${GREEN}✓ Data parallel with $NP processes completed${NC}"
@@ -142,7 +143,7 @@ for NP in "${PIPELINE_COUNTS[@]}"; do
     echo -e "\n${YELLOW}Testing with $NP processes (5-stage pipeline)...${NC}"
     echo -e "\n==================== PIPELINE PARALLEL EXECUTION ($NP processes) ====================\n" >> $RESULTS_FILE
     
-    OUTPUT=$(mpirun -np $NP ./pipeline_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte 2>&1)
+    OUTPUT=$(mpirun -np $NP ./pipeline_parallel_inference ./data/t10k-images-idx3-ubyte ./data/t10k-labels-idx1-ubyte --json $RESULTS_DB 2>&1)
     echo "$OUTPUT" | tee -a $RESULTS_FILE
     
     if [ ${PIPESTATUS[0]} -eq 0 ]; then
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+################################################################################
+# Shared-Memory Trainer Comparison
+#
+# Runs the threaded trainer with one thread (the serial train.c loop on a
+# single replica) and then with each thread count in both update modes,
+# tabulating training time, throughput, final accuracy and time to target.
+#
+# Environment overrides:
+#   THREADS="2 4 8"                      thread counts to compare
+#   TRAIN_ARGS="--epochs 3 --target 97"  extra trainer options
+################################################################################
+
+RESULTS_DIR="results"
+RESULTS_FILE="$RESULTS_DIR/hogwild_comparison.txt"
+DATA_DIR="data"
+TIMESTAMP=$(date '+%Y-%m-%d %H:%M:%S')
+
+THREADS=${THREADS:-"2 4 8"}
+TRAIN_ARGS=${TRAIN_ARGS:-""}
+
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+echo "================================================================================"
+echo "              SHARED-MEMORY TRAINING: HOGWILD vs. STRIPED vs. SERIAL           "
+echo "================================================================================"
+echo ""
+echo "Timestamp: $TIMESTAMP"
+echo "Thread counts: $THREADS"
+echo "Trainer options: ${TRAIN_ARGS:-(defaults)}"
+echo ""
+
+mkdir -p $RESULTS_DIR
+make -s train_hogwild_prog || exit 1
+
+{
+    echo "Shared-memory training comparison - $TIMESTAMP"
+    echo "Trainer options: ${TRAIN_ARGS:-(defaults)}"
+    echo ""
+    printf "%-8s %-9s %12s %14s %10s %12s %18s\n" \
+        "Threads" "Update" "Train(s)" "Samples/s" "Speedup" "Accuracy" "Time to target"
+    echo "--------------------------------------------------------------------------------------"
+} > $RESULTS_FILE
+
+BASE_TIME=""
+run_trainer() {
+    local NT=$1
+    local MODE=$2
+    echo -e "${YELLOW}  $NT thread(s), $MODE updates...${NC}"
+    OUTPUT=$(./train_hogwild $DATA_DIR/train-images-idx3-ubyte $DATA_DIR/train-labels-idx1-ubyte \
+        $DATA_DIR/t10k-images-idx3-ubyte $DATA_DIR/t10k-labels-idx1-ubyte \
+        --threads $NT --update $MODE $TRAIN_ARGS 2>&1)
+    if [ $? -ne 0 ]; then
+        echo -e "${RED}  ✗ Run with $NT threads ($MODE) failed${NC}"
+        return
+    fi
+
+    TRAIN_TIME=$(echo "$OUTPUT" | grep "Training Time:" | awk '{print $3}')
+    THROUGHPUT=$(echo "$OUTPUT" | grep "Throughput:" | awk '{print $2}')
+    ACCURACY=$(echo "$OUTPUT" | grep "Final Accuracy:" | awk '{print $3}')
+    TARGET=$(echo "$OUTPUT" | grep "Time to " | sed 's/.*: *//')
+    if [ -z "$BASE_TIME" ]; then BASE_TIME=$TRAIN_TIME; fi
+    SPEEDUP=$(echo "scale=2; $BASE_TIME / $TRAIN_TIME" | bc)
+
+    printf "%-8s %-9s %12s %14s %9sx %12s %18s\n" \
+        "$NT" "$MODE" "$TRAIN_TIME" "$THROUGHPUT" "$SPEEDUP" "$ACCURACY" "$TARGET" >> $RESULTS_FILE
+    echo -e "${GREEN}  ✓ ${TRAIN_TIME}s, accuracy $ACCURACY${NC}"
+}
+
+# One thread has no contention: this is the serial baseline.
+run_trainer 1 striped
+for NT in $THREADS; do
+    run_trainer $NT hogwild
+    run_trainer $NT striped
+done
+
+echo ""
+cat $RESULTS_FILE
+echo ""
+echo "Results saved to: $RESULTS_FILE"
@@ -0,0 +1,116 @@
+#!/bin/bash
+
+################################################################################
+# Strong- and Weak-Scaling Sweep for Data Parallel Inference
+#
+# Strong scaling: fixed dataset (t10k by default), growing process count.
+# Weak scaling:   images per process held constant on a synthetic dataset
+#                 generated by ./idx_generate (replicated or perturbed MNIST).
+#
+# Environment overrides:
+#   PROCS="1 2 4 8"          process counts to sweep
+#   IMAGES_PER_RANK=100000   weak-scaling work per process
+#   STRONG_IMAGES/STRONG_LABELS   strong-scaling dataset
+#   MPIRUN_ARGS="--bind-to core"  extra mpirun arguments
+#   GEN_MODE=perturb         idx_generate mode (replicate, perturb, random)
+################################################################################
+
+RESULTS_DIR="results"
+RESULTS_DB="$RESULTS_DIR/scaling_results.jsonl"
+DATA_DIR="data"
+TIMESTAMP=$(date '+%Y-%m-%d %H:%M:%S')
+
+PROCS=${PROCS:-"1 2 3 4 5 6 7 8"}
+IMAGES_PER_RANK=${IMAGES_PER_RANK:-100000}
+STRONG_IMAGES=${STRONG_IMAGES:-"$DATA_DIR/t10k-images-idx3-ubyte"}
+STRONG_LABELS=${STRONG_LABELS:-"$DATA_DIR/t10k-labels-idx1-ubyte"}
+MPIRUN_ARGS=${MPIRUN_ARGS:-""}
+GEN_MODE=${GEN_MODE:-replicate}
+GEN_THREADS=$(nproc 2>/dev/null || echo 1)
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+echo "================================================================================"
+echo "              STRONG & WEAK SCALING SWEEP (DATA PARALLEL)                      "
+echo "================================================================================"
+echo ""
+echo "Timestamp: $TIMESTAMP"
+echo "Process counts: $PROCS"
+echo "Weak scaling: $IMAGES_PER_RANK images per process"
+echo ""
+
+mkdir -p $RESULTS_DIR
+
+################################################################################
+# Prerequisites
+################################################################################
+echo -e "${BLUE}[Step 1/4] Checking prerequisites...${NC}"
+
+if [ ! -f "./models/cnn_model.bin" ]; then
+    echo -e "${RED}✗ Model file not found${NC}"
+    echo "Please run 'make train' first to train the model."
+    exit 1
+fi
+
+make -s data_parallel idx_generate_prog || exit 1
+
+MAX_NP=1
+for NP in $PROCS; do
+    if [ $NP -gt $MAX_NP ]; then MAX_NP=$NP; fi
+done
+WEAK_TOTAL=$((MAX_NP * IMAGES_PER_RANK))
+WEAK_IMAGES="$DATA_DIR/synthetic-${GEN_MODE}-${WEAK_TOTAL}-images-idx3-ubyte"
+WEAK_LABELS="$DATA_DIR/synthetic-${GEN_MODE}-${WEAK_TOTAL}-labels-idx1-ubyte"
+
+echo -e "${GREEN}✓ All prerequisites met${NC}"
+echo ""
+
+################################################################################
+# Synthetic dataset for weak scaling
+################################################################################
+echo -e "${BLUE}[Step 2/4] Preparing weak-scaling dataset ($WEAK_TOTAL images)...${NC}"
+
+if [ -f "$WEAK_IMAGES" ] && [ -f "$WEAK_LABELS" ]; then
+    echo "  ✓ Reusing $WEAK_IMAGES"
+else
+    ./idx_generate --count $WEAK_TOTAL --mode $GEN_MODE --threads $GEN_THREADS \
+        --source-images $STRONG_IMAGES --source-labels $STRONG_LABELS \
+        --out-images $WEAK_IMAGES --out-labels $WEAK_LABELS || exit 1
+fi
+echo ""
+
+################################################################################
+# Strong scaling
+################################################################################
+echo -e "${BLUE}[Step 3/4] Strong scaling (fixed dataset: $STRONG_IMAGES)...${NC}"
+
+for NP in $PROCS; do
+    echo -e "${YELLOW}  $NP process(es)...${NC}"
+    mpirun $MPIRUN_ARGS -np $NP ./data_parallel_inference $STRONG_IMAGES $STRONG_LABELS \
+        --json $RESULTS_DB --tag strong > /dev/null 2>&1
+    if [ $? -ne 0 ]; then
+        echo -e "${RED}  ✗ Strong scaling run with $NP processes failed${NC}"
+    fi
+done
+echo ""
+
+################################################################################
+# Weak scaling
+################################################################################
+echo -e "${BLUE}[Step 4/4] Weak scaling ($IMAGES_PER_RANK images per process)...${NC}"
+
+for NP in $PROCS; do
+    echo -e "${YELLOW}  $NP process(es), $((NP * IMAGES_PER_RANK)) images...${NC}"
+    mpirun $MPIRUN_ARGS -np $NP ./data_parallel_inference $WEAK_IMAGES $WEAK_LABELS \
+        --limit $((NP * IMAGES_PER_RANK)) --json $RESULTS_DB --tag weak > /dev/null 2>&1
+    if [ $? -ne 0 ]; then
+        echo -e "${RED}  ✗ Weak scaling run with $NP processes failed${NC}"
+    fi
+done
+echo ""
+
+python3 ./scripts/scaling_report.py $RESULTS_DB
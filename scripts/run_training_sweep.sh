@@ -0,0 +1,79 @@
+#!/bin/bash
+
+################################################################################
+# Time-to-Accuracy Sweep for Data Parallel Training
+#
+# Trains the same model (same seed, same global batch) with a growing number
+# of MPI ranks and tabulates wall-clock training time, throughput, final
+# accuracy and time to the target accuracy.
+#
+# Environment overrides:
+#   PROCS="1 2 4 8"               process counts to sweep
+#   TRAIN_ARGS="--epochs 3 --target 97"  extra trainer options
+#   MPIRUN_ARGS="--bind-to core"  extra mpirun arguments
+################################################################################
+
+RESULTS_DIR="results"
+RESULTS_FILE="$RESULTS_DIR/training_scaling.txt"
+DATA_DIR="data"
+TIMESTAMP=$(date '+%Y-%m-%d %H:%M:%S')
+
+PROCS=${PROCS:-"1 2 4 8"}
+TRAIN_ARGS=${TRAIN_ARGS:-""}
+MPIRUN_ARGS=${MPIRUN_ARGS:-""}
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+echo "================================================================================"
+echo "              TIME-TO-ACCURACY SWEEP (DATA PARALLEL TRAINING)                  "
+echo "================================================================================"
+echo ""
+echo "Timestamp: $TIMESTAMP"
+echo "Process counts: $PROCS"
+echo "Trainer options: ${TRAIN_ARGS:-(defaults)}"
+echo ""
+
+mkdir -p $RESULTS_DIR
+make -s train_dp_prog || exit 1
+
+{
+    echo "Time-to-accuracy sweep - $TIMESTAMP"
+    echo "Trainer options: ${TRAIN_ARGS:-(defaults)}"
+    echo ""
+    printf "%-10s %12s %14s %10s %12s %18s\n" \
+        "Processes" "Train(s)" "Samples/s" "Speedup" "Accuracy" "Time to target"
+    echo "--------------------------------------------------------------------------------"
+} > $RESULTS_FILE
+
+BASE_TIME=""
+for NP in $PROCS; do
+    echo -e "${YELLOW}  Training with $NP process(es)...${NC}"
+    OUTPUT=$(mpirun $MPIRUN_ARGS -np $NP ./train_data_parallel \
+        $DATA_DIR/train-images-idx3-ubyte $DATA_DIR/train-labels-idx1-ubyte \
+        $DATA_DIR/t10k-images-idx3-ubyte $DATA_DIR/t10k-labels-idx1-ubyte \
+        $TRAIN_ARGS 2>&1)
+    if [ $? -ne 0 ]; then
+        echo -e "${RED}  ✗ Training with $NP processes failed${NC}"
+        continue
+    fi
+
+    TRAIN_TIME=$(echo "$OUTPUT" | grep "Training Time:" | awk '{print $3}')
+    THROUGHPUT=$(echo "$OUTPUT" | grep "Throughput:" | awk '{print $2}')
+    ACCURACY=$(echo "$OUTPUT" | grep "Final Accuracy:" | awk '{print $3}')
+    TARGET=$(echo "$OUTPUT" | grep "Time to " | sed 's/.*: *//')
+    if [ -z "$BASE_TIME" ]; then BASE_TIME=$TRAIN_TIME; fi
+    SPEEDUP=$(echo "scale=2; $BASE_TIME / $TRAIN_TIME" | bc)
+
+    printf "%-10s %12s %14s %9sx %12s %18s\n" \
+        "$NP" "$TRAIN_TIME" "$THROUGHPUT" "$SPEEDUP" "$ACCURACY" "$TARGET" >> $RESULTS_FILE
+    echo -e "${GREEN}  ✓ ${TRAIN_TIME}s, accuracy $ACCURACY${NC}"
+done
+
+echo ""
+cat $RESULTS_FILE
+echo ""
+echo "Results saved to: $RESULTS_FILE"
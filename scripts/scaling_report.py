@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Strong- and weak-scaling efficiency report from --json records.
+
+Strong scaling (fixed total work):   E(N) = T(1) / (N * T(N))
+Weak scaling (fixed work per rank):  E(N) = T(1) / T(N)
+
+Records are grouped by their --tag ("strong" / "weak"); the latest record
+for each process count is used. Writes a CSV next to the input and, when
+matplotlib is available, an efficiency plot.
+"""
+
+import csv
+import json
+import sys
+from pathlib import Path
+
+
+def load_latest(path):
+    latest = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            record = json.loads(line)
+            tag = record['config'].get('tag')
+            if tag not in ('strong', 'weak'):
+                continue
+            latest[(tag, record['config']['num_processes'])] = record
+    return latest
+
+
+def efficiency_rows(latest, tag):
+    points = sorted((np, r) for (t, np), r in latest.items() if t == tag)
+    if not points:
+        return []
+    base_np, base = points[0]
+    # Normalise to one process even if the sweep did not include it.
+    base_time = base['metrics']['inference_time'] * (base_np if tag == 'strong' else 1)
+    rows = []
+    for np, r in points:
+        m = r['metrics']
+        t = m['inference_time']
+        if tag == 'strong':
+            speedup = base_time / t
+            eff = speedup / np * 100.0
+        else:
+            # Scaled speedup: N times the work in time T(N).
+            speedup = np * base_time / t
+            eff = base_time / t * 100.0
+        rows.append({
+            'mode': tag,
+            'processes': np,
+            'images': m['total_images'],
+            'inference_time': t,
+            'throughput': m['throughput_images_per_sec'],
+            'speedup': speedup,
+            'efficiency': eff,
+            'load_imbalance': m['load_imbalance'] * 100.0,
+            'peak_memory_mb': m['peak_memory_bytes'] / (1024.0 * 1024.0),
+        })
+    return rows
+
+
+def print_table(title, rows):
+    print(f"\n{title}")
+    print("-" * 92)
+    print(f"{'Processes':<10} {'Images':>10} {'Time(s)':>10} {'Throughput':>14} "
+          f"{'Speedup':>9} {'Efficiency':>11} {'Imbalance':>10} {'Mem(MB)':>9}")
+    for r in rows:
+        print(f"{r['processes']:<10} {r['images']:>10} {r['inference_time']:>10.3f} "
+              f"{r['throughput']:>10.1f} i/s {r['speedup']:>8.2f}x {r['efficiency']:>10.1f}% "
+              f"{r['load_imbalance']:>9.2f}% {r['peak_memory_mb']:>9.1f}")
+
+
+def plot(strong, weak, out_path):
+    try:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("  (matplotlib not available; skipping plot)")
+        return
+    fig, ax = plt.subplots(figsize=(8, 5))
+    for rows, label, marker in ((strong, 'Strong scaling', 'o'), (weak, 'Weak scaling', 's')):
+        if rows:
+            ax.plot([r['processes'] for r in rows], [r['efficiency'] for r in rows],
+                    marker=marker, linewidth=2, label=label)
+    ax.axhline(100, color='gray', linestyle='--', linewidth=1)
+    ax.set_xlabel('Processes')
+    ax.set_ylabel('Parallel efficiency (%)')
+    ax.set_title('Data Parallel Inference Scaling Efficiency')
+    ax.set_ylim(bottom=0)
+    ax.grid(True, alpha=0.3)
+    ax.legend()
+    fig.tight_layout()
+    fig.savefig(out_path, dpi=150)
+    print(f"  Plot saved to: {out_path}")
+
+
+def main():
+    path = Path(sys.argv[1] if len(sys.argv) > 1 else 'results/scaling_results.jsonl')
+    if not path.exists():
+        print(f"Error: Results file not found: {path}")
+        print("Please run the sweep first: ./scripts/run_scaling_sweep.sh")
+        sys.exit(1)
+
+    latest = load_latest(path)
+    strong = efficiency_rows(latest, 'strong')
+    weak = efficiency_rows(latest, 'weak')
+
+    print("=" * 92)
+    print(" " * 30 + "SCALING EFFICIENCY REPORT")
+    print("=" * 92)
+    if strong:
+        print_table("STRONG SCALING (fixed total work)", strong)
+    if weak:
+        print_table(f"WEAK SCALING (fixed work per process: "
+                    f"{weak[0]['images'] // weak[0]['processes']} images)", weak)
+    print("=" * 92)
+
+    csv_path = path.with_name('scaling_efficiency.csv')
+    with open(csv_path, 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=list((strong + weak)[0].keys()) if strong + weak else ['mode'])
+        writer.writeheader()
+        writer.writerows(strong + weak)
+    print(f"  CSV saved to: {csv_path}")
+    plot(strong, weak, path.with_name('scaling_efficiency.png'))
+
+
+if __name__ == '__main__':
+    main()
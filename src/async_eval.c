@@ -0,0 +1,169 @@
+#include "async_eval.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_SIZE 784
+
+struct AsyncEvaluator {
+    Layer** train_layers;
+    Layer** eval_layers;
+    int num_layers;
+    const MNISTImages* images;
+    const MNISTLabels* labels;
+    uint32_t limit;
+
+    /* Weights copied by the trainer, waiting for the thread. */
+    double** snapshot_weights;
+    double** snapshot_biases;
+    double snapshot_time;
+    uint64_t snapshot_samples;
+
+    AccuracyPoint* points;
+    int num_points;
+    int capacity;
+    int dropped;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    int stop;
+};
+
+double evaluate_accuracy(Layer* linput, Layer* loutput,
+                         const MNISTImages* images, const MNISTLabels* labels, uint32_t count) {
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    double y[10];
+    int correct = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        mnist_get_image(images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+        Layer_setInputs(linput, img_norm);
+        Layer_getOutputs(loutput, y);
+
+        int predicted = 0;
+        for (int j = 1; j < 10; j++) {
+            if (y[j] > y[predicted]) {
+                predicted = j;
+            }
+        }
+        if (predicted == mnist_get_label(labels, i)) {
+            correct++;
+        }
+    }
+    return (correct * 100.0) / count;
+}
+
+static void* eval_thread(void* arg) {
+    AsyncEvaluator* eval = (AsyncEvaluator*)arg;
+    Layer* linput = eval->eval_layers[0];
+    Layer* loutput = eval->eval_layers[eval->num_layers - 1];
+
+    pthread_mutex_lock(&eval->lock);
+    for (;;) {
+        while (!eval->pending && !eval->stop) {
+            pthread_cond_wait(&eval->cond, &eval->lock);
+        }
+        if (!eval->pending) break;
+
+        /* Take the snapshot under the lock; the trainer may refill it
+           while this evaluation runs. */
+        for (int l = 0; l < eval->num_layers; l++) {
+            Layer* layer = eval->eval_layers[l];
+            memcpy(layer->weights, eval->snapshot_weights[l], layer->nweights * sizeof(double));
+            memcpy(layer->biases, eval->snapshot_biases[l], layer->nbiases * sizeof(double));
+        }
+        AccuracyPoint point = {eval->snapshot_time, eval->snapshot_samples, 0.0};
+        eval->pending = 0;
+        pthread_mutex_unlock(&eval->lock);
+
+        point.accuracy = evaluate_accuracy(linput, loutput, eval->images, eval->labels, eval->limit);
+
+        pthread_mutex_lock(&eval->lock);
+        if (eval->num_points == eval->capacity) {
+            eval->capacity = eval->capacity ? 2 * eval->capacity : 16;
+            eval->points = (AccuracyPoint*)realloc(eval->points, eval->capacity * sizeof(AccuracyPoint));
+        }
+        eval->points[eval->num_points++] = point;
+    }
+    pthread_mutex_unlock(&eval->lock);
+    return NULL;
+}
+
+AsyncEvaluator* async_eval_create(Layer** train_layers, Layer** eval_layers, int num_layers,
+                                  const MNISTImages* images, const MNISTLabels* labels,
+                                  uint32_t limit) {
+    AsyncEvaluator* eval = (AsyncEvaluator*)calloc(1, sizeof(AsyncEvaluator));
+    if (eval == NULL) return NULL;
+    eval->train_layers = train_layers;
+    eval->eval_layers = eval_layers;
+    eval->num_layers = num_layers;
+    eval->images = images;
+    eval->labels = labels;
+    eval->limit = (limit == 0 || limit > images->num_images) ? images->num_images : limit;
+
+    eval->snapshot_weights = (double**)calloc(num_layers, sizeof(double*));
+    eval->snapshot_biases = (double**)calloc(num_layers, sizeof(double*));
+    for (int l = 0; l < num_layers; l++) {
+        eval->snapshot_weights[l] = (double*)malloc((train_layers[l]->nweights + 1) * sizeof(double));
+        eval->snapshot_biases[l] = (double*)malloc((train_layers[l]->nbiases + 1) * sizeof(double));
+    }
+
+    pthread_mutex_init(&eval->lock, NULL);
+    pthread_cond_init(&eval->cond, NULL);
+    if (pthread_create(&eval->thread, NULL, eval_thread, eval) != 0) {
+        fprintf(stderr, "Failed to start evaluation thread\n");
+        eval->stop = 1;
+        free(async_eval_finish(eval, NULL, NULL));
+        return NULL;
+    }
+    return eval;
+}
+
+void async_eval_request(AsyncEvaluator* eval, double time, uint64_t samples) {
+    pthread_mutex_lock(&eval->lock);
+    if (eval->pending) {
+        eval->dropped++;
+    }
+    for (int l = 0; l < eval->num_layers; l++) {
+        Layer* layer = eval->train_layers[l];
+        memcpy(eval->snapshot_weights[l], layer->weights, layer->nweights * sizeof(double));
+        memcpy(eval->snapshot_biases[l], layer->biases, layer->nbiases * sizeof(double));
+    }
+    eval->snapshot_time = time;
+    eval->snapshot_samples = samples;
+    eval->pending = 1;
+    pthread_cond_signal(&eval->cond);
+    pthread_mutex_unlock(&eval->lock);
+}
+
+AccuracyPoint* async_eval_finish(AsyncEvaluator* eval, int* count, int* dropped) {
+    pthread_mutex_lock(&eval->lock);
+    int started = !eval->stop;
+    eval->stop = 1;
+    pthread_cond_signal(&eval->cond);
+    pthread_mutex_unlock(&eval->lock);
+    if (started) {
+        pthread_join(eval->thread, NULL);
+    }
+
+    AccuracyPoint* points = eval->points;
+    if (count != NULL) *count = eval->num_points;
+    if (dropped != NULL) *dropped = eval->dropped;
+
+    pthread_mutex_destroy(&eval->lock);
+    pthread_cond_destroy(&eval->cond);
+    for (int l = 0; l < eval->num_layers; l++) {
+        free(eval->snapshot_weights[l]);
+        free(eval->snapshot_biases[l]);
+    }
+    free(eval->snapshot_weights);
+    free(eval->snapshot_biases);
+    free(eval);
+    return points;
+}
@@ -0,0 +1,32 @@
+#ifndef ASYNC_EVAL_H
+#define ASYNC_EVAL_H
+
+#include <stdint.h>
+#include "cnn.h"
+#include "mnist_loader.h"
+#include "performance_metrics.h"
+
+typedef struct AsyncEvaluator AsyncEvaluator;
+
+/* Measures test accuracy while training continues. eval_layers is a second
+   network with the same architecture as train_layers; the evaluator owns
+   it until async_eval_finish. Only the first `limit` test images are used
+   (0: all of them). */
+AsyncEvaluator* async_eval_create(Layer** train_layers, Layer** eval_layers, int num_layers,
+                                  const MNISTImages* images, const MNISTLabels* labels,
+                                  uint32_t limit);
+
+/* Copies the current weights and returns; a thread evaluates the copy.
+   If the previous copy has not been picked up yet it is replaced, so the
+   trainer never waits for an evaluation. */
+void async_eval_request(AsyncEvaluator* eval, double time, uint64_t samples);
+
+/* Waits for the last evaluation and returns the points in request order
+   (caller frees). `dropped` counts requests replaced before they ran. */
+AccuracyPoint* async_eval_finish(AsyncEvaluator* eval, int* count, int* dropped);
+
+/* Accuracy (%) of the network on the first `count` images. */
+double evaluate_accuracy(Layer* linput, Layer* loutput,
+                         const MNISTImages* images, const MNISTLabels* labels, uint32_t count);
+
+#endif
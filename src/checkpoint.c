@@ -0,0 +1,390 @@
+#include "checkpoint.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Parameters of one layer, laid out as in the checkpoint file. */
+typedef struct {
+    int nweights;
+    int nbiases;
+    double* weights;
+    double* biases;
+    double* u_weights;
+    double* u_biases;
+} LayerRecord;
+
+struct CheckpointWriter {
+    char* filepath;
+    Layer** layers;
+    int num_layers;
+    LayerRecord* snapshot;
+    const double* state;
+    double* state_snapshot;
+    size_t state_count;
+    CheckpointSettings settings;
+    CheckpointCursor cursor;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;                /* Snapshot waiting to be written */
+    int busy;                   /* Thread writing the snapshot */
+    int stop;
+    int error;
+    CheckpointStats stats;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t length) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void record_from_layer(LayerRecord* record, Layer* layer) {
+    record->nweights = layer->nweights;
+    record->nbiases = layer->nbiases;
+    record->weights = layer->weights;
+    record->biases = layer->biases;
+    record->u_weights = layer->u_weights;
+    record->u_biases = layer->u_biases;
+}
+
+static uint64_t records_checksum(const LayerRecord* records, int num_layers) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < num_layers; i++) {
+        const LayerRecord* r = &records[i];
+        hash = fnv1a(hash, &r->nweights, sizeof(int));
+        hash = fnv1a(hash, &r->nbiases, sizeof(int));
+        hash = fnv1a(hash, r->weights, r->nweights * sizeof(double));
+        hash = fnv1a(hash, r->biases, r->nbiases * sizeof(double));
+        hash = fnv1a(hash, r->u_weights, r->nweights * sizeof(double));
+        hash = fnv1a(hash, r->u_biases, r->nbiases * sizeof(double));
+    }
+    return hash;
+}
+
+/* Version 2 appends the optimizer state to the checksummed data. */
+static uint64_t state_checksum(uint64_t hash, const double* state, uint64_t state_count) {
+    hash = fnv1a(hash, &state_count, sizeof(uint64_t));
+    return fnv1a(hash, state, state_count * sizeof(double));
+}
+
+/* Version 3 appends the training settings to the checksummed data. */
+static uint64_t settings_checksum(uint64_t hash, const CheckpointSettings* settings) {
+    return fnv1a(hash, settings, sizeof(CheckpointSettings));
+}
+
+static int write_records(const char* filepath, const LayerRecord* records, int num_layers,
+                         const double* state, uint64_t state_count,
+                         const CheckpointCursor* cursor, const CheckpointSettings* settings) {
+    size_t tmp_len = strlen(filepath) + 5;
+    char* tmp_path = (char*)malloc(tmp_len);
+    snprintf(tmp_path, tmp_len, "%s.tmp", filepath);
+
+    FILE* fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.layer_count = num_layers;
+    header.cursor = *cursor;
+    CheckpointSettings recorded = *settings;
+    recorded.recorded = 1;
+    header.checksum = settings_checksum(state_checksum(records_checksum(records, num_layers),
+                                                       state, state_count), &recorded);
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(&recorded, sizeof(recorded), 1, fp) == 1;
+    for (int i = 0; ok && i < num_layers; i++) {
+        const LayerRecord* r = &records[i];
+        ok = fwrite(&r->nweights, sizeof(int), 1, fp) == 1 &&
+             fwrite(&r->nbiases, sizeof(int), 1, fp) == 1 &&
+             fwrite(r->weights, sizeof(double), r->nweights, fp) == (size_t)r->nweights &&
+             fwrite(r->biases, sizeof(double), r->nbiases, fp) == (size_t)r->nbiases &&
+             fwrite(r->u_weights, sizeof(double), r->nweights, fp) == (size_t)r->nweights &&
+             fwrite(r->u_biases, sizeof(double), r->nbiases, fp) == (size_t)r->nbiases;
+    }
+    ok = ok && fwrite(&state_count, sizeof(uint64_t), 1, fp) == 1 &&
+         fwrite(state, sizeof(double), state_count, fp) == state_count;
+    /* The data must be on disk before the rename makes it visible. */
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok && rename(tmp_path, filepath) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to write checkpoint %s\n", filepath);
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    return ok ? 0 : -1;
+}
+
+int checkpoint_save(const char* filepath, Layer** layers, int num_layers,
+                    const double* state, size_t state_count,
+                    const CheckpointCursor* cursor, const CheckpointSettings* settings) {
+    LayerRecord* records = (LayerRecord*)malloc(num_layers * sizeof(LayerRecord));
+    for (int i = 0; i < num_layers; i++) {
+        record_from_layer(&records[i], layers[i]);
+    }
+    int result = write_records(filepath, records, num_layers, state, state_count, cursor, settings);
+    free(records);
+    return result;
+}
+
+int checkpoint_load(const char* filepath, Layer** layers, int num_layers,
+                    double* state, size_t state_count,
+                    CheckpointCursor* cursor, CheckpointSettings* settings) {
+    FILE* fp = fopen(filepath, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", filepath);
+        return -1;
+    }
+
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        fprintf(stderr, "Failed to read checkpoint header\n");
+        fclose(fp);
+        return -1;
+    }
+    if (header.magic != CHECKPOINT_MAGIC || header.version < 1 || header.version > CHECKPOINT_VERSION) {
+        fprintf(stderr, "Invalid checkpoint file: magic 0x%X, version %u\n", header.magic, header.version);
+        fclose(fp);
+        return -1;
+    }
+    if ((int)header.layer_count != num_layers) {
+        fprintf(stderr, "Checkpoint layer count mismatch: expected %d, got %u\n",
+                num_layers, header.layer_count);
+        fclose(fp);
+        return -1;
+    }
+    CheckpointSettings recorded;
+    memset(&recorded, 0, sizeof(recorded));
+    if (header.version >= 3 && fread(&recorded, sizeof(recorded), 1, fp) != 1) {
+        fprintf(stderr, "Failed to read checkpoint settings\n");
+        fclose(fp);
+        return -1;
+    }
+
+    LayerRecord* records = (LayerRecord*)malloc(num_layers * sizeof(LayerRecord));
+    int ok = 1;
+    for (int i = 0; ok && i < num_layers; i++) {
+        Layer* layer = layers[i];
+        int nweights, nbiases;
+        ok = fread(&nweights, sizeof(int), 1, fp) == 1 &&
+             fread(&nbiases, sizeof(int), 1, fp) == 1;
+        if (ok && (nweights != layer->nweights || nbiases != layer->nbiases)) {
+            fprintf(stderr, "Checkpoint layer size mismatch: expected w=%d b=%d, got w=%d b=%d\n",
+                    layer->nweights, layer->nbiases, nweights, nbiases);
+            ok = 0;
+        }
+        ok = ok &&
+             fread(layer->weights, sizeof(double), nweights, fp) == (size_t)nweights &&
+             fread(layer->biases, sizeof(double), nbiases, fp) == (size_t)nbiases &&
+             fread(layer->u_weights, sizeof(double), nweights, fp) == (size_t)nweights &&
+             fread(layer->u_biases, sizeof(double), nbiases, fp) == (size_t)nbiases;
+        record_from_layer(&records[i], layer);
+    }
+
+    uint64_t checksum = ok ? records_checksum(records, num_layers) : 0;
+    if (state_count > 0) {
+        memset(state, 0, state_count * sizeof(double));
+    }
+    if (ok && header.version >= 2) {
+        uint64_t file_count;
+        ok = fread(&file_count, sizeof(uint64_t), 1, fp) == 1;
+        if (ok && file_count != 0 && file_count != state_count) {
+            fprintf(stderr, "Checkpoint optimizer state mismatch: expected %zu values, got %llu\n",
+                    state_count, (unsigned long long)file_count);
+            ok = 0;
+        }
+        ok = ok && fread(state, sizeof(double), file_count, fp) == file_count;
+        if (ok) {
+            checksum = state_checksum(checksum, state, file_count);
+        }
+    }
+    if (ok && header.version >= 3) {
+        checksum = settings_checksum(checksum, &recorded);
+    }
+    fclose(fp);
+
+    if (ok && checksum != header.checksum) {
+        fprintf(stderr, "Checkpoint checksum mismatch: %s is corrupt\n", filepath);
+        ok = 0;
+    } else if (!ok) {
+        fprintf(stderr, "Failed to read checkpoint %s\n", filepath);
+    }
+    free(records);
+    if (ok && cursor != NULL) {
+        *cursor = header.cursor;
+    }
+    if (ok && settings != NULL) {
+        *settings = recorded;
+    }
+    return ok ? 0 : -1;
+}
+
+int checkpoint_read_settings(const char* filepath, CheckpointSettings* settings) {
+    FILE* fp = fopen(filepath, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", filepath);
+        return -1;
+    }
+    CheckpointHeader header;
+    memset(settings, 0, sizeof(*settings));
+    int ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == CHECKPOINT_MAGIC;
+    if (ok && header.version >= 3) {
+        ok = fread(settings, sizeof(*settings), 1, fp) == 1;
+    }
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "Failed to read checkpoint settings from %s\n", filepath);
+    }
+    return ok ? 0 : -1;
+}
+
+static void* writer_thread(void* arg) {
+    CheckpointWriter* writer = (CheckpointWriter*)arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->pending && !writer->stop) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (!writer->pending) break;
+        writer->pending = 0;
+        writer->busy = 1;
+        CheckpointCursor cursor = writer->cursor;
+        pthread_mutex_unlock(&writer->lock);
+
+        double t0 = now_seconds();
+        int result = write_records(writer->filepath, writer->snapshot, writer->num_layers,
+                                   writer->state_snapshot, writer->state_count, &cursor,
+                                   &writer->settings);
+        double t1 = now_seconds();
+
+        pthread_mutex_lock(&writer->lock);
+        writer->busy = 0;
+        writer->stats.write_time += t1 - t0;
+        if (result == 0) {
+            writer->stats.written++;
+        } else {
+            writer->error = 1;
+        }
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+CheckpointWriter* checkpoint_writer_create(const char* filepath, Layer** layers, int num_layers,
+                                           const double* state, size_t state_count,
+                                           const CheckpointSettings* settings) {
+    CheckpointWriter* writer = (CheckpointWriter*)calloc(1, sizeof(CheckpointWriter));
+    if (writer == NULL) return NULL;
+    writer->filepath = strdup(filepath);
+    writer->layers = layers;
+    writer->num_layers = num_layers;
+
+    writer->snapshot = (LayerRecord*)calloc(num_layers, sizeof(LayerRecord));
+    for (int i = 0; i < num_layers; i++) {
+        LayerRecord* r = &writer->snapshot[i];
+        r->nweights = layers[i]->nweights;
+        r->nbiases = layers[i]->nbiases;
+        r->weights = (double*)malloc((r->nweights + 1) * sizeof(double));
+        r->biases = (double*)malloc((r->nbiases + 1) * sizeof(double));
+        r->u_weights = (double*)malloc((r->nweights + 1) * sizeof(double));
+        r->u_biases = (double*)malloc((r->nbiases + 1) * sizeof(double));
+    }
+    writer->state = state;
+    writer->state_count = state_count;
+    writer->state_snapshot = (double*)malloc((state_count + 1) * sizeof(double));
+    writer->settings = *settings;
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+        fprintf(stderr, "Failed to start checkpoint thread\n");
+        writer->stop = 1;
+        checkpoint_writer_destroy(writer, NULL);
+        return NULL;
+    }
+    return writer;
+}
+
+int checkpoint_writer_request(CheckpointWriter* writer, const CheckpointCursor* cursor) {
+    double t0 = now_seconds();
+    pthread_mutex_lock(&writer->lock);
+    while (writer->pending || writer->busy) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    double t1 = now_seconds();
+
+    /* The thread is idle: the snapshot buffer is ours until pending is set. */
+    for (int i = 0; i < writer->num_layers; i++) {
+        LayerRecord* r = &writer->snapshot[i];
+        Layer* layer = writer->layers[i];
+        memcpy(r->weights, layer->weights, r->nweights * sizeof(double));
+        memcpy(r->biases, layer->biases, r->nbiases * sizeof(double));
+        memcpy(r->u_weights, layer->u_weights, r->nweights * sizeof(double));
+        memcpy(r->u_biases, layer->u_biases, r->nbiases * sizeof(double));
+    }
+    if (writer->state_count > 0) {
+        memcpy(writer->state_snapshot, writer->state, writer->state_count * sizeof(double));
+    }
+    writer->cursor = *cursor;
+    writer->pending = 1;
+    writer->stats.stall_time += t1 - t0;
+    writer->stats.snapshot_time += now_seconds() - t1;
+    int error = writer->error;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    return error ? -1 : 0;
+}
+
+/* Flushes the last requested snapshot, then stops the thread. */
+int checkpoint_writer_destroy(CheckpointWriter* writer, CheckpointStats* stats) {
+    if (writer == NULL) return 0;
+    pthread_mutex_lock(&writer->lock);
+    int started = !writer->stop;
+    writer->stop = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    if (started) {
+        pthread_join(writer->thread, NULL);
+    }
+    int error = writer->error;
+    if (stats != NULL) {
+        *stats = writer->stats;
+    }
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->cond);
+    for (int i = 0; i < writer->num_layers; i++) {
+        free(writer->snapshot[i].weights);
+        free(writer->snapshot[i].biases);
+        free(writer->snapshot[i].u_weights);
+        free(writer->snapshot[i].u_biases);
+    }
+    free(writer->snapshot);
+    free(writer->state_snapshot);
+    free(writer->filepath);
+    free(writer);
+    return error ? -1 : 0;
+}
@@ -0,0 +1,72 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cnn.h"
+
+#define CHECKPOINT_MAGIC 0x434E4E43
+#define CHECKPOINT_VERSION 3
+
+/* Where training resumes: the next sample of the given epoch. */
+typedef struct {
+    uint32_t epoch;
+    uint32_t sample;
+    uint64_t rng_seed;          /* Data loader seed */
+    uint64_t rng_state;         /* Unused: the loader's draws are counter-based */
+} CheckpointCursor;
+
+/* Settings that decide what the remaining samples do; a resumed run must
+   use the same ones. Version 3 writes them after the header. */
+typedef struct {
+    uint32_t recorded;          /* 0: file predates version 3, settings unknown */
+    uint32_t shuffle;
+    int32_t max_shift;          /* Random shift range in pixels */
+    uint32_t optimizer;         /* OptimizerKind */
+    double momentum;
+} CheckpointSettings;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layer_count;
+    uint32_t reserved;
+    CheckpointCursor cursor;
+    uint64_t checksum;          /* FNV-1a over the layer records and state */
+} CheckpointHeader;
+
+typedef struct {
+    int written;
+    double snapshot_time;       /* Trainer: copying parameters */
+    double stall_time;          /* Trainer: waiting for the previous write */
+    double write_time;          /* Background thread: file I/O */
+} CheckpointStats;
+
+typedef struct CheckpointWriter CheckpointWriter;
+
+/* Synchronous save/load of weights, biases and the u_weights/u_biases
+   accumulators, plus an optional optimizer state vector (state_count
+   doubles, e.g. momentum velocity). Files are written to <path>.tmp and
+   renamed, so a crash never leaves a truncated checkpoint behind.
+   Loading a version 1 file, or one saved without state, zeroes state;
+   loading a file older than version 3 clears settings->recorded. */
+int checkpoint_save(const char* filepath, Layer** layers, int num_layers,
+                    const double* state, size_t state_count,
+                    const CheckpointCursor* cursor, const CheckpointSettings* settings);
+int checkpoint_load(const char* filepath, Layer** layers, int num_layers,
+                    double* state, size_t state_count,
+                    CheckpointCursor* cursor, CheckpointSettings* settings);
+/* Reads only the settings, so they can be checked before any layer or
+   optimizer state is touched. */
+int checkpoint_read_settings(const char* filepath, CheckpointSettings* settings);
+
+/* Background writer: checkpoint_writer_request copies the parameters into
+   a snapshot buffer and returns; a thread writes the snapshot. Only one
+   write is in flight; a request made while it runs waits for it. */
+CheckpointWriter* checkpoint_writer_create(const char* filepath, Layer** layers, int num_layers,
+                                           const double* state, size_t state_count,
+                                           const CheckpointSettings* settings);
+int checkpoint_writer_request(CheckpointWriter* writer, const CheckpointCursor* cursor);
+int checkpoint_writer_destroy(CheckpointWriter* writer, CheckpointStats* stats);
+
+#endif
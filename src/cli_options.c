@@ -0,0 +1,103 @@
+
+#include "cli_options.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Positional arguments fill images_path then labels_path; callers may
+   pre-set defaults before parsing. Returns -1 on an unknown option. */
+int inference_options_parse(int argc, char* argv[], InferenceOptions* options) {
+    int positional = 0;
+    const char* predictions_format = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --json\n");
+                return -1;
+            }
+            options->json_path = argv[++i];
+        } else if (strcmp(argv[i], "--model") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --model\n");
+                return -1;
+            }
+            options->model_path = argv[++i];
+        } else if (strcmp(argv[i], "--tag") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --tag\n");
+                return -1;
+            }
+            options->tag = argv[++i];
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            char* end = NULL;
+            if (i + 1 < argc) {
+                options->limit = strtoul(argv[++i], &end, 10);
+            }
+            if (end == NULL || *end != '\0' || options->limit == 0) {
+                fprintf(stderr, "--limit expects a positive image count\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            char* end = NULL;
+            if (i + 1 < argc) {
+                options->cache_entries = strtoul(argv[++i], &end, 10);
+            }
+            if (end == NULL || *end != '\0') {
+                fprintf(stderr, "--cache expects an entry count (0 disables the cache)\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--predictions") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --predictions\n");
+                return -1;
+            }
+            options->predictions_path = argv[++i];
+        } else if (strcmp(argv[i], "--predictions-format") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for --predictions-format\n");
+                return -1;
+            }
+            predictions_format = argv[++i];
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        } else if (positional == 0) {
+            options->images_path = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            options->labels_path = argv[i];
+            positional++;
+        } else {
+            fprintf(stderr, "Unexpected argument: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    /* Without an explicit format the file extension decides. */
+    if (predictions_format != NULL) {
+        if (prediction_format_parse(predictions_format, &options->predictions_format) != 0) {
+            fprintf(stderr, "--predictions-format expects binary or csv\n");
+            return -1;
+        }
+    } else if (options->predictions_path != NULL) {
+        options->predictions_format = prediction_format_for_path(options->predictions_path);
+    }
+
+    if (options->model_path == NULL) {
+        options->model_path = "./models/cnn_model.bin";
+    }
+
+    return 0;
+}
+
+void inference_options_usage(const char* program) {
+    fprintf(stderr, "Usage: %s <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --model <file>  Model to load (default ./models/cnn_model.bin, any trained width)\n");
+    fprintf(stderr, "  --json <file>   Append a JSON results record to <file>\n");
+    fprintf(stderr, "  --tag <label>   Label stored in the JSON record (e.g. strong, weak)\n");
+    fprintf(stderr, "  --limit <n>     Only process the first <n> images\n");
+    fprintf(stderr, "  --cache <n>     Cache predictions of up to <n> distinct images (XXH64 of the pixels)\n");
+    fprintf(stderr, "  --predictions <file>          Write each image's prediction and class probabilities\n");
+    fprintf(stderr, "  --predictions-format <f>      binary or csv (default: csv for *.csv, else binary)\n");
+}
@@ -0,0 +1,22 @@
+
+#ifndef CLI_OPTIONS_H
+#define CLI_OPTIONS_H
+
+#include "prediction_sink.h"
+
+typedef struct {
+    const char* images_path;
+    const char* labels_path;
+    const char* model_path;             /* --model: NULL = ./models/cnn_model.bin */
+    const char* json_path;
+    const char* tag;
+    unsigned long limit;
+    const char* predictions_path;       /* --predictions: per-image output */
+    PredictionFormat predictions_format;
+    unsigned long cache_entries;        /* --cache: prediction cache size, 0 = off */
+} InferenceOptions;
+
+int inference_options_parse(int argc, char* argv[], InferenceOptions* options);
+void inference_options_usage(const char* program);
+
+#endif
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "cnn.h"
 
@@ -120,9 +121,17 @@ void Layer_destroy(Layer* self)
     free(self->gradients);
     free(self->errors);
 
-    free(self->biases);
+    /* Replicas borrow their parameters from the master. */
+    if (self->master == NULL) {
+        free(self->biases);
+        free(self->weights);
+        if (self->ltype == LAYER_FULL) {
+            Layer_densify(self);
+        } else if (self->ltype == LAYER_CONV) {
+            Layer_direct(self);
+        }
+    }
     free(self->u_biases);
-    free(self->weights);
     free(self->u_weights);
 
     free(self);
@@ -294,6 +303,55 @@ void Load_pretrainedValues(const Layer *self, FILE *fp)
     }
 }
 
+/* Layer_feedForw_full_csr(self, inputs)
+   Y = (W * X + B) from the CSR weights. The products are summed in
+   the same order as the dense loop, minus the zero terms.
+*/
+static void Layer_feedForw_full_csr(Layer* self, const double* inputs)
+{
+    const int* rowptr = self->data.full.rowptr;
+    const int* cols = self->data.full.cols;
+    const double* values = self->data.full.values;
+
+    for (int i = 0; i < self->nnodes; i++) {
+        double x = self->biases[i];
+        for (int p = rowptr[i]; p < rowptr[i+1]; p++) {
+            x += (inputs[cols[p]] * values[p]);
+        }
+        self->outputs[i] = x;
+    }
+}
+
+/* Layer_feedForw_full_lowrank(self, inputs)
+   Y = (W * X + B) with W = factor_out * factor_in: the inputs are
+   projected onto the rank factor_in rows first.
+*/
+static void Layer_feedForw_full_lowrank(Layer* self, const double* inputs)
+{
+    int rank = self->data.full.rank;
+    int nin = self->nweights / self->nnodes;
+    const double* factor_in = self->data.full.factor_in;
+    const double* factor_out = self->data.full.factor_out;
+    double hidden[LAYER_MAX_RANK];
+
+    for (int r = 0; r < rank; r++) {
+        const double* row = &factor_in[r * nin];
+        double x = 0;
+        for (int j = 0; j < nin; j++) {
+            x += (inputs[j] * row[j]);
+        }
+        hidden[r] = x;
+    }
+    for (int i = 0; i < self->nnodes; i++) {
+        const double* row = &factor_out[i * rank];
+        double x = self->biases[i];
+        for (int r = 0; r < rank; r++) {
+            x += (hidden[r] * row[r]);
+        }
+        self->outputs[i] = x;
+    }
+}
+
 /* Layer_feedForw_full(self)
    Performs feed forward updates.
 */
@@ -303,14 +361,20 @@ static void Layer_feedForw_full(Layer* self)
     assert (self->lprev != NULL);
     Layer* lprev = self->lprev;
 
-    int k = 0;
-    for (int i = 0; i < self->nnodes; i++) {
-        /* Compute Y = (W * X + B) without activation function. */
-        double x = self->biases[i];
-        for (int j = 0; j < lprev->nnodes; j++) {
-            x += (lprev->outputs[j] * self->weights[k++]);
+    if (self->data.full.rowptr != NULL) {
+        Layer_feedForw_full_csr(self, lprev->outputs);
+    } else if (self->data.full.rank > 0) {
+        Layer_feedForw_full_lowrank(self, lprev->outputs);
+    } else {
+        int k = 0;
+        for (int i = 0; i < self->nnodes; i++) {
+            /* Compute Y = (W * X + B) without activation function. */
+            double x = self->biases[i];
+            for (int j = 0; j < lprev->nnodes; j++) {
+                x += (lprev->outputs[j] * self->weights[k++]);
+            }
+            self->outputs[i] = x;
         }
-        self->outputs[i] = x;
     }
 
     if (self->lnext == NULL) {
@@ -362,14 +426,20 @@ void Layer_feedForw_full_withInput(Layer* self, double* lprev_outputs)
     assert (self->lprev != NULL);
     Layer* lprev = self->lprev;
 
-    int k = 0;
-    for (int i = 0; i < self->nnodes; i++) {
-        /* Compute Y = (W * X + B) without activation function. */
-        double x = self->biases[i];
-        for (int j = 0; j < lprev->nnodes; j++) {
-            x += (lprev_outputs[j] * self->weights[k++]);
+    if (self->data.full.rowptr != NULL) {
+        Layer_feedForw_full_csr(self, lprev_outputs);
+    } else if (self->data.full.rank > 0) {
+        Layer_feedForw_full_lowrank(self, lprev_outputs);
+    } else {
+        int k = 0;
+        for (int i = 0; i < self->nnodes; i++) {
+            /* Compute Y = (W * X + B) without activation function. */
+            double x = self->biases[i];
+            for (int j = 0; j < lprev->nnodes; j++) {
+                x += (lprev_outputs[j] * self->weights[k++]);
+            }
+            self->outputs[i] = x;
         }
-        self->outputs[i] = x;
     }
 
     if (self->lnext == NULL) {
@@ -415,7 +485,7 @@ void Layer_feedForw_full_withInput(Layer* self, double* lprev_outputs)
 #endif
 }
 
-static void Layer_feedBack_full(Layer* self)
+void Layer_feedBack_full(Layer* self)
 {
     assert (self->ltype == LAYER_FULL);
     assert (self->lprev != NULL);
@@ -453,6 +523,19 @@ static void Layer_feedBack_full(Layer* self)
 #endif
 }
 
+/* Layer_feedForw_conv_winograd(self, inputs)
+   Feed forward of a conv layer with cached Winograd transforms.
+*/
+static void Layer_feedForw_conv_winograd(Layer* self, const double* inputs)
+{
+    Layer_conv_winograd(self, inputs, self->data.conv.winograd_plane, self->outputs);
+    for (int i = 0; i < self->nnodes; i++) {
+        double v = relu(self->outputs[i]);
+        self->outputs[i] = v;
+        self->gradients[i] = relu_g(v);
+    }
+}
+
 /* Layer_feedForw_conv(self)
    Performs feed forward updates.
 */
@@ -462,6 +545,11 @@ static void Layer_feedForw_conv(Layer* self)
     assert (self->lprev != NULL);
     Layer* lprev = self->lprev;
 
+    if (self->data.conv.winograd != NULL) {
+        Layer_feedForw_conv_winograd(self, lprev->outputs);
+        return;
+    }
+
     int kernsize = self->data.conv.kernsize;
     int i = 0;
     for (int z1 = 0; z1 < self->depth; z1++) {
@@ -523,6 +611,11 @@ void Layer_feedForw_conv_withInput(Layer* self, double* lprev_outputs)
     assert (self->lprev != NULL);
     Layer* lprev = self->lprev;
 
+    if (self->data.conv.winograd != NULL) {
+        Layer_feedForw_conv_winograd(self, lprev_outputs);
+        return;
+    }
+
     int kernsize = self->data.conv.kernsize;
     int i = 0;
     for (int z1 = 0; z1 < self->depth; z1++) {
@@ -578,7 +671,7 @@ void Layer_feedForw_conv_withInput(Layer* self, double* lprev_outputs)
 #endif
 }
 
-static void Layer_feedBack_conv(Layer* self)
+void Layer_feedBack_conv(Layer* self)
 {
     assert (self->ltype == LAYER_CONV);
     assert (self->lprev != NULL);
@@ -710,6 +803,16 @@ double Layer_getErrorTotal(const Layer* self)
    Learns the output values.
 */
 void Layer_learnOutputs(Layer* self, const double* values)
+{
+    Layer_learnOutputs_withHook(self, values, NULL, NULL);
+}
+
+/* Layer_learnOutputs_withHook(self, values, hook, ctx)
+   Learns the output values, calling hook(layer, ctx) as soon as
+   each layer's weight/bias updates are complete.
+*/
+void Layer_learnOutputs_withHook(
+    Layer* self, const double* values, LayerHook hook, void* ctx)
 {
     assert (self != NULL);
     assert (self->ltype != LAYER_INPUT);
@@ -732,9 +835,11 @@ void Layer_learnOutputs(Layer* self, const double* values)
         switch (layer->ltype) {
         case LAYER_FULL:
             Layer_feedBack_full(layer);
+            if (hook != NULL) hook(layer, ctx);
             break;
         case LAYER_CONV:
             Layer_feedBack_conv(layer);
+            if (hook != NULL) hook(layer, ctx);
             break;
         default:
             break;
@@ -744,10 +849,28 @@ void Layer_learnOutputs(Layer* self, const double* values)
 }
 
 /* Layer_update(self, rate)
-   Updates the weights.
+   Updates the weights of this layer and every layer before it.
 */
 void Layer_update(Layer* self, double rate)
 {
+    for (Layer* layer = self; layer != NULL; layer = layer->lprev) {
+        Layer_updateSingle(layer, rate);
+    }
+}
+
+/* Layer_updateSingle(self, rate)
+   Updates the weights of this layer only.
+*/
+void Layer_updateSingle(Layer* self, double rate)
+{
+    /* The CSR copy, the factors or the Winograd transforms would go stale. */
+    if (self->ltype == LAYER_FULL &&
+        (self->data.full.rowptr != NULL || self->data.full.rank > 0)) {
+        Layer_densify(self);
+    }
+    if (self->ltype == LAYER_CONV && self->data.conv.winograd != NULL) {
+        Layer_direct(self);
+    }
     for (int i = 0; i < self->nbiases; i++) {
         self->biases[i] -= rate * self->u_biases[i];
         self->u_biases[i] = 0;
@@ -756,8 +879,247 @@ void Layer_update(Layer* self, double rate)
         self->weights[i] -= rate * self->u_weights[i];
         self->u_weights[i] = 0;
     }
-    if (self->lprev != NULL) {
-        Layer_update(self->lprev, rate);
+}
+
+/* Layer_sparsify(self)
+   Builds CSR weights from the nonzero weights.
+*/
+int Layer_sparsify(Layer* self)
+{
+    assert (self != NULL);
+    assert (self->ltype == LAYER_FULL);
+    Layer_densify(self);
+
+    int nin = self->nweights / self->nnodes;
+    int nnz = 0;
+    for (int k = 0; k < self->nweights; k++) {
+        if (self->weights[k] != 0.0) nnz++;
+    }
+    int* rowptr = (int*)malloc((self->nnodes + 1) * sizeof(int));
+    int* cols = (int*)malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    double* values = (double*)malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+    if (rowptr == NULL || cols == NULL || values == NULL) {
+        free(rowptr);
+        free(cols);
+        free(values);
+        return -1;
+    }
+
+    int p = 0;
+    for (int i = 0; i < self->nnodes; i++) {
+        rowptr[i] = p;
+        const double* row = &self->weights[i * nin];
+        for (int j = 0; j < nin; j++) {
+            if (row[j] != 0.0) {
+                cols[p] = j;
+                values[p] = row[j];
+                p++;
+            }
+        }
+    }
+    rowptr[self->nnodes] = p;
+
+    self->data.full.nnz = nnz;
+    self->data.full.rowptr = rowptr;
+    self->data.full.cols = cols;
+    self->data.full.values = values;
+    return nnz;
+}
+
+/* Layer_factorize(self, rank, factor_in, factor_out)
+   Stores the factors and sets the weights to their product.
+*/
+int Layer_factorize(Layer* self, int rank, const double* factor_in, const double* factor_out)
+{
+    assert (self != NULL);
+    assert (self->ltype == LAYER_FULL);
+    if (rank < 1 || rank > LAYER_MAX_RANK) return -1;
+    Layer_densify(self);
+
+    int nin = self->nweights / self->nnodes;
+    double* fin = (double*)malloc((size_t)rank * nin * sizeof(double));
+    double* fout = (double*)malloc((size_t)self->nnodes * rank * sizeof(double));
+    if (fin == NULL || fout == NULL) {
+        free(fin);
+        free(fout);
+        return -1;
+    }
+    memcpy(fin, factor_in, (size_t)rank * nin * sizeof(double));
+    memcpy(fout, factor_out, (size_t)self->nnodes * rank * sizeof(double));
+
+    for (int i = 0; i < self->nnodes; i++) {
+        double* row = &self->weights[i * nin];
+        for (int j = 0; j < nin; j++) {
+            row[j] = 0;
+        }
+        for (int r = 0; r < rank; r++) {
+            double a = fout[i * rank + r];
+            const double* f = &fin[r * nin];
+            for (int j = 0; j < nin; j++) {
+                row[j] += a * f[j];
+            }
+        }
+    }
+
+    self->data.full.rank = rank;
+    self->data.full.factor_in = fin;
+    self->data.full.factor_out = fout;
+    return 0;
+}
+
+/* Layer_densify(self)
+   Drops the CSR weights and the low-rank factors.
+*/
+void Layer_densify(Layer* self)
+{
+    assert (self != NULL);
+    assert (self->ltype == LAYER_FULL);
+    free(self->data.full.rowptr);
+    free(self->data.full.cols);
+    free(self->data.full.values);
+    self->data.full.nnz = 0;
+    self->data.full.rowptr = NULL;
+    self->data.full.cols = NULL;
+    self->data.full.values = NULL;
+    free(self->data.full.factor_in);
+    free(self->data.full.factor_out);
+    self->data.full.rank = 0;
+    self->data.full.factor_in = NULL;
+    self->data.full.factor_out = NULL;
+}
+
+/* Layer_winograd(self)
+   Caches U = G g G^T for every output channel, with
+     G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1].
+   g is the kernel at qbase (the direct loop indexes the kernels by
+   output channel only). Also allocates the plane scratch of the
+   per-image feed forward.
+*/
+int Layer_winograd(Layer* self)
+{
+    assert (self != NULL);
+    assert (self->ltype == LAYER_CONV);
+    if (self->data.conv.kernsize != 3 || self->data.conv.stride != 1) return -1;
+    Layer_direct(self);
+
+    double* transforms = (double*)malloc(self->depth * 16 * sizeof(double));
+    double* plane = (double*)malloc(self->lprev->width * self->lprev->height * sizeof(double));
+    if (transforms == NULL || plane == NULL) {
+        free(transforms);
+        free(plane);
+        return -1;
+    }
+    for (int z1 = 0; z1 < self->depth; z1++) {
+        const double* g = &self->weights[z1 * self->lprev->depth * 9];
+        double* u = &transforms[z1 * 16];
+        double gg[4][3];
+        for (int j = 0; j < 3; j++) {
+            gg[0][j] = g[j];
+            gg[1][j] = 0.5 * (g[j] + g[3+j] + g[6+j]);
+            gg[2][j] = 0.5 * (g[j] - g[3+j] + g[6+j]);
+            gg[3][j] = g[6+j];
+        }
+        for (int i = 0; i < 4; i++) {
+            u[i*4+0] = gg[i][0];
+            u[i*4+1] = 0.5 * (gg[i][0] + gg[i][1] + gg[i][2]);
+            u[i*4+2] = 0.5 * (gg[i][0] - gg[i][1] + gg[i][2]);
+            u[i*4+3] = gg[i][2];
+        }
+    }
+    self->data.conv.winograd = transforms;
+    self->data.conv.winograd_plane = plane;
+    return 0;
+}
+
+/* Layer_direct(self)
+   Drops the Winograd transforms and the plane scratch.
+*/
+void Layer_direct(Layer* self)
+{
+    assert (self != NULL);
+    assert (self->ltype == LAYER_CONV);
+    free(self->data.conv.winograd);
+    free(self->data.conv.winograd_plane);
+    self->data.conv.winograd = NULL;
+    self->data.conv.winograd_plane = NULL;
+}
+
+/* Layer_conv_winograd(self, inputs, plane, outputs)
+   F(2x2,3x3): for each 2x2 output tile, the 4x4 input tile d becomes
+   V = B^T d B, and each output channel's tile is A^T (U .* V) A with
+     B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1]
+     A^T = [1 1 1 0; 0 1 -1 -1].
+   Every input channel shares its output channel's kernel, so the input
+   channels are summed into one plane first and V is shared by all the
+   output channels.
+*/
+void Layer_conv_winograd(const Layer* self, const double* inputs, double* plane, double* outputs)
+{
+    assert (self->data.conv.winograd != NULL);
+    const Layer* lprev = self->lprev;
+    int pad = self->data.conv.padding;
+    int w0 = lprev->width, h0 = lprev->height;
+    int nplane = w0 * h0;
+    int npos = self->width * self->height;
+
+    memcpy(plane, inputs, nplane * sizeof(double));
+    for (int z0 = 1; z0 < lprev->depth; z0++) {
+        for (int p = 0; p < nplane; p++) {
+            plane[p] += inputs[z0 * nplane + p];
+        }
+    }
+
+    for (int ty = 0; ty < self->height; ty += 2) {
+        for (int tx = 0; tx < self->width; tx += 2) {
+            /* Input tile at (ty-pad, tx-pad), zero outside the plane. */
+            double d[4][4];
+            for (int i = 0; i < 4; i++) {
+                int y = ty - pad + i;
+                for (int j = 0; j < 4; j++) {
+                    int x = tx - pad + j;
+                    d[i][j] = (0 <= y && y < h0 && 0 <= x && x < w0)? plane[y*w0 + x] : 0;
+                }
+            }
+            double t[4][4], v[16];
+            for (int j = 0; j < 4; j++) {
+                t[0][j] = d[0][j] - d[2][j];
+                t[1][j] = d[1][j] + d[2][j];
+                t[2][j] = d[2][j] - d[1][j];
+                t[3][j] = d[1][j] - d[3][j];
+            }
+            for (int i = 0; i < 4; i++) {
+                v[i*4+0] = t[i][0] - t[i][2];
+                v[i*4+1] = t[i][1] + t[i][2];
+                v[i*4+2] = t[i][2] - t[i][1];
+                v[i*4+3] = t[i][1] - t[i][3];
+            }
+
+            int ny = (ty + 2 <= self->height)? 2 : 1;
+            int nx = (tx + 2 <= self->width)? 2 : 1;
+            for (int z1 = 0; z1 < self->depth; z1++) {
+                const double* u = &self->data.conv.winograd[z1 * 16];
+                double m[16];
+                for (int k = 0; k < 16; k++) {
+                    m[k] = u[k] * v[k];
+                }
+                double r[2][4];
+                for (int j = 0; j < 4; j++) {
+                    r[0][j] = m[j] + m[4+j] + m[8+j];
+                    r[1][j] = m[4+j] - m[8+j] - m[12+j];
+                }
+                double y[2][2];
+                for (int i = 0; i < 2; i++) {
+                    y[i][0] = r[i][0] + r[i][1] + r[i][2];
+                    y[i][1] = r[i][1] - r[i][2] - r[i][3];
+                }
+                double* out = &outputs[z1 * npos + ty * self->width + tx];
+                for (int i = 0; i < ny; i++) {
+                    for (int j = 0; j < nx; j++) {
+                        out[i * self->width + j] = self->biases[z1] + y[i][j];
+                    }
+                }
+            }
+        }
     }
 }
 
@@ -781,7 +1143,8 @@ Layer* Layer_create_full(Layer* lprev, int nnodes, double std)
         nnodes, nnodes * lprev->nnodes);
     assert (self != NULL);
 
-    for (int i = 0; i < self->nweights; i++) {
+    /* std == 0 leaves the weights zeroed without drawing from rand(). */
+    for (int i = 0; std != 0.0 && i < self->nweights; i++) {
         self->weights[i] = std * nrnd();
     }
 
@@ -791,6 +1154,53 @@ Layer* Layer_create_full(Layer* lprev, int nnodes, double std)
     return self;
 }
 
+/* Layer_create_replica(lprev, master)
+   Creates a Layer shaped like master that shares its weights and
+   biases, with private outputs, errors and weight updates.
+*/
+Layer* Layer_create_replica(Layer* lprev, Layer* master)
+{
+    assert (master != NULL);
+    assert ((lprev == NULL) == (master->lprev == NULL));
+    Layer* self = Layer_create(
+        lprev, master->ltype, master->depth, master->width, master->height,
+        master->nbiases, master->nweights);
+    assert (self != NULL);
+
+    free(self->biases);
+    free(self->weights);
+    self->master = master;
+    self->biases = master->biases;
+    self->weights = master->weights;
+    self->data = master->data;
+    return self;
+}
+
+/* Layer_create_full_rows(full, row0, nrows)
+   Creates a fully-connected Layer holding the output nodes
+   [row0, row0+nrows) of full (a copy of their weights and biases).
+   It reads full's previous layer but is not linked into the chain.
+*/
+Layer* Layer_create_full_rows(Layer* full, int row0, int nrows)
+{
+    assert (full != NULL);
+    assert (full->ltype == LAYER_FULL);
+    assert (0 <= row0 && 0 < nrows && row0+nrows <= full->nnodes);
+    int nin = full->lprev->nnodes;
+    Layer* self = Layer_create(
+        NULL, LAYER_FULL, nrows, 1, 1,
+        nrows, nrows * nin);
+    assert (self != NULL);
+
+    /* Keep the neighbours (lnext != NULL: not the softmax layer). */
+    self->lprev = full->lprev;
+    self->lnext = full->lnext;
+    self->lid = full->lid;
+    memcpy(self->weights, &full->weights[row0 * nin], self->nweights * sizeof(double));
+    memcpy(self->biases, &full->biases[row0], self->nbiases * sizeof(double));
+    return self;
+}
+
 /* Layer_create_conv(lprev, depth, width, height, kernsize, padding, stride, std)
    Creates a convolutional Layer.
 */
@@ -812,7 +1222,8 @@ Layer* Layer_create_conv(
     self->data.conv.padding = padding;
     self->data.conv.stride = stride;
 
-    for (int i = 0; i < self->nweights; i++) {
+    /* std == 0 leaves the weights zeroed without drawing from rand(). */
+    for (int i = 0; std != 0.0 && i < self->nweights; i++) {
         self->weights[i] = std * nrnd();
     }
 
@@ -9,6 +9,10 @@
 #include <stddef.h>
 #include <stdio.h>
 
+/*  Kernel backend and precision (reported in benchmark records). */
+#define CNN_KERNEL_BACKEND "scalar"
+#define CNN_PRECISION "fp64"
+
 /*  LayerType */
 typedef enum _LayerType {
     LAYER_INPUT = 0,
@@ -32,10 +36,18 @@ typedef struct _Layer {
     int nweights;               /* Num. of Weights */
     double* weights;            /* Weights (trained) */
     double* u_weights;          /* Weight updates */
+    struct _Layer* master;      /* Parameter owner (replicas only) */
     LayerType ltype;            /* Layer type */
     union {
         /* Full */
         struct {
+            int nnz;            /* Stored weights (CSR only) */
+            int* rowptr;        /* CSR row starts (nnodes+1); NULL: dense */
+            int* cols;          /* CSR column of each stored weight */
+            double* values;     /* CSR stored weights */
+            int rank;           /* Low-rank factors (0: none) */
+            double* factor_in;  /* rank x inputs */
+            double* factor_out; /* nnodes x rank */
         } full;
 
         /* Conv */
@@ -43,6 +55,8 @@ typedef struct _Layer {
             int kernsize;       /* kernel size (>0) */
             int padding;        /* padding size */
             int stride;         /* stride (>0) */
+            double* winograd;   /* depth x 16 transformed kernels; NULL: direct */
+            double* winograd_plane; /* Summed input plane for the per-image path */
         } conv;
     } data;
 } Layer;
@@ -55,17 +69,30 @@ Layer* Layer_create_input(
 
 /* Layer_create_full(lprev, nnodes, std)
    Creates a fully-connected Layer.
+   std == 0 skips the random weight init (for weights loaded from a file).
 */
 Layer* Layer_create_full(
     Layer* lprev, int nnodes, double std);
 
 /* Layer_create_conv(lprev, depth, width, height, kernsize, padding, stride, std)
-   Creates a convolutional Layer.
+   Creates a convolutional Layer. std == 0 as for Layer_create_full.
 */
 Layer* Layer_create_conv(
     Layer* lprev, int depth, int width, int height,
     int kernsize, int padding, int stride, double std);
 
+/* Layer_create_replica(lprev, master)
+   Creates a Layer shaped like master that shares its weights and
+   biases, with private outputs, errors and weight updates.
+*/
+Layer* Layer_create_replica(Layer* lprev, Layer* master);
+
+/* Layer_create_full_rows(full, row0, nrows)
+   Creates an unlinked fully-connected Layer holding the output nodes
+   [row0, row0+nrows) of full (tensor-parallel shard).
+*/
+Layer* Layer_create_full_rows(Layer* full, int row0, int nrows);
+
 /* Layer_destroy(self)
    Releases the memory.
 */
@@ -106,14 +133,83 @@ double Layer_getErrorTotal(const Layer* self);
 */
 void Layer_learnOutputs(Layer* self, const double* values);
 
+/* LayerHook
+   Callback invoked by Layer_learnOutputs_withHook after a layer's
+   backward pass (e.g. to start communicating its updates).
+*/
+typedef void (*LayerHook)(Layer* layer, void* ctx);
+
+/* Layer_learnOutputs_withHook(self, values, hook, ctx)
+   Learns the output values, calling hook(layer, ctx) as soon as
+   each layer's weight/bias updates are complete.
+*/
+void Layer_learnOutputs_withHook(
+    Layer* self, const double* values, LayerHook hook, void* ctx);
+
 /* Layer_update(self, rate)
    Updates the weights.
 */
 void Layer_update(Layer* self, double rate);
 
+/* Layer_updateSingle(self, rate)
+   Updates the weights of this layer only.
+*/
+void Layer_updateSingle(Layer* self, double rate);
+
+/* Layer_sparsify(self)
+   Builds CSR weights from the nonzero weights of a full layer; the
+   feed forward then runs as a sparse matrix-vector product. The dense
+   weights stay the trained copy: Layer_update drops the CSR again.
+   Returns the number of stored weights.
+*/
+int Layer_sparsify(Layer* self);
+
+/* Layer_factorize(self, rank, factor_in, factor_out)
+   Replaces the weights of a full layer by the product
+   factor_out (nnodes x rank) * factor_in (rank x inputs); the feed
+   forward then runs as two thin products. The dense weights are set
+   to the product, so the backward pass sees the same matrix.
+   Returns 0, or -1 for a rank outside [1, LAYER_MAX_RANK].
+*/
+#define LAYER_MAX_RANK 256
+int Layer_factorize(Layer* self, int rank, const double* factor_in, const double* factor_out);
+
+/* Layer_densify(self)
+   Drops the CSR weights and low-rank factors (back to the dense kernel).
+*/
+void Layer_densify(Layer* self);
+
+/* Layer_winograd(self)
+   Caches the F(2x2,3x3) Winograd transforms G g G^T of a conv layer's
+   kernels; the feed forward then runs on 4x4 input tiles, 16
+   multiplies per 2x2 outputs instead of 36. Only 3x3 stride-1 layers
+   qualify (model_load calls it for those); others keep the direct
+   kernel. Layer_update drops the cache again.
+   Returns 0, or -1 when the layer does not qualify.
+*/
+int Layer_winograd(Layer* self);
+
+/* Layer_direct(self)
+   Drops the Winograd transforms (back to the direct kernel).
+*/
+void Layer_direct(Layer* self);
+
+/* Layer_conv_winograd(self, inputs, plane, outputs)
+   Computes bias + convolution (no activation) of one sample into
+   outputs with the cached transforms. plane is caller-owned scratch of
+   lprev->width * lprev->height doubles.
+*/
+void Layer_conv_winograd(const Layer* self, const double* inputs, double* plane, double* outputs);
+
 /* Layer_feedForw_conv_withInput(self, lprev_outputs)
    feedforward for conv.
 */
 void Layer_feedForw_conv_withInput(Layer* self, double* lprev_outputs);
 void Layer_feedForw_full_withInput(Layer* self, double* lprev_outputs);
+
+/* Layer_feedBack_conv(self)
+   backpropagation for conv (single layer).
+*/
+void Layer_feedBack_conv(Layer* self);
+void Layer_feedBack_full(Layer* self);
 #endif
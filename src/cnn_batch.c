@@ -0,0 +1,542 @@
+/*
+  cnn_batch.c
+  Minibatch (GEMM-based) forward and backward passes for cnn.c layers.
+
+  Full layers use three matrix products per batch instead of one
+  matrix-vector product and one rank-1 update per sample:
+    forward   Y  = X  * W^T      (n x out)
+    backward  dX = dY * W        (n x in)
+              dW += dY^T * X     (out x in)
+  so each weight tile is loaded once per batch rather than per sample.
+
+  Conv layers follow cnn.c, where a kernel is indexed by (z1, dy, dx)
+  only: every output channel applies the same k x k weights to all input
+  channels. That is the same as a single-channel convolution of the sum
+  of the input channels, which is what im2col/col2im operate on here.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cnn_batch.h"
+
+/* Cache tiles: rows of B (gemm_nt) or columns of B (gemm_nn/gemm_tn)
+   kept hot while every row block of A streams past them. */
+#define GEMM_TILE_ROWS 16
+#define GEMM_TILE_COLS 256
+#define SPMM_TILE_SAMPLES 32
+
+
+/*  GEMM helpers (row-major, C += op(A) * op(B))
+    Each computes a 4 x 4 (nt) or 4 x 8 (nn/tn) block of C in registers
+    so that every loaded element feeds several independent accumulators.
+ */
+
+/* gemm_nt: C[M x N] += A[M x K] * B[N x K]^T */
+static void gemm_nt(int M, int N, int K,
+                    const double* A, int lda, const double* B, int ldb,
+                    double* C, int ldc)
+{
+    for (int j0 = 0; j0 < N; j0 += GEMM_TILE_ROWS) {
+        int j1 = (j0 + GEMM_TILE_ROWS < N)? j0 + GEMM_TILE_ROWS : N;
+        int i = 0;
+        for (; i + 4 <= M; i += 4) {
+            int j = j0;
+            for (; j + 4 <= j1; j += 4) {
+                double acc[4][4] = {{0}};
+                for (int k = 0; k < K; k++) {
+                    double a0 = A[i * lda + k], a1 = A[(i+1) * lda + k];
+                    double a2 = A[(i+2) * lda + k], a3 = A[(i+3) * lda + k];
+                    for (int c = 0; c < 4; c++) {
+                        double b = B[(j+c) * ldb + k];
+                        acc[0][c] += a0 * b;
+                        acc[1][c] += a1 * b;
+                        acc[2][c] += a2 * b;
+                        acc[3][c] += a3 * b;
+                    }
+                }
+                for (int r = 0; r < 4; r++) {
+                    for (int c = 0; c < 4; c++) {
+                        C[(i+r) * ldc + j + c] += acc[r][c];
+                    }
+                }
+            }
+            for (; j < j1; j++) {
+                for (int r = 0; r < 4; r++) {
+                    double v = 0;
+                    for (int k = 0; k < K; k++) {
+                        v += A[(i+r) * lda + k] * B[j * ldb + k];
+                    }
+                    C[(i+r) * ldc + j] += v;
+                }
+            }
+        }
+        for (; i < M; i++) {
+            for (int j = j0; j < j1; j++) {
+                double v = 0;
+                for (int k = 0; k < K; k++) {
+                    v += A[i * lda + k] * B[j * ldb + k];
+                }
+                C[i * ldc + j] += v;
+            }
+        }
+    }
+}
+
+/* gemm_kernel: C[M x N] += A * B[K x N], where element (i, k) of A is
+   A[i * a_row + k * a_col]. Covers both A and A^T without copying. */
+static void gemm_kernel(int M, int N, int K,
+                        const double* A, int a_row, int a_col,
+                        const double* B, int ldb, double* C, int ldc)
+{
+    for (int j0 = 0; j0 < N; j0 += GEMM_TILE_COLS) {
+        int j1 = (j0 + GEMM_TILE_COLS < N)? j0 + GEMM_TILE_COLS : N;
+        int i = 0;
+        for (; i + 4 <= M; i += 4) {
+            int j = j0;
+            for (; j + 8 <= j1; j += 8) {
+                double acc[4][8];
+                for (int r = 0; r < 4; r++) {
+                    for (int c = 0; c < 8; c++) {
+                        acc[r][c] = C[(i+r) * ldc + j + c];
+                    }
+                }
+                for (int k = 0; k < K; k++) {
+                    const double* b = &B[k * ldb + j];
+                    for (int r = 0; r < 4; r++) {
+                        double a = A[(i+r) * a_row + k * a_col];
+                        for (int c = 0; c < 8; c++) {
+                            acc[r][c] += a * b[c];
+                        }
+                    }
+                }
+                for (int r = 0; r < 4; r++) {
+                    for (int c = 0; c < 8; c++) {
+                        C[(i+r) * ldc + j + c] = acc[r][c];
+                    }
+                }
+            }
+            for (; j < j1; j++) {
+                for (int r = 0; r < 4; r++) {
+                    double v = C[(i+r) * ldc + j];
+                    for (int k = 0; k < K; k++) {
+                        v += A[(i+r) * a_row + k * a_col] * B[k * ldb + j];
+                    }
+                    C[(i+r) * ldc + j] = v;
+                }
+            }
+        }
+        for (; i < M; i++) {
+            for (int k = 0; k < K; k++) {
+                double a = A[i * a_row + k * a_col];
+                const double* b = &B[k * ldb];
+                for (int j = j0; j < j1; j++) {
+                    C[i * ldc + j] += a * b[j];
+                }
+            }
+        }
+    }
+}
+
+/* spmm_nt: C[M x N] += A[M x K] * B^T, B (N x K) in CSR. Each row of B
+   is applied to a tile of samples while its indices and values are
+   still in cache. */
+static void spmm_nt(int M, int N, const int* rowptr, const int* cols, const double* values,
+                    const double* A, int lda, double* C, int ldc)
+{
+    for (int i0 = 0; i0 < M; i0 += SPMM_TILE_SAMPLES) {
+        int i1 = (i0 + SPMM_TILE_SAMPLES < M) ? i0 + SPMM_TILE_SAMPLES : M;
+        for (int j = 0; j < N; j++) {
+            for (int i = i0; i < i1; i++) {
+                const double* a = &A[i * lda];
+                double sum = 0.0;
+                for (int p = rowptr[j]; p < rowptr[j+1]; p++) {
+                    sum += a[cols[p]] * values[p];
+                }
+                C[i * ldc + j] += sum;
+            }
+        }
+    }
+}
+
+/* gemm_nn: C[M x N] += A[M x K] * B[K x N] */
+static void gemm_nn(int M, int N, int K,
+                    const double* A, int lda, const double* B, int ldb,
+                    double* C, int ldc)
+{
+    gemm_kernel(M, N, K, A, lda, 1, B, ldb, C, ldc);
+}
+
+/* gemm_tn: C[M x N] += A[K x M]^T * B[K x N] */
+static void gemm_tn(int M, int N, int K,
+                    const double* A, int lda, const double* B, int ldb,
+                    double* C, int ldc)
+{
+    gemm_kernel(M, N, K, A, 1, lda, B, ldb, C, ldc);
+}
+
+
+/*  im2col / col2im on a single (channel-summed) plane
+ */
+
+static void im2col(const Layer* self, const double* plane, double* cols)
+{
+    const Layer* lprev = self->lprev;
+    int kernsize = self->data.conv.kernsize;
+    int npos = self->width * self->height;
+    for (int dy = 0; dy < kernsize; dy++) {
+        for (int dx = 0; dx < kernsize; dx++) {
+            double* row = &cols[(dy * kernsize + dx) * npos];
+            int p = 0;
+            for (int y1 = 0; y1 < self->height; y1++) {
+                int y = self->data.conv.stride * y1 - self->data.conv.padding + dy;
+                for (int x1 = 0; x1 < self->width; x1++) {
+                    int x = self->data.conv.stride * x1 - self->data.conv.padding + dx;
+                    row[p++] = (0 <= y && y < lprev->height && 0 <= x && x < lprev->width)?
+                        plane[y * lprev->width + x] : 0;
+                }
+            }
+        }
+    }
+}
+
+static void col2im(const Layer* self, const double* cols, double* plane)
+{
+    const Layer* lprev = self->lprev;
+    int kernsize = self->data.conv.kernsize;
+    int npos = self->width * self->height;
+    memset(plane, 0, lprev->width * lprev->height * sizeof(double));
+    for (int dy = 0; dy < kernsize; dy++) {
+        for (int dx = 0; dx < kernsize; dx++) {
+            const double* row = &cols[(dy * kernsize + dx) * npos];
+            int p = 0;
+            for (int y1 = 0; y1 < self->height; y1++) {
+                int y = self->data.conv.stride * y1 - self->data.conv.padding + dy;
+                for (int x1 = 0; x1 < self->width; x1++) {
+                    int x = self->data.conv.stride * x1 - self->data.conv.padding + dx;
+                    if (0 <= y && y < lprev->height && 0 <= x && x < lprev->width) {
+                        plane[y * lprev->width + x] += row[p];
+                    }
+                    p++;
+                }
+            }
+        }
+    }
+}
+
+
+/*  LayerBatch
+ */
+
+/* LayerBatch_create(layer, lprev, capacity)
+   Creates the batch state for layer, linked after lprev.
+*/
+LayerBatch* LayerBatch_create(Layer* layer, LayerBatch* lprev, int capacity)
+{
+    assert (layer != NULL);
+    assert (capacity > 0);
+    LayerBatch* self = (LayerBatch*)calloc(1, sizeof(LayerBatch));
+    if (self == NULL) return NULL;
+
+    self->layer = layer;
+    self->lprev = lprev;
+    self->lnext = NULL;
+    if (lprev != NULL) {
+        assert (lprev->layer == layer->lprev);
+        lprev->lnext = self;
+    }
+    self->capacity = capacity;
+
+    size_t n = (size_t)capacity * layer->nnodes;
+    self->outputs = (double*)calloc(n, sizeof(double));
+    self->gradients = (double*)calloc(n, sizeof(double));
+    self->errors = (double*)calloc(n, sizeof(double));
+    self->deltas = (double*)calloc(n, sizeof(double));
+
+    if (layer->ltype == LAYER_CONV) {
+        int kk = layer->data.conv.kernsize * layer->data.conv.kernsize;
+        int npos = layer->width * layer->height;
+        int nplane = layer->lprev->width * layer->lprev->height;
+        self->columns = (double*)calloc((size_t)capacity * kk * npos, sizeof(double));
+        /* Summed input plane, or col2im columns followed by a plane. */
+        self->scratch = (double*)calloc((size_t)kk * npos + nplane, sizeof(double));
+    } else if (layer->ltype == LAYER_FULL && layer->data.full.rank > 0) {
+        /* Low-rank: the projected inputs, capacity x rank. */
+        self->scratch = (double*)calloc((size_t)capacity * layer->data.full.rank, sizeof(double));
+    }
+
+    return self;
+}
+
+/* LayerBatch_destroy(self)
+   Releases the memory (the wrapped Layer is kept).
+*/
+void LayerBatch_destroy(LayerBatch* self)
+{
+    assert (self != NULL);
+
+    free(self->outputs);
+    free(self->gradients);
+    free(self->errors);
+    free(self->deltas);
+    free(self->columns);
+    free(self->scratch);
+
+    free(self);
+}
+
+static void LayerBatch_feedForw_full(LayerBatch* self, int n)
+{
+    Layer* layer = self->layer;
+    int nin = layer->lprev->nnodes;
+    int nout = layer->nnodes;
+
+    /* Y = X * W^T + B */
+    for (int s = 0; s < n; s++) {
+        memcpy(&self->outputs[s * nout], layer->biases, nout * sizeof(double));
+    }
+    if (layer->data.full.rowptr != NULL) {
+        spmm_nt(n, nout, layer->data.full.rowptr, layer->data.full.cols, layer->data.full.values,
+                self->lprev->outputs, nin, self->outputs, nout);
+    } else if (layer->data.full.rank > 0) {
+        /* Y = (X * Fin^T) * Fout^T + B */
+        int rank = layer->data.full.rank;
+        assert (self->scratch != NULL);
+        memset(self->scratch, 0, (size_t)n * rank * sizeof(double));
+        gemm_nt(n, rank, nin, self->lprev->outputs, nin, layer->data.full.factor_in, nin,
+                self->scratch, rank);
+        gemm_nt(n, nout, rank, self->scratch, rank, layer->data.full.factor_out, rank,
+                self->outputs, nout);
+    } else {
+        gemm_nt(n, nout, nin, self->lprev->outputs, nin, layer->weights, nin,
+                self->outputs, nout);
+    }
+
+    for (int s = 0; s < n; s++) {
+        double* out = &self->outputs[s * nout];
+        double* grad = &self->gradients[s * nout];
+        if (layer->lnext == NULL) {
+            /* Last layer - use Softmax. */
+            double m = -1;
+            for (int i = 0; i < nout; i++) {
+                if (m < out[i]) { m = out[i]; }
+            }
+            double t = 0;
+            for (int i = 0; i < nout; i++) {
+                out[i] = exp(out[i]-m);
+                t += out[i];
+            }
+            for (int i = 0; i < nout; i++) {
+                out[i] /= t;
+                grad[i] = 1;
+            }
+        } else {
+            /* Otherwise, use Tanh. */
+            for (int i = 0; i < nout; i++) {
+                double y = tanh(out[i]);
+                out[i] = y;
+                grad[i] = 1.0 - y*y;
+            }
+        }
+    }
+}
+
+static void LayerBatch_feedBack_full(LayerBatch* self, int n)
+{
+    Layer* layer = self->layer;
+    int nin = layer->lprev->nnodes;
+    int nout = layer->nnodes;
+
+    for (int i = 0; i < n * nout; i++) {
+        self->deltas[i] = self->errors[i] * self->gradients[i];
+    }
+
+    /* dW += dY^T * X, dB += sum(dY) */
+    gemm_tn(nout, nin, n, self->deltas, nout, self->lprev->outputs, nin,
+            layer->u_weights, nin);
+    for (int s = 0; s < n; s++) {
+        for (int i = 0; i < nout; i++) {
+            layer->u_biases[i] += self->deltas[s * nout + i];
+        }
+    }
+
+    /* dX = dY * W */
+    memset(self->lprev->errors, 0, (size_t)n * nin * sizeof(double));
+    gemm_nn(n, nin, nout, self->deltas, nout, layer->weights, nin,
+            self->lprev->errors, nin);
+}
+
+static void LayerBatch_feedForw_conv(LayerBatch* self, int n)
+{
+    Layer* layer = self->layer;
+    Layer* lprev = layer->lprev;
+    int kk = layer->data.conv.kernsize * layer->data.conv.kernsize;
+    int npos = layer->width * layer->height;
+    int nplane = lprev->width * lprev->height;
+    /* Row z1 of the effective weights starts at z1 * (Cin * k * k). */
+    int ldw = lprev->depth * kk;
+
+    for (int s = 0; s < n; s++) {
+        const double* in = &self->lprev->outputs[s * lprev->nnodes];
+        double* plane = self->scratch;
+        double* cols = &self->columns[(size_t)s * kk * npos];
+        double* out = &self->outputs[s * layer->nnodes];
+        double* grad = &self->gradients[s * layer->nnodes];
+
+        if (layer->data.conv.winograd != NULL) {
+            Layer_conv_winograd(layer, in, plane, out);
+            for (int i = 0; i < layer->nnodes; i++) {
+                double v = (0 < out[i])? out[i] : 0;
+                out[i] = v;
+                grad[i] = (0 < v)? 1 : 0;
+            }
+            continue;
+        }
+
+        memcpy(plane, in, nplane * sizeof(double));
+        for (int z0 = 1; z0 < lprev->depth; z0++) {
+            for (int p = 0; p < nplane; p++) {
+                plane[p] += in[z0 * nplane + p];
+            }
+        }
+        im2col(layer, plane, cols);
+
+        for (int z1 = 0; z1 < layer->depth; z1++) {
+            for (int p = 0; p < npos; p++) {
+                out[z1 * npos + p] = layer->biases[z1];
+            }
+        }
+        gemm_nn(layer->depth, npos, kk, layer->weights, ldw, cols, npos, out, npos);
+
+        for (int i = 0; i < layer->nnodes; i++) {
+            double v = (0 < out[i])? out[i] : 0;
+            out[i] = v;
+            grad[i] = (0 < v)? 1 : 0;
+        }
+    }
+}
+
+static void LayerBatch_feedBack_conv(LayerBatch* self, int n)
+{
+    Layer* layer = self->layer;
+    Layer* lprev = layer->lprev;
+    int kk = layer->data.conv.kernsize * layer->data.conv.kernsize;
+    int npos = layer->width * layer->height;
+    int nplane = lprev->width * lprev->height;
+    int ldw = lprev->depth * kk;
+
+    for (int i = 0; i < n * layer->nnodes; i++) {
+        self->deltas[i] = self->errors[i] * self->gradients[i];
+    }
+
+    for (int s = 0; s < n; s++) {
+        const double* delta = &self->deltas[s * layer->nnodes];
+        const double* cols = &self->columns[(size_t)s * kk * npos];
+
+        /* dW += dY * cols^T, dB += sum(dY) */
+        gemm_nt(layer->depth, kk, npos, delta, npos, cols, npos, layer->u_weights, ldw);
+        for (int z1 = 0; z1 < layer->depth; z1++) {
+            for (int p = 0; p < npos; p++) {
+                layer->u_biases[z1] += delta[z1 * npos + p];
+            }
+        }
+
+        /* dcols = W^T * dY, then col2im; every input channel gets the same plane. */
+        double* dcols = self->scratch;
+        double* dplane = &self->scratch[kk * npos];
+        memset(dcols, 0, (size_t)kk * npos * sizeof(double));
+        gemm_tn(kk, npos, layer->depth, layer->weights, ldw, delta, npos, dcols, npos);
+        col2im(layer, dcols, dplane);
+        double* errors = &self->lprev->errors[s * lprev->nnodes];
+        for (int z0 = 0; z0 < lprev->depth; z0++) {
+            memcpy(&errors[z0 * nplane], dplane, nplane * sizeof(double));
+        }
+    }
+}
+
+/* LayerBatch_feedForw(self, n)
+   Forward pass of one layer for n samples.
+*/
+void LayerBatch_feedForw(LayerBatch* self, int n)
+{
+    assert (self->lprev != NULL);
+    assert (n <= self->capacity);
+    switch (self->layer->ltype) {
+    case LAYER_FULL:
+        LayerBatch_feedForw_full(self, n);
+        break;
+    case LAYER_CONV:
+        LayerBatch_feedForw_conv(self, n);
+        break;
+    default:
+        break;
+    }
+}
+
+/* LayerBatch_feedBack(self, n)
+   Backward pass of one layer for n samples.
+*/
+void LayerBatch_feedBack(LayerBatch* self, int n)
+{
+    assert (self->lprev != NULL);
+    assert (n <= self->capacity);
+    switch (self->layer->ltype) {
+    case LAYER_FULL:
+        LayerBatch_feedBack_full(self, n);
+        break;
+    case LAYER_CONV:
+        LayerBatch_feedBack_conv(self, n);
+        break;
+    default:
+        break;
+    }
+}
+
+/* LayerBatch_setInputs(self, values, n)
+   Sets n input samples (n x nnodes) and feeds them forward.
+*/
+void LayerBatch_setInputs(LayerBatch* self, const double* values, int n)
+{
+    assert (self != NULL);
+    assert (self->layer->ltype == LAYER_INPUT);
+    assert (n <= self->capacity);
+
+    memcpy(self->outputs, values, (size_t)n * self->layer->nnodes * sizeof(double));
+
+    LayerBatch* batch = self->lnext;
+    while (batch != NULL) {
+        LayerBatch_feedForw(batch, n);
+        batch = batch->lnext;
+    }
+}
+
+/* LayerBatch_getOutputs(self, outputs, n)
+   Gets the outputs of n samples (n x nnodes).
+*/
+void LayerBatch_getOutputs(const LayerBatch* self, double* outputs, int n)
+{
+    assert (self != NULL);
+    memcpy(outputs, self->outputs, (size_t)n * self->layer->nnodes * sizeof(double));
+}
+
+/* LayerBatch_learnOutputs(self, values, n)
+   Learns the n target vectors, accumulating into u_weights/u_biases.
+*/
+void LayerBatch_learnOutputs(LayerBatch* self, const double* values, int n)
+{
+    assert (self != NULL);
+    assert (self->layer->ltype != LAYER_INPUT);
+    assert (n <= self->capacity);
+
+    for (int i = 0; i < n * self->layer->nnodes; i++) {
+        self->errors[i] = (self->outputs[i] - values[i]);
+    }
+
+    /* Start backpropagation. */
+    LayerBatch* batch = self;
+    while (batch != NULL && batch->lprev != NULL) {
+        LayerBatch_feedBack(batch, n);
+        batch = batch->lprev;
+    }
+}
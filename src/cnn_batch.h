@@ -0,0 +1,66 @@
+/*
+  cnn_batch.h
+  Minibatch (GEMM-based) forward and backward passes for cnn.c layers.
+*/
+
+#ifndef _CNN_BATCH_H
+#define _CNN_BATCH_H
+
+#include "cnn.h"
+
+/*  LayerBatch
+    Per-sample state for a whole minibatch. Parameters and the
+    u_weights/u_biases accumulators stay in the wrapped Layer, so
+    Layer_update applies batched gradients unchanged.
+*/
+typedef struct _LayerBatch {
+    Layer* layer;                   /* Wrapped Layer (parameters) */
+    struct _LayerBatch* lprev;      /* Previous LayerBatch */
+    struct _LayerBatch* lnext;      /* Next LayerBatch */
+    int capacity;                   /* Max. samples per batch */
+    double* outputs;                /* capacity x nnodes */
+    double* gradients;              /* capacity x nnodes */
+    double* errors;                 /* capacity x nnodes */
+    double* deltas;                 /* errors * gradients */
+    double* columns;                /* Conv: im2col, capacity x k*k x (w*h) */
+    double* scratch;                /* Conv: summed input / col2im buffers;
+                                       low-rank full: projected inputs */
+} LayerBatch;
+
+/* LayerBatch_create(layer, lprev, capacity)
+   Creates the batch state for layer, linked after lprev.
+   Factorize layers (Layer_factorize) before creating their batch state.
+*/
+LayerBatch* LayerBatch_create(Layer* layer, LayerBatch* lprev, int capacity);
+
+/* LayerBatch_destroy(self)
+   Releases the memory (the wrapped Layer is kept).
+*/
+void LayerBatch_destroy(LayerBatch* self);
+
+/* LayerBatch_setInputs(self, values, n)
+   Sets n input samples (n x nnodes) and feeds them forward.
+*/
+void LayerBatch_setInputs(LayerBatch* self, const double* values, int n);
+
+/* LayerBatch_getOutputs(self, outputs, n)
+   Gets the outputs of n samples (n x nnodes).
+*/
+void LayerBatch_getOutputs(const LayerBatch* self, double* outputs, int n);
+
+/* LayerBatch_learnOutputs(self, values, n)
+   Learns the n target vectors, accumulating into u_weights/u_biases.
+*/
+void LayerBatch_learnOutputs(LayerBatch* self, const double* values, int n);
+
+/* LayerBatch_feedForw(self, n)
+   Forward pass of one layer for n samples.
+*/
+void LayerBatch_feedForw(LayerBatch* self, int n);
+
+/* LayerBatch_feedBack(self, n)
+   Backward pass of one layer for n samples.
+*/
+void LayerBatch_feedBack(LayerBatch* self, int n);
+
+#endif
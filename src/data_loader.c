@@ -0,0 +1,277 @@
+#include "data_loader.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_CLASSES 10
+#define NUM_SLOTS 2
+
+/* Independent random streams drawn from the same (seed, epoch). */
+#define STREAM_PERMUTATION 0
+#define STREAM_SHIFT 1
+
+typedef struct {
+    double* inputs;
+    double* targets;
+    uint8_t* labels;
+    uint32_t first;
+    int count;
+} BatchSlot;
+
+struct DataLoader {
+    const MNISTImages* images;
+    const MNISTLabels* labels;
+    DataLoaderConfig config;
+    size_t image_size;
+
+    /* Owned by the background thread. */
+    uint32_t* permutation;
+    int64_t permutation_epoch;
+    uint8_t* raw;
+
+    BatchSlot slots[NUM_SLOTS];
+    int head;                   /* Next slot the trainer consumes */
+    int filled;                 /* Published slots, including the one held */
+    int holding;                /* Trainer still reads slots[head] */
+
+    uint32_t epoch;
+    uint32_t next_position;     /* First sample of the next batch to prepare */
+    unsigned long generation;   /* Bumped by every data_loader_start_epoch */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+    DataLoaderStats stats;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Counter-based generator: the i-th draw of a stream needs no state. */
+static uint64_t random_draw(uint64_t seed, int stream, uint32_t epoch, uint32_t i) {
+    uint64_t key = ((uint64_t)epoch << 34) | ((uint64_t)stream << 32) | i;
+    return mix64(seed ^ mix64(key + 0x9e3779b97f4a7c15ULL));
+}
+
+static uint32_t random_below(uint64_t r, uint32_t bound) {
+    return (uint32_t)(((r >> 32) * bound) >> 32);
+}
+
+static void build_permutation(DataLoader* loader, uint32_t epoch) {
+    uint32_t n = loader->images->num_images;
+    uint32_t* perm = loader->permutation;
+    for (uint32_t i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    for (uint32_t i = n - 1; i > 0; i--) {
+        uint32_t j = random_below(random_draw(loader->config.seed, STREAM_PERMUTATION, epoch, i), i + 1);
+        uint32_t tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+    loader->permutation_epoch = epoch;
+}
+
+/* Normalizes one image, translated by (dx, dy) with zero fill. */
+static void normalize_shifted(const uint8_t* input, double* output, int rows, int cols, int dx, int dy) {
+    for (int y = 0; y < rows; y++) {
+        int sy = y - dy;
+        for (int x = 0; x < cols; x++) {
+            int sx = x - dx;
+            int inside = sy >= 0 && sy < rows && sx >= 0 && sx < cols;
+            output[y * cols + x] = inside ? input[sy * cols + sx] / 255.0 : 0.0;
+        }
+    }
+}
+
+static void prepare_batch(DataLoader* loader, BatchSlot* slot, uint32_t epoch,
+                          uint32_t first, int count) {
+    const DataLoaderConfig* config = &loader->config;
+    int rows = (int)loader->images->num_rows;
+    int cols = (int)loader->images->num_cols;
+    int span = 2 * config->max_shift + 1;
+
+    memset(slot->targets, 0, (size_t)count * NUM_CLASSES * sizeof(double));
+    for (int s = 0; s < count; s++) {
+        uint32_t position = first + s;
+        uint32_t index = config->shuffle ? loader->permutation[position] : position;
+        double* x = &slot->inputs[(size_t)s * loader->image_size];
+
+        mnist_get_image(loader->images, index, loader->raw);
+        if (config->max_shift > 0) {
+            uint64_t r = random_draw(config->seed, STREAM_SHIFT, epoch, position);
+            int dx = (int)random_below(r, span) - config->max_shift;
+            int dy = (int)random_below(r << 32, span) - config->max_shift;
+            normalize_shifted(loader->raw, x, rows, cols, dx, dy);
+        } else {
+            mnist_normalize_image(loader->raw, x, loader->image_size);
+        }
+        slot->labels[s] = mnist_get_label(loader->labels, index);
+        slot->targets[s * NUM_CLASSES + slot->labels[s]] = 1.0;
+    }
+    slot->first = first;
+    slot->count = count;
+}
+
+static void* loader_thread(void* arg) {
+    DataLoader* loader = (DataLoader*)arg;
+    uint32_t num_images = loader->images->num_images;
+    uint32_t batch_size = (uint32_t)loader->config.batch_size;
+
+    pthread_mutex_lock(&loader->lock);
+    for (;;) {
+        while (!loader->stop &&
+               (loader->next_position >= num_images || loader->filled == NUM_SLOTS)) {
+            pthread_cond_wait(&loader->cond, &loader->lock);
+        }
+        if (loader->stop) break;
+        unsigned long generation = loader->generation;
+        uint32_t epoch = loader->epoch;
+        uint32_t first = loader->next_position;
+        BatchSlot* slot = &loader->slots[(loader->head + loader->filled) % NUM_SLOTS];
+        pthread_mutex_unlock(&loader->lock);
+
+        /* Batches end on multiples of batch_size, like the optimizer steps. */
+        uint32_t end = (first / batch_size + 1) * batch_size;
+        if (end > num_images) end = num_images;
+
+        double t0 = now_seconds();
+        if (loader->config.shuffle && loader->permutation_epoch != (int64_t)epoch) {
+            build_permutation(loader, epoch);
+        }
+        prepare_batch(loader, slot, epoch, first, (int)(end - first));
+        double t1 = now_seconds();
+
+        pthread_mutex_lock(&loader->lock);
+        loader->stats.prepare_time += t1 - t0;
+        /* A batch of an abandoned epoch is dropped. */
+        if (generation == loader->generation) {
+            loader->filled++;
+            loader->next_position = end;
+            loader->stats.batches++;
+            pthread_cond_broadcast(&loader->cond);
+        }
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+DataLoader* data_loader_create(const MNISTImages* images, const MNISTLabels* labels,
+                               const DataLoaderConfig* config) {
+    if (images->num_rows != MNIST_ROWS || images->num_cols != MNIST_COLS) {
+        fprintf(stderr, "Data loader: %ux%u images, but the network takes %dx%d\n",
+                images->num_rows, images->num_cols, MNIST_ROWS, MNIST_COLS);
+        return NULL;
+    }
+    DataLoader* loader = (DataLoader*)calloc(1, sizeof(DataLoader));
+    if (loader == NULL) return NULL;
+    loader->images = images;
+    loader->labels = labels;
+    loader->config = *config;
+    loader->image_size = (size_t)images->num_rows * images->num_cols;
+
+    loader->permutation = (uint32_t*)malloc((images->num_images + 1) * sizeof(uint32_t));
+    loader->permutation_epoch = -1;
+    loader->raw = (uint8_t*)malloc(loader->image_size);
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        BatchSlot* slot = &loader->slots[i];
+        slot->inputs = (double*)malloc((size_t)config->batch_size * loader->image_size * sizeof(double));
+        slot->targets = (double*)malloc((size_t)config->batch_size * NUM_CLASSES * sizeof(double));
+        slot->labels = (uint8_t*)malloc(config->batch_size);
+    }
+    /* Idle until the first epoch starts. */
+    loader->next_position = images->num_images;
+
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->cond, NULL);
+    if (pthread_create(&loader->thread, NULL, loader_thread, loader) != 0) {
+        fprintf(stderr, "Failed to start data loader thread\n");
+        loader->stop = 1;
+        data_loader_destroy(loader, NULL);
+        return NULL;
+    }
+    return loader;
+}
+
+void data_loader_start_epoch(DataLoader* loader, uint32_t epoch, uint32_t start) {
+    pthread_mutex_lock(&loader->lock);
+    loader->epoch = epoch;
+    loader->next_position = start;
+    loader->head = 0;
+    loader->filled = 0;
+    loader->holding = 0;
+    loader->generation++;
+    pthread_cond_broadcast(&loader->cond);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+int data_loader_next(DataLoader* loader, DataBatch* batch) {
+    pthread_mutex_lock(&loader->lock);
+    if (loader->holding) {
+        loader->head = (loader->head + 1) % NUM_SLOTS;
+        loader->filled--;
+        loader->holding = 0;
+        pthread_cond_broadcast(&loader->cond);
+    }
+
+    double t0 = now_seconds();
+    while (loader->filled == 0 && loader->next_position < loader->images->num_images) {
+        pthread_cond_wait(&loader->cond, &loader->lock);
+    }
+    loader->stats.stall_time += now_seconds() - t0;
+
+    int available = loader->filled > 0;
+    if (available) {
+        const BatchSlot* slot = &loader->slots[loader->head];
+        batch->inputs = slot->inputs;
+        batch->image_size = (int)loader->image_size;
+        batch->targets = slot->targets;
+        batch->labels = slot->labels;
+        batch->first = slot->first;
+        batch->count = slot->count;
+        loader->holding = 1;
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return available;
+}
+
+void data_loader_destroy(DataLoader* loader, DataLoaderStats* stats) {
+    if (loader == NULL) return;
+    pthread_mutex_lock(&loader->lock);
+    int started = !loader->stop;
+    loader->stop = 1;
+    pthread_cond_broadcast(&loader->cond);
+    pthread_mutex_unlock(&loader->lock);
+    if (started) {
+        pthread_join(loader->thread, NULL);
+    }
+    if (stats != NULL) {
+        *stats = loader->stats;
+    }
+
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->cond);
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        free(loader->slots[i].inputs);
+        free(loader->slots[i].targets);
+        free(loader->slots[i].labels);
+    }
+    free(loader->permutation);
+    free(loader->raw);
+    free(loader);
+}
@@ -0,0 +1,50 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include <stdint.h>
+#include "mnist_loader.h"
+
+typedef struct {
+    int batch_size;
+    int shuffle;                /* Per-epoch permutation instead of file order */
+    int max_shift;              /* Random shift of up to +-max_shift pixels (0: off) */
+    uint64_t seed;
+} DataLoaderConfig;
+
+/* One prepared minibatch: normalized inputs (count x image_size) and
+   one-hot targets (count x 10). Valid until the next data_loader_next. */
+typedef struct {
+    const double* inputs;
+    int image_size;             /* rows*cols: stride between samples in inputs */
+    const double* targets;
+    const uint8_t* labels;
+    uint32_t first;             /* Epoch position of the first sample */
+    int count;
+} DataBatch;
+
+typedef struct {
+    int batches;
+    double prepare_time;        /* Background thread: permutation, copy, normalize */
+    double stall_time;          /* Trainer: waiting for a batch that was not ready */
+} DataLoaderStats;
+
+typedef struct DataLoader DataLoader;
+
+/* A background thread prepares the next minibatch into a double buffer
+   while the trainer consumes the current one. Every random draw is a pure
+   function of (seed, epoch, position), so an epoch can be restarted at any
+   sample with the same order and augmentation. Returns NULL unless the
+   images are MNIST_ROWS x MNIST_COLS, the network's input size. */
+DataLoader* data_loader_create(const MNISTImages* images, const MNISTLabels* labels,
+                               const DataLoaderConfig* config);
+
+/* Begins an epoch at the given position. Batches stay aligned to
+   multiples of batch_size, so the first one may be short. */
+void data_loader_start_epoch(DataLoader* loader, uint32_t epoch, uint32_t start);
+
+/* Returns 1 with the next batch, or 0 at the end of the epoch. */
+int data_loader_next(DataLoader* loader, DataBatch* batch);
+
+void data_loader_destroy(DataLoader* loader, DataLoaderStats* stats);
+
+#endif
@@ -0,0 +1,70 @@
+#include "early_exit.h"
+#include "model_io.h"
+
+void exit_head_create(ExitHead* head, const Layer* tap, double std) {
+    head->layers[0] = Layer_create_input(tap->depth, tap->width, tap->height);
+    head->layers[1] = Layer_create_full(head->layers[0], EXIT_NUM_CLASSES, std);
+}
+
+void exit_head_destroy(ExitHead* head) {
+    for (int l = EXIT_HEAD_LAYERS - 1; l >= 0; l--) {
+        Layer_destroy(head->layers[l]);
+        head->layers[l] = NULL;
+    }
+}
+
+int exit_head_save(const char* path, ExitHead* head) {
+    return model_save(path, head->layers, EXIT_HEAD_LAYERS);
+}
+
+int exit_head_load(const char* path, ExitHead* head) {
+    return model_load(path, head->layers, EXIT_HEAD_LAYERS);
+}
+
+static void layer_forward(Layer* layer, const double* input) {
+    if (layer->ltype == LAYER_CONV) {
+        Layer_feedForw_conv_withInput(layer, (double*)input);
+    } else {
+        Layer_feedForw_full_withInput(layer, (double*)input);
+    }
+}
+
+void network_forward_until(Layer** layers, int last, const double* input) {
+    const double* x = input;
+    for (int l = 1; l <= last; l++) {
+        layer_forward(layers[l], x);
+        x = layers[l]->outputs;
+    }
+}
+
+void network_forward_from(Layer** layers, int first, int num_layers) {
+    for (int l = first; l < num_layers; l++) {
+        layer_forward(layers[l], layers[l - 1]->outputs);
+    }
+}
+
+double exit_head_forward(ExitHead* head, const double* features, int* predicted, double* probabilities) {
+    Layer* output = head->layers[EXIT_HEAD_LAYERS - 1];
+    /* Only the output layer computes; the input layer just holds features. */
+    layer_forward(output, features);
+
+    const double* y = output->outputs;
+    int best = 0;
+    for (int j = 1; j < EXIT_NUM_CLASSES; j++) {
+        if (y[j] > y[best]) best = j;
+    }
+    if (probabilities != NULL) {
+        for (int j = 0; j < EXIT_NUM_CLASSES; j++) probabilities[j] = y[j];
+    }
+    *predicted = best;
+    return y[best];
+}
+
+void exit_head_learn(ExitHead* head, const double* features, const double* target) {
+    Layer_setInputs(head->layers[0], features);
+    Layer_learnOutputs(head->layers[EXIT_HEAD_LAYERS - 1], target);
+}
+
+void exit_head_update(ExitHead* head, double rate) {
+    Layer_update(head->layers[EXIT_HEAD_LAYERS - 1], rate);
+}
@@ -0,0 +1,49 @@
+#ifndef EARLY_EXIT_H
+#define EARLY_EXIT_H
+
+#include "cnn.h"
+
+/* Early-exit cascade.
+
+   The exit head is a softmax classifier on the Conv2 feature map
+   (layers[EXIT_TAP], 32x7x7). Inference runs the trunk up to Conv2, then
+   the head; if the head's top probability reaches the threshold, FC1, FC2
+   and the output layer are skipped. Conv2 rather than FC1 is the tap
+   because FC1 holds over half of the network's multiply-adds: a head after
+   FC1 would only save FC2 and the output layer.
+
+   The head is a separate two-layer chain (an input layer shaped like the
+   tap plus a 10-node full layer) so the main network's layer list stays
+   untouched, and it is saved with model_save like any other network. */
+
+#define EXIT_TAP 2                  /* Index of Conv2 in the 6-layer network */
+#define EXIT_HEAD_LAYERS 2
+#define EXIT_NUM_CLASSES 10
+
+typedef struct {
+    Layer* layers[EXIT_HEAD_LAYERS];
+} ExitHead;
+
+void exit_head_create(ExitHead* head, const Layer* tap, double std);
+void exit_head_destroy(ExitHead* head);
+int exit_head_save(const char* path, ExitHead* head);
+int exit_head_load(const char* path, ExitHead* head);
+
+/* Feeds input through layers[1..last] only; layers[last]->outputs then
+   holds that layer's activations. */
+void network_forward_until(Layer** layers, int last, const double* input);
+
+/* Finishes a pass started by network_forward_until(layers, first - 1, ...)
+   through layers[first..num_layers-1]. */
+void network_forward_from(Layer** layers, int first, int num_layers);
+
+/* Runs the head on the tap's activations; returns the top probability and
+   stores its class in predicted. probabilities may be NULL. */
+double exit_head_forward(ExitHead* head, const double* features, int* predicted, double* probabilities);
+
+/* Forward plus backward pass for one sample; accumulates the updates
+   applied by exit_head_update. */
+void exit_head_learn(ExitHead* head, const double* features, const double* target);
+void exit_head_update(ExitHead* head, double rate);
+
+#endif
@@ -0,0 +1,244 @@
+#include "cnn.h"
+#include "lowrank.h"
+#include "mnist_loader.h"
+#include "model_io.h"
+#include "performance_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_SIZE 784
+#define NUM_LAYERS MODEL_NUM_LAYERS
+#define FC1 3
+#define DEFAULT_ENERGY 0.95
+
+/* Offline low-rank transform: FC1 (nnodes x inputs) becomes the product of
+   two thin factors from its truncated SVD, chosen by a fixed rank, an
+   energy target, or the smallest rank within an accuracy budget. The
+   result is saved as a version-2 model with a low-rank FC1, which every
+   binary taking --model loads; train_cnn --finetune can then recover
+   accuracy with the factors held fixed. */
+
+typedef struct {
+    const char* images_path;
+    const char* labels_path;
+    const char* model_path;
+    const char* output_path;
+    int rank;                   /* 0: choose */
+    double energy;
+    double max_drop;            /* Accuracy points; < 0: use the energy target */
+    unsigned long limit;
+} FactorizeOptions;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --model <file>      Model to factorize (default ./models/cnn_model.bin)\n");
+    fprintf(stderr, "  --output <file>     Factorized model (default ./models/cnn_lowrank.bin)\n");
+    fprintf(stderr, "  --rank <r>          Use rank r\n");
+    fprintf(stderr, "  --energy <e>        Smallest rank keeping fraction e of sum(sigma^2) (default %.2f)\n",
+            DEFAULT_ENERGY);
+    fprintf(stderr, "  --max-drop <pts>    Smallest rank within pts accuracy points of the dense model\n");
+    fprintf(stderr, "  --limit <n>         Use only the first n test images\n");
+}
+
+static int parse_args(int argc, char* argv[], FactorizeOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->model_path = "./models/cnn_model.bin";
+    opts->output_path = "./models/cnn_lowrank.bin";
+    opts->energy = DEFAULT_ENERGY;
+    opts->max_drop = -1.0;
+    if (argc < 3) return -1;
+    opts->images_path = argv[1];
+    opts->labels_path = argv[2];
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return -1;
+        } else if (strcmp(argv[i], "--model") == 0) {
+            opts->model_path = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0) {
+            opts->output_path = argv[++i];
+        } else if (strcmp(argv[i], "--rank") == 0) {
+            opts->rank = atoi(argv[++i]);
+            if (opts->rank < 1) return -1;
+        } else if (strcmp(argv[i], "--energy") == 0) {
+            opts->energy = atof(argv[++i]);
+            if (opts->energy <= 0.0 || opts->energy > 1.0) return -1;
+        } else if (strcmp(argv[i], "--max-drop") == 0) {
+            opts->max_drop = atof(argv[++i]);
+            if (opts->max_drop < 0.0) return -1;
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            long limit = atol(argv[++i]);
+            if (limit < 1) return -1;
+            opts->limit = (unsigned long)limit;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    double accuracy;
+    double images_per_sec;
+} Evaluation;
+
+static Evaluation evaluate(Layer** layers, const MNISTImages* images, const MNISTLabels* labels) {
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    int correct = 0;
+
+    double start = get_current_time_sec();
+    for (uint32_t i = 0; i < images->num_images; i++) {
+        mnist_get_image(images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+        Layer_setInputs(layers[0], img_norm);
+
+        const double* y = layers[NUM_LAYERS - 1]->outputs;
+        int best = 0;
+        for (int j = 1; j < MODEL_NUM_CLASSES; j++) {
+            if (y[j] > y[best]) best = j;
+        }
+        if (best == mnist_get_label(labels, i)) correct++;
+    }
+    double elapsed = get_current_time_sec() - start;
+
+    Evaluation e;
+    e.accuracy = (correct * 100.0) / images->num_images;
+    e.images_per_sec = elapsed > 0.0 ? images->num_images / elapsed : 0.0;
+    return e;
+}
+
+static void print_row(const char* label, const LowRank* lr, int rank, const Evaluation* e) {
+    long dense = (long)lr->nrows * lr->ncols;
+    long kept = rank > 0 ? (long)rank * (lr->nrows + lr->ncols) : dense;
+    printf("  %-8s %8.4f %12ld %10.1f %9.2fx %9.2f%% %10.0f\n", label,
+           rank > 0 ? lowrank_energy(lr, rank) : 1.0, kept, kept * sizeof(double) / 1024.0,
+           (double)dense / kept, e->accuracy, e->images_per_sec);
+}
+
+/* Smallest rank within max_drop points of the dense accuracy, by
+   bisection (accuracy is close to monotone in the rank); 0 if no rank
+   below break-even is. */
+static int rank_for_accuracy(LowRank* lr, Layer** layers, const MNISTImages* images,
+                             const MNISTLabels* labels, double floor) {
+    int max_rank = lowrank_break_even_rank(lr);
+    int lo = 1, hi = max_rank + 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        lowrank_apply(lr, mid);
+        Evaluation e = evaluate(layers, images, labels);
+        char label[16];
+        snprintf(label, sizeof(label), "r=%d", mid);
+        print_row(label, lr, mid, &e);
+        if (e.accuracy >= floor) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo <= max_rank ? lo : 0;
+}
+
+int main(int argc, char* argv[]) {
+    FactorizeOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("=================================================\n");
+    printf("   LOW-RANK FC1 FACTORIZATION (Truncated SVD)    \n");
+    printf("=================================================\n\n");
+
+    printf("[1/4] Loading model...\n");
+    Layer* layers[NUM_LAYERS];
+    ModelTopology topology;
+    if (model_open_network(opts.model_path, layers, &topology) != 0) {
+        fprintf(stderr, "Failed to load model. Have you trained the model?\n");
+        return 1;
+    }
+    char network[192];
+    model_topology_describe(&topology, network, sizeof(network));
+    printf("    ✓ %s: %s\n\n", opts.model_path, network);
+
+    printf("[2/4] Loading MNIST test dataset...\n");
+    MNISTImages test_images;
+    MNISTLabels test_labels;
+    if (mnist_read_header(opts.images_path, opts.labels_path, &test_images) != 0) {
+        fprintf(stderr, "Failed to load test dataset\n");
+        return 1;
+    }
+    uint32_t num_images = test_images.num_images;
+    if (opts.limit > 0 && opts.limit < num_images) {
+        num_images = (uint32_t)opts.limit;
+    }
+    if (mnist_load_images_range(opts.images_path, 0, num_images, &test_images) != 0) {
+        fprintf(stderr, "Failed to load test images\n");
+        return 1;
+    }
+    if (mnist_load_labels_range(opts.labels_path, 0, num_images, &test_labels) != 0) {
+        fprintf(stderr, "Failed to load test labels\n");
+        mnist_free_images(&test_images);
+        return 1;
+    }
+    printf("    ✓ Loaded %u test images\n\n", num_images);
+
+    printf("[3/4] SVD of FC1 (%d x %d)...\n", layers[FC1]->nnodes, layers[FC1]->nweights / layers[FC1]->nnodes);
+    Layer_densify(layers[FC1]);
+    double start = get_current_time_sec();
+    LowRank* lr = lowrank_create(layers[FC1]);
+    if (lr == NULL) {
+        fprintf(stderr, "FC1 cannot be factorized\n");
+        return 1;
+    }
+    printf("    ✓ %.2f s, sigma[0] = %.4f, sigma[%d] = %.4f\n\n", get_current_time_sec() - start,
+           lr->sigma[0], lr->nrows - 1, lr->sigma[lr->nrows - 1]);
+
+    printf("[4/4] Choosing the rank...\n\n");
+    printf("  %-8s %8s %12s %10s %10s %10s %10s\n", "FC1", "Energy", "MACs", "KiB", "Saving", "Accuracy",
+           "Images/s");
+    Evaluation dense = evaluate(layers, &test_images, &test_labels);
+    print_row("dense", lr, 0, &dense);
+
+    /* Past break-even the factors cost more than FC1 itself: keep it dense. */
+    int break_even = lowrank_break_even_rank(lr);
+    int rank = opts.rank;
+    if (rank > break_even) {
+        printf("\n  Rank %d is not below the break-even rank %d\n", rank, break_even);
+        rank = 0;
+    } else if (rank == 0 && opts.max_drop >= 0.0) {
+        rank = rank_for_accuracy(lr, layers, &test_images, &test_labels, dense.accuracy - opts.max_drop);
+        if (rank == 0) {
+            printf("\n  No rank up to %d is within %.2f points of dense\n", break_even, opts.max_drop);
+        }
+    } else if (rank == 0) {
+        rank = lowrank_rank_for_energy(lr, opts.energy);
+        if (rank == 0) {
+            printf("\n  No rank up to %d keeps %.4f of the energy\n", break_even, opts.energy);
+        }
+    }
+
+    int rc;
+    if (rank == 0) {
+        lowrank_restore(lr);
+        rc = model_save(opts.output_path, layers, NUM_LAYERS);
+        if (rc == 0) printf("  ✓ FC1 kept dense; model saved to: %s\n", opts.output_path);
+    } else if ((rc = lowrank_apply(lr, rank)) == 0) {
+        Evaluation e = evaluate(layers, &test_images, &test_labels);
+        char label[16];
+        snprintf(label, sizeof(label), "r=%d", rank);
+        print_row(label, lr, rank, &e);
+        printf("\n  Accuracy change: %+.2f points (fine-tune with train_cnn --finetune %s)\n",
+               e.accuracy - dense.accuracy, opts.output_path);
+        rc = model_save(opts.output_path, layers, NUM_LAYERS);
+        if (rc == 0) printf("  ✓ Rank-%d model saved to: %s\n", rank, opts.output_path);
+    } else {
+        fprintf(stderr, "Failed to factorize FC1 at rank %d\n", rank);
+    }
+
+    lowrank_destroy(lr);
+    mnist_free_images(&test_images);
+    mnist_free_labels(&test_labels);
+    model_destroy_network(layers);
+    return rc != 0;
+}
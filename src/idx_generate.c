@@ -0,0 +1,377 @@
+/*
+  idx_generate.c
+  Writes large IDX3/IDX1 datasets for load testing.
+
+  Images are produced by replicating an existing MNIST set, by replicating
+  it with random shifts and pixel noise, or by random generation. Each
+  image is derived from its index and the seed only, so the output is
+  identical for any thread count. Worker threads fill fixed-size chunks
+  and write them at their final offsets, so memory use does not grow with
+  the image count.
+
+  Usage:
+  $ ./idx_generate --count N --out-images <idx3> --out-labels <idx1>
+                   [--mode replicate|perturb|random]
+                   [--source-images <idx3> --source-labels <idx1>]
+                   [--rows R --cols C] [--seed S] [--threads T]
+                   [--max-shift S] [--noise A]
+*/
+
+#include "mnist_loader.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <libkern/OSByteOrder.h>
+#define htobe32(x) OSSwapHostToBigInt32(x)
+#else
+#include <endian.h>
+#endif
+
+#define CHUNK_IMAGES 4096
+#define IMAGES_HEADER_SIZE 16
+#define LABELS_HEADER_SIZE 8
+#define MAX_THREADS 256
+
+typedef enum {
+    MODE_REPLICATE,
+    MODE_PERTURB,
+    MODE_RANDOM
+} GenerateMode;
+
+typedef struct {
+    unsigned long count;
+    GenerateMode mode;
+    uint32_t rows;
+    uint32_t cols;
+    uint64_t seed;
+    int threads;
+    int max_shift;
+    int noise;
+    const char* source_images;
+    const char* source_labels;
+    const char* out_images;
+    const char* out_labels;
+} GenerateOptions;
+
+/* Shared, read-only state for the worker threads. */
+typedef struct {
+    const GenerateOptions* opts;
+    const uint8_t* source;        /* source images resized to rows x cols */
+    const uint8_t* source_labels;
+    uint32_t num_source;
+    size_t image_size;
+    uint32_t num_chunks;
+    int fd_images;
+    int fd_labels;
+} GenerateContext;
+
+typedef struct {
+    const GenerateContext* ctx;
+    int thread_id;
+    int rc;
+} Worker;
+
+/* splitmix64: seeded per image so output does not depend on scheduling. */
+static uint64_t rng_next(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int pwrite_all(int fd, const void* buf, size_t len, off_t offset) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int write_be32_at(int fd, uint32_t value, off_t offset) {
+    uint32_t be = htobe32(value);
+    return pwrite_all(fd, &be, sizeof(uint32_t), offset);
+}
+
+/* Nearest-neighbour resize of every source image to rows x cols. */
+static uint8_t* resize_source(const MNISTImages* images, uint32_t rows, uint32_t cols) {
+    size_t out_size = (size_t)rows * cols;
+    uint8_t* out = (uint8_t*)malloc((size_t)images->num_images * out_size);
+    if (out == NULL) return NULL;
+    for (uint32_t n = 0; n < images->num_images; n++) {
+        const uint8_t* src = &images->data[(size_t)n * images->num_rows * images->num_cols];
+        uint8_t* dst = &out[(size_t)n * out_size];
+        for (uint32_t y = 0; y < rows; y++) {
+            uint32_t sy = (uint32_t)((uint64_t)y * images->num_rows / rows);
+            for (uint32_t x = 0; x < cols; x++) {
+                uint32_t sx = (uint32_t)((uint64_t)x * images->num_cols / cols);
+                dst[y * cols + x] = src[sy * images->num_cols + sx];
+            }
+        }
+    }
+    return out;
+}
+
+static void generate_image(const GenerateContext* ctx, uint64_t index,
+                           uint8_t* image, uint8_t* label) {
+    const GenerateOptions* opts = ctx->opts;
+    uint64_t state = opts->seed ^ (index * 0xD1B54A32D192ED03ULL);
+
+    if (opts->mode == MODE_RANDOM) {
+        /* Sparse strokes-like images: ~20% of pixels lit, as in MNIST. */
+        *label = (uint8_t)(rng_next(&state) % 10);
+        for (size_t i = 0; i < ctx->image_size; i += 4) {
+            uint64_t r = rng_next(&state);
+            for (size_t k = 0; k < 4 && i + k < ctx->image_size; k++) {
+                uint16_t bits = (uint16_t)(r >> (16 * k));
+                image[i + k] = ((bits & 0xff) < 51) ? (uint8_t)(bits >> 8) : 0;
+            }
+        }
+        return;
+    }
+
+    uint32_t src = (uint32_t)(index % ctx->num_source);
+    const uint8_t* source = &ctx->source[(size_t)src * ctx->image_size];
+    *label = ctx->source_labels[src];
+
+    if (opts->mode == MODE_REPLICATE) {
+        memcpy(image, source, ctx->image_size);
+        return;
+    }
+
+    int span = 2 * opts->max_shift + 1;
+    int dx = (int)(rng_next(&state) % (uint64_t)span) - opts->max_shift;
+    int dy = (int)(rng_next(&state) % (uint64_t)span) - opts->max_shift;
+    int rows = (int)opts->rows;
+    int cols = (int)opts->cols;
+    for (int y = 0; y < rows; y++) {
+        int sy = y - dy;
+        for (int x = 0; x < cols; x++) {
+            int sx = x - dx;
+            int v = (sy >= 0 && sy < rows && sx >= 0 && sx < cols) ? source[sy * cols + sx] : 0;
+            if (opts->noise > 0) {
+                v += (int)(rng_next(&state) % (uint64_t)(2 * opts->noise + 1)) - opts->noise;
+                v = v < 0 ? 0 : (v > 255 ? 255 : v);
+            }
+            image[y * cols + x] = (uint8_t)v;
+        }
+    }
+}
+
+/* Thread t handles chunks t, t+T, t+2T, ... and writes each in place. */
+static void* generate_worker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    const GenerateContext* ctx = worker->ctx;
+    uint8_t* chunk = (uint8_t*)malloc(CHUNK_IMAGES * ctx->image_size);
+    uint8_t* chunk_labels = (uint8_t*)malloc(CHUNK_IMAGES);
+    worker->rc = (chunk == NULL || chunk_labels == NULL) ? -1 : 0;
+
+    for (uint32_t c = (uint32_t)worker->thread_id;
+         c < ctx->num_chunks && worker->rc == 0; c += (uint32_t)ctx->opts->threads) {
+        uint64_t base = (uint64_t)c * CHUNK_IMAGES;
+        uint32_t n = (ctx->opts->count - base < CHUNK_IMAGES) ?
+                     (uint32_t)(ctx->opts->count - base) : CHUNK_IMAGES;
+        for (uint32_t k = 0; k < n; k++) {
+            generate_image(ctx, base + k, &chunk[k * ctx->image_size], &chunk_labels[k]);
+        }
+        if (pwrite_all(ctx->fd_images, chunk, n * ctx->image_size,
+                       (off_t)(IMAGES_HEADER_SIZE + base * ctx->image_size)) != 0 ||
+            pwrite_all(ctx->fd_labels, chunk_labels, n,
+                       (off_t)(LABELS_HEADER_SIZE + base)) != 0) {
+            worker->rc = -1;
+        }
+    }
+
+    free(chunk);
+    free(chunk_labels);
+    return NULL;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s --count N --out-images <idx3> --out-labels <idx1> [options]\n", program);
+    fprintf(stderr, "  --mode <m>              replicate (default), perturb or random\n");
+    fprintf(stderr, "  --source-images <idx3>  Source images (replicate/perturb)\n");
+    fprintf(stderr, "  --source-labels <idx1>  Source labels (replicate/perturb)\n");
+    fprintf(stderr, "  --rows R --cols C       Output image size (default: source size, 28x28);\n");
+    fprintf(stderr, "                          the CNN binaries only load 28x28 files\n");
+    fprintf(stderr, "  --seed S                Random seed (default 1)\n");
+    fprintf(stderr, "  --threads T             Writer threads (default 1)\n");
+    fprintf(stderr, "  --max-shift S           perturb: max shift in pixels (default 2)\n");
+    fprintf(stderr, "  --noise A               perturb: max +/- pixel noise (default 16)\n");
+}
+
+static int parse_args(int argc, char* argv[], GenerateOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->mode = MODE_REPLICATE;
+    opts->seed = 1;
+    opts->threads = 1;
+    opts->max_shift = 2;
+    opts->noise = 16;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return -1;
+        if (strcmp(argv[i], "--count") == 0) {
+            opts->count = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mode") == 0) {
+            i++;
+            if (strcmp(argv[i], "replicate") == 0) opts->mode = MODE_REPLICATE;
+            else if (strcmp(argv[i], "perturb") == 0) opts->mode = MODE_PERTURB;
+            else if (strcmp(argv[i], "random") == 0) opts->mode = MODE_RANDOM;
+            else return -1;
+        } else if (strcmp(argv[i], "--rows") == 0) {
+            opts->rows = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cols") == 0) {
+            opts->cols = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            opts->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            opts->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-shift") == 0) {
+            opts->max_shift = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--noise") == 0) {
+            opts->noise = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--source-images") == 0) {
+            opts->source_images = argv[++i];
+        } else if (strcmp(argv[i], "--source-labels") == 0) {
+            opts->source_labels = argv[++i];
+        } else if (strcmp(argv[i], "--out-images") == 0) {
+            opts->out_images = argv[++i];
+        } else if (strcmp(argv[i], "--out-labels") == 0) {
+            opts->out_labels = argv[++i];
+        } else {
+            return -1;
+        }
+    }
+    if (opts->count == 0 || opts->count > UINT32_MAX ||
+        opts->out_images == NULL || opts->out_labels == NULL) {
+        return -1;
+    }
+    if (opts->mode != MODE_RANDOM && (opts->source_images == NULL || opts->source_labels == NULL)) {
+        return -1;
+    }
+    if (opts->threads < 1 || opts->threads > MAX_THREADS || opts->max_shift < 0 ||
+        opts->noise < 0 || opts->noise > 255) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    GenerateOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    GenerateContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opts = &opts;
+
+    MNISTImages source_images = {0};
+    MNISTLabels source_labels = {0};
+    uint8_t* resized = NULL;
+    if (opts.mode != MODE_RANDOM) {
+        if (mnist_load_images(opts.source_images, &source_images) != 0) {
+            return 1;
+        }
+        if (mnist_load_labels(opts.source_labels, &source_labels) != 0) {
+            mnist_free_images(&source_images);
+            return 1;
+        }
+        if (source_labels.num_labels != source_images.num_images) {
+            fprintf(stderr, "Source image/label counts differ (%u vs %u)\n",
+                    source_images.num_images, source_labels.num_labels);
+            mnist_free_images(&source_images);
+            mnist_free_labels(&source_labels);
+            return 1;
+        }
+        if (opts.rows == 0) opts.rows = source_images.num_rows;
+        if (opts.cols == 0) opts.cols = source_images.num_cols;
+        if (opts.rows == source_images.num_rows && opts.cols == source_images.num_cols) {
+            ctx.source = source_images.data;
+        } else {
+            resized = resize_source(&source_images, opts.rows, opts.cols);
+            if (resized == NULL) {
+                fprintf(stderr, "Failed to allocate resized source images\n");
+                mnist_free_images(&source_images);
+                mnist_free_labels(&source_labels);
+                return 1;
+            }
+            ctx.source = resized;
+        }
+        ctx.source_labels = source_labels.labels;
+        ctx.num_source = source_images.num_images;
+    } else {
+        if (opts.rows == 0) opts.rows = MNIST_ROWS;
+        if (opts.cols == 0) opts.cols = MNIST_COLS;
+    }
+
+    ctx.image_size = (size_t)opts.rows * opts.cols;
+    ctx.num_chunks = (uint32_t)((opts.count + CHUNK_IMAGES - 1) / CHUNK_IMAGES);
+    ctx.fd_images = open(opts.out_images, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ctx.fd_labels = open(opts.out_labels, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ctx.fd_images < 0 || ctx.fd_labels < 0) {
+        fprintf(stderr, "Failed to open output files\n");
+        return 1;
+    }
+
+    uint32_t count = (uint32_t)opts.count;
+    int rc = 0;
+    rc |= write_be32_at(ctx.fd_images, 0x00000803, 0);
+    rc |= write_be32_at(ctx.fd_images, count, 4);
+    rc |= write_be32_at(ctx.fd_images, opts.rows, 8);
+    rc |= write_be32_at(ctx.fd_images, opts.cols, 12);
+    rc |= write_be32_at(ctx.fd_labels, 0x00000801, 0);
+    rc |= write_be32_at(ctx.fd_labels, count, 4);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < opts.threads && rc == 0; t++) {
+        workers[t].ctx = &ctx;
+        workers[t].thread_id = t;
+        workers[t].rc = 0;
+        if (pthread_create(&threads[t], NULL, generate_worker, &workers[t]) != 0) {
+            rc = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        rc |= workers[t].rc;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (close(ctx.fd_images) != 0) rc = -1;
+    if (close(ctx.fd_labels) != 0) rc = -1;
+    free(resized);
+    if (opts.mode != MODE_RANDOM) {
+        mnist_free_images(&source_images);
+        mnist_free_labels(&source_labels);
+    }
+
+    if (rc != 0) {
+        fprintf(stderr, "Failed to write dataset\n");
+        return 1;
+    }
+    double megabytes = (IMAGES_HEADER_SIZE + (double)count * ctx.image_size) / (1024.0 * 1024.0);
+    printf("✓ Wrote %u images (%ux%u) to %s and %s\n", count,
+           opts.rows, opts.cols, opts.out_images, opts.out_labels);
+    printf("  %.1f MB in %.2f s (%.1f MB/s, %d thread(s))\n", megabytes, elapsed,
+           elapsed > 0 ? megabytes / elapsed : 0.0, opts.threads);
+    return 0;
+}
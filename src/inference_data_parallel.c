@@ -1,7 +1,10 @@
 #include "cnn.h"
+#include "cli_options.h"
 #include "mnist_loader.h"
 #include "model_io.h"
 #include "performance_metrics.h"
+#include "prediction_cache.h"
+#include "prediction_sink_mpi.h"
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,9 +18,11 @@ int main(int argc, char *argv[]) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
-    if (argc != 3) {
+    InferenceOptions options = {0};
+    if (inference_options_parse(argc, argv, &options) != 0 ||
+        options.images_path == NULL || options.labels_path == NULL) {
         if (rank == 0) {
-            fprintf(stderr, "Usage: %s <test-images> <test-labels>\n", argv[0]);
+            inference_options_usage(argv[0]);
         }
         MPI_Finalize();
         return 1;
@@ -30,55 +35,56 @@ int main(int argc, char *argv[]) {
     double start_total = MPI_Wtime();
     
     double model_load_start = MPI_Wtime();
-    Layer *linput = Layer_create_input(1, 28, 28);
-    Layer *lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
-    Layer *lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
-    Layer *lfull1 = Layer_create_full(lconv2, 200, 0.1);
-    Layer *lfull2 = Layer_create_full(lfull1, 200, 0.1);
-    Layer *loutput = Layer_create_full(lfull2, 10, 0.1);
-    
-    Layer *layers[] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
-    
-    if (model_load("./models/cnn_model.bin", layers, 6) != 0) {
+    Layer *layers[MODEL_NUM_LAYERS];
+    if (model_open_network(options.model_path, layers, NULL) != 0) {
         if (rank == 0) {
             fprintf(stderr, "Failed to load model\n");
         }
         MPI_Finalize();
         return 1;
     }
+    Layer *linput = layers[0];
+    Layer *loutput = layers[MODEL_NUM_LAYERS - 1];
     double model_load_end = MPI_Wtime();
     metrics.load_model_time = model_load_end - model_load_start;
     
     double data_load_start = MPI_Wtime();
-    MNISTImages test_images;
-    MNISTLabels test_labels;
-    
-    if (mnist_load_images(argv[1], &test_images) != 0) {
-        if (rank == 0) {
-            fprintf(stderr, "Failed to load test images\n");
-        }
-        MPI_Finalize();
-        return 1;
-    }
+    MNISTImages test_images = {0};
+    MNISTLabels test_labels = {0};
     
-    if (mnist_load_labels(argv[2], &test_labels) != 0) {
+    if (mnist_read_header(options.images_path, options.labels_path, &test_images) != 0) {
         if (rank == 0) {
-            fprintf(stderr, "Failed to load test labels\n");
+            fprintf(stderr, "Failed to load test dataset\n");
         }
-        mnist_free_images(&test_images);
         MPI_Finalize();
         return 1;
     }
-    double data_load_end = MPI_Wtime();
-    metrics.load_data_time = data_load_end - data_load_start;
     
     uint32_t total_images = test_images.num_images;
+    if (options.limit > 0 && options.limit < total_images) {
+        total_images = (uint32_t)options.limit;
+    }
     uint32_t images_per_process = total_images / size;
     uint32_t remainder = total_images % size;
     
     uint32_t start_idx = rank * images_per_process + ((uint32_t)rank < remainder ? (uint32_t)rank : remainder);
     uint32_t end_idx = start_idx + images_per_process + ((uint32_t)rank < remainder ? 1 : 0);
     
+    /* Each process reads only its own shard of the dataset. */
+    if (end_idx > start_idx) {
+        if (mnist_load_images_range(options.images_path, start_idx, end_idx - start_idx, &test_images) != 0) {
+            fprintf(stderr, "Rank %d: failed to load test images\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        
+        if (mnist_load_labels_range(options.labels_path, start_idx, end_idx - start_idx, &test_labels) != 0) {
+            fprintf(stderr, "Rank %d: failed to load test labels\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    double data_load_end = MPI_Wtime();
+    metrics.load_data_time = data_load_end - data_load_start;
+    
     double inference_start = MPI_Wtime();
     
     uint8_t img_raw[IMAGE_SIZE];
@@ -88,30 +94,59 @@ int main(int argc, char *argv[]) {
     
     double local_min_latency = 1e9;
     double local_max_latency = 0.0;
+    int local_count = (int)(end_idx - start_idx);
+    double* local_latencies = (double*)malloc((local_count > 0 ? local_count : 1) * sizeof(double));
+    PredictionBuffer predictions;
+    prediction_buffer_init(&predictions);
+    /* One cache per rank: ranks share no memory. */
+    PredictionCache* cache = NULL;
+    if (options.cache_entries > 0) {
+        cache = prediction_cache_create(options.cache_entries);
+        if (cache == NULL) {
+            fprintf(stderr, "Rank %d: failed to allocate the prediction cache\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
     
     for (uint32_t i = start_idx; i < end_idx; i++) {
         double img_start = MPI_Wtime();
         
-        mnist_get_image(&test_images, i, img_raw);
-        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
-        
-        Layer_setInputs(linput, img_norm);
-        Layer_getOutputs(loutput, y);
+        mnist_get_image(&test_images, i - start_idx, img_raw);
         
-        int predicted = 0;
-        for (int j = 1; j < 10; j++) {
-            if (y[j] > y[predicted]) {
-                predicted = j;
+        int32_t predicted = 0;
+        uint64_t key = 0;
+        int hit = 0;
+        if (cache != NULL) {
+            key = prediction_cache_key(img_raw, IMAGE_SIZE);
+            hit = prediction_cache_lookup(cache, key, &predicted, y);
+        }
+        if (!hit) {
+            mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+            
+            Layer_setInputs(linput, img_norm);
+            Layer_getOutputs(loutput, y);
+            
+            for (int j = 1; j < 10; j++) {
+                if (y[j] > y[predicted]) {
+                    predicted = j;
+                }
+            }
+            if (cache != NULL) {
+                prediction_cache_insert(cache, key, predicted, y);
             }
         }
         
-        uint8_t actual = mnist_get_label(&test_labels, i);
+        uint8_t actual = mnist_get_label(&test_labels, i - start_idx);
         if (predicted == actual) {
             local_correct++;
         }
+        if (options.predictions_path != NULL) {
+            prediction_buffer_add(&predictions, i, predicted, y);
+        }
         
         double img_end = MPI_Wtime();
         double img_latency = (img_end - img_start) * 1000.0;
+        local_latencies[i - start_idx] = img_latency;
         
         if (img_latency < local_min_latency) {
             local_min_latency = img_latency;
@@ -136,16 +171,55 @@ int main(int argc, char *argv[]) {
     MPI_Reduce(&local_min_latency, &global_min_latency, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
     MPI_Reduce(&local_max_latency, &global_max_latency, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     
+    /* Gather per-image latencies so rank 0 can compute exact percentiles. */
+    int* latency_counts = NULL;
+    int* latency_displs = NULL;
+    double* all_latencies = NULL;
+    if (rank == 0) {
+        latency_counts = (int*)malloc(size * sizeof(int));
+        latency_displs = (int*)malloc(size * sizeof(int));
+        all_latencies = (double*)malloc(total_images * sizeof(double));
+    }
+    MPI_Gather(&local_count, 1, MPI_INT, latency_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        int offset = 0;
+        for (int r = 0; r < size; r++) {
+            latency_displs[r] = offset;
+            offset += latency_counts[r];
+        }
+    }
+    MPI_Gatherv(local_latencies, local_count, MPI_DOUBLE,
+                all_latencies, latency_counts, latency_displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    free(local_latencies);
+    
     double max_inference_time;
     MPI_Reduce(&local_inference_time, &max_inference_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     double min_inference_time;
     MPI_Reduce(&local_inference_time, &min_inference_time, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
     
+    PredictionCacheStats cache_stats;
+    prediction_cache_stats(cache, &cache_stats);
+    uint64_t local_cache[2] = {cache_stats.lookups, cache_stats.hits};
+    uint64_t global_cache[2] = {0, 0};
+    MPI_Reduce(local_cache, global_cache, 2, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    prediction_cache_destroy(cache);
+    
     double comm_end = MPI_Wtime();
     double communication_time = comm_end - comm_start;
     
     double end_total = MPI_Wtime();
     
+    /* Each rank writes its own slice; kept out of the timings above. */
+    double predictions_time = 0.0;
+    int predictions_ok = 0;
+    if (options.predictions_path != NULL) {
+        double write_start = MPI_Wtime();
+        predictions_ok = predictions_write_mpi(options.predictions_path, options.predictions_format,
+                                               &predictions, MPI_COMM_WORLD) == 0;
+        predictions_time = MPI_Wtime() - write_start;
+    }
+    prediction_buffer_free(&predictions);
+    
     if (rank == 0) {
         metrics.total_time = end_total - start_total;
         metrics.inference_time = max_inference_time;
@@ -154,6 +228,8 @@ int main(int argc, char *argv[]) {
         metrics.total_images = total_images;
         metrics.min_latency_ms = global_min_latency;
         metrics.max_latency_ms = global_max_latency;
+        metrics.cache_lookups = global_cache[0];
+        metrics.cache_hits = global_cache[1];
         
         metrics.load_imbalance = (max_inference_time - min_inference_time) / max_inference_time;
         
@@ -161,6 +237,10 @@ int main(int argc, char *argv[]) {
         metrics.bytes_sent = 0;
         
         metrics_calculate_derived(&metrics, 0);
+        metrics_set_latency_percentiles(&metrics, all_latencies, (int)total_images);
+        free(all_latencies);
+        free(latency_counts);
+        free(latency_displs);
         
         printf("\n");
         metrics_print_detailed(&metrics, "DATA PARALLEL INFERENCE");
@@ -180,17 +260,26 @@ int main(int argc, char *argv[]) {
             printf("  ✗ Poor load balance (> 15%% imbalance)\n");
         }
         printf("\n");
+        
+        if (predictions_ok) {
+            printf("Predictions: %u records (%s) written to %s by %d ranks (MPI-IO) in %.3f seconds\n\n",
+                   total_images, prediction_format_name(options.predictions_format),
+                   options.predictions_path, size, predictions_time);
+        }
+        
+        if (options.json_path != NULL) {
+            RunConfig config;
+            run_config_init(&config, "data_parallel", size);
+            config.images_path = options.images_path;
+            config.tag = options.tag;
+            metrics_append_json(options.json_path, &metrics, &config);
+        }
     }
     
     mnist_free_images(&test_images);
     mnist_free_labels(&test_labels);
     
-    Layer_destroy(loutput);
-    Layer_destroy(lfull2);
-    Layer_destroy(lfull1);
-    Layer_destroy(lconv2);
-    Layer_destroy(lconv1);
-    Layer_destroy(linput);
+    model_destroy_network(layers);
     
     MPI_Finalize();
     return 0;
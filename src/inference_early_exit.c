@@ -0,0 +1,270 @@
+#include "cnn.h"
+#include "early_exit.h"
+#include "mnist_loader.h"
+#include "model_io.h"
+#include "performance_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_SIZE 784
+#define NUM_LAYERS MODEL_NUM_LAYERS
+#define MAX_THRESHOLDS 16
+#define DEFAULT_REPEATS 5
+
+/* Early-exit inference: the full network as the baseline, then each
+   confidence threshold, where images whose exit-head confidence reaches
+   the threshold skip FC1, FC2 and the output layer. After one untimed
+   warm-up pass, every configuration is timed as the median of several
+   passes. */
+
+typedef struct {
+    const char* images_path;
+    const char* labels_path;
+    const char* model_path;
+    const char* head_path;
+    double thresholds[MAX_THRESHOLDS];
+    int num_thresholds;
+    unsigned long limit;
+    int repeats;
+    const char* json_path;
+    const char* tag;
+} EarlyExitOptions;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --model <file>          Model (default ./models/cnn_model.bin)\n");
+    fprintf(stderr, "  --head <file>           Exit head from train_cnn --exit-head (default ./models/exit_head.bin)\n");
+    fprintf(stderr, "  --thresholds <a,b,...>  Confidence thresholds to sweep (default 0.9,0.95,0.99,0.999)\n");
+    fprintf(stderr, "  --limit <n>             Use only the first n images\n");
+    fprintf(stderr, "  --repeats <n>           Timed passes per configuration, median reported (default %d)\n",
+            DEFAULT_REPEATS);
+    fprintf(stderr, "  --json <file>           Append one JSON record per threshold to <file>\n");
+    fprintf(stderr, "  --tag <label>           Label stored in the JSON records\n");
+}
+
+static int parse_thresholds(const char* list, EarlyExitOptions* opts) {
+    opts->num_thresholds = 0;
+    const char* p = list;
+    while (*p != '\0') {
+        char* end;
+        double threshold = strtod(p, &end);
+        if (end == p || threshold <= 0.0 || opts->num_thresholds == MAX_THRESHOLDS) {
+            return -1;
+        }
+        opts->thresholds[opts->num_thresholds++] = threshold;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return -1;
+    }
+    return opts->num_thresholds > 0 ? 0 : -1;
+}
+
+static int parse_args(int argc, char* argv[], EarlyExitOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->model_path = "./models/cnn_model.bin";
+    opts->head_path = "./models/exit_head.bin";
+    opts->repeats = DEFAULT_REPEATS;
+    if (parse_thresholds("0.9,0.95,0.99,0.999", opts) != 0) return -1;
+    if (argc < 3) return -1;
+    opts->images_path = argv[1];
+    opts->labels_path = argv[2];
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return -1;
+        } else if (strcmp(argv[i], "--model") == 0) {
+            opts->model_path = argv[++i];
+        } else if (strcmp(argv[i], "--head") == 0) {
+            opts->head_path = argv[++i];
+        } else if (strcmp(argv[i], "--thresholds") == 0) {
+            if (parse_thresholds(argv[++i], opts) != 0) return -1;
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            long limit = atol(argv[++i]);
+            if (limit < 1) return -1;
+            opts->limit = (unsigned long)limit;
+        } else if (strcmp(argv[i], "--repeats") == 0) {
+            opts->repeats = atoi(argv[++i]);
+            if (opts->repeats < 1) return -1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opts->json_path = argv[++i];
+        } else if (strcmp(argv[i], "--tag") == 0) {
+            opts->tag = argv[++i];
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int argmax(const double* y) {
+    int best = 0;
+    for (int j = 1; j < 10; j++) {
+        if (y[j] > y[best]) best = j;
+    }
+    return best;
+}
+
+/* One pass over the images; threshold <= 0 runs the full network for all
+   of them. predicted receives every image's class. */
+static void run_pass(Layer** layers, ExitHead* head, const MNISTImages* images, const MNISTLabels* labels,
+                     double threshold, int* predicted, PerformanceMetrics* metrics) {
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    uint32_t exited = 0;
+    int correct = 0;
+
+    double start = get_current_time_sec();
+    for (uint32_t i = 0; i < images->num_images; i++) {
+        mnist_get_image(images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+        int p;
+        if (threshold > 0.0) {
+            network_forward_until(layers, EXIT_TAP, img_norm);
+            if (exit_head_forward(head, layers[EXIT_TAP]->outputs, &p, NULL) >= threshold) {
+                exited++;
+            } else {
+                network_forward_from(layers, EXIT_TAP + 1, NUM_LAYERS);
+                p = argmax(layers[NUM_LAYERS - 1]->outputs);
+            }
+        } else {
+            network_forward_until(layers, NUM_LAYERS - 1, img_norm);
+            p = argmax(layers[NUM_LAYERS - 1]->outputs);
+        }
+        predicted[i] = p;
+        if (p == mnist_get_label(labels, i)) {
+            correct++;
+        }
+    }
+
+    metrics_init(metrics);
+    metrics->latency_measured = 0;          /* Only whole-pass times */
+    metrics->num_processes = 1;
+    metrics->inference_time = get_current_time_sec() - start;
+    metrics->total_images = (int)images->num_images;
+    metrics->correct_predictions = correct;
+    metrics->exit_threshold = threshold > 0.0 ? threshold : 0.0;
+    metrics->exit_fraction = (double)exited / images->num_images;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* run_pass repeated; the pass time is the median over the repeats. */
+static void time_config(Layer** layers, ExitHead* head, const MNISTImages* images, const MNISTLabels* labels,
+                        double threshold, int repeats, double serial_time, int* predicted,
+                        PerformanceMetrics* metrics) {
+    double* times = (double*)malloc(repeats * sizeof(double));
+    for (int r = 0; r < repeats; r++) {
+        run_pass(layers, head, images, labels, threshold, predicted, metrics);
+        times[r] = metrics->inference_time;
+    }
+    qsort(times, repeats, sizeof(double), compare_double);
+    metrics->inference_time = (repeats % 2) ? times[repeats / 2]
+                                            : 0.5 * (times[repeats / 2 - 1] + times[repeats / 2]);
+    free(times);
+    metrics->total_time = metrics->inference_time;
+    metrics_calculate_derived(metrics, serial_time);
+}
+
+static void append_json(const EarlyExitOptions* opts, const PerformanceMetrics* metrics) {
+    RunConfig config;
+    run_config_init(&config, metrics->exit_threshold > 0.0 ? "serial_early_exit" : "serial", 1);
+    config.images_path = opts->images_path;
+    config.tag = opts->tag;
+    metrics_append_json(opts->json_path, metrics, &config);
+}
+
+int main(int argc, char* argv[]) {
+    EarlyExitOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("=================================================\n");
+    printf("   EARLY-EXIT CNN INFERENCE (Confidence Cascade) \n");
+    printf("=================================================\n\n");
+
+    printf("[1/4] Loading model and exit head...\n");
+    Layer* layers[NUM_LAYERS];
+    if (model_open_network(opts.model_path, layers, NULL) != 0) {
+        fprintf(stderr, "Failed to load model. Have you trained the model?\n");
+        return 1;
+    }
+    ExitHead head;
+    exit_head_create(&head, layers[EXIT_TAP], 0.0);
+    if (exit_head_load(opts.head_path, &head) != 0) {
+        fprintf(stderr, "Failed to load exit head. Train one with train_cnn --exit-head %s\n", opts.head_path);
+        return 1;
+    }
+    printf("    ✓ %s, exit head %s (after Conv2)\n\n", opts.model_path, opts.head_path);
+
+    printf("[2/4] Loading MNIST test dataset...\n");
+    MNISTImages test_images;
+    MNISTLabels test_labels;
+    if (mnist_read_header(opts.images_path, opts.labels_path, &test_images) != 0) {
+        fprintf(stderr, "Failed to load test dataset\n");
+        return 1;
+    }
+    uint32_t num_images = test_images.num_images;
+    if (opts.limit > 0 && opts.limit < num_images) {
+        num_images = (uint32_t)opts.limit;
+    }
+    if (mnist_load_images_range(opts.images_path, 0, num_images, &test_images) != 0) {
+        fprintf(stderr, "Failed to load test images\n");
+        return 1;
+    }
+    if (mnist_load_labels_range(opts.labels_path, 0, num_images, &test_labels) != 0) {
+        fprintf(stderr, "Failed to load test labels\n");
+        mnist_free_images(&test_images);
+        return 1;
+    }
+    printf("    ✓ Loaded %u test images\n\n", num_images);
+
+    printf("[3/4] Full network (baseline, median of %d)...\n", opts.repeats);
+    int* full_predicted = (int*)malloc(num_images * sizeof(int));
+    int* predicted = (int*)malloc(num_images * sizeof(int));
+    if (full_predicted == NULL || predicted == NULL) {
+        fprintf(stderr, "Failed to allocate predictions\n");
+        return 1;
+    }
+    PerformanceMetrics baseline;
+    run_pass(layers, &head, &test_images, &test_labels, 0.0, full_predicted, &baseline);    /* Warm-up */
+    time_config(layers, &head, &test_images, &test_labels, 0.0, opts.repeats, 0.0, full_predicted, &baseline);
+    printf("    ✓ %.0f images/s, accuracy %.2f%%\n\n", baseline.throughput_images_per_sec, baseline.accuracy);
+    if (opts.json_path != NULL) append_json(&opts, &baseline);
+
+    printf("[4/4] Threshold sweep...\n\n");
+    printf("  %-10s %9s %10s %10s %12s %9s\n", "Threshold", "Exited", "Accuracy", "Agreement", "Images/s", "Speedup");
+    printf("  %-10s %9s %9.2f%% %9.2f%% %12.0f %8.2fx\n", "full", "0.00%", baseline.accuracy, 100.0,
+           baseline.throughput_images_per_sec, 1.0);
+    for (int t = 0; t < opts.num_thresholds; t++) {
+        PerformanceMetrics metrics;
+        time_config(layers, &head, &test_images, &test_labels, opts.thresholds[t], opts.repeats,
+                    baseline.inference_time, predicted, &metrics);
+
+        uint32_t agree = 0;
+        for (uint32_t i = 0; i < num_images; i++) {
+            if (predicted[i] == full_predicted[i]) agree++;
+        }
+        printf("  %-10g %8.2f%% %9.2f%% %9.2f%% %12.0f %8.2fx\n", opts.thresholds[t],
+               metrics.exit_fraction * 100.0, metrics.accuracy, (agree * 100.0) / num_images,
+               metrics.throughput_images_per_sec, metrics.speedup);
+        if (opts.json_path != NULL) append_json(&opts, &metrics);
+    }
+    printf("\n  Agreement: predictions identical to the full network's\n");
+    if (opts.json_path != NULL) {
+        printf("  ✓ Results appended to %s\n", opts.json_path);
+    }
+
+    free(predicted);
+    free(full_predicted);
+    mnist_free_images(&test_images);
+    mnist_free_labels(&test_labels);
+    exit_head_destroy(&head);
+    model_destroy_network(layers);
+    return 0;
+}
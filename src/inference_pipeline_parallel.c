@@ -5,7 +5,10 @@
 #include <string.h>
 #include <mpi.h>
 #include "cnn.h"
+#include "cli_options.h"
 #include "model_io.h"
+#include "performance_metrics.h"
+#include "prediction_sink_mpi.h"
 
 #ifdef __APPLE__
 #include <libkern/OSByteOrder.h>
@@ -62,7 +65,7 @@ IdxFile *IdxFile_read(FILE *fp)
 
     if (fread(self->dims, sizeof(uint32_t), self->ndims, fp) == self->ndims)
     {
-        uint32_t nbytes = sizeof(uint8_t);
+        size_t nbytes = sizeof(uint8_t);
         for (int i = 0; i < self->ndims; i++)
         {
             /* Fix the byte order. */
@@ -77,10 +80,17 @@ IdxFile *IdxFile_read(FILE *fp)
         self->data = (uint8_t *)malloc(nbytes);
         if (self->data != NULL)
         {
-            fread(self->data, sizeof(uint8_t), nbytes, fp);
+            size_t n = fread(self->data, sizeof(uint8_t), nbytes, fp);
 #if DEBUG_IDXFILE
-            fprintf(stderr, "IdxFile_read: read: %lu bytes\n", n);
+            fprintf(stderr, "IdxFile_read: read: %zu bytes\n", n);
 #endif
+            if (n != nbytes)
+            {
+                free(self->data);
+                free(self->dims);
+                free(self);
+                return NULL;
+            }
         }
     }
 
@@ -143,33 +153,31 @@ int main(int argc, char *argv[])
 
     start_time = MPI_Wtime();
     int ncorrect = 0;
-    /* argv[1] = train images */
-    /* argv[2] = train labels */
-    /* argv[3] = test images */
-    /* argv[4] = test labels */
-    // if (argc < 4) return 100;
+    /* Filled by the output stage ranks only. */
+    PredictionBuffer predictions;
+    prediction_buffer_init(&predictions);
+    /* argv[1] = test images (default ./data/t10k-images-idx3-ubyte) */
+    /* argv[2] = test labels (default ./data/t10k-labels-idx1-ubyte) */
+    InferenceOptions options = {0};
+    options.images_path = "./data/t10k-images-idx3-ubyte";
+    options.labels_path = "./data/t10k-labels-idx1-ubyte";
+    if (inference_options_parse(argc, argv, &options) != 0)
+    {
+        if (id == 0)
+        {
+            inference_options_usage(argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
 
     /* Use a fixed random seed for debugging. */
     srand(0);
     /* Initialize layers. */
-    /* Input layer - 1x28x28. */
-    Layer *linput = Layer_create_input(1, 28, 28);
-    /* Conv1 layer - 16x14x14, 3x3 conv, padding=1, stride=2. */
-    /* (14-1)*2+3 < 28+1*2 */
-    Layer *lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
-    /* Conv2 layer - 32x7x7, 3x3 conv, padding=1, stride=2. */
-    /* (7-1)*2+3 < 14+1*2 */
-    Layer *lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
-    /* FC1 layer - 200 nodes. */
-    Layer *lfull1 = Layer_create_full(lconv2, 200, 0.1);
-    /* FC2 layer - 200 nodes. */
-    Layer *lfull2 = Layer_create_full(lfull1, 200, 0.1);
-    /* Output layer - 10 nodes. */
-    Layer *loutput = Layer_create_full(lfull2, 10, 0.1);
-
-    Layer *layers[] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
-    
-    if (model_load("./models/cnn_model.bin", layers, 6) != 0)
+    /* Input(1x28x28) -> Conv1 -> Conv2 (3x3 conv, padding=1, stride=2) -> FC1 -> FC2 -> Output(10);
+       the widths are read from the model file, so student models load too. */
+    Layer *layers[MODEL_NUM_LAYERS];
+    if (model_open_network(options.model_path, layers, NULL) != 0)
     {
         if (id == 0)
         {
@@ -178,12 +186,18 @@ int main(int argc, char *argv[])
         MPI_Finalize();
         return 1;
     }
+    Layer *linput = layers[0];
+    Layer *lconv1 = layers[1];
+    Layer *lconv2 = layers[2];
+    Layer *lfull1 = layers[3];
+    Layer *lfull2 = layers[4];
+    Layer *loutput = layers[5];
 
     /* Read the test images & labels. */
 
     IdxFile *images_test = NULL;
     {
-        FILE *fp = fopen("./data/t10k-images-idx3-ubyte", "rb");
+        FILE *fp = fopen(options.images_path, "rb");
         if (fp == NULL)
             return 111;
         images_test = IdxFile_read(fp);
@@ -193,7 +207,7 @@ int main(int argc, char *argv[])
     }
     IdxFile *labels_test = NULL;
     {
-        FILE *fp = fopen("./data/t10k-labels-idx1-ubyte", "rb");
+        FILE *fp = fopen(options.labels_path, "rb");
         if (fp == NULL)
             return 111;
         labels_test = IdxFile_read(fp);
@@ -201,20 +215,44 @@ int main(int argc, char *argv[])
             return 111;
         fclose(fp);
     }
+    if (labels_test->dims[0] != images_test->dims[0])
+    {
+        if (id == 0)
+        {
+            fprintf(stderr, "Label count %u does not match image count %u\n",
+                    labels_test->dims[0], images_test->dims[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (images_test->ndims != 3 || images_test->dims[1] != 28 || images_test->dims[2] != 28)
+    {
+        if (id == 0)
+        {
+            fprintf(stderr, "%s: images are not 28x28\n", options.images_path);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    /* Every stage derives its share of the run from ntests. */
+    int ntests = images_test->dims[0];
+    if (options.limit > 0 && options.limit < (unsigned long)ntests)
+    {
+        ntests = (int)options.limit;
+    }
 
     if (p % 5 == 0)
     {
         if (id == 0 || id % 5 == 0) // input + conv1
         {
             printf("in cpu %d\n", id);
-            int ntests = images_test->dims[0];
             int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series;
             int end_index = start_index + images_per_series;
             // printf("no error at image indexing..\n");
             if (id == p - 5)
-                end_index = 10000;
+                end_index = ntests;
 
             for (int i = start_index; i < end_index; i++)
             {
@@ -244,13 +282,13 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
             // printf("no error at image indexing..\n");
             if (id == p - 4)
-                end_index = 10000;
+                end_index = ntests;
             int image_count = end_index - start_index;
 
             while (count < image_count)
@@ -271,13 +309,13 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
             // printf("no error at image indexing..\n");
             if (id == p - 3)
-                end_index = 10000;
+                end_index = ntests;
             int image_count = end_index - start_index;
 
             while (count < image_count)
@@ -298,13 +336,13 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 3) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
             // printf("no error at image indexing..\n");
             if (id == p - 2)
-                end_index = 10000;
+                end_index = ntests;
             int image_count = end_index - start_index;
 
             while (count < image_count)
@@ -326,13 +364,13 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 4) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
             // printf("no error at image indexing..\n");
             if (id == p - 1)
-                end_index = 10000;
+                end_index = ntests;
             int image_count = end_index - start_index;
 
             // while (count<image_count)
@@ -355,6 +393,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -376,7 +418,6 @@ int main(int argc, char *argv[])
         if ((id == 0 || id % 5 == 0) && (id != p - 1)) // input + conv1
         {
             printf("in cpu %d\n", id);
-            int ntests = images_test->dims[0];
             int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series;
@@ -413,7 +454,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -440,7 +481,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -467,7 +508,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 3) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -495,7 +536,7 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 4) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -524,6 +565,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -541,11 +586,11 @@ int main(int argc, char *argv[])
         else if (id == p - 1)
         {
             printf("in cpu %d\n", id);
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
             int ncorrect_series = 0;
 
             int start_index = id / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
             // printf("no error at image indexing..\n");
             // if (id == p - 5)
@@ -585,6 +630,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -606,7 +655,6 @@ int main(int argc, char *argv[])
         if ((id == 0 || id % 5 == 0) && (id < p - 2)) // input + conv1
         {
             printf("in cpu %d\n", id);
-            int ntests = images_test->dims[0];
             int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series;
@@ -643,7 +691,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -670,7 +718,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -697,7 +745,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 3) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -725,7 +773,7 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 4) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -754,6 +802,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -771,11 +823,11 @@ int main(int argc, char *argv[])
         else if (id == p - 2)
         {
             printf("in cpu %d\n", id);
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
             int ncorrect_series = 0;
 
             int start_index = id / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
             // printf("no error at image indexing..\n");
             // if (id == p - 5)
@@ -809,10 +861,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -835,6 +887,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -855,7 +911,6 @@ int main(int argc, char *argv[])
         if ((id == 0 || id % 5 == 0) && (id < p - 3)) // input + conv1
         {
             printf("in cpu %d\n", id);
-            int ntests = images_test->dims[0];
             int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series;
@@ -892,7 +947,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -919,7 +974,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -946,7 +1001,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 3) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -974,7 +1029,7 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 4) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -1003,6 +1058,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -1020,11 +1079,11 @@ int main(int argc, char *argv[])
         else if (id == p - 3)
         {
             printf("in cpu %d\n", id);
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
             int ncorrect_series = 0;
 
             int start_index = id / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
             // printf("no error at image indexing..\n");
             // if (id == p - 5)
@@ -1059,10 +1118,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -1083,10 +1142,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -1107,6 +1166,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -1127,7 +1190,6 @@ int main(int argc, char *argv[])
         if ((id == 0 || id % 5 == 0) && (id < p - 4)) // input + conv1
         {
             printf("in cpu %d\n", id);
-            int ntests = images_test->dims[0];
             int images_per_series = ntests / p * 5;
 
             int start_index = id / 5 * images_per_series;
@@ -1164,7 +1226,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -1191,7 +1253,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -1218,7 +1280,7 @@ int main(int argc, char *argv[])
             printf("in cpu %d\n", id);
             int count = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 3) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -1246,7 +1308,7 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 4) / 5 * images_per_series;
             int end_index = start_index + images_per_series;
@@ -1275,6 +1337,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -1292,11 +1358,11 @@ int main(int argc, char *argv[])
         else if (id == p - 4)
         {
             printf("in cpu %d\n", id);
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
             int ncorrect_series = 0;
 
             int start_index = id / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
             // printf("no error at image indexing..\n");
             // if (id == p - 5)
@@ -1331,10 +1397,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lconv1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -1353,10 +1419,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lconv2->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 1) / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -1376,10 +1442,10 @@ int main(int argc, char *argv[])
             int count = 0;
             int ncorrect_series = 0;
             double *prevl_output = (double *)calloc(lfull1->nnodes, sizeof(double));
-            int images_per_series = 10000 / p * 5;
+            int images_per_series = ntests / p * 5;
 
             int start_index = (id - 2) / 5 * images_per_series; // remaining images;
-            int end_index = 10000;
+            int end_index = ntests;
             int image_count = end_index - start_index;
 
             for (int i = start_index; i < end_index; i++)
@@ -1400,6 +1466,10 @@ int main(int argc, char *argv[])
                         mj = j;
                     }
                 }
+                if (options.predictions_path != NULL)
+                {
+                    prediction_buffer_add(&predictions, i, mj, y);
+                }
                 if (mj == label)
                 {
                     ncorrect_series++;
@@ -1421,10 +1491,44 @@ int main(int argc, char *argv[])
     end_time = MPI_Wtime();
     double execution_time = end_time - start_time;
 
+    /* Output stages write their slices collectively; other ranks add nothing. */
+    int predictions_ok = 0;
+    if (options.predictions_path != NULL)
+    {
+        predictions_ok = predictions_write_mpi(options.predictions_path, options.predictions_format,
+                                               &predictions, MPI_COMM_WORLD) == 0;
+    }
+    prediction_buffer_free(&predictions);
+
     if (id == 0)
     {
         printf("Total correct predictions: %d\n", total_correct);
         printf("Total execution time: %f seconds\n", execution_time);
+        if (predictions_ok)
+        {
+            printf("Predictions (%s) written to %s\n",
+                   prediction_format_name(options.predictions_format), options.predictions_path);
+        }
+
+        if (options.json_path != NULL)
+        {
+            PerformanceMetrics metrics;
+            metrics_init(&metrics);
+            metrics.num_processes = p;
+            metrics.total_time = execution_time;
+            metrics.inference_time = execution_time;
+            metrics.correct_predictions = total_correct;
+            metrics.total_images = ntests;
+            metrics_calculate_derived(&metrics, 0);
+            /* Images cross several ranks; no per-image latency is measured. */
+            metrics.latency_measured = 0;
+
+            RunConfig config;
+            run_config_init(&config, "pipeline_parallel", p);
+            config.images_path = options.images_path;
+            config.tag = options.tag;
+            metrics_append_json(options.json_path, &metrics, &config);
+        }
     }
 
     IdxFile_destroy(images_test);
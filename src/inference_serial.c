@@ -1,7 +1,10 @@
 #include "cnn.h"
+#include "cli_options.h"
 #include "mnist_loader.h"
 #include "model_io.h"
 #include "performance_metrics.h"
+#include "prediction_cache.h"
+#include "prediction_sink.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -9,8 +12,10 @@
 #define IMAGE_SIZE 784
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <test-images> <test-labels>\n", argv[0]);
+    InferenceOptions options = {0};
+    if (inference_options_parse(argc, argv, &options) != 0 ||
+        options.images_path == NULL || options.labels_path == NULL) {
+        inference_options_usage(argv[0]);
         return 1;
     }
     
@@ -26,21 +31,25 @@ int main(int argc, char* argv[]) {
     
     printf("[1/5] Initializing CNN layers...\n");
     double layer_start = get_current_time_sec();
-    Layer *linput = Layer_create_input(1, 28, 28);
-    Layer *lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
-    Layer *lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
-    Layer *lfull1 = Layer_create_full(lconv2, 200, 0.1);
-    Layer *lfull2 = Layer_create_full(lfull1, 200, 0.1);
-    Layer *loutput = Layer_create_full(lfull2, 10, 0.1);
+    /* The layer widths come from the model file (teacher or student). */
+    ModelTopology topology;
+    if (model_read_topology(options.model_path, &topology) != 0) {
+        fprintf(stderr, "Failed to load model. Have you trained the model?\n");
+        return 1;
+    }
+    Layer *layers[MODEL_NUM_LAYERS];
+    model_create_network(&topology, layers, 0.1);
+    Layer *linput = layers[0];
+    Layer *loutput = layers[MODEL_NUM_LAYERS - 1];
     double layer_end = get_current_time_sec();
-    printf("    ✓ Network initialized: Input(1×28×28) → Conv1(16×14×14) → Conv2(32×7×7) → FC1(200) → FC2(200) → Output(10)\n");
+    char network[192];
+    model_topology_describe(&topology, network, sizeof(network));
+    printf("    ✓ Network initialized: %s\n", network);
     printf("    ✓ Layer creation time: %.3f seconds\n\n", layer_end - layer_start);
     
     printf("[2/5] Loading pre-trained model weights...\n");
     double model_load_start = get_current_time_sec();
-    Layer *layers[] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
-    
-    if (model_load("./models/cnn_model.bin", layers, 6) != 0) {
+    if (model_load(options.model_path, layers, MODEL_NUM_LAYERS) != 0) {
         fprintf(stderr, "Failed to load model. Have you trained the model?\n");
         return 1;
     }
@@ -54,12 +63,21 @@ int main(int argc, char* argv[]) {
     MNISTImages test_images;
     MNISTLabels test_labels;
     
-    if (mnist_load_images(argv[1], &test_images) != 0) {
+    if (mnist_read_header(options.images_path, options.labels_path, &test_images) != 0) {
+        fprintf(stderr, "Failed to load test dataset\n");
+        return 1;
+    }
+    uint32_t num_images = test_images.num_images;
+    if (options.limit > 0 && options.limit < num_images) {
+        num_images = (uint32_t)options.limit;
+    }
+    
+    if (mnist_load_images_range(options.images_path, 0, num_images, &test_images) != 0) {
         fprintf(stderr, "Failed to load test images\n");
         return 1;
     }
     
-    if (mnist_load_labels(argv[2], &test_labels) != 0) {
+    if (mnist_load_labels_range(options.labels_path, 0, num_images, &test_labels) != 0) {
         fprintf(stderr, "Failed to load test labels\n");
         mnist_free_images(&test_images);
         return 1;
@@ -79,6 +97,17 @@ int main(int argc, char* argv[]) {
     double img_norm[IMAGE_SIZE];
     double y[10];
     int correct = 0;
+    double* latencies = (double*)malloc(test_images.num_images * sizeof(double));
+    PredictionBuffer predictions;
+    prediction_buffer_init(&predictions);
+    PredictionCache* cache = NULL;
+    if (options.cache_entries > 0) {
+        cache = prediction_cache_create(options.cache_entries);
+        if (cache == NULL) {
+            fprintf(stderr, "Failed to allocate the prediction cache\n");
+            return 1;
+        }
+    }
     
     metrics.total_images = test_images.num_images;
     
@@ -86,15 +115,27 @@ int main(int argc, char* argv[]) {
         double img_start = get_current_time_sec();
         
         mnist_get_image(&test_images, i, img_raw);
-        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
         
-        Layer_setInputs(linput, img_norm);
-        Layer_getOutputs(loutput, y);
-        
-        int predicted = 0;
-        for (int j = 1; j < 10; j++) {
-            if (y[j] > y[predicted]) {
-                predicted = j;
+        int32_t predicted = 0;
+        uint64_t key = 0;
+        int hit = 0;
+        if (cache != NULL) {
+            key = prediction_cache_key(img_raw, IMAGE_SIZE);
+            hit = prediction_cache_lookup(cache, key, &predicted, y);
+        }
+        if (!hit) {
+            mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+            
+            Layer_setInputs(linput, img_norm);
+            Layer_getOutputs(loutput, y);
+            
+            for (int j = 1; j < 10; j++) {
+                if (y[j] > y[predicted]) {
+                    predicted = j;
+                }
+            }
+            if (cache != NULL) {
+                prediction_cache_insert(cache, key, predicted, y);
             }
         }
         
@@ -102,9 +143,13 @@ int main(int argc, char* argv[]) {
         if (predicted == actual) {
             correct++;
         }
+        if (options.predictions_path != NULL) {
+            prediction_buffer_add(&predictions, i, predicted, y);
+        }
         
         double img_end = get_current_time_sec();
         double img_latency = (img_end - img_start) * 1000.0;
+        latencies[i] = img_latency;
         
         if (img_latency < metrics.min_latency_ms) {
             metrics.min_latency_ms = img_latency;
@@ -123,11 +168,20 @@ int main(int argc, char* argv[]) {
     double inference_end = get_current_time_sec();
     metrics.inference_time = inference_end - inference_start;
     metrics.correct_predictions = correct;
+    if (cache != NULL) {
+        PredictionCacheStats cache_stats;
+        prediction_cache_stats(cache, &cache_stats);
+        metrics.cache_lookups = cache_stats.lookups;
+        metrics.cache_hits = cache_stats.hits;
+        prediction_cache_destroy(cache);
+    }
     
     double end_total = get_current_time_sec();
     metrics.total_time = end_total - start_total;
     
     metrics_calculate_derived(&metrics, metrics.inference_time);
+    metrics_set_latency_percentiles(&metrics, latencies, test_images.num_images);
+    free(latencies);
     
     printf("\n[5/5] Results:\n");
     metrics_print_detailed(&metrics, "SERIAL INFERENCE");
@@ -136,15 +190,28 @@ int main(int argc, char* argv[]) {
     printf("  This is SERIAL execution (1 CPU core)\n");
     printf("  Use this as baseline for parallel comparison\n\n");
     
+    if (options.predictions_path != NULL) {
+        double write_start = get_current_time_sec();
+        if (predictions_write(options.predictions_path, options.predictions_format, &predictions) == 0) {
+            printf("Predictions: %u records (%s) written to %s in %.3f seconds\n\n", predictions.count,
+                   prediction_format_name(options.predictions_format), options.predictions_path,
+                   get_current_time_sec() - write_start);
+        }
+    }
+    prediction_buffer_free(&predictions);
+    
+    if (options.json_path != NULL) {
+        RunConfig config;
+        run_config_init(&config, "serial", 1);
+        config.images_path = options.images_path;
+        config.tag = options.tag;
+        metrics_append_json(options.json_path, &metrics, &config);
+    }
+    
     mnist_free_images(&test_images);
     mnist_free_labels(&test_labels);
     
-    Layer_destroy(loutput);
-    Layer_destroy(lfull2);
-    Layer_destroy(lfull1);
-    Layer_destroy(lconv2);
-    Layer_destroy(lconv1);
-    Layer_destroy(linput);
+    model_destroy_network(layers);
     
     return 0;
 }
@@ -0,0 +1,550 @@
+/*
+  inference_server.c
+  Long-running inference daemon with dynamic request batching.
+
+  The model is loaded once. Clients connect to a Unix domain socket and
+  send ServeRequest records (serve_protocol.h); one reader thread per
+  connection appends them to a shared queue. Worker threads each own a
+  libcnn session over the shared, read-only model. A worker takes the
+  oldest request and waits until either --max-batch requests are queued or
+  that request has waited --max-wait-us, then runs the whole batch through
+  one GEMM-based forward pass and writes each response back to its
+  connection. A small max wait bounds the latency added by batching; under
+  load batches fill up before the deadline. With --cache, requests whose
+  image was seen before are answered from a shared prediction cache and
+  only the misses go through the forward pass.
+
+  Usage:
+  $ ./cnn_server [--model file] [--socket path] [--workers N]
+                 [--max-batch N] [--max-wait-us N] [--queue N] [--cache N]
+  Stops on SIGINT/SIGTERM and prints the batching statistics.
+*/
+
+#include "libcnn.h"
+#include "performance_metrics.h"
+#include "prediction_cache.h"
+#include "serve_protocol.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MODEL_PATH "./models/cnn_model.bin"
+#define DEFAULT_WORKERS 2
+#define DEFAULT_MAX_BATCH 32
+#define DEFAULT_MAX_WAIT_US 500
+#define DEFAULT_QUEUE 4096
+#define MAX_WORKERS 64
+
+typedef struct {
+    const char* model_path;
+    const char* socket_path;
+    int workers;
+    int max_batch;
+    long max_wait_us;
+    int queue_capacity;
+    long cache_entries;             /* 0: no prediction cache */
+} ServerOptions;
+
+/* Freed when the reader has exited and no queued request refers to it. */
+typedef struct Connection {
+    int fd;
+    int refs;
+    pthread_mutex_t write_lock;
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+typedef struct {
+    Connection* conn;
+    uint32_t id;
+    double arrival;
+    uint8_t pixels[SERVE_IMAGE_SIZE];
+} PendingRequest;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t batches;
+    uint64_t full_batches;          /* Dispatched because max_batch was reached */
+    double queue_time;              /* Sum over requests: arrival to dispatch */
+    double compute_time;
+} ServerStats;
+
+typedef struct Server Server;
+
+typedef struct {
+    Server* server;
+    pthread_t thread;
+    CnnSession* session;
+    PendingRequest* taken;
+    ServeResponse* responses;
+    uint64_t* keys;                 /* Cache key per taken request */
+    int* misses;                    /* Taken requests that need the forward pass */
+    uint8_t* pixels;                /* max_batch x SERVE_IMAGE_SIZE, misses only */
+    int32_t* predicted;
+    double* scores;
+    ServerStats stats;
+} Worker;
+
+struct Server {
+    ServerOptions options;
+    CnnModel* model;
+    PredictionCache* cache;         /* Shared by the workers; NULL if disabled */
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t readers_done;
+    PendingRequest* queue;
+    int head;
+    int count;
+    int stopping;                   /* No new requests; workers drain the queue */
+    int readers;
+    Connection* connections;
+
+    Worker workers[MAX_WORKERS];
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Caller holds server->lock. */
+static void connection_release(Server* server, Connection* conn) {
+    if (--conn->refs > 0) return;
+    if (conn->prev != NULL) conn->prev->next = conn->next;
+    else server->connections = conn->next;
+    if (conn->next != NULL) conn->next->prev = conn->prev;
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->write_lock);
+    free(conn);
+}
+
+typedef struct {
+    Server* server;
+    Connection* conn;
+} ReaderArgs;
+
+static void* reader_thread(void* arg) {
+    ReaderArgs* args = (ReaderArgs*)arg;
+    Server* server = args->server;
+    Connection* conn = args->conn;
+    free(args);
+
+    ServeRequest request;
+    while (serve_read_full(conn->fd, &request, sizeof(request)) == 0) {
+        if (request.magic != SERVE_REQUEST_MAGIC) {
+            ServeResponse response;
+            memset(&response, 0, sizeof(response));
+            response.magic = SERVE_RESPONSE_MAGIC;
+            response.id = request.id;
+            response.status = SERVE_STATUS_BAD_REQUEST;
+            response.predicted = -1;
+            pthread_mutex_lock(&conn->write_lock);
+            serve_write_full(conn->fd, &response, sizeof(response));
+            pthread_mutex_unlock(&conn->write_lock);
+            break;
+        }
+        double arrival = monotonic_seconds();
+
+        pthread_mutex_lock(&server->lock);
+        while (server->count == server->options.queue_capacity && !server->stopping) {
+            pthread_cond_wait(&server->not_full, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        int tail = (server->head + server->count) % server->options.queue_capacity;
+        PendingRequest* pending = &server->queue[tail];
+        pending->conn = conn;
+        pending->id = request.id;
+        pending->arrival = arrival;
+        memcpy(pending->pixels, request.pixels, SERVE_IMAGE_SIZE);
+        conn->refs++;
+        server->count++;
+        pthread_cond_signal(&server->not_empty);
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    pthread_mutex_lock(&server->lock);
+    connection_release(server, conn);
+    if (--server->readers == 0) {
+        pthread_cond_broadcast(&server->readers_done);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/* Waits for a batch under server->lock; returns its size (0: shut down). */
+static int take_batch(Server* server, Worker* worker) {
+    const ServerOptions* options = &server->options;
+    while (server->count == 0 && !server->stopping) {
+        pthread_cond_wait(&server->not_empty, &server->lock);
+    }
+    if (server->count == 0) return 0;
+
+    /* Dynamic batching: hold the oldest request until the batch is full
+       or its deadline passes. */
+    while (server->count > 0 && server->count < options->max_batch && !server->stopping) {
+        double deadline = server->queue[server->head].arrival + options->max_wait_us * 1e-6;
+        double now = monotonic_seconds();
+        if (now >= deadline) break;
+        struct timespec ts;
+        ts.tv_sec = (time_t)deadline;
+        ts.tv_nsec = (long)((deadline - (double)ts.tv_sec) * 1e9);
+        pthread_cond_timedwait(&server->not_empty, &server->lock, &ts);
+    }
+    /* Another worker may have taken the requests meanwhile. */
+    if (server->count == 0) return -1;
+
+    int n = (server->count < options->max_batch) ? server->count : options->max_batch;
+    if (n == options->max_batch) {
+        worker->stats.full_batches++;
+    }
+    for (int i = 0; i < n; i++) {
+        worker->taken[i] = server->queue[server->head];
+        server->head = (server->head + 1) % options->queue_capacity;
+    }
+    server->count -= n;
+    pthread_cond_broadcast(&server->not_full);
+    /* Wake another worker for the requests left behind. */
+    if (server->count > 0) {
+        pthread_cond_signal(&server->not_empty);
+    }
+    return n;
+}
+
+static void run_batch(Worker* worker, int n) {
+    PredictionCache* cache = worker->server->cache;
+    double start = monotonic_seconds();
+    int num_misses = 0;
+    for (int s = 0; s < n; s++) {
+        ServeResponse* response = &worker->responses[s];
+        response->magic = SERVE_RESPONSE_MAGIC;
+        response->id = worker->taken[s].id;
+        response->status = SERVE_STATUS_OK;
+        worker->stats.queue_time += start - worker->taken[s].arrival;
+
+        int hit = 0;
+        if (cache != NULL) {
+            worker->keys[s] = prediction_cache_key(worker->taken[s].pixels, SERVE_IMAGE_SIZE);
+            hit = prediction_cache_lookup(cache, worker->keys[s], &response->predicted, response->scores);
+        }
+        if (!hit) {
+            memcpy(&worker->pixels[num_misses * SERVE_IMAGE_SIZE], worker->taken[s].pixels, SERVE_IMAGE_SIZE);
+            worker->misses[num_misses++] = s;
+        }
+    }
+
+    if (num_misses > 0) {
+        CnnStatus status = cnn_infer_batch(worker->session, worker->pixels, num_misses,
+                                           worker->predicted, worker->scores);
+        for (int m = 0; m < num_misses; m++) {
+            int s = worker->misses[m];
+            ServeResponse* response = &worker->responses[s];
+            if (status == CNN_OK) {
+                response->predicted = worker->predicted[m];
+                memcpy(response->scores, &worker->scores[m * SERVE_NUM_CLASSES], sizeof(response->scores));
+                if (cache != NULL) {
+                    prediction_cache_insert(cache, worker->keys[s], response->predicted, response->scores);
+                }
+            } else {
+                response->status = SERVE_STATUS_ERROR;
+                response->predicted = -1;
+                memset(response->scores, 0, sizeof(response->scores));
+            }
+        }
+    }
+
+    for (int s = 0; s < n; s++) {
+        Connection* conn = worker->taken[s].conn;
+        pthread_mutex_lock(&conn->write_lock);
+        serve_write_full(conn->fd, &worker->responses[s], sizeof(ServeResponse));
+        pthread_mutex_unlock(&conn->write_lock);
+    }
+    worker->stats.compute_time += monotonic_seconds() - start;
+    worker->stats.requests += n;
+    worker->stats.batches++;
+}
+
+static void* worker_thread(void* arg) {
+    Worker* worker = (Worker*)arg;
+    Server* server = worker->server;
+
+    pthread_mutex_lock(&server->lock);
+    for (;;) {
+        int n = take_batch(server, worker);
+        if (n == 0) break;
+        if (n < 0) continue;
+        pthread_mutex_unlock(&server->lock);
+
+        run_batch(worker, n);
+
+        pthread_mutex_lock(&server->lock);
+        for (int s = 0; s < n; s++) {
+            connection_release(server, worker->taken[s].conn);
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+static int open_listener(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void accept_connection(Server* server, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+    conn->fd = fd;
+    conn->refs = 1;                 /* The reader */
+    pthread_mutex_init(&conn->write_lock, NULL);
+    ReaderArgs* args = (ReaderArgs*)malloc(sizeof(ReaderArgs));
+    args->server = server;
+    args->conn = conn;
+
+    pthread_mutex_lock(&server->lock);
+    conn->next = server->connections;
+    if (server->connections != NULL) server->connections->prev = conn;
+    server->connections = conn;
+    server->readers++;
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, reader_thread, args) != 0) {
+        fprintf(stderr, "Failed to start reader thread\n");
+        free(args);
+        pthread_mutex_lock(&server->lock);
+        server->readers--;
+        connection_release(server, conn);
+        pthread_mutex_unlock(&server->lock);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --model <file>     Model to serve (default %s)\n", DEFAULT_MODEL_PATH);
+    fprintf(stderr, "  --socket <path>    Unix socket to listen on (default %s)\n", SERVE_DEFAULT_SOCKET);
+    fprintf(stderr, "  --workers <n>      Inference threads (default %d)\n", DEFAULT_WORKERS);
+    fprintf(stderr, "  --max-batch <n>    Largest batch per forward pass (default %d)\n", DEFAULT_MAX_BATCH);
+    fprintf(stderr, "  --max-wait-us <n>  Longest a request waits for its batch to fill (default %d)\n",
+            DEFAULT_MAX_WAIT_US);
+    fprintf(stderr, "  --queue <n>        Pending requests before readers block (default %d)\n", DEFAULT_QUEUE);
+    fprintf(stderr, "  --cache <n>        Cache predictions of up to n distinct images (default 0: off)\n");
+}
+
+static int parse_args(int argc, char* argv[], ServerOptions* opts) {
+    opts->model_path = DEFAULT_MODEL_PATH;
+    opts->socket_path = SERVE_DEFAULT_SOCKET;
+    opts->workers = DEFAULT_WORKERS;
+    opts->max_batch = DEFAULT_MAX_BATCH;
+    opts->max_wait_us = DEFAULT_MAX_WAIT_US;
+    opts->queue_capacity = DEFAULT_QUEUE;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return -1;
+        if (strcmp(argv[i], "--model") == 0) {
+            opts->model_path = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0) {
+            opts->socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0) {
+            opts->workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-batch") == 0) {
+            opts->max_batch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-wait-us") == 0) {
+            opts->max_wait_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--queue") == 0) {
+            opts->queue_capacity = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            opts->cache_entries = atol(argv[++i]);
+        } else {
+            return -1;
+        }
+    }
+    if (opts->workers < 1 || opts->workers > MAX_WORKERS || opts->max_batch < 1 ||
+        opts->max_wait_us < 0 || opts->queue_capacity < opts->max_batch ||
+        opts->cache_entries < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    static Server server;
+    if (parse_args(argc, argv, &server.options) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const ServerOptions* options = &server.options;
+
+    if (cnn_model_open(options->model_path, &server.model) != CNN_OK) {
+        fprintf(stderr, "Failed to load model %s. Have you trained the model?\n", options->model_path);
+        return 1;
+    }
+    if (options->cache_entries > 0) {
+        server.cache = prediction_cache_create((size_t)options->cache_entries);
+        if (server.cache == NULL) {
+            fprintf(stderr, "Failed to allocate the prediction cache\n");
+            return 1;
+        }
+    }
+
+    server.queue = (PendingRequest*)malloc(options->queue_capacity * sizeof(PendingRequest));
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&server.not_empty, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_cond_init(&server.not_full, NULL);
+    pthread_cond_init(&server.readers_done, NULL);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = open_listener(options->socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    for (int w = 0; w < options->workers; w++) {
+        Worker* worker = &server.workers[w];
+        worker->server = &server;
+        worker->session = cnn_session_create(server.model, options->max_batch);
+        if (worker->session == NULL) {
+            fprintf(stderr, "Failed to create an inference session\n");
+            return 1;
+        }
+        worker->taken = (PendingRequest*)malloc(options->max_batch * sizeof(PendingRequest));
+        worker->responses = (ServeResponse*)malloc(options->max_batch * sizeof(ServeResponse));
+        worker->keys = (uint64_t*)malloc(options->max_batch * sizeof(uint64_t));
+        worker->misses = (int*)malloc(options->max_batch * sizeof(int));
+        worker->pixels = (uint8_t*)malloc((size_t)options->max_batch * SERVE_IMAGE_SIZE);
+        worker->predicted = (int32_t*)malloc(options->max_batch * sizeof(int32_t));
+        worker->scores = (double*)malloc((size_t)options->max_batch * SERVE_NUM_CLASSES * sizeof(double));
+        pthread_create(&worker->thread, NULL, worker_thread, worker);
+    }
+
+    printf("cnn_server: serving %s on %s (%d workers, max batch %d, max wait %ld us)\n",
+           options->model_path, options->socket_path, options->workers, options->max_batch,
+           options->max_wait_us);
+    fflush(stdout);
+
+    double start = get_current_time_sec();
+    while (!g_stop) {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 200);
+        if (ready > 0 && (pfd.revents & POLLIN)) {
+            accept_connection(&server, listen_fd);
+        }
+    }
+    double uptime = get_current_time_sec() - start;
+
+    /* Stop accepting, unblock the readers, then let the workers drain. */
+    close(listen_fd);
+    unlink(options->socket_path);
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    for (Connection* conn = server.connections; conn != NULL; conn = conn->next) {
+        shutdown(conn->fd, SHUT_RD);
+    }
+    pthread_cond_broadcast(&server.not_empty);
+    pthread_cond_broadcast(&server.not_full);
+    while (server.readers > 0) {
+        pthread_cond_wait(&server.readers_done, &server.lock);
+    }
+    pthread_mutex_unlock(&server.lock);
+
+    ServerStats total;
+    memset(&total, 0, sizeof(total));
+    for (int w = 0; w < options->workers; w++) {
+        Worker* worker = &server.workers[w];
+        pthread_join(worker->thread, NULL);
+        total.requests += worker->stats.requests;
+        total.batches += worker->stats.batches;
+        total.full_batches += worker->stats.full_batches;
+        total.queue_time += worker->stats.queue_time;
+        total.compute_time += worker->stats.compute_time;
+        cnn_session_destroy(worker->session);
+        free(worker->taken);
+        free(worker->responses);
+        free(worker->keys);
+        free(worker->misses);
+        free(worker->pixels);
+        free(worker->predicted);
+        free(worker->scores);
+    }
+
+    printf("\ncnn_server: shutting down after %.1f s\n", uptime);
+    printf("  Requests:          %llu\n", (unsigned long long)total.requests);
+    if (total.batches > 0) {
+        printf("  Batches:           %llu (avg %.1f requests, %llu full)\n",
+               (unsigned long long)total.batches, (double)total.requests / total.batches,
+               (unsigned long long)total.full_batches);
+        printf("  Avg queue wait:    %.3f ms\n", total.queue_time * 1000.0 / total.requests);
+        printf("  Avg batch compute: %.3f ms\n", total.compute_time * 1000.0 / total.batches);
+    }
+    if (server.cache != NULL) {
+        PredictionCacheStats cache_stats;
+        prediction_cache_stats(server.cache, &cache_stats);
+        printf("  Cache:             %llu / %llu hits (%.1f%%), %llu evictions, %zu entries (%.1f MB)\n",
+               (unsigned long long)cache_stats.hits, (unsigned long long)cache_stats.lookups,
+               cache_stats.lookups ? cache_stats.hits * 100.0 / cache_stats.lookups : 0.0,
+               (unsigned long long)cache_stats.evictions, cache_stats.capacity,
+               cache_stats.bytes / (1024.0 * 1024.0));
+        prediction_cache_destroy(server.cache);
+    }
+
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.not_empty);
+    pthread_cond_destroy(&server.not_full);
+    pthread_cond_destroy(&server.readers_done);
+    free(server.queue);
+    cnn_model_close(server.model);
+    return 0;
+}
@@ -0,0 +1,387 @@
+/*
+  inference_stream.c
+  Streaming inference over stdin, a pipe or a FIFO.
+
+  Reads 28x28 images either as an IDX image stream (the header is parsed,
+  the item count is ignored and records are read until EOF) or as bare
+  784-byte records, and writes one prediction line per image to stdout as
+  soon as its chunk is classified. A reader thread fills a ring of --depth
+  chunks of --chunk records; the main thread classifies full chunks through
+  libcnn and prints them. If the input goes quiet for --flush-ms with
+  records buffered, the partial chunk is dispatched anyway, so a slow feed
+  is answered promptly. Memory stays at depth x chunk records whatever the
+  length of the input.
+
+  Output: "<index>\t<digit>" per image, plus ten "\t<score>" columns with
+  --scores. Statistics go to stderr.
+
+  Usage:
+  $ ./cnn_stream [input|-] [--model file] [--format auto|idx|raw]
+                 [--chunk N] [--depth N] [--flush-ms N] [--scores]
+  $ cat data/t10k-images-idx3-ubyte | ./cnn_stream > predictions.tsv
+*/
+
+#include "libcnn.h"
+#include "performance_metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_MODEL_PATH "models/cnn_model.bin"
+#define DEFAULT_CHUNK 64
+#define DEFAULT_DEPTH 4
+#define DEFAULT_FLUSH_MS 10
+#define IDX_IMAGE_MAGIC 0x00000803u
+#define IDX_HEADER_SIZE 16
+
+typedef enum {
+    FORMAT_AUTO,
+    FORMAT_IDX,
+    FORMAT_RAW
+} StreamFormat;
+
+typedef struct {
+    const char* input_path;         /* NULL: stdin */
+    const char* model_path;
+    StreamFormat format;
+    int chunk;
+    int depth;
+    int flush_ms;
+    int scores;
+} StreamOptions;
+
+typedef struct {
+    uint8_t* pixels;                /* chunk x CNN_INPUT_SIZE */
+    int count;
+    long first;                     /* Index of the chunk's first record */
+} Chunk;
+
+typedef struct {
+    const StreamOptions* options;
+    int fd;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    Chunk* chunks;                  /* Ring of options->depth chunks */
+    int head;
+    int count;
+    int done;                       /* Reader finished (EOF or error) */
+    int failed;
+
+    /* Reader statistics */
+    long records;
+    long timed_flushes;             /* Partial chunks sent after --flush-ms */
+    long trailing_bytes;            /* Incomplete record at EOF */
+} Stream;
+
+static int read_exact(int fd, uint8_t* buffer, size_t size, size_t* got) {
+    *got = 0;
+    while (*got < size) {
+        ssize_t n = read(fd, buffer + *got, size - *got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        *got += (size_t)n;
+    }
+    return 0;
+}
+
+static uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Waits for a free slot in the ring; it stays private until published. */
+static Chunk* acquire_chunk(Stream* stream, long first) {
+    pthread_mutex_lock(&stream->lock);
+    while (stream->count == stream->options->depth) {
+        pthread_cond_wait(&stream->not_full, &stream->lock);
+    }
+    Chunk* chunk = &stream->chunks[(stream->head + stream->count) % stream->options->depth];
+    pthread_mutex_unlock(&stream->lock);
+    chunk->count = 0;
+    chunk->first = first;
+    return chunk;
+}
+
+static void publish_chunk(Stream* stream, Chunk* chunk, int records) {
+    chunk->count = records;
+    pthread_mutex_lock(&stream->lock);
+    stream->count++;
+    stream->records += records;
+    pthread_cond_signal(&stream->not_empty);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+static void finish_reader(Stream* stream, int failed) {
+    pthread_mutex_lock(&stream->lock);
+    stream->done = 1;
+    stream->failed = failed;
+    pthread_cond_signal(&stream->not_empty);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+/* Reads the IDX header if there is one. The first bytes of a raw stream
+   are returned in prefix so they become part of the first record. */
+static int read_header(Stream* stream, uint8_t* prefix, size_t* prefix_size) {
+    const StreamOptions* options = stream->options;
+    *prefix_size = 0;
+    if (options->format == FORMAT_RAW) return 0;
+
+    uint8_t header[IDX_HEADER_SIZE];
+    size_t got;
+    if (read_exact(stream->fd, header, 4, &got) != 0) return -1;
+    if (got == 4 && read_be32(header) == IDX_IMAGE_MAGIC) {
+        if (read_exact(stream->fd, header + 4, IDX_HEADER_SIZE - 4, &got) != 0 ||
+            got != IDX_HEADER_SIZE - 4) {
+            fprintf(stderr, "Truncated IDX header\n");
+            return -1;
+        }
+        uint32_t rows = read_be32(header + 8);
+        uint32_t cols = read_be32(header + 12);
+        if (rows != CNN_INPUT_HEIGHT || cols != CNN_INPUT_WIDTH) {
+            fprintf(stderr, "IDX images are %ux%u, the model expects %dx%d\n",
+                    rows, cols, CNN_INPUT_HEIGHT, CNN_INPUT_WIDTH);
+            return -1;
+        }
+        return 0;
+    }
+    if (options->format == FORMAT_IDX) {
+        fprintf(stderr, "Input is not an IDX image stream\n");
+        return -1;
+    }
+    memcpy(prefix, header, got);
+    *prefix_size = got;
+    return 0;
+}
+
+static void* reader_thread(void* arg) {
+    Stream* stream = (Stream*)arg;
+    const StreamOptions* options = stream->options;
+    const size_t chunk_bytes = (size_t)options->chunk * CNN_INPUT_SIZE;
+
+    uint8_t prefix[4];
+    size_t filled;
+    if (read_header(stream, prefix, &filled) != 0) {
+        finish_reader(stream, 1);
+        return NULL;
+    }
+    long next_index = 0;
+    Chunk* chunk = acquire_chunk(stream, next_index);
+    memcpy(chunk->pixels, prefix, filled);
+
+    int failed = 0;
+    for (;;) {
+        /* Block indefinitely until the chunk holds a whole record. */
+        int timeout = (filled >= CNN_INPUT_SIZE) ? options->flush_ms : -1;
+        struct pollfd pfd = {stream->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR) continue;
+
+        ssize_t n = 0;
+        if (ready != 0) {
+            n = read(stream->fd, chunk->pixels + filled, chunk_bytes - filled);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                perror("read");
+                failed = 1;
+                break;
+            }
+            if (n == 0) break;
+            filled += (size_t)n;
+            if (filled < chunk_bytes) continue;
+        } else {
+            stream->timed_flushes++;
+        }
+
+        /* Full chunk or quiet input: send the whole records, carry the rest. */
+        int records = (int)(filled / CNN_INPUT_SIZE);
+        size_t carry = filled - (size_t)records * CNN_INPUT_SIZE;
+        uint8_t partial[CNN_INPUT_SIZE];
+        memcpy(partial, chunk->pixels + (size_t)records * CNN_INPUT_SIZE, carry);
+        publish_chunk(stream, chunk, records);
+        next_index += records;
+        chunk = acquire_chunk(stream, next_index);
+        memcpy(chunk->pixels, partial, carry);
+        filled = carry;
+    }
+
+    int records = (int)(filled / CNN_INPUT_SIZE);
+    stream->trailing_bytes = (long)(filled - (size_t)records * CNN_INPUT_SIZE);
+    if (records > 0) {
+        publish_chunk(stream, chunk, records);
+    }
+    finish_reader(stream, failed);
+    return NULL;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [input|-] [options]\n", program);
+    fprintf(stderr, "  input               IDX image file, FIFO or '-' for stdin (default stdin)\n");
+    fprintf(stderr, "  --model <file>      Model to use (default %s)\n", DEFAULT_MODEL_PATH);
+    fprintf(stderr, "  --format <f>        auto, idx or raw 784-byte records (default auto)\n");
+    fprintf(stderr, "  --chunk <n>         Records per forward pass (default %d)\n", DEFAULT_CHUNK);
+    fprintf(stderr, "  --depth <n>         Chunks buffered between reader and inference (default %d)\n",
+            DEFAULT_DEPTH);
+    fprintf(stderr, "  --flush-ms <n>      Send a partial chunk after n ms without input (default %d)\n",
+            DEFAULT_FLUSH_MS);
+    fprintf(stderr, "  --scores            Also print the ten output scores\n");
+}
+
+static int parse_args(int argc, char* argv[], StreamOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->model_path = DEFAULT_MODEL_PATH;
+    opts->format = FORMAT_AUTO;
+    opts->chunk = DEFAULT_CHUNK;
+    opts->depth = DEFAULT_DEPTH;
+    opts->flush_ms = DEFAULT_FLUSH_MS;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scores") == 0) {
+            opts->scores = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            if (i + 1 >= argc) return -1;
+            const char* value = argv[++i];
+            if (strcmp(argv[i - 1], "--model") == 0) {
+                opts->model_path = value;
+            } else if (strcmp(argv[i - 1], "--format") == 0) {
+                if (strcmp(value, "auto") == 0) opts->format = FORMAT_AUTO;
+                else if (strcmp(value, "idx") == 0) opts->format = FORMAT_IDX;
+                else if (strcmp(value, "raw") == 0) opts->format = FORMAT_RAW;
+                else return -1;
+            } else if (strcmp(argv[i - 1], "--chunk") == 0) {
+                opts->chunk = atoi(value);
+            } else if (strcmp(argv[i - 1], "--depth") == 0) {
+                opts->depth = atoi(value);
+            } else if (strcmp(argv[i - 1], "--flush-ms") == 0) {
+                opts->flush_ms = atoi(value);
+            } else {
+                return -1;
+            }
+        } else if (positional == 0) {
+            if (strcmp(argv[i], "-") != 0) opts->input_path = argv[i];
+            positional++;
+        } else {
+            return -1;
+        }
+    }
+    if (opts->chunk < 1 || opts->depth < 2 || opts->flush_ms < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    StreamOptions options;
+    if (parse_args(argc, argv, &options) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CnnModel* model;
+    CnnStatus status = cnn_model_open(options.model_path, &model);
+    if (status != CNN_OK) {
+        fprintf(stderr, "Failed to load model %s: %s\n", options.model_path, cnn_status_string(status));
+        return 1;
+    }
+    CnnSession* session = cnn_session_create(model, options.chunk);
+    if (session == NULL) {
+        fprintf(stderr, "Failed to create an inference session\n");
+        cnn_model_close(model);
+        return 1;
+    }
+
+    Stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.options = &options;
+    stream.fd = STDIN_FILENO;
+    if (options.input_path != NULL) {
+        /* Opening a FIFO blocks until a writer appears. */
+        stream.fd = open(options.input_path, O_RDONLY);
+        if (stream.fd < 0) {
+            fprintf(stderr, "Failed to open %s: %s\n", options.input_path, strerror(errno));
+            return 1;
+        }
+    }
+    stream.chunks = (Chunk*)calloc(options.depth, sizeof(Chunk));
+    for (int c = 0; c < options.depth; c++) {
+        stream.chunks[c].pixels = (uint8_t*)malloc((size_t)options.chunk * CNN_INPUT_SIZE);
+    }
+    int32_t* predicted = (int32_t*)malloc(options.chunk * sizeof(int32_t));
+    double* scores = (double*)malloc((size_t)options.chunk * CNN_NUM_CLASSES * sizeof(double));
+    pthread_mutex_init(&stream.lock, NULL);
+    pthread_cond_init(&stream.not_empty, NULL);
+    pthread_cond_init(&stream.not_full, NULL);
+
+    double start = get_current_time_sec();
+    double compute_time = 0.0;
+    long chunks = 0;
+    pthread_t reader;
+    pthread_create(&reader, NULL, reader_thread, &stream);
+
+    for (;;) {
+        pthread_mutex_lock(&stream.lock);
+        while (stream.count == 0 && !stream.done) {
+            pthread_cond_wait(&stream.not_empty, &stream.lock);
+        }
+        if (stream.count == 0) {
+            pthread_mutex_unlock(&stream.lock);
+            break;
+        }
+        Chunk* chunk = &stream.chunks[stream.head];
+        pthread_mutex_unlock(&stream.lock);
+
+        double t0 = get_current_time_sec();
+        cnn_infer_batch(session, chunk->pixels, chunk->count, predicted, options.scores ? scores : NULL);
+        compute_time += get_current_time_sec() - t0;
+        for (int s = 0; s < chunk->count; s++) {
+            printf("%ld\t%d", chunk->first + s, predicted[s]);
+            if (options.scores) {
+                for (int j = 0; j < CNN_NUM_CLASSES; j++) {
+                    printf("\t%.6f", scores[s * CNN_NUM_CLASSES + j]);
+                }
+            }
+            putchar('\n');
+        }
+        fflush(stdout);
+        chunks++;
+
+        pthread_mutex_lock(&stream.lock);
+        stream.head = (stream.head + 1) % options.depth;
+        stream.count--;
+        pthread_cond_signal(&stream.not_full);
+        pthread_mutex_unlock(&stream.lock);
+    }
+    pthread_join(reader, NULL);
+    double elapsed = get_current_time_sec() - start;
+
+    fprintf(stderr, "cnn_stream: %ld images in %ld chunks, %.3f s (%.0f images/s, %.1f%% in inference)\n",
+            stream.records, chunks, elapsed, elapsed > 0 ? stream.records / elapsed : 0.0,
+            elapsed > 0 ? compute_time * 100.0 / elapsed : 0.0);
+    fprintf(stderr, "  buffers: %d x %d records (%.1f KB), %ld partial chunk%s flushed on idle input\n",
+            options.depth, options.chunk, options.depth * (double)options.chunk * CNN_INPUT_SIZE / 1024.0,
+            stream.timed_flushes, stream.timed_flushes == 1 ? "" : "s");
+    if (stream.trailing_bytes > 0) {
+        fprintf(stderr, "  warning: ignored %ld trailing bytes (incomplete record)\n", stream.trailing_bytes);
+    }
+
+    pthread_mutex_destroy(&stream.lock);
+    pthread_cond_destroy(&stream.not_empty);
+    pthread_cond_destroy(&stream.not_full);
+    for (int c = 0; c < options.depth; c++) {
+        free(stream.chunks[c].pixels);
+    }
+    free(stream.chunks);
+    free(predicted);
+    free(scores);
+    if (stream.fd != STDIN_FILENO) close(stream.fd);
+    cnn_session_destroy(session);
+    cnn_model_close(model);
+    return stream.failed ? 1 : 0;
+}
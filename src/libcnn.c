@@ -0,0 +1,118 @@
+#include "libcnn.h"
+#include "cnn.h"
+#include "cnn_batch.h"
+#include "model_io.h"
+#include <stdlib.h>
+
+#define NUM_LAYERS MODEL_NUM_LAYERS
+
+struct CnnModel {
+    Layer* layers[NUM_LAYERS];
+};
+
+struct CnnSession {
+    const CnnModel* model;
+    int max_batch;
+    LayerBatch* batches[NUM_LAYERS];
+    double* inputs;             /* max_batch x CNN_INPUT_SIZE */
+    double* outputs;            /* max_batch x CNN_NUM_CLASSES */
+};
+
+int cnn_api_version(void) {
+    return CNN_API_VERSION;
+}
+
+const char* cnn_status_string(CnnStatus status) {
+    switch (status) {
+    case CNN_OK: return "ok";
+    case CNN_ERROR_ARGUMENT: return "invalid argument";
+    case CNN_ERROR_MEMORY: return "out of memory";
+    case CNN_ERROR_MODEL: return "cannot load model";
+    }
+    return "unknown error";
+}
+
+CnnStatus cnn_model_open(const char* path, CnnModel** model) {
+    if (path == NULL || model == NULL) return CNN_ERROR_ARGUMENT;
+    *model = NULL;
+
+    CnnModel* m = (CnnModel*)calloc(1, sizeof(CnnModel));
+    if (m == NULL) return CNN_ERROR_MEMORY;
+    /* The layer widths come from the file; the layers are created with
+       std 0, so rand() stays untouched. */
+    if (model_open_network(path, m->layers, NULL) != 0) {
+        free(m);
+        return CNN_ERROR_MODEL;
+    }
+    *model = m;
+    return CNN_OK;
+}
+
+void cnn_model_close(CnnModel* model) {
+    if (model == NULL) return;
+    model_destroy_network(model->layers);
+    free(model);
+}
+
+CnnSession* cnn_session_create(const CnnModel* model, int max_batch) {
+    if (model == NULL || max_batch < 1) return NULL;
+    CnnSession* session = (CnnSession*)calloc(1, sizeof(CnnSession));
+    if (session == NULL) return NULL;
+    session->model = model;
+    session->max_batch = max_batch;
+
+    /* The batch chain only reads the shared layers' weights and biases. */
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        session->batches[l] = LayerBatch_create(model->layers[l], (l > 0) ? session->batches[l - 1] : NULL,
+                                                max_batch);
+        if (session->batches[l] == NULL) {
+            cnn_session_destroy(session);
+            return NULL;
+        }
+    }
+    session->inputs = (double*)malloc((size_t)max_batch * CNN_INPUT_SIZE * sizeof(double));
+    session->outputs = (double*)malloc((size_t)max_batch * CNN_NUM_CLASSES * sizeof(double));
+    if (session->inputs == NULL || session->outputs == NULL) {
+        cnn_session_destroy(session);
+        return NULL;
+    }
+    return session;
+}
+
+void cnn_session_destroy(CnnSession* session) {
+    if (session == NULL) return;
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        if (session->batches[l] != NULL) LayerBatch_destroy(session->batches[l]);
+    }
+    free(session->inputs);
+    free(session->outputs);
+    free(session);
+}
+
+CnnStatus cnn_infer_batch(CnnSession* session, const uint8_t* images, int n,
+                          int32_t* predictions, double* scores) {
+    if (session == NULL || images == NULL || predictions == NULL || n < 1 || n > session->max_batch) {
+        return CNN_ERROR_ARGUMENT;
+    }
+    size_t count = (size_t)n * CNN_INPUT_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        session->inputs[i] = images[i] / 255.0;
+    }
+    LayerBatch_setInputs(session->batches[0], session->inputs, n);
+    LayerBatch_getOutputs(session->batches[NUM_LAYERS - 1], session->outputs, n);
+
+    for (int s = 0; s < n; s++) {
+        const double* y = &session->outputs[s * CNN_NUM_CLASSES];
+        int32_t best = 0;
+        for (int j = 1; j < CNN_NUM_CLASSES; j++) {
+            if (y[j] > y[best]) best = j;
+        }
+        predictions[s] = best;
+        if (scores != NULL) {
+            for (int j = 0; j < CNN_NUM_CLASSES; j++) {
+                scores[s * CNN_NUM_CLASSES + j] = y[j];
+            }
+        }
+    }
+    return CNN_OK;
+}
@@ -0,0 +1,69 @@
+/*
+  libcnn.h
+  Stable C inference API (libcnn.a / libcnn.so).
+
+  A CnnModel is the loaded, read-only network; open it once and share it
+  between any number of threads. A CnnSession is one thread's workspace
+  (activations and batch buffers) for a model: create one per thread that
+  runs inference. Calls on different sessions may run concurrently; a
+  single session must not be used by two threads at once. The library
+  keeps no global state.
+*/
+
+#ifndef LIBCNN_H
+#define LIBCNN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CNN_API __attribute__((visibility("default")))
+#else
+#define CNN_API
+#endif
+
+#define CNN_API_VERSION 1
+#define CNN_INPUT_WIDTH 28
+#define CNN_INPUT_HEIGHT 28
+#define CNN_INPUT_SIZE (CNN_INPUT_WIDTH * CNN_INPUT_HEIGHT)
+#define CNN_NUM_CLASSES 10
+
+typedef enum {
+    CNN_OK = 0,
+    CNN_ERROR_ARGUMENT = -1,    /* NULL pointer, n out of range, ... */
+    CNN_ERROR_MEMORY = -2,
+    CNN_ERROR_MODEL = -3        /* Missing, corrupt or mismatched model file */
+} CnnStatus;
+
+typedef struct CnnModel CnnModel;
+typedef struct CnnSession CnnSession;
+
+/* Version of this header the library was built with. */
+CNN_API int cnn_api_version(void);
+CNN_API const char* cnn_status_string(CnnStatus status);
+
+/* Loads a model written by train_cnn (models/cnn_model.bin or a distilled
+   student; the layer widths are read from the file). */
+CNN_API CnnStatus cnn_model_open(const char* path, CnnModel** model);
+
+/* All sessions of the model must be destroyed first. */
+CNN_API void cnn_model_close(CnnModel* model);
+
+/* Workspace for batches of up to max_batch images. NULL on failure. */
+CNN_API CnnSession* cnn_session_create(const CnnModel* model, int max_batch);
+CNN_API void cnn_session_destroy(CnnSession* session);
+
+/* Classifies n images (n x CNN_INPUT_SIZE bytes, row-major, 0-255).
+   predictions receives n class indices; scores, if not NULL, receives
+   n x CNN_NUM_CLASSES output activations. 1 <= n <= max_batch. */
+CNN_API CnnStatus cnn_infer_batch(CnnSession* session, const uint8_t* images, int n,
+                                  int32_t* predictions, double* scores);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
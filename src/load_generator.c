@@ -0,0 +1,244 @@
+/*
+  load_generator.c
+  Load generator for cnn_server.
+
+  Opens --concurrency connections, each driven by its own thread in a
+  closed loop: send one test image, wait for the prediction, repeat. The
+  requests are spread over the test set in order. Reports throughput
+  (QPS), latency percentiles measured at the client, and the accuracy of
+  the returned predictions.
+
+  Usage:
+  $ ./cnn_loadgen <test-images> <test-labels> [--socket path]
+                  [--concurrency N] [--requests N] [--json file] [--tag label]
+*/
+
+#include "mnist_loader.h"
+#include "performance_metrics.h"
+#include "serve_protocol.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_CONCURRENCY 16
+#define DEFAULT_REQUESTS 10000
+#define MAX_CONCURRENCY 1024
+
+typedef struct {
+    const char* images_path;
+    const char* labels_path;
+    const char* socket_path;
+    int concurrency;
+    long requests;
+    const char* json_path;
+    const char* tag;
+} LoadOptions;
+
+typedef struct {
+    const LoadOptions* options;
+    const MNISTImages* images;
+    const MNISTLabels* labels;
+    int index;
+    long first;                     /* Requests first .. first+count-1 */
+    long count;
+    double* latencies_ms;           /* Shared array, this client's slice */
+    long completed;
+    int correct;
+    int failed;
+    pthread_t thread;
+} Client;
+
+static void* client_thread(void* arg) {
+    Client* client = (Client*)arg;
+    int fd = serve_connect(client->options->socket_path);
+    if (fd < 0) {
+        client->failed = 1;
+        return NULL;
+    }
+
+    ServeRequest request;
+    ServeResponse response;
+    request.magic = SERVE_REQUEST_MAGIC;
+    for (long r = 0; r < client->count; r++) {
+        long n = client->first + r;
+        uint32_t image = (uint32_t)(n % client->images->num_images);
+        request.id = (uint32_t)n;
+        mnist_get_image(client->images, image, request.pixels);
+
+        double start = get_current_time_sec();
+        if (serve_write_full(fd, &request, sizeof(request)) != 0 ||
+            serve_read_full(fd, &response, sizeof(response)) != 0) {
+            fprintf(stderr, "Client %d: connection lost\n", client->index);
+            client->failed = 1;
+            break;
+        }
+        double end = get_current_time_sec();
+
+        if (response.magic != SERVE_RESPONSE_MAGIC || response.id != request.id ||
+            response.status != SERVE_STATUS_OK) {
+            fprintf(stderr, "Client %d: bad response to request %u\n", client->index, request.id);
+            client->failed = 1;
+            break;
+        }
+        client->latencies_ms[client->completed++] = (end - start) * 1000.0;
+        if (response.predicted == mnist_get_label(client->labels, image)) {
+            client->correct++;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --socket <path>      Server socket (default %s)\n", SERVE_DEFAULT_SOCKET);
+    fprintf(stderr, "  --concurrency <n>    Concurrent connections, one request in flight each (default %d)\n",
+            DEFAULT_CONCURRENCY);
+    fprintf(stderr, "  --requests <n>       Total requests (default %d)\n", DEFAULT_REQUESTS);
+    fprintf(stderr, "  --json <file>        Append a JSON results record to <file>\n");
+    fprintf(stderr, "  --tag <label>        Label stored in the JSON record\n");
+}
+
+static int parse_args(int argc, char* argv[], LoadOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->socket_path = SERVE_DEFAULT_SOCKET;
+    opts->concurrency = DEFAULT_CONCURRENCY;
+    opts->requests = DEFAULT_REQUESTS;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            if (i + 1 >= argc) return -1;
+            if (strcmp(argv[i], "--socket") == 0) {
+                opts->socket_path = argv[++i];
+            } else if (strcmp(argv[i], "--concurrency") == 0) {
+                opts->concurrency = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--requests") == 0) {
+                opts->requests = atol(argv[++i]);
+            } else if (strcmp(argv[i], "--json") == 0) {
+                opts->json_path = argv[++i];
+            } else if (strcmp(argv[i], "--tag") == 0) {
+                opts->tag = argv[++i];
+            } else {
+                return -1;
+            }
+        } else if (positional == 0) {
+            opts->images_path = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            opts->labels_path = argv[i];
+            positional++;
+        } else {
+            return -1;
+        }
+    }
+    if (positional != 2 || opts->concurrency < 1 || opts->concurrency > MAX_CONCURRENCY ||
+        opts->requests < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (parse_args(argc, argv, &options) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    MNISTImages images;
+    MNISTLabels labels;
+    if (mnist_load_images(options.images_path, &images) != 0 ||
+        mnist_load_labels(options.labels_path, &labels) != 0) {
+        fprintf(stderr, "Failed to load the test set\n");
+        return 1;
+    }
+
+    int concurrency = options.concurrency;
+    if (concurrency > options.requests) concurrency = (int)options.requests;
+    double* latencies_ms = (double*)malloc(options.requests * sizeof(double));
+    Client* clients = (Client*)calloc(concurrency, sizeof(Client));
+
+    printf("cnn_loadgen: %ld requests over %d connections to %s\n",
+           options.requests, concurrency, options.socket_path);
+
+    double start = get_current_time_sec();
+    for (int c = 0; c < concurrency; c++) {
+        Client* client = &clients[c];
+        client->options = &options;
+        client->images = &images;
+        client->labels = &labels;
+        client->index = c;
+        client->first = options.requests * c / concurrency;
+        client->count = options.requests * (c + 1) / concurrency - client->first;
+        client->latencies_ms = &latencies_ms[client->first];
+        pthread_create(&client->thread, NULL, client_thread, client);
+    }
+
+    long completed = 0;
+    int correct = 0;
+    int failed = 0;
+    for (int c = 0; c < concurrency; c++) {
+        pthread_join(clients[c].thread, NULL);
+    }
+    double elapsed = get_current_time_sec() - start;
+
+    /* Pack the per-client slices so the percentiles see every sample. */
+    for (int c = 0; c < concurrency; c++) {
+        memmove(&latencies_ms[completed], clients[c].latencies_ms, clients[c].completed * sizeof(double));
+        completed += clients[c].completed;
+        correct += clients[c].correct;
+        failed += clients[c].failed;
+    }
+    if (completed == 0) {
+        fprintf(stderr, "No request completed. Is cnn_server running on %s?\n", options.socket_path);
+        return 1;
+    }
+
+    PerformanceMetrics metrics;
+    metrics_init(&metrics);
+    metrics.num_processes = 1;
+    metrics.total_time = elapsed;
+    metrics.inference_time = elapsed;
+    metrics.total_images = (int)completed;
+    metrics.correct_predictions = correct;
+    metrics.accuracy = correct * 100.0 / completed;
+    metrics.throughput_images_per_sec = completed / elapsed;
+    double sum = 0.0;
+    for (long i = 0; i < completed; i++) {
+        sum += latencies_ms[i];
+        if (latencies_ms[i] < metrics.min_latency_ms) metrics.min_latency_ms = latencies_ms[i];
+        if (latencies_ms[i] > metrics.max_latency_ms) metrics.max_latency_ms = latencies_ms[i];
+    }
+    metrics.avg_latency_per_image_ms = sum / completed;
+    metrics_set_latency_percentiles(&metrics, latencies_ms, (int)completed);
+
+    printf("==========================================================================\n");
+    printf("                    LOAD GENERATOR SUMMARY                               \n");
+    printf("==========================================================================\n");
+    printf("  Requests:          %ld completed, %d connection%s failed\n", completed, failed,
+           failed == 1 ? "" : "s");
+    printf("  Concurrency:       %d\n", concurrency);
+    printf("  Throughput:        %.0f QPS\n", metrics.throughput_images_per_sec);
+    printf("  Latency (ms):      avg %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+           metrics.avg_latency_per_image_ms, metrics.p50_latency_ms, metrics.p95_latency_ms,
+           metrics.p99_latency_ms, metrics.max_latency_ms);
+    printf("  Accuracy:          %.2f%%\n", metrics.accuracy);
+    printf("==========================================================================\n");
+
+    if (options.json_path != NULL) {
+        RunConfig config;
+        run_config_init(&config, "cnn_server", 1);
+        config.images_path = options.images_path;
+        config.tag = options.tag;
+        metrics_append_json(options.json_path, &metrics, &config);
+    }
+
+    free(clients);
+    free(latencies_ms);
+    mnist_free_images(&images);
+    mnist_free_labels(&labels);
+    return failed ? 1 : 0;
+}
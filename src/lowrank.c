@@ -0,0 +1,187 @@
+#include "lowrank.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JACOBI_MAX_SWEEPS 64
+
+/* Cyclic Jacobi on the symmetric n x n matrix a (destroyed): the
+   eigenvalues end up on its diagonal, the eigenvectors in the columns
+   of v. */
+static void jacobi_eigen(double* a, double* v, int n) {
+    for (int i = 0; i < n * n; i++) v[i] = 0.0;
+    for (int i = 0; i < n; i++) v[i * n + i] = 1.0;
+
+    for (int sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++) {
+        double off = 0.0, diag = 0.0;
+        for (int p = 0; p < n; p++) {
+            diag += a[p * n + p] * a[p * n + p];
+            for (int q = p + 1; q < n; q++) off += a[p * n + q] * a[p * n + q];
+        }
+        if (off <= 1e-30 * diag) break;
+
+        for (int p = 0; p < n - 1; p++) {
+            for (int q = p + 1; q < n; q++) {
+                double apq = a[p * n + q];
+                if (apq == 0.0) continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < n; k++) {
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++) {
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++) {
+                    double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+LowRank* lowrank_create(Layer* layer) {
+    int nrows = layer->nnodes;
+    int ncols = layer->nweights / nrows;
+    if (layer->ltype != LAYER_FULL || nrows > ncols) return NULL;
+
+    LowRank* lr = (LowRank*)calloc(1, sizeof(LowRank));
+    double* gram = (double*)malloc((size_t)nrows * nrows * sizeof(double));
+    double* vectors = (double*)malloc((size_t)nrows * nrows * sizeof(double));
+    if (lr == NULL || gram == NULL || vectors == NULL) {
+        free(lr);
+        free(gram);
+        free(vectors);
+        return NULL;
+    }
+    lr->layer = layer;
+    lr->nrows = nrows;
+    lr->ncols = ncols;
+    lr->weights = (double*)malloc((size_t)layer->nweights * sizeof(double));
+    lr->sigma = (double*)malloc(nrows * sizeof(double));
+    lr->basis = (double*)malloc((size_t)nrows * nrows * sizeof(double));
+    if (lr->weights == NULL || lr->sigma == NULL || lr->basis == NULL) {
+        free(gram);
+        free(vectors);
+        lowrank_destroy(lr);
+        return NULL;
+    }
+    memcpy(lr->weights, layer->weights, (size_t)layer->nweights * sizeof(double));
+
+    /* G = W W^T */
+    const double* w = lr->weights;
+    for (int i = 0; i < nrows; i++) {
+        for (int j = i; j < nrows; j++) {
+            double x = 0.0;
+            for (int k = 0; k < ncols; k++) x += w[i * ncols + k] * w[j * ncols + k];
+            gram[i * nrows + j] = x;
+            gram[j * nrows + i] = x;
+        }
+    }
+    jacobi_eigen(gram, vectors, nrows);
+
+    /* Selection sort by eigenvalue, descending; sigma = sqrt(lambda). */
+    int* order = (int*)malloc(nrows * sizeof(int));
+    if (order == NULL) {
+        free(gram);
+        free(vectors);
+        lowrank_destroy(lr);
+        return NULL;
+    }
+    for (int i = 0; i < nrows; i++) order[i] = i;
+    for (int i = 0; i < nrows; i++) {
+        int best = i;
+        for (int j = i + 1; j < nrows; j++) {
+            if (gram[order[j] * nrows + order[j]] > gram[order[best] * nrows + order[best]]) best = j;
+        }
+        int tmp = order[i];
+        order[i] = order[best];
+        order[best] = tmp;
+
+        double lambda = gram[order[i] * nrows + order[i]];
+        lr->sigma[i] = lambda > 0.0 ? sqrt(lambda) : 0.0;
+        for (int k = 0; k < nrows; k++) {
+            lr->basis[i * nrows + k] = vectors[k * nrows + order[i]];
+        }
+    }
+    free(order);
+    free(gram);
+    free(vectors);
+    return lr;
+}
+
+void lowrank_destroy(LowRank* lr) {
+    if (lr == NULL) return;
+    free(lr->weights);
+    free(lr->sigma);
+    free(lr->basis);
+    free(lr);
+}
+
+int lowrank_max_rank(const LowRank* lr) {
+    return lr->nrows < LAYER_MAX_RANK ? lr->nrows : LAYER_MAX_RANK;
+}
+
+double lowrank_energy(const LowRank* lr, int rank) {
+    double kept = 0.0, total = 0.0;
+    for (int i = 0; i < lr->nrows; i++) {
+        double e = lr->sigma[i] * lr->sigma[i];
+        total += e;
+        if (i < rank) kept += e;
+    }
+    return total > 0.0 ? kept / total : 1.0;
+}
+
+int lowrank_break_even_rank(const LowRank* lr) {
+    long dense = (long)lr->nrows * lr->ncols;
+    int rank = (int)((dense - 1) / (lr->nrows + lr->ncols));
+    return rank < lowrank_max_rank(lr) ? rank : lowrank_max_rank(lr);
+}
+
+int lowrank_rank_for_energy(const LowRank* lr, double energy) {
+    int max_rank = lowrank_break_even_rank(lr);
+    for (int r = 1; r <= max_rank; r++) {
+        if (lowrank_energy(lr, r) >= energy) return r;
+    }
+    return 0;
+}
+
+int lowrank_apply(const LowRank* lr, int rank) {
+    if (rank < 1 || rank > lowrank_max_rank(lr)) return -1;
+    int nrows = lr->nrows, ncols = lr->ncols;
+    double* factor_in = (double*)calloc((size_t)rank * ncols, sizeof(double));
+    double* factor_out = (double*)malloc((size_t)nrows * rank * sizeof(double));
+    if (factor_in == NULL || factor_out == NULL) {
+        free(factor_in);
+        free(factor_out);
+        return -1;
+    }
+
+    /* factor_in row r = u_r^T W, factor_out column r = u_r */
+    for (int r = 0; r < rank; r++) {
+        const double* u = &lr->basis[r * nrows];
+        double* row = &factor_in[(size_t)r * ncols];
+        for (int i = 0; i < nrows; i++) {
+            const double* w = &lr->weights[(size_t)i * ncols];
+            for (int k = 0; k < ncols; k++) row[k] += u[i] * w[k];
+            factor_out[i * rank + r] = u[i];
+        }
+    }
+    int rc = Layer_factorize(lr->layer, rank, factor_in, factor_out);
+    free(factor_in);
+    free(factor_out);
+    return rc;
+}
+
+void lowrank_restore(const LowRank* lr) {
+    Layer_densify(lr->layer);
+    memcpy(lr->layer->weights, lr->weights, (size_t)lr->layer->nweights * sizeof(double));
+}
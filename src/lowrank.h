@@ -0,0 +1,48 @@
+#ifndef LOWRANK_H
+#define LOWRANK_H
+
+#include "cnn.h"
+
+/* Truncated SVD of a fully-connected layer's weights W (nnodes x inputs,
+   nnodes <= inputs, e.g. FC1 at 200 x 1568).
+
+   The singular values and left singular vectors u_i come from the
+   eigendecomposition of the small Gram matrix W W^T (cyclic Jacobi).
+   Keeping the top r gives W ~= U_r (U_r^T W): factor_out = U_r
+   (nnodes x r) and factor_in = U_r^T W (r x inputs), so the layer costs
+   r * (inputs + nnodes) multiply-adds instead of nnodes * inputs. The
+   nonlinearity stays after the second product; the first is linear. */
+
+typedef struct {
+    Layer* layer;
+    int nrows;                  /* nnodes */
+    int ncols;                  /* inputs */
+    double* weights;            /* The dense weights the SVD was taken of */
+    double* sigma;              /* Singular values, descending */
+    double* basis;              /* u_i as row i (nrows x nrows) */
+} LowRank;
+
+/* SVD of the layer's current weights; NULL if nnodes > inputs. */
+LowRank* lowrank_create(Layer* layer);
+void lowrank_destroy(LowRank* lr);
+
+/* Largest rank lowrank_apply accepts. */
+int lowrank_max_rank(const LowRank* lr);
+
+/* Fraction of sum(sigma^2) kept by the top rank singular values. */
+double lowrank_energy(const LowRank* lr, int rank);
+
+/* Largest rank with fewer multiply-adds than the dense layer (0 if none). */
+int lowrank_break_even_rank(const LowRank* lr);
+
+/* Smallest rank whose energy reaches the target; 0 if no rank up to the
+   break-even rank does. */
+int lowrank_rank_for_energy(const LowRank* lr, double energy);
+
+/* Factorizes the layer at this rank (Layer_factorize); returns 0 or -1. */
+int lowrank_apply(const LowRank* lr, int rank);
+
+/* Puts back the dense weights the SVD was taken of. */
+void lowrank_restore(const LowRank* lr);
+
+#endif
@@ -0,0 +1,606 @@
+/*
+  microbench.c
+  Kernel-level microbenchmarks for the cnn.c primitives.
+
+  Usage:
+  $ ./cnn_microbench [--warmup N] [--reps N] [--min-time MS] [--batch N]
+                     [--conv Cin,H,W,Cout,Hout,Wout,K,pad,stride]... [--full In,Out[,tanh|softmax]]...
+*/
+
+#include "cnn.h"
+#include "cnn_batch.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SHAPES 16
+#define DEFAULT_WARMUP 5
+#define DEFAULT_REPS 30
+#define DEFAULT_MIN_TIME_MS 2.0
+#define DEFAULT_BATCH 32
+#define CHECK_TOLERANCE 1e-9
+#define WINOGRAD_TOLERANCE 1e-12      /* Relative to the largest |output| */
+
+typedef struct {
+    LayerType ltype;
+    int in_depth, in_width, in_height;
+    int out_depth, out_width, out_height;
+    int kernsize, padding, stride;
+    int softmax;
+} KernelShape;
+
+typedef struct {
+    int warmup;
+    int reps;
+    double min_time_ms;
+    int batch;
+} BenchConfig;
+
+typedef struct {
+    double median_sec;
+    double mad_sec;
+    int inner;
+} BenchResult;
+
+typedef void (*KernelFn)(void* ctx);
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double* values, int n) {
+    qsort(values, n, sizeof(double), compare_double);
+    return (n % 2) ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+/* Runs fn enough times per repetition to cover min_time_ms, then reports the
+   median per-call time and the median absolute deviation across reps. */
+static BenchResult bench_run(const BenchConfig* config, KernelFn fn, void* ctx) {
+    BenchResult result;
+    int inner = 1;
+    for (;;) {
+        double t0 = now_sec();
+        for (int i = 0; i < inner; i++) fn(ctx);
+        double elapsed = now_sec() - t0;
+        if (elapsed * 1000.0 >= config->min_time_ms || inner >= (1 << 24)) break;
+        inner *= 2;
+    }
+
+    for (int w = 0; w < config->warmup; w++) {
+        for (int i = 0; i < inner; i++) fn(ctx);
+    }
+
+    double* samples = (double*)malloc(config->reps * sizeof(double));
+    double* deviations = (double*)malloc(config->reps * sizeof(double));
+    for (int r = 0; r < config->reps; r++) {
+        double t0 = now_sec();
+        for (int i = 0; i < inner; i++) fn(ctx);
+        samples[r] = (now_sec() - t0) / inner;
+    }
+
+    result.median_sec = median(samples, config->reps);
+    for (int r = 0; r < config->reps; r++) {
+        deviations[r] = fabs(samples[r] - result.median_sec);
+    }
+    result.mad_sec = median(deviations, config->reps);
+    result.inner = inner;
+
+    free(samples);
+    free(deviations);
+    return result;
+}
+
+/*  Scalar reference kernels (straightforward loops, used for correctness).
+    Like cnn.c, a conv kernel is indexed by (z1, dy, dx) only, so each output
+    channel applies the same k x k weights to every input channel.
+ */
+
+static void ref_conv_forward(const KernelShape* s, const double* in, const double* w,
+                             const double* b, double* out) {
+    int k = s->kernsize;
+    for (int z1 = 0; z1 < s->out_depth; z1++) {
+        for (int y1 = 0; y1 < s->out_height; y1++) {
+            for (int x1 = 0; x1 < s->out_width; x1++) {
+                double v = b[z1];
+                for (int z0 = 0; z0 < s->in_depth; z0++) {
+                    for (int dy = 0; dy < k; dy++) {
+                        for (int dx = 0; dx < k; dx++) {
+                            int y = y1 * s->stride - s->padding + dy;
+                            int x = x1 * s->stride - s->padding + dx;
+                            if (y < 0 || y >= s->in_height || x < 0 || x >= s->in_width) continue;
+                            v += in[(z0 * s->in_height + y) * s->in_width + x] *
+                                 w[(z1 * s->in_depth * k + dy) * k + dx];
+                        }
+                    }
+                }
+                out[(z1 * s->out_height + y1) * s->out_width + x1] = (v > 0) ? v : 0;
+            }
+        }
+    }
+}
+
+static void ref_conv_backward(const KernelShape* s, const double* in, const double* w,
+                              const double* dnet, double* din, double* dw, double* db) {
+    int k = s->kernsize;
+    int nin = s->in_depth * s->in_height * s->in_width;
+    memset(din, 0, nin * sizeof(double));
+    for (int z1 = 0; z1 < s->out_depth; z1++) {
+        for (int y1 = 0; y1 < s->out_height; y1++) {
+            for (int x1 = 0; x1 < s->out_width; x1++) {
+                double d = dnet[(z1 * s->out_height + y1) * s->out_width + x1];
+                for (int z0 = 0; z0 < s->in_depth; z0++) {
+                    for (int dy = 0; dy < k; dy++) {
+                        for (int dx = 0; dx < k; dx++) {
+                            int y = y1 * s->stride - s->padding + dy;
+                            int x = x1 * s->stride - s->padding + dx;
+                            if (y < 0 || y >= s->in_height || x < 0 || x >= s->in_width) continue;
+                            int p = (z0 * s->in_height + y) * s->in_width + x;
+                            int q = (z1 * s->in_depth * k + dy) * k + dx;
+                            din[p] += w[q] * d;
+                            dw[q] += d * in[p];
+                        }
+                    }
+                }
+                db[z1] += d;
+            }
+        }
+    }
+}
+
+static void ref_full_forward(int nin, int nout, int softmax, const double* in,
+                             const double* w, const double* b, double* out) {
+    for (int i = 0; i < nout; i++) {
+        double v = b[i];
+        for (int j = 0; j < nin; j++) v += w[i * nin + j] * in[j];
+        out[i] = softmax ? v : tanh(v);
+    }
+    if (softmax) {
+        double m = out[0], t = 0;
+        for (int i = 1; i < nout; i++) if (out[i] > m) m = out[i];
+        for (int i = 0; i < nout; i++) { out[i] = exp(out[i] - m); t += out[i]; }
+        for (int i = 0; i < nout; i++) out[i] /= t;
+    }
+}
+
+static void ref_full_backward(int nin, int nout, const double* in, const double* w,
+                              const double* dnet, double* din, double* dw, double* db) {
+    memset(din, 0, nin * sizeof(double));
+    for (int i = 0; i < nout; i++) {
+        for (int j = 0; j < nin; j++) {
+            din[j] += w[i * nin + j] * dnet[i];
+            dw[i * nin + j] += dnet[i] * in[j];
+        }
+        db[i] += dnet[i];
+    }
+}
+
+static double max_abs_diff(const double* a, const double* b, int n) {
+    double m = 0;
+    for (int i = 0; i < n; i++) {
+        double d = fabs(a[i] - b[i]);
+        if (d > m) m = d;
+    }
+    return m;
+}
+
+/*  Kernel wrappers
+ */
+
+typedef struct {
+    Layer* linput;
+    Layer* layer;
+    double* input;
+} KernelCtx;
+
+static void run_conv_forward(void* ctx) {
+    KernelCtx* c = (KernelCtx*)ctx;
+    Layer_feedForw_conv_withInput(c->layer, c->input);
+}
+
+static double max_abs(const double* a, int n) {
+    double m = 0;
+    for (int i = 0; i < n; i++) {
+        if (fabs(a[i]) > m) m = fabs(a[i]);
+    }
+    return m;
+}
+
+static void run_full_forward(void* ctx) {
+    KernelCtx* c = (KernelCtx*)ctx;
+    Layer_feedForw_full_withInput(c->layer, c->input);
+}
+
+static void run_conv_backward(void* ctx) {
+    KernelCtx* c = (KernelCtx*)ctx;
+    Layer_feedBack_conv(c->layer);
+}
+
+static void run_full_backward(void* ctx) {
+    KernelCtx* c = (KernelCtx*)ctx;
+    Layer_feedBack_full(c->layer);
+}
+
+static void run_update(void* ctx) {
+    KernelCtx* c = (KernelCtx*)ctx;
+    /* Rate 0 keeps the weights fixed across repetitions. */
+    Layer_update(c->layer, 0.0);
+}
+
+static void print_result(const char* kernel, const char* shape, const BenchResult* r,
+                         double flops, double bytes, const char* check) {
+    printf("  %-12s %-28s %10.3f %9.3f %9.2f %9.2f  %s\n",
+           kernel, shape, r->median_sec * 1e6, r->mad_sec * 1e6,
+           flops / r->median_sec * 1e-9, bytes / r->median_sec * 1e-9, check);
+}
+
+static int bench_shape(const BenchConfig* config, const KernelShape* s) {
+    int failures = 0;
+    char shape[64];
+    Layer* linput = Layer_create_input(s->in_depth, s->in_width, s->in_height);
+    Layer* lnext = NULL;
+    Layer* layer;
+    if (s->ltype == LAYER_CONV) {
+        layer = Layer_create_conv(linput, s->out_depth, s->out_width, s->out_height,
+                                  s->kernsize, s->padding, s->stride, 0.1);
+        snprintf(shape, sizeof(shape), "%dx%dx%d->%dx%dx%d k%ds%d",
+                 s->in_depth, s->in_height, s->in_width,
+                 s->out_depth, s->out_height, s->out_width, s->kernsize, s->stride);
+    } else {
+        layer = Layer_create_full(linput, s->out_depth, 0.1);
+        snprintf(shape, sizeof(shape), "%d->%d %s", linput->nnodes, layer->nnodes,
+                 s->softmax ? "softmax" : "tanh");
+        /* A full layer applies Tanh unless it is the last layer. */
+        if (!s->softmax) lnext = Layer_create_full(layer, 1, 0.1);
+    }
+    for (int i = 0; i < layer->nbiases; i++) {
+        layer->biases[i] = 0.01 * (rand() % 21 - 10);
+    }
+
+    int nin = linput->nnodes;
+    int nout = layer->nnodes;
+    for (int i = 0; i < nin; i++) {
+        linput->outputs[i] = (double)rand() / RAND_MAX;
+    }
+
+    KernelCtx ctx = { linput, layer, linput->outputs };
+    double* ref_out = (double*)calloc(nout, sizeof(double));
+    double* ref_din = (double*)calloc(nin, sizeof(double));
+    double* ref_dw = (double*)calloc(layer->nweights, sizeof(double));
+    double* ref_db = (double*)calloc(layer->nbiases, sizeof(double));
+    double* dnet = (double*)calloc(nout, sizeof(double));
+
+    /* FLOP and minimum-traffic models per call. */
+    double macs = (s->ltype == LAYER_CONV)
+        ? (double)nout * s->in_depth * s->kernsize * s->kernsize
+        : (double)nin * nout;
+    double wbytes = layer->nweights * sizeof(double);
+    double abytes = (nin + nout) * sizeof(double);
+
+    /* Forward. */
+    if (s->ltype == LAYER_CONV) {
+        run_conv_forward(&ctx);
+        ref_conv_forward(s, linput->outputs, layer->weights, layer->biases, ref_out);
+    } else {
+        run_full_forward(&ctx);
+        ref_full_forward(nin, nout, s->softmax, linput->outputs, layer->weights, layer->biases, ref_out);
+    }
+    double err = max_abs_diff(layer->outputs, ref_out, nout);
+    int ok = err <= CHECK_TOLERANCE;
+    failures += !ok;
+    BenchResult r = bench_run(config, (s->ltype == LAYER_CONV) ? run_conv_forward : run_full_forward, &ctx);
+    print_result("forward", shape, &r, 2 * macs, wbytes + abytes, ok ? "ok" : "MISMATCH");
+
+    /* Winograd F(2x2,3x3) for 3x3 stride-1 convolutions: a different
+       summation order, so it is checked to a relative tolerance and the
+       error is reported. GFLOP/s stay in direct-kernel FLOPs. */
+    if (s->ltype == LAYER_CONV && Layer_winograd(layer) == 0) {
+        char check[48];
+        run_conv_forward(&ctx);
+        double rel = max_abs_diff(layer->outputs, ref_out, nout) / fmax(max_abs(ref_out, nout), 1e-300);
+        ok = rel <= WINOGRAD_TOLERANCE;
+        failures += !ok;
+        snprintf(check, sizeof(check), "%s (rel. err %.1e)", ok ? "ok" : "MISMATCH", rel);
+        r = bench_run(config, run_conv_forward, &ctx);
+        print_result("winograd", shape, &r, 2 * macs, wbytes + abytes, check);
+        Layer_direct(layer);
+    }
+
+    /* Backward: one call from zeroed accumulators is checked, then timed. */
+    for (int i = 0; i < nout; i++) {
+        layer->errors[i] = (double)rand() / RAND_MAX - 0.5;
+        dnet[i] = layer->errors[i] * layer->gradients[i];
+    }
+    memset(layer->u_weights, 0, layer->nweights * sizeof(double));
+    memset(layer->u_biases, 0, layer->nbiases * sizeof(double));
+    if (s->ltype == LAYER_CONV) {
+        run_conv_backward(&ctx);
+        ref_conv_backward(s, linput->outputs, layer->weights, dnet, ref_din, ref_dw, ref_db);
+    } else {
+        run_full_backward(&ctx);
+        ref_full_backward(nin, nout, linput->outputs, layer->weights, dnet, ref_din, ref_dw, ref_db);
+    }
+    err = max_abs_diff(linput->errors, ref_din, nin);
+    double err_w = max_abs_diff(layer->u_weights, ref_dw, layer->nweights);
+    double err_b = max_abs_diff(layer->u_biases, ref_db, layer->nbiases);
+    if (err_w > err) err = err_w;
+    if (err_b > err) err = err_b;
+    ok = err <= CHECK_TOLERANCE;
+    failures += !ok;
+    r = bench_run(config, (s->ltype == LAYER_CONV) ? run_conv_backward : run_full_backward, &ctx);
+    print_result("backward", shape, &r, 4 * macs, 3 * wbytes + 2 * abytes, ok ? "ok" : "MISMATCH");
+
+    /* Optimizer step: read-modify-write of weights and updates. */
+    r = bench_run(config, run_update, &ctx);
+    print_result("update", shape, &r, 2.0 * (layer->nweights + layer->nbiases),
+                 4.0 * (layer->nweights + layer->nbiases) * sizeof(double), "-");
+
+    free(ref_out);
+    free(ref_din);
+    free(ref_dw);
+    free(ref_db);
+    free(dnet);
+    if (lnext != NULL) Layer_destroy(lnext);
+    Layer_destroy(layer);
+    Layer_destroy(linput);
+    return failures;
+}
+
+/*  Batched (GEMM) kernels from cnn_batch.c, checked sample by sample
+    against the per-sample cnn.c kernels and reported per sample.
+ */
+
+typedef struct {
+    LayerBatch* binput;
+    LayerBatch* blayer;
+    int n;
+} BatchCtx;
+
+static void run_batch_forward(void* ctx) {
+    BatchCtx* c = (BatchCtx*)ctx;
+    LayerBatch_feedForw(c->blayer, c->n);
+}
+
+static void run_batch_backward(void* ctx) {
+    BatchCtx* c = (BatchCtx*)ctx;
+    LayerBatch_feedBack(c->blayer, c->n);
+}
+
+static int bench_shape_batched(const BenchConfig* config, const KernelShape* s) {
+    int failures = 0;
+    int n = config->batch;
+    char shape[64];
+    char kernel[24];
+    Layer* linput = Layer_create_input(s->in_depth, s->in_width, s->in_height);
+    Layer* lnext = NULL;
+    Layer* layer;
+    if (s->ltype == LAYER_CONV) {
+        layer = Layer_create_conv(linput, s->out_depth, s->out_width, s->out_height,
+                                  s->kernsize, s->padding, s->stride, 0.1);
+        snprintf(shape, sizeof(shape), "%dx%dx%d->%dx%dx%d k%ds%d",
+                 s->in_depth, s->in_height, s->in_width,
+                 s->out_depth, s->out_height, s->out_width, s->kernsize, s->stride);
+    } else {
+        layer = Layer_create_full(linput, s->out_depth, 0.1);
+        snprintf(shape, sizeof(shape), "%d->%d %s", linput->nnodes, layer->nnodes,
+                 s->softmax ? "softmax" : "tanh");
+        if (!s->softmax) lnext = Layer_create_full(layer, 1, 0.1);
+    }
+    for (int i = 0; i < layer->nbiases; i++) {
+        layer->biases[i] = 0.01 * (rand() % 21 - 10);
+    }
+
+    int nin = linput->nnodes;
+    int nout = layer->nnodes;
+    LayerBatch* binput = LayerBatch_create(linput, NULL, n);
+    LayerBatch* blayer = LayerBatch_create(layer, binput, n);
+    for (int i = 0; i < n * nin; i++) {
+        binput->outputs[i] = (double)rand() / RAND_MAX;
+    }
+    BatchCtx ctx = { binput, blayer, n };
+
+    double macs = (s->ltype == LAYER_CONV)
+        ? (double)nout * s->in_depth * s->kernsize * s->kernsize
+        : (double)nin * nout;
+    double wbytes = layer->nweights * sizeof(double) / n;
+    double abytes = (nin + nout) * sizeof(double);
+
+    /* Forward: compare every sample with the per-sample kernel. */
+    LayerBatch_feedForw(blayer, n);
+    double err = 0;
+    for (int b = 0; b < n; b++) {
+        double* x = &binput->outputs[b * nin];
+        if (s->ltype == LAYER_CONV) Layer_feedForw_conv_withInput(layer, x);
+        else Layer_feedForw_full_withInput(layer, x);
+        double e = max_abs_diff(layer->outputs, &blayer->outputs[b * nout], nout);
+        if (e > err) err = e;
+    }
+    int ok = err <= CHECK_TOLERANCE;
+    failures += !ok;
+    BenchResult r = bench_run(config, run_batch_forward, &ctx);
+    r.median_sec /= n;
+    r.mad_sec /= n;
+    snprintf(kernel, sizeof(kernel), "fwd-b%d", n);
+    print_result(kernel, shape, &r, 2 * macs, wbytes + abytes, ok ? "ok" : "MISMATCH");
+
+    if (s->ltype == LAYER_CONV && Layer_winograd(layer) == 0) {
+        char check[48];
+        double* direct = (double*)malloc((size_t)n * nout * sizeof(double));
+        memcpy(direct, blayer->outputs, (size_t)n * nout * sizeof(double));
+        LayerBatch_feedForw(blayer, n);
+        double rel = max_abs_diff(blayer->outputs, direct, n * nout) / fmax(max_abs(direct, n * nout), 1e-300);
+        ok = rel <= WINOGRAD_TOLERANCE;
+        failures += !ok;
+        snprintf(check, sizeof(check), "%s (rel. err %.1e)", ok ? "ok" : "MISMATCH", rel);
+        r = bench_run(config, run_batch_forward, &ctx);
+        r.median_sec /= n;
+        r.mad_sec /= n;
+        snprintf(kernel, sizeof(kernel), "wino-b%d", n);
+        print_result(kernel, shape, &r, 2 * macs, wbytes + abytes, check);
+        Layer_direct(layer);
+        LayerBatch_feedForw(blayer, n);
+        free(direct);
+    }
+
+    /* Backward: accumulated dW/dB over the batch and per-sample dX. */
+    for (int i = 0; i < n * nout; i++) {
+        blayer->errors[i] = (double)rand() / RAND_MAX - 0.5;
+    }
+    memset(layer->u_weights, 0, layer->nweights * sizeof(double));
+    memset(layer->u_biases, 0, layer->nbiases * sizeof(double));
+    LayerBatch_feedBack(blayer, n);
+    double* batch_dw = (double*)malloc(layer->nweights * sizeof(double));
+    double* batch_db = (double*)malloc(layer->nbiases * sizeof(double));
+    memcpy(batch_dw, layer->u_weights, layer->nweights * sizeof(double));
+    memcpy(batch_db, layer->u_biases, layer->nbiases * sizeof(double));
+
+    memset(layer->u_weights, 0, layer->nweights * sizeof(double));
+    memset(layer->u_biases, 0, layer->nbiases * sizeof(double));
+    err = 0;
+    for (int b = 0; b < n; b++) {
+        memcpy(linput->outputs, &binput->outputs[b * nin], nin * sizeof(double));
+        if (s->ltype == LAYER_CONV) Layer_feedForw_conv_withInput(layer, linput->outputs);
+        else Layer_feedForw_full_withInput(layer, linput->outputs);
+        memcpy(layer->errors, &blayer->errors[b * nout], nout * sizeof(double));
+        if (s->ltype == LAYER_CONV) Layer_feedBack_conv(layer);
+        else Layer_feedBack_full(layer);
+        double e = max_abs_diff(linput->errors, &binput->errors[b * nin], nin);
+        if (e > err) err = e;
+    }
+    double err_w = max_abs_diff(layer->u_weights, batch_dw, layer->nweights);
+    double err_b = max_abs_diff(layer->u_biases, batch_db, layer->nbiases);
+    if (err_w > err) err = err_w;
+    if (err_b > err) err = err_b;
+    ok = err <= CHECK_TOLERANCE;
+    failures += !ok;
+    r = bench_run(config, run_batch_backward, &ctx);
+    r.median_sec /= n;
+    r.mad_sec /= n;
+    snprintf(kernel, sizeof(kernel), "bwd-b%d", n);
+    print_result(kernel, shape, &r, 4 * macs, 3 * wbytes + 2 * abytes, ok ? "ok" : "MISMATCH");
+
+    free(batch_dw);
+    free(batch_db);
+    LayerBatch_destroy(blayer);
+    LayerBatch_destroy(binput);
+    if (lnext != NULL) Layer_destroy(lnext);
+    Layer_destroy(layer);
+    Layer_destroy(linput);
+    return failures;
+}
+
+static int parse_conv(const char* arg, KernelShape* s) {
+    memset(s, 0, sizeof(*s));
+    s->ltype = LAYER_CONV;
+    int n = sscanf(arg, "%d,%d,%d,%d,%d,%d,%d,%d,%d",
+                   &s->in_depth, &s->in_height, &s->in_width,
+                   &s->out_depth, &s->out_height, &s->out_width,
+                   &s->kernsize, &s->padding, &s->stride);
+    if (n != 9 || s->kernsize % 2 != 1 || s->stride < 1 ||
+        (s->out_width - 1) * s->stride + s->kernsize > s->in_width + s->padding * 2 ||
+        (s->out_height - 1) * s->stride + s->kernsize > s->in_height + s->padding * 2) {
+        fprintf(stderr, "Invalid conv shape: %s\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_full(const char* arg, KernelShape* s) {
+    memset(s, 0, sizeof(*s));
+    s->ltype = LAYER_FULL;
+    s->in_width = s->in_height = 1;
+    s->out_width = s->out_height = 1;
+    char activation[16] = "tanh";
+    int n = sscanf(arg, "%d,%d,%15s", &s->in_depth, &s->out_depth, activation);
+    s->softmax = (strcmp(activation, "softmax") == 0);
+    if (n < 2 || s->in_depth < 1 || s->out_depth < 1 ||
+        (!s->softmax && strcmp(activation, "tanh") != 0)) {
+        fprintf(stderr, "Invalid full shape: %s\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--warmup N] [--reps N] [--min-time MS] [--batch N]\n", program);
+    fprintf(stderr, "       [--conv Cin,H,W,Cout,Hout,Wout,K,pad,stride]... [--full In,Out[,tanh|softmax]]...\n");
+    fprintf(stderr, "Without shapes, the layers of the MNIST model are benchmarked.\n");
+    fprintf(stderr, "--batch N also runs the batched GEMM kernels (default %d, 0 disables).\n", DEFAULT_BATCH);
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config = { DEFAULT_WARMUP, DEFAULT_REPS, DEFAULT_MIN_TIME_MS, DEFAULT_BATCH };
+    KernelShape shapes[MAX_SHAPES];
+    int nshapes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+            config.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && has_value) {
+            config.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0 && has_value) {
+            config.min_time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && has_value) {
+            config.batch = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--conv") == 0 || strcmp(argv[i], "--full") == 0) && has_value) {
+            if (nshapes == MAX_SHAPES) {
+                fprintf(stderr, "Too many shapes (max %d)\n", MAX_SHAPES);
+                return 1;
+            }
+            int rc = (argv[i][2] == 'c') ? parse_conv(argv[i + 1], &shapes[nshapes])
+                                         : parse_full(argv[i + 1], &shapes[nshapes]);
+            if (rc != 0) return 1;
+            nshapes++;
+            i++;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.reps < 1) config.reps = 1;
+    if (config.warmup < 0) config.warmup = 0;
+
+    if (nshapes == 0) {
+        parse_conv("1,28,28,16,14,14,3,1,2", &shapes[nshapes++]);
+        parse_conv("16,14,14,32,7,7,3,1,2", &shapes[nshapes++]);
+        parse_conv("16,14,14,32,14,14,3,1,1", &shapes[nshapes++]);
+        parse_full("1568,200", &shapes[nshapes++]);
+        parse_full("200,200", &shapes[nshapes++]);
+        parse_full("200,10,softmax", &shapes[nshapes++]);
+    }
+
+    srand(0);
+    printf("========================================================================\n");
+    printf("  CNN KERNEL MICROBENCHMARKS (%s, %s)\n", CNN_KERNEL_BACKEND, CNN_PRECISION);
+    printf("  warmup=%d reps=%d min-time=%.1f ms\n", config.warmup, config.reps, config.min_time_ms);
+    printf("========================================================================\n");
+    printf("  %-12s %-28s %10s %9s %9s %9s  %s\n",
+           "Kernel", "Shape", "Median(us)", "MAD(us)", "GFLOP/s", "GB/s", "Check");
+    printf("------------------------------------------------------------------------\n");
+
+    int failures = 0;
+    for (int i = 0; i < nshapes; i++) {
+        failures += bench_shape(&config, &shapes[i]);
+        if (config.batch > 0) {
+            failures += bench_shape_batched(&config, &shapes[i]);
+        }
+    }
+
+    printf("========================================================================\n");
+    if (failures > 0) {
+        printf("  ✗ %d kernel(s) disagree with the scalar reference\n", failures);
+        return 1;
+    }
+    printf("  ✓ All kernels match the scalar reference\n");
+    return 0;
+}
@@ -61,7 +61,7 @@ IdxFile* IdxFile_read(FILE* fp)
     if (self->dims == NULL) return NULL;
     
     if (fread(self->dims, sizeof(uint32_t), self->ndims, fp) == self->ndims) {
-        uint32_t nbytes = sizeof(uint8_t);
+        size_t nbytes = sizeof(uint8_t);
         for (int i = 0; i < self->ndims; i++) {
             /* Fix the byte order. */
             uint32_t size = be32toh(self->dims[i]);
@@ -74,10 +74,16 @@ IdxFile* IdxFile_read(FILE* fp)
         /* Read the data. */
         self->data = (uint8_t*) malloc(nbytes);
         if (self->data != NULL) {
-            fread(self->data, sizeof(uint8_t), nbytes, fp);
+            size_t n = fread(self->data, sizeof(uint8_t), nbytes, fp);
 #if DEBUG_IDXFILE
-            fprintf(stderr, "IdxFile_read: read: %lu bytes\n", n);
+            fprintf(stderr, "IdxFile_read: read: %zu bytes\n", n);
 #endif
+            if (n != nbytes) {
+                free(self->data);
+                free(self->dims);
+                free(self);
+                return NULL;
+            }
         }
     }
 
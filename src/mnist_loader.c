@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 #ifdef __APPLE__
 #include <libkern/OSByteOrder.h>
@@ -18,36 +19,146 @@ static uint32_t read_be32(FILE* fp) {
     return be32toh(value);
 }
 
-int mnist_load_images(const char* filepath, MNISTImages* images) {
+/* Opens an IDX3 image file and reads its header; the stream is left at the
+   first pixel. */
+static FILE* open_images(const char* filepath, MNISTImages* images) {
     if (filepath == NULL || images == NULL) {
         fprintf(stderr, "Invalid arguments to mnist_load_images\n");
-        return -1;
+        return NULL;
     }
     
     FILE* fp = fopen(filepath, "rb");
     if (fp == NULL) {
         fprintf(stderr, "Failed to open image file: %s\n", filepath);
-        return -1;
+        return NULL;
     }
     
     uint32_t magic = read_be32(fp);
     if (magic != 0x00000803) {
         fprintf(stderr, "Invalid MNIST image file magic: 0x%X\n", magic);
         fclose(fp);
-        return -1;
+        return NULL;
     }
     
     images->num_images = read_be32(fp);
     images->num_rows = read_be32(fp);
     images->num_cols = read_be32(fp);
+    images->data = NULL;
     
     if (images->num_images == 0 || images->num_rows == 0 || images->num_cols == 0) {
         fprintf(stderr, "Invalid MNIST image dimensions\n");
         fclose(fp);
+        return NULL;
+    }
+    if (images->num_rows != MNIST_ROWS || images->num_cols != MNIST_COLS) {
+        fprintf(stderr, "%s: %ux%u images, but the network takes %dx%d\n",
+                filepath, images->num_rows, images->num_cols, MNIST_ROWS, MNIST_COLS);
+        fclose(fp);
+        return NULL;
+    }
+    
+    return fp;
+}
+
+/* Opens an IDX1 label file and reads its header. */
+static FILE* open_labels(const char* filepath, MNISTLabels* labels) {
+    if (filepath == NULL || labels == NULL) {
+        fprintf(stderr, "Invalid arguments to mnist_load_labels\n");
+        return NULL;
+    }
+    
+    FILE* fp = fopen(filepath, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open label file: %s\n", filepath);
+        return NULL;
+    }
+    
+    uint32_t magic = read_be32(fp);
+    if (magic != 0x00000801) {
+        fprintf(stderr, "Invalid MNIST label file magic: 0x%X\n", magic);
+        fclose(fp);
+        return NULL;
+    }
+    
+    labels->num_labels = read_be32(fp);
+    labels->labels = NULL;
+    
+    if (labels->num_labels == 0) {
+        fprintf(stderr, "Invalid MNIST label count\n");
+        fclose(fp);
+        return NULL;
+    }
+    
+    return fp;
+}
+
+int mnist_load_images(const char* filepath, MNISTImages* images) {
+    MNISTImages header;
+    FILE* fp = open_images(filepath, &header);
+    if (fp == NULL) {
+        return -1;
+    }
+    fclose(fp);
+    return mnist_load_images_range(filepath, 0, header.num_images, images);
+}
+
+int mnist_load_labels(const char* filepath, MNISTLabels* labels) {
+    MNISTLabels header;
+    FILE* fp = open_labels(filepath, &header);
+    if (fp == NULL) {
+        return -1;
+    }
+    fclose(fp);
+    return mnist_load_labels_range(filepath, 0, header.num_labels, labels);
+}
+
+/* Reads only the image header (counts and dimensions); header->data stays
+   NULL. Fails unless the label file holds exactly as many labels, so the
+   range loaders can then be given the same range for both files. */
+int mnist_read_header(const char* images_path, const char* labels_path, MNISTImages* header) {
+    FILE* fp = open_images(images_path, header);
+    if (fp == NULL) {
+        return -1;
+    }
+    fclose(fp);
+    
+    MNISTLabels labels;
+    fp = open_labels(labels_path, &labels);
+    if (fp == NULL) {
+        return -1;
+    }
+    fclose(fp);
+    
+    if (labels.num_labels != header->num_images) {
+        fprintf(stderr, "Label count %u does not match image count %u (%s, %s)\n",
+                labels.num_labels, header->num_images, labels_path, images_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Loads images [start, start+count) so each process only holds its shard. */
+int mnist_load_images_range(const char* filepath, uint32_t start, uint32_t count, MNISTImages* images) {
+    FILE* fp = open_images(filepath, images);
+    if (fp == NULL) {
+        return -1;
+    }
+    
+    if (count == 0 || start > images->num_images || count > images->num_images - start) {
+        fprintf(stderr, "Invalid image range [%u, %u) for %u images\n",
+                start, start + count, images->num_images);
+        fclose(fp);
+        return -1;
+    }
+    
+    size_t image_size = (size_t)images->num_rows * images->num_cols;
+    if (fseeko(fp, (off_t)(16 + (uint64_t)start * image_size), SEEK_SET) != 0) {
+        fprintf(stderr, "Failed to seek to image %u\n", start);
+        fclose(fp);
         return -1;
     }
     
-    size_t total_size = (size_t)images->num_images * images->num_rows * images->num_cols;
+    size_t total_size = (size_t)count * image_size;
     images->data = (uint8_t*)malloc(total_size);
     if (images->data == NULL) {
         fprintf(stderr, "Failed to allocate memory for images\n");
@@ -58,54 +169,50 @@ int mnist_load_images(const char* filepath, MNISTImages* images) {
     if (fread(images->data, 1, total_size, fp) != total_size) {
         fprintf(stderr, "Failed to read image data\n");
         free(images->data);
+        images->data = NULL;
         fclose(fp);
         return -1;
     }
+    images->num_images = count;
     
     fclose(fp);
     return 0;
 }
 
-int mnist_load_labels(const char* filepath, MNISTLabels* labels) {
-    if (filepath == NULL || labels == NULL) {
-        fprintf(stderr, "Invalid arguments to mnist_load_labels\n");
-        return -1;
-    }
-    
-    FILE* fp = fopen(filepath, "rb");
+int mnist_load_labels_range(const char* filepath, uint32_t start, uint32_t count, MNISTLabels* labels) {
+    FILE* fp = open_labels(filepath, labels);
     if (fp == NULL) {
-        fprintf(stderr, "Failed to open label file: %s\n", filepath);
         return -1;
     }
     
-    uint32_t magic = read_be32(fp);
-    if (magic != 0x00000801) {
-        fprintf(stderr, "Invalid MNIST label file magic: 0x%X\n", magic);
+    if (count == 0 || start > labels->num_labels || count > labels->num_labels - start) {
+        fprintf(stderr, "Invalid label range [%u, %u) for %u labels\n",
+                start, start + count, labels->num_labels);
         fclose(fp);
         return -1;
     }
     
-    labels->num_labels = read_be32(fp);
-    
-    if (labels->num_labels == 0) {
-        fprintf(stderr, "Invalid MNIST label count\n");
+    if (fseeko(fp, (off_t)(8 + (uint64_t)start), SEEK_SET) != 0) {
+        fprintf(stderr, "Failed to seek to label %u\n", start);
         fclose(fp);
         return -1;
     }
     
-    labels->labels = (uint8_t*)malloc(labels->num_labels);
+    labels->labels = (uint8_t*)malloc(count);
     if (labels->labels == NULL) {
         fprintf(stderr, "Failed to allocate memory for labels\n");
         fclose(fp);
         return -1;
     }
     
-    if (fread(labels->labels, 1, labels->num_labels, fp) != labels->num_labels) {
+    if (fread(labels->labels, 1, count, fp) != count) {
         fprintf(stderr, "Failed to read label data\n");
         free(labels->labels);
+        labels->labels = NULL;
         fclose(fp);
         return -1;
     }
+    labels->num_labels = count;
     
     fclose(fp);
     return 0;
@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* The network's input layer is 1x28x28; the loaders reject other sizes. */
+#define MNIST_ROWS 28
+#define MNIST_COLS 28
+
 typedef struct {
     uint32_t num_images;
     uint32_t num_rows;
@@ -18,6 +22,9 @@ typedef struct {
 
 int mnist_load_images(const char* filepath, MNISTImages* images);
 int mnist_load_labels(const char* filepath, MNISTLabels* labels);
+int mnist_read_header(const char* images_path, const char* labels_path, MNISTImages* header);
+int mnist_load_images_range(const char* filepath, uint32_t start, uint32_t count, MNISTImages* images);
+int mnist_load_labels_range(const char* filepath, uint32_t start, uint32_t count, MNISTLabels* labels);
 void mnist_free_images(MNISTImages* images);
 void mnist_free_labels(MNISTLabels* labels);
 
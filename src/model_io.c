@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+const ModelTopology MODEL_TOPOLOGY_DEFAULT = {16, 32, 200, 200};
+
 static uint32_t calculate_checksum(FILE* fp, long start_pos, size_t length) {
     (void)fp;
     (void)start_pos;
@@ -9,7 +11,17 @@ static uint32_t calculate_checksum(FILE* fp, long start_pos, size_t length) {
     return 0;
 }
 
-static void write_layer_data(FILE* fp, Layer* layer) {
+static int layer_encoding(const Layer* layer) {
+    if (layer->ltype != LAYER_FULL) return MODEL_ENCODING_DENSE;
+    if (layer->data.full.rowptr != NULL) return MODEL_ENCODING_CSR;
+    if (layer->data.full.rank > 0) return MODEL_ENCODING_LOWRANK;
+    return MODEL_ENCODING_DENSE;
+}
+
+/* Version 2 adds an encoding word after the counts; CSR layers store
+   nnz, row starts, columns and values in place of the dense weights,
+   low-rank layers the rank and both factors. */
+static void write_layer_data(FILE* fp, Layer* layer, uint32_t version) {
     if (layer == NULL) return;
     
     int nweights = layer->nweights;
@@ -18,6 +30,26 @@ static void write_layer_data(FILE* fp, Layer* layer) {
     fwrite(&nweights, sizeof(int), 1, fp);
     fwrite(&nbiases, sizeof(int), 1, fp);
     
+    if (version >= MODEL_VERSION_SPARSE) {
+        int encoding = layer_encoding(layer);
+        fwrite(&encoding, sizeof(int), 1, fp);
+        if (encoding == MODEL_ENCODING_CSR) {
+            int nnz = layer->data.full.nnz;
+            fwrite(&nnz, sizeof(int), 1, fp);
+            fwrite(layer->data.full.rowptr, sizeof(int), layer->nnodes + 1, fp);
+            fwrite(layer->data.full.cols, sizeof(int), nnz, fp);
+            fwrite(layer->data.full.values, sizeof(double), nnz, fp);
+            nweights = 0;
+        } else if (encoding == MODEL_ENCODING_LOWRANK) {
+            int rank = layer->data.full.rank;
+            int nin = layer->nweights / layer->nnodes;
+            fwrite(&rank, sizeof(int), 1, fp);
+            fwrite(layer->data.full.factor_in, sizeof(double), (size_t)rank * nin, fp);
+            fwrite(layer->data.full.factor_out, sizeof(double), (size_t)layer->nnodes * rank, fp);
+            nweights = 0;
+        }
+    }
+    
     if (nweights > 0 && layer->weights != NULL) {
         fwrite(layer->weights, sizeof(double), nweights, fp);
     }
@@ -27,7 +59,60 @@ static void write_layer_data(FILE* fp, Layer* layer) {
     }
 }
 
-static int read_layer_data(FILE* fp, Layer* layer) {
+/* Expands a CSR record into the dense weights and keeps the CSR for
+   the sparse kernels. */
+static int read_layer_csr(FILE* fp, Layer* layer) {
+    int nnz;
+    if (layer->ltype != LAYER_FULL) return -1;
+    if (fread(&nnz, sizeof(int), 1, fp) != 1 || nnz < 0 || nnz > layer->nweights) return -1;
+    
+    int nrows = layer->nnodes;
+    int nin = layer->nweights / nrows;
+    int* rowptr = (int*)malloc((nrows + 1) * sizeof(int));
+    int* cols = (int*)malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    double* values = (double*)malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+    int ok = rowptr != NULL && cols != NULL && values != NULL &&
+             fread(rowptr, sizeof(int), nrows + 1, fp) == (size_t)(nrows + 1) &&
+             fread(cols, sizeof(int), nnz, fp) == (size_t)nnz &&
+             fread(values, sizeof(double), nnz, fp) == (size_t)nnz &&
+             rowptr[0] == 0 && rowptr[nrows] == nnz;
+    
+    memset(layer->weights, 0, layer->nweights * sizeof(double));
+    for (int i = 0; ok && i < nrows; i++) {
+        if (rowptr[i] > rowptr[i + 1]) ok = 0;
+        for (int p = rowptr[i]; ok && p < rowptr[i + 1]; p++) {
+            if (cols[p] < 0 || cols[p] >= nin) ok = 0;
+            else layer->weights[i * nin + cols[p]] = values[p];
+        }
+    }
+    free(rowptr);
+    free(cols);
+    free(values);
+    if (!ok) return -1;
+    return Layer_sparsify(layer) == nnz ? 0 : -1;
+}
+
+/* Reads both factors; Layer_factorize rebuilds the dense weights. */
+static int read_layer_lowrank(FILE* fp, Layer* layer) {
+    int rank;
+    if (layer->ltype != LAYER_FULL) return -1;
+    if (fread(&rank, sizeof(int), 1, fp) != 1 || rank < 1 || rank > LAYER_MAX_RANK) return -1;
+    
+    int nin = layer->nweights / layer->nnodes;
+    size_t nfin = (size_t)rank * nin;
+    size_t nfout = (size_t)layer->nnodes * rank;
+    double* factor_in = (double*)malloc(nfin * sizeof(double));
+    double* factor_out = (double*)malloc(nfout * sizeof(double));
+    int ok = factor_in != NULL && factor_out != NULL &&
+             fread(factor_in, sizeof(double), nfin, fp) == nfin &&
+             fread(factor_out, sizeof(double), nfout, fp) == nfout &&
+             Layer_factorize(layer, rank, factor_in, factor_out) == 0;
+    free(factor_in);
+    free(factor_out);
+    return ok ? 0 : -1;
+}
+
+static int read_layer_data(FILE* fp, Layer* layer, uint32_t version) {
     if (layer == NULL) return -1;
     
     int nweights, nbiases;
@@ -41,6 +126,23 @@ static int read_layer_data(FILE* fp, Layer* layer) {
         return -1;
     }
     
+    if (layer->ltype == LAYER_FULL) {
+        Layer_densify(layer);
+    }
+    if (version >= MODEL_VERSION_SPARSE) {
+        int encoding;
+        if (fread(&encoding, sizeof(int), 1, fp) != 1) return -1;
+        if (encoding == MODEL_ENCODING_CSR) {
+            if (read_layer_csr(fp, layer) != 0) return -1;
+            nweights = 0;
+        } else if (encoding == MODEL_ENCODING_LOWRANK) {
+            if (read_layer_lowrank(fp, layer) != 0) return -1;
+            nweights = 0;
+        } else if (encoding != MODEL_ENCODING_DENSE) {
+            return -1;
+        }
+    }
+    
     if (nweights > 0 && layer->weights != NULL) {
         if (fread(layer->weights, sizeof(double), nweights, fp) != (size_t)nweights) {
             return -1;
@@ -53,6 +155,11 @@ static int read_layer_data(FILE* fp, Layer* layer) {
         }
     }
     
+    /* 3x3 stride-1 convolutions switch to the Winograd kernel. */
+    if (layer->ltype == LAYER_CONV) {
+        Layer_winograd(layer);
+    }
+    
     return 0;
 }
 
@@ -63,9 +170,17 @@ int model_save(const char* filepath, Layer** layers, int num_layers) {
         return -1;
     }
     
+    /* Dense models keep the version-1 layout. */
+    uint32_t version = MODEL_VERSION;
+    for (int i = 0; i < num_layers; i++) {
+        if (layers[i] != NULL && layer_encoding(layers[i]) != MODEL_ENCODING_DENSE) {
+            version = MODEL_VERSION_SPARSE;
+        }
+    }
+    
     ModelHeader header;
     header.magic = MODEL_MAGIC;
-    header.version = MODEL_VERSION;
+    header.version = version;
     header.layer_count = num_layers;
     header.checksum = 0;
     
@@ -73,7 +188,7 @@ int model_save(const char* filepath, Layer** layers, int num_layers) {
     fwrite(&header, sizeof(ModelHeader), 1, fp);
     
     for (int i = 0; i < num_layers; i++) {
-        write_layer_data(fp, layers[i]);
+        write_layer_data(fp, layers[i], version);
     }
     
     long end_pos = ftell(fp);
@@ -107,7 +222,7 @@ int model_load(const char* filepath, Layer** layers, int num_layers) {
         return -1;
     }
     
-    if (header.version != MODEL_VERSION) {
+    if (header.version != MODEL_VERSION && header.version != MODEL_VERSION_SPARSE) {
         fprintf(stderr, "Unsupported model version: %d\n", header.version);
         fclose(fp);
         return -1;
@@ -124,7 +239,7 @@ int model_load(const char* filepath, Layer** layers, int num_layers) {
     fseek(fp, data_start, SEEK_SET);
     
     for (int i = 0; i < num_layers; i++) {
-        if (read_layer_data(fp, layers[i]) != 0) {
+        if (read_layer_data(fp, layers[i], header.version) != 0) {
             fprintf(stderr, "Failed to read layer %d\n", i);
             fclose(fp);
             return -1;
@@ -145,7 +260,8 @@ int model_validate(const char* filepath) {
         return -1;
     }
     
-    if (header.magic != MODEL_MAGIC || header.version != MODEL_VERSION) {
+    if (header.magic != MODEL_MAGIC ||
+        (header.version != MODEL_VERSION && header.version != MODEL_VERSION_SPARSE)) {
         fclose(fp);
         return -1;
     }
@@ -154,3 +270,126 @@ int model_validate(const char* filepath) {
     return 0;
 }
 
+
+int model_topology_parse(const char* text, ModelTopology* topology) {
+    int widths[4];
+    const char* p = text;
+    for (int i = 0; i < 4; i++) {
+        char* end;
+        long width = strtol(p, &end, 10);
+        if (end == p || width < 1 || width > 4096) return -1;
+        widths[i] = (int)width;
+        if (i < 3 && *end != ',') return -1;
+        if (i == 3 && *end != '\0') return -1;
+        p = end + 1;
+    }
+    topology->conv1_channels = widths[0];
+    topology->conv2_channels = widths[1];
+    topology->fc1_nodes = widths[2];
+    topology->fc2_nodes = widths[3];
+    return 0;
+}
+
+void model_topology_describe(const ModelTopology* topology, char* buffer, size_t size) {
+    snprintf(buffer, size,
+             "Input(1×28×28) → Conv1(%d×14×14) → Conv2(%d×7×7) → FC1(%d) → FC2(%d) → Output(%d)",
+             topology->conv1_channels, topology->conv2_channels, topology->fc1_nodes,
+             topology->fc2_nodes, MODEL_NUM_CLASSES);
+}
+
+long model_topology_macs(const ModelTopology* t) {
+    long conv1 = (long)t->conv1_channels * 14 * 14 * 9;
+    long conv2 = (long)t->conv2_channels * 7 * 7 * t->conv1_channels * 9;
+    long fc1 = (long)t->fc1_nodes * t->conv2_channels * 7 * 7;
+    long fc2 = (long)t->fc2_nodes * t->fc1_nodes;
+    long output = (long)MODEL_NUM_CLASSES * t->fc2_nodes;
+    return conv1 + conv2 + fc1 + fc2 + output;
+}
+
+int model_read_topology(const char* filepath, ModelTopology* topology) {
+    FILE* fp = fopen(filepath, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", filepath);
+        return -1;
+    }
+    
+    ModelHeader header;
+    if (fread(&header, sizeof(ModelHeader), 1, fp) != 1 || header.magic != MODEL_MAGIC ||
+        (header.version != MODEL_VERSION && header.version != MODEL_VERSION_SPARSE) ||
+        header.layer_count != MODEL_NUM_LAYERS) {
+        fprintf(stderr, "%s is not a %d-layer model file\n", filepath, MODEL_NUM_LAYERS);
+        fclose(fp);
+        return -1;
+    }
+    
+    int counts[MODEL_NUM_LAYERS][2];
+    for (int i = 0; i < MODEL_NUM_LAYERS; i++) {
+        long skip = 0;
+        int ok = fread(counts[i], sizeof(int), 2, fp) == 2;
+        long nrows = counts[i][1];
+        long dense = counts[i][0];
+        if (ok && header.version >= MODEL_VERSION_SPARSE) {
+            int encoding, nnz, rank;
+            ok = fread(&encoding, sizeof(int), 1, fp) == 1;
+            if (ok && encoding == MODEL_ENCODING_CSR) {
+                ok = fread(&nnz, sizeof(int), 1, fp) == 1;
+                skip = (nrows + 1 + nnz) * (long)sizeof(int) + nnz * (long)sizeof(double);
+                dense = 0;
+            } else if (ok && encoding == MODEL_ENCODING_LOWRANK) {
+                ok = fread(&rank, sizeof(int), 1, fp) == 1 && nrows > 0;
+                skip = ok ? rank * (dense / nrows + nrows) * (long)sizeof(double) : 0;
+                dense = 0;
+            }
+        }
+        skip += (dense + counts[i][1]) * (long)sizeof(double);
+        if (!ok || fseek(fp, skip, SEEK_CUR) != 0) {
+            fprintf(stderr, "Failed to read layer %d of %s\n", i, filepath);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    
+    ModelTopology t = {counts[1][1], counts[2][1], counts[3][1], counts[4][1]};
+    int consistent = counts[0][0] == 0 && counts[0][1] == 0 &&
+                     t.conv1_channels > 0 && t.conv2_channels > 0 && t.fc1_nodes > 0 && t.fc2_nodes > 0 &&
+                     counts[1][0] == t.conv1_channels * 9 &&
+                     counts[2][0] == t.conv2_channels * t.conv1_channels * 9 &&
+                     counts[3][0] == t.fc1_nodes * t.conv2_channels * 49 &&
+                     counts[4][0] == t.fc2_nodes * t.fc1_nodes &&
+                     counts[5][1] == MODEL_NUM_CLASSES && counts[5][0] == MODEL_NUM_CLASSES * t.fc2_nodes;
+    if (!consistent) {
+        fprintf(stderr, "%s: layer sizes do not match the CNN architecture\n", filepath);
+        return -1;
+    }
+    *topology = t;
+    return 0;
+}
+
+void model_create_network(const ModelTopology* t, Layer** layers, double std) {
+    layers[0] = Layer_create_input(1, 28, 28);
+    layers[1] = Layer_create_conv(layers[0], t->conv1_channels, 14, 14, 3, 1, 2, std);
+    layers[2] = Layer_create_conv(layers[1], t->conv2_channels, 7, 7, 3, 1, 2, std);
+    layers[3] = Layer_create_full(layers[2], t->fc1_nodes, std);
+    layers[4] = Layer_create_full(layers[3], t->fc2_nodes, std);
+    layers[5] = Layer_create_full(layers[4], MODEL_NUM_CLASSES, std);
+}
+
+void model_destroy_network(Layer** layers) {
+    for (int l = MODEL_NUM_LAYERS - 1; l >= 0; l--) {
+        Layer_destroy(layers[l]);
+        layers[l] = NULL;
+    }
+}
+
+int model_open_network(const char* filepath, Layer** layers, ModelTopology* topology) {
+    ModelTopology t;
+    if (model_read_topology(filepath, &t) != 0) return -1;
+    model_create_network(&t, layers, 0.0);
+    if (model_load(filepath, layers, MODEL_NUM_LAYERS) != 0) {
+        model_destroy_network(layers);
+        return -1;
+    }
+    if (topology != NULL) *topology = t;
+    return 0;
+}
@@ -7,6 +7,11 @@
 
 #define MODEL_MAGIC 0x434E4E4D
 #define MODEL_VERSION 1
+#define MODEL_VERSION_SPARSE 2          /* Some full layers stored as CSR or low-rank */
+
+#define MODEL_ENCODING_DENSE 0
+#define MODEL_ENCODING_CSR 1
+#define MODEL_ENCODING_LOWRANK 2
 
 typedef struct {
     uint32_t magic;
@@ -15,9 +20,51 @@ typedef struct {
     uint32_t checksum;
 } ModelHeader;
 
+/* Widths of the hidden layers of the 6-layer network
+   Input(1x28x28) -> Conv1 -> Conv2 -> FC1 -> FC2 -> Output(10).
+   The layer kinds and spatial shapes (3x3, padding 1, stride 2 convolutions
+   down to 14x14 and 7x7) are fixed; only the widths vary between models.
+   A saved model records every layer's weight and bias counts, so its
+   widths can be read back from the file itself. */
+typedef struct {
+    int conv1_channels;
+    int conv2_channels;
+    int fc1_nodes;
+    int fc2_nodes;
+} ModelTopology;
+
+#define MODEL_NUM_LAYERS 6
+#define MODEL_NUM_CLASSES 10
+
+extern const ModelTopology MODEL_TOPOLOGY_DEFAULT;     /* 16/32/200/200 */
+
+/* Full layers that hold CSR weights (Layer_sparsify) or low-rank factors
+   (Layer_factorize) are saved in that form, in a version-2 file;
+   model_load restores them as saved, so inference runs the sparse or
+   low-rank kernels. model_load also caches the Winograd transforms of
+   3x3 stride-1 conv layers (Layer_winograd). */
 int model_save(const char* filepath, Layer** layers, int num_layers);
 int model_load(const char* filepath, Layer** layers, int num_layers);
 int model_validate(const char* filepath);
 
+/* Parses "conv1,conv2,fc1,fc2", e.g. "8,16,100,100". */
+int model_topology_parse(const char* text, ModelTopology* topology);
+
+/* "Input(1×28×28) → Conv1(16×14×14) → ... → Output(10)" */
+void model_topology_describe(const ModelTopology* topology, char* buffer, size_t size);
+
+/* Multiply-adds of one forward pass. */
+long model_topology_macs(const ModelTopology* topology);
+
+int model_read_topology(const char* filepath, ModelTopology* topology);
+
+/* Creates the MODEL_NUM_LAYERS layers; std as for Layer_create_full
+   (0: leave the parameters zeroed for model_load). */
+void model_create_network(const ModelTopology* topology, Layer** layers, double std);
+void model_destroy_network(Layer** layers);
+
+/* model_read_topology, model_create_network and model_load in one step. */
+int model_open_network(const char* filepath, Layer** layers, ModelTopology* topology);
+
 #endif
 
@@ -0,0 +1,231 @@
+#include "optimizer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A contiguous run of parameters with its accumulator and velocity. */
+typedef struct {
+    double* params;
+    double* updates;
+    double* velocity;
+    size_t count;
+    size_t offset;              /* Global index of params[0] */
+} ParamSegment;
+
+typedef struct {
+    Optimizer* opt;
+    int index;
+    pthread_t thread;
+} OptimizerWorker;
+
+struct Optimizer {
+    OptimizerKind kind;
+    double momentum;
+    ParamSegment* segments;
+    int num_segments;
+    size_t total;
+    double* velocity;
+
+    int num_threads;
+    OptimizerWorker* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    int remaining;
+    int stop;
+    double rate;
+};
+
+static void step_sgd(double* restrict w, double* restrict u, size_t n, double rate) {
+    for (size_t i = 0; i < n; i++) {
+        w[i] -= rate * u[i];
+        u[i] = 0;
+    }
+}
+
+static void step_momentum(double* restrict w, double* restrict u, double* restrict v,
+                          size_t n, double rate, double mu) {
+    for (size_t i = 0; i < n; i++) {
+        double vi = mu * v[i] + u[i];
+        v[i] = vi;
+        w[i] -= rate * vi;
+        u[i] = 0;
+    }
+}
+
+static void step_nesterov(double* restrict w, double* restrict u, double* restrict v,
+                          size_t n, double rate, double mu) {
+    for (size_t i = 0; i < n; i++) {
+        double g = u[i];
+        double vi = mu * v[i] + g;
+        v[i] = vi;
+        w[i] -= rate * (g + mu * vi);
+        u[i] = 0;
+    }
+}
+
+/* Updates the global index range owned by thread t. */
+static void optimizer_run_chunk(Optimizer* opt, int t, double rate) {
+    size_t begin = opt->total * t / opt->num_threads;
+    size_t end = opt->total * (t + 1) / opt->num_threads;
+    for (int s = 0; s < opt->num_segments; s++) {
+        const ParamSegment* seg = &opt->segments[s];
+        size_t lo = (begin > seg->offset) ? begin - seg->offset : 0;
+        size_t hi = (end < seg->offset + seg->count) ? end - seg->offset : seg->count;
+        if (end <= seg->offset || lo >= hi) continue;
+
+        double* w = seg->params + lo;
+        double* u = seg->updates + lo;
+        switch (opt->kind) {
+        case OPTIMIZER_SGD:
+            step_sgd(w, u, hi - lo, rate);
+            break;
+        case OPTIMIZER_MOMENTUM:
+            step_momentum(w, u, seg->velocity + lo, hi - lo, rate, opt->momentum);
+            break;
+        case OPTIMIZER_NESTEROV:
+            step_nesterov(w, u, seg->velocity + lo, hi - lo, rate, opt->momentum);
+            break;
+        }
+    }
+}
+
+static void* optimizer_worker(void* arg) {
+    OptimizerWorker* worker = (OptimizerWorker*)arg;
+    Optimizer* opt = worker->opt;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&opt->lock);
+    for (;;) {
+        while (opt->generation == seen && !opt->stop) {
+            pthread_cond_wait(&opt->start, &opt->lock);
+        }
+        if (opt->stop) break;
+        seen = opt->generation;
+        double rate = opt->rate;
+        pthread_mutex_unlock(&opt->lock);
+
+        optimizer_run_chunk(opt, worker->index, rate);
+
+        pthread_mutex_lock(&opt->lock);
+        if (--opt->remaining == 0) {
+            pthread_cond_signal(&opt->done);
+        }
+    }
+    pthread_mutex_unlock(&opt->lock);
+    return NULL;
+}
+
+static void add_segment(Optimizer* opt, double* params, double* updates, size_t count) {
+    if (count == 0) return;
+    ParamSegment* seg = &opt->segments[opt->num_segments++];
+    seg->params = params;
+    seg->updates = updates;
+    seg->velocity = NULL;
+    seg->count = count;
+    seg->offset = opt->total;
+    opt->total += count;
+}
+
+Optimizer* optimizer_create(Layer** layers, int num_layers, OptimizerKind kind,
+                            double momentum, int num_threads) {
+    Optimizer* opt = (Optimizer*)calloc(1, sizeof(Optimizer));
+    if (opt == NULL) return NULL;
+    opt->kind = kind;
+    opt->momentum = momentum;
+    opt->num_threads = (num_threads > 0) ? num_threads : 1;
+
+    opt->segments = (ParamSegment*)calloc(2 * num_layers, sizeof(ParamSegment));
+    for (int l = 0; l < num_layers; l++) {
+        add_segment(opt, layers[l]->weights, layers[l]->u_weights, layers[l]->nweights);
+        add_segment(opt, layers[l]->biases, layers[l]->u_biases, layers[l]->nbiases);
+    }
+    if (kind != OPTIMIZER_SGD) {
+        opt->velocity = (double*)calloc(opt->total, sizeof(double));
+        for (int s = 0; s < opt->num_segments; s++) {
+            opt->segments[s].velocity = opt->velocity + opt->segments[s].offset;
+        }
+    }
+
+    pthread_mutex_init(&opt->lock, NULL);
+    pthread_cond_init(&opt->start, NULL);
+    pthread_cond_init(&opt->done, NULL);
+    opt->workers = (OptimizerWorker*)calloc(opt->num_threads, sizeof(OptimizerWorker));
+    for (int t = 1; t < opt->num_threads; t++) {
+        opt->workers[t].opt = opt;
+        opt->workers[t].index = t;
+        if (pthread_create(&opt->workers[t].thread, NULL, optimizer_worker, &opt->workers[t]) != 0) {
+            fprintf(stderr, "Failed to start optimizer thread %d\n", t);
+            opt->num_threads = t;
+            break;
+        }
+    }
+    return opt;
+}
+
+void optimizer_step(Optimizer* opt, double rate) {
+    if (opt->num_threads == 1) {
+        optimizer_run_chunk(opt, 0, rate);
+        return;
+    }
+    pthread_mutex_lock(&opt->lock);
+    opt->rate = rate;
+    opt->remaining = opt->num_threads - 1;
+    opt->generation++;
+    pthread_cond_broadcast(&opt->start);
+    pthread_mutex_unlock(&opt->lock);
+
+    optimizer_run_chunk(opt, 0, rate);
+
+    pthread_mutex_lock(&opt->lock);
+    while (opt->remaining > 0) {
+        pthread_cond_wait(&opt->done, &opt->lock);
+    }
+    pthread_mutex_unlock(&opt->lock);
+}
+
+void optimizer_destroy(Optimizer* opt) {
+    if (opt == NULL) return;
+    pthread_mutex_lock(&opt->lock);
+    opt->stop = 1;
+    pthread_cond_broadcast(&opt->start);
+    pthread_mutex_unlock(&opt->lock);
+    for (int t = 1; t < opt->num_threads; t++) {
+        pthread_join(opt->workers[t].thread, NULL);
+    }
+    pthread_mutex_destroy(&opt->lock);
+    pthread_cond_destroy(&opt->start);
+    pthread_cond_destroy(&opt->done);
+    free(opt->workers);
+    free(opt->segments);
+    free(opt->velocity);
+    free(opt);
+}
+
+double* optimizer_state(Optimizer* opt, size_t* count) {
+    *count = (opt->velocity != NULL) ? opt->total : 0;
+    return opt->velocity;
+}
+
+int optimizer_parse_kind(const char* name, OptimizerKind* kind) {
+    if (strcmp(name, "sgd") == 0) {
+        *kind = OPTIMIZER_SGD;
+    } else if (strcmp(name, "momentum") == 0) {
+        *kind = OPTIMIZER_MOMENTUM;
+    } else if (strcmp(name, "nesterov") == 0) {
+        *kind = OPTIMIZER_NESTEROV;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char* optimizer_kind_name(OptimizerKind kind) {
+    switch (kind) {
+    case OPTIMIZER_MOMENTUM: return "momentum";
+    case OPTIMIZER_NESTEROV: return "nesterov";
+    default: return "sgd";
+    }
+}
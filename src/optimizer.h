@@ -0,0 +1,33 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stddef.h>
+#include "cnn.h"
+
+typedef enum {
+    OPTIMIZER_SGD = 0,
+    OPTIMIZER_MOMENTUM,
+    OPTIMIZER_NESTEROV
+} OptimizerKind;
+
+typedef struct Optimizer Optimizer;
+
+/* Applies the accumulated u_weights/u_biases of every layer and zeroes
+   them in one streaming pass per element:
+     sgd       w -= rate * g
+     momentum  v = mu * v + g;  w -= rate * v
+     nesterov  v = mu * v + g;  w -= rate * (g + mu * v)
+   The parameters are split into equal chunks across num_threads threads
+   (the caller's thread included), regardless of layer boundaries. */
+Optimizer* optimizer_create(Layer** layers, int num_layers, OptimizerKind kind,
+                            double momentum, int num_threads);
+void optimizer_step(Optimizer* opt, double rate);
+void optimizer_destroy(Optimizer* opt);
+
+/* Velocity of every parameter (NULL/0 for plain SGD), for checkpoints. */
+double* optimizer_state(Optimizer* opt, size_t* count);
+
+int optimizer_parse_kind(const char* name, OptimizerKind* kind);
+const char* optimizer_kind_name(OptimizerKind kind);
+
+#endif
@@ -1,14 +1,22 @@
 #include "performance_metrics.h"
+#include "cnn.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
 void metrics_init(PerformanceMetrics* metrics) {
     memset(metrics, 0, sizeof(PerformanceMetrics));
     metrics->min_latency_ms = 1e9;
     metrics->max_latency_ms = 0.0;
+    metrics->latency_measured = 1;
 }
 
 double get_current_time_sec(void) {
@@ -30,6 +38,9 @@ uint64_t get_memory_usage_bytes(void) {
 void metrics_calculate_derived(PerformanceMetrics* metrics, double serial_time) {
     if (metrics->total_images > 0) {
         metrics->accuracy = (metrics->correct_predictions * 100.0) / metrics->total_images;
+        if (metrics->cache_lookups > 0) {
+            metrics->cache_hit_rate = (double)metrics->cache_hits / metrics->cache_lookups;
+        }
         metrics->throughput_images_per_sec = metrics->total_images / metrics->inference_time;
         metrics->avg_latency_per_image_ms = (metrics->inference_time * 1000.0) / metrics->total_images;
     }
@@ -44,6 +55,29 @@ void metrics_calculate_derived(PerformanceMetrics* metrics, double serial_time)
     metrics->peak_memory_bytes = get_memory_usage_bytes();
 }
 
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of an ascending array. */
+static double percentile(const double* sorted, int count, double pct) {
+    int rank = (int)((pct / 100.0) * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+/* Sorts latencies_ms in place. */
+void metrics_set_latency_percentiles(PerformanceMetrics* metrics, double* latencies_ms, int count) {
+    if (count <= 0) return;
+    qsort(latencies_ms, count, sizeof(double), compare_double);
+    metrics->p50_latency_ms = percentile(latencies_ms, count, 50.0);
+    metrics->p95_latency_ms = percentile(latencies_ms, count, 95.0);
+    metrics->p99_latency_ms = percentile(latencies_ms, count, 99.0);
+}
+
 void metrics_print(const PerformanceMetrics* metrics, const char* implementation_name) {
     printf("\n");
     printf("========================================================================\n");
@@ -89,8 +123,14 @@ void metrics_print(const PerformanceMetrics* metrics, const char* implementation
     printf("\n  Throughput & Latency:\n");
     printf("    Throughput:              %.2f images/second\n", metrics->throughput_images_per_sec);
     printf("    Avg Latency per Image:   %.3f ms\n", metrics->avg_latency_per_image_ms);
-    printf("    Min Latency:             %.3f ms\n", metrics->min_latency_ms);
-    printf("    Max Latency:             %.3f ms\n", metrics->max_latency_ms);
+    if (metrics->latency_measured) {
+        printf("    Min Latency:             %.3f ms\n", metrics->min_latency_ms);
+        printf("    Max Latency:             %.3f ms\n", metrics->max_latency_ms);
+    }
+    if (metrics->latency_measured && metrics->p99_latency_ms > 0) {
+        printf("    P50 / P95 / P99 Latency: %.3f / %.3f / %.3f ms\n",
+               metrics->p50_latency_ms, metrics->p95_latency_ms, metrics->p99_latency_ms);
+    }
     
     printf("\n  Memory Usage:\n");
     printf("    Peak Memory:             %.2f MB\n", metrics->peak_memory_bytes / (1024.0 * 1024.0));
@@ -114,6 +154,19 @@ void metrics_print(const PerformanceMetrics* metrics, const char* implementation
                (metrics->bytes_sent + metrics->bytes_received) / (1024.0 * 1024.0));
     }
     
+    if (metrics->cache_lookups > 0) {
+        printf("\n  Prediction Cache:\n");
+        printf("    Hits:                    %llu / %llu\n",
+               (unsigned long long)metrics->cache_hits, (unsigned long long)metrics->cache_lookups);
+        printf("    Hit Rate:                %.2f%%\n", metrics->cache_hit_rate * 100.0);
+    }
+    
+    if (metrics->exit_threshold > 0.0) {
+        printf("\n  Early Exit:\n");
+        printf("    Threshold:               %.4f\n", metrics->exit_threshold);
+        printf("    Exited at Conv2:         %.2f%%\n", metrics->exit_fraction * 100.0);
+    }
+    
     printf("\n  Accuracy:\n");
     printf("    Correct Predictions:     %d / %d\n", metrics->correct_predictions, metrics->total_images);
     printf("    Accuracy:                %.2f%%\n", metrics->accuracy);
@@ -151,6 +204,230 @@ void metrics_print_detailed(const PerformanceMetrics* metrics, const char* imple
     printf("\n");
 }
 
+void run_config_init(RunConfig* config, const char* implementation, int num_processes) {
+    config->implementation = implementation;
+    config->num_processes = num_processes;
+    config->batch_size = 1;
+    config->kernel_backend = CNN_KERNEL_BACKEND;
+    config->precision = CNN_PRECISION;
+    config->images_path = NULL;
+    config->tag = NULL;
+}
+
+static void get_cpu_model(char* buffer, size_t size) {
+    snprintf(buffer, size, "unknown");
+#ifdef __APPLE__
+    size_t len = size;
+    if (sysctlbyname("machdep.cpu.brand_string", buffer, &len, NULL, 0) != 0) {
+        snprintf(buffer, size, "unknown");
+    }
+#else
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (fp == NULL) return;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "model name", 10) == 0) {
+            char* value = strchr(line, ':');
+            if (value != NULL) {
+                value++;
+                while (*value == ' ' || *value == '\t') value++;
+                value[strcspn(value, "\n")] = '\0';
+                snprintf(buffer, size, "%s", value);
+            }
+            break;
+        }
+    }
+    fclose(fp);
+#endif
+}
+
+/* "key":value, or "key":null when the value was not measured. */
+static void json_write_optional(FILE* fp, const char* key, double value, int present) {
+    if (present) {
+        fprintf(fp, "\"%s\":%.9g,", key, value);
+    } else {
+        fprintf(fp, "\"%s\":null,", key);
+    }
+}
+
+static void json_write_string(FILE* fp, const char* value) {
+    if (value == NULL) {
+        fputs("null", fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char* c = value; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', fp);
+            fputc(*c, fp);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* Opens filepath for appending and writes the start of a record: schema,
+   timestamp, run configuration and host. The caller adds its own object
+   and closes the record with json_close_record. */
+static FILE* json_open_record(const char* filepath, const RunConfig* config) {
+    FILE* fp = fopen(filepath, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for appending\n", filepath);
+        return NULL;
+    }
+
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname) - 1);
+    char cpu_model[256];
+    get_cpu_model(cpu_model, sizeof(cpu_model));
+    struct utsname uts;
+    memset(&uts, 0, sizeof(uts));
+    uname(&uts);
+
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(fp, "{\"schema\":1,\"timestamp\":");
+    json_write_string(fp, timestamp);
+
+    fprintf(fp, ",\"config\":{\"implementation\":");
+    json_write_string(fp, config->implementation);
+    fprintf(fp, ",\"num_processes\":%d,\"batch_size\":%d,\"kernel_backend\":",
+            config->num_processes, config->batch_size);
+    json_write_string(fp, config->kernel_backend);
+    fprintf(fp, ",\"precision\":");
+    json_write_string(fp, config->precision);
+    fprintf(fp, ",\"images_path\":");
+    json_write_string(fp, config->images_path);
+    fprintf(fp, ",\"tag\":");
+    json_write_string(fp, config->tag);
+    fprintf(fp, "}");
+
+    fprintf(fp, ",\"host\":{\"hostname\":");
+    json_write_string(fp, hostname);
+    fprintf(fp, ",\"os\":");
+    json_write_string(fp, uts.sysname);
+    fprintf(fp, ",\"os_release\":");
+    json_write_string(fp, uts.release);
+    fprintf(fp, ",\"arch\":");
+    json_write_string(fp, uts.machine);
+    fprintf(fp, ",\"cpu_model\":");
+    json_write_string(fp, cpu_model);
+    fprintf(fp, ",\"cpu_cores\":%ld}", sysconf(_SC_NPROCESSORS_ONLN));
+    return fp;
+}
+
+static int json_close_record(FILE* fp, const char* filepath) {
+    fprintf(fp, "}\n");
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Failed to write %s\n", filepath);
+        return -1;
+    }
+    return 0;
+}
+
+/* Appends one JSON object per line (JSON Lines), so repeated runs accumulate
+   into a single results database that can be loaded record by record. */
+int metrics_append_json(const char* filepath, const PerformanceMetrics* metrics, const RunConfig* config) {
+    FILE* fp = json_open_record(filepath, config);
+    if (fp == NULL) return -1;
+
+    fprintf(fp, ",\"metrics\":{");
+    fprintf(fp, "\"total_time\":%.9g,", metrics->total_time);
+    fprintf(fp, "\"load_model_time\":%.9g,", metrics->load_model_time);
+    fprintf(fp, "\"load_data_time\":%.9g,", metrics->load_data_time);
+    fprintf(fp, "\"inference_time\":%.9g,", metrics->inference_time);
+    fprintf(fp, "\"communication_time\":%.9g,", metrics->communication_time);
+    fprintf(fp, "\"conv1_time\":%.9g,", metrics->conv1_time);
+    fprintf(fp, "\"conv2_time\":%.9g,", metrics->conv2_time);
+    fprintf(fp, "\"fc1_time\":%.9g,", metrics->fc1_time);
+    fprintf(fp, "\"fc2_time\":%.9g,", metrics->fc2_time);
+    fprintf(fp, "\"output_time\":%.9g,", metrics->output_time);
+    fprintf(fp, "\"memory_used_bytes\":%llu,", (unsigned long long)metrics->memory_used_bytes);
+    fprintf(fp, "\"peak_memory_bytes\":%llu,", (unsigned long long)metrics->peak_memory_bytes);
+    fprintf(fp, "\"throughput_images_per_sec\":%.9g,", metrics->throughput_images_per_sec);
+    fprintf(fp, "\"avg_latency_per_image_ms\":%.9g,", metrics->avg_latency_per_image_ms);
+    json_write_optional(fp, "min_latency_ms", metrics->min_latency_ms, metrics->latency_measured);
+    json_write_optional(fp, "max_latency_ms", metrics->max_latency_ms, metrics->latency_measured);
+    json_write_optional(fp, "p50_latency_ms", metrics->p50_latency_ms, metrics->latency_measured);
+    json_write_optional(fp, "p95_latency_ms", metrics->p95_latency_ms, metrics->latency_measured);
+    json_write_optional(fp, "p99_latency_ms", metrics->p99_latency_ms, metrics->latency_measured);
+    fprintf(fp, "\"num_processes\":%d,", metrics->num_processes);
+    fprintf(fp, "\"parallel_efficiency\":%.9g,", metrics->parallel_efficiency);
+    fprintf(fp, "\"speedup\":%.9g,", metrics->speedup);
+    fprintf(fp, "\"mpi_wait_time\":%.9g,", metrics->mpi_wait_time);
+    fprintf(fp, "\"mpi_send_time\":%.9g,", metrics->mpi_send_time);
+    fprintf(fp, "\"mpi_recv_time\":%.9g,", metrics->mpi_recv_time);
+    fprintf(fp, "\"bytes_sent\":%llu,", (unsigned long long)metrics->bytes_sent);
+    fprintf(fp, "\"bytes_received\":%llu,", (unsigned long long)metrics->bytes_received);
+    fprintf(fp, "\"cpu_utilization\":%.9g,", metrics->cpu_utilization);
+    fprintf(fp, "\"load_imbalance\":%.9g,", metrics->load_imbalance);
+    fprintf(fp, "\"correct_predictions\":%d,", metrics->correct_predictions);
+    fprintf(fp, "\"total_images\":%d,", metrics->total_images);
+    fprintf(fp, "\"accuracy\":%.9g,", metrics->accuracy);
+    fprintf(fp, "\"cache_lookups\":%llu,", (unsigned long long)metrics->cache_lookups);
+    fprintf(fp, "\"cache_hits\":%llu,", (unsigned long long)metrics->cache_hits);
+    fprintf(fp, "\"cache_hit_rate\":%.9g,", metrics->cache_hit_rate);
+    fprintf(fp, "\"exit_threshold\":%.9g,", metrics->exit_threshold);
+    fprintf(fp, "\"exit_fraction\":%.9g", metrics->exit_fraction);
+    fprintf(fp, "}");
+    return json_close_record(fp, filepath);
+}
+
+/* Training records share the envelope of the inference records and carry
+   a "training" object instead of "metrics". */
+int training_metrics_append_json(const char* filepath, const TrainingMetrics* metrics,
+                                 const RunConfig* config) {
+    FILE* fp = json_open_record(filepath, config);
+    if (fp == NULL) return -1;
+
+    fprintf(fp, ",\"training\":{");
+    fprintf(fp, "\"epochs\":%d,", metrics->epochs);
+    fprintf(fp, "\"samples\":%llu,", (unsigned long long)metrics->samples);
+    fprintf(fp, "\"train_time\":%.9g,", metrics->train_time);
+    fprintf(fp, "\"samples_per_sec\":%.9g,", metrics->samples_per_sec);
+    fprintf(fp, "\"eval_images\":%d,", metrics->eval_images);
+    fprintf(fp, "\"final_accuracy\":%.9g,", metrics->final_accuracy);
+    fprintf(fp, "\"targets\":[");
+    for (int i = 0; i < metrics->num_targets; i++) {
+        const AccuracyTarget* t = &metrics->targets[i];
+        fprintf(fp, "%s{\"accuracy\":%.9g,", i > 0 ? "," : "", t->accuracy);
+        if (t->reached) {
+            fprintf(fp, "\"time\":%.9g,\"samples\":%llu}", t->time, (unsigned long long)t->samples);
+        } else {
+            fprintf(fp, "\"time\":null,\"samples\":null}");
+        }
+    }
+    fprintf(fp, "],\"curve\":[");
+    for (int i = 0; i < metrics->num_points; i++) {
+        const AccuracyPoint* p = &metrics->points[i];
+        fprintf(fp, "%s{\"time\":%.9g,\"samples\":%llu,\"accuracy\":%.9g}",
+                i > 0 ? "," : "", p->time, (unsigned long long)p->samples, p->accuracy);
+    }
+    fprintf(fp, "]}");
+    return json_close_record(fp, filepath);
+}
+
+/* Fills in time/samples of every target from the first point reaching it. */
+void training_metrics_find_targets(TrainingMetrics* metrics) {
+    for (int i = 0; i < metrics->num_targets; i++) {
+        AccuracyTarget* t = &metrics->targets[i];
+        t->reached = 0;
+        for (int p = 0; p < metrics->num_points; p++) {
+            if (metrics->points[p].accuracy >= t->accuracy) {
+                t->reached = 1;
+                t->time = metrics->points[p].time;
+                t->samples = metrics->points[p].samples;
+                break;
+            }
+        }
+    }
+}
+
 void print_comparison_table(PerformanceMetrics* serial, PerformanceMetrics* data_parallel[], 
                             int num_data_parallel, PerformanceMetrics* pipeline) {
     printf("\n");
@@ -24,6 +24,10 @@ typedef struct {
     double avg_latency_per_image_ms;
     double min_latency_ms;
     double max_latency_ms;
+    double p50_latency_ms;
+    double p95_latency_ms;
+    double p99_latency_ms;
+    int latency_measured;           /* 0: min/max/percentiles unknown, JSON null */
     
     int num_processes;
     double parallel_efficiency;
@@ -41,14 +45,67 @@ typedef struct {
     int correct_predictions;
     int total_images;
     double accuracy;
+    
+    uint64_t cache_lookups;         /* Prediction cache (--cache); 0 when disabled */
+    uint64_t cache_hits;
+    double cache_hit_rate;
+    
+    double exit_threshold;          /* Early-exit confidence threshold; 0 when disabled */
+    double exit_fraction;           /* Share of images answered by the exit head */
 } PerformanceMetrics;
 
+typedef struct {
+    const char* implementation;
+    int num_processes;
+    int batch_size;
+    const char* kernel_backend;
+    const char* precision;
+    const char* images_path;
+    const char* tag;
+} RunConfig;
+
+/* Test accuracy of the model as it was after `samples` training samples,
+   `time` seconds into training. */
+typedef struct {
+    double time;
+    uint64_t samples;
+    double accuracy;
+} AccuracyPoint;
+
+typedef struct {
+    double accuracy;
+    int reached;
+    double time;
+    uint64_t samples;
+} AccuracyTarget;
+
+#define MAX_ACCURACY_TARGETS 8
+
+typedef struct {
+    int epochs;
+    uint64_t samples;
+    double train_time;
+    double samples_per_sec;
+    int eval_images;            /* Test images per interval evaluation */
+    double final_accuracy;
+    AccuracyTarget targets[MAX_ACCURACY_TARGETS];
+    int num_targets;
+    const AccuracyPoint* points;
+    int num_points;
+} TrainingMetrics;
+
 void metrics_init(PerformanceMetrics* metrics);
 void metrics_print(const PerformanceMetrics* metrics, const char* implementation_name);
 void metrics_print_detailed(const PerformanceMetrics* metrics, const char* implementation_name);
 void metrics_calculate_derived(PerformanceMetrics* metrics, double serial_time);
+void metrics_set_latency_percentiles(PerformanceMetrics* metrics, double* latencies_ms, int count);
 double get_current_time_sec(void);
 uint64_t get_memory_usage_bytes(void);
+void run_config_init(RunConfig* config, const char* implementation, int num_processes);
+int metrics_append_json(const char* filepath, const PerformanceMetrics* metrics, const RunConfig* config);
+int training_metrics_append_json(const char* filepath, const TrainingMetrics* metrics,
+                                 const RunConfig* config);
+void training_metrics_find_targets(TrainingMetrics* metrics);
 void print_comparison_table(PerformanceMetrics* serial, PerformanceMetrics* data_parallel[], int num_data_parallel, PerformanceMetrics* pipeline);
 
 #endif
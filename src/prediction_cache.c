@@ -0,0 +1,248 @@
+#include "prediction_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SHARDS 64
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+typedef struct {
+    uint64_t key;               /* 0: empty */
+    int32_t predicted;
+    int32_t referenced;         /* CLOCK bit, set on hits */
+    double scores[CACHE_NUM_CLASSES];
+} CacheEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    CacheEntry* slots;
+    uint32_t mask;
+    uint32_t hand;
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t evictions;
+    char pad[64];               /* Keep neighbouring shards' locks apart */
+} CacheShard;
+
+struct PredictionCache {
+    CacheShard* shards;
+    uint32_t num_shards;
+    uint32_t window;
+    size_t capacity;
+};
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t value) {
+    acc ^= xxh64_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/* XXH64 (little-endian reads, as on every host this builds for). */
+uint64_t xxh64(const void* data, size_t length, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += (uint64_t)length;
+
+    while (p + 8 <= end) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t prediction_cache_key(const uint8_t* pixels, size_t size) {
+    uint64_t key = xxh64(pixels, size, 0);
+    return key != 0 ? key : 1;
+}
+
+PredictionCache* prediction_cache_create(size_t capacity) {
+    if (capacity == 0) return NULL;
+    size_t total = CACHE_PROBE_WINDOW;
+    while (total < capacity) total <<= 1;
+    uint32_t num_shards = 1;
+    while (num_shards < MAX_SHARDS && total / (num_shards * 2) >= 4 * CACHE_PROBE_WINDOW) {
+        num_shards <<= 1;
+    }
+
+    PredictionCache* cache = (PredictionCache*)calloc(1, sizeof(PredictionCache));
+    if (cache == NULL) return NULL;
+    cache->shards = (CacheShard*)calloc(num_shards, sizeof(CacheShard));
+    if (cache->shards == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->num_shards = num_shards;
+    cache->window = CACHE_PROBE_WINDOW;
+    cache->capacity = total;
+
+    size_t per_shard = total / num_shards;
+    for (uint32_t s = 0; s < num_shards; s++) {
+        CacheShard* shard = &cache->shards[s];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->slots = (CacheEntry*)calloc(per_shard, sizeof(CacheEntry));
+        shard->mask = (uint32_t)(per_shard - 1);
+        if (shard->slots == NULL) {
+            cache->num_shards = s + 1;
+            prediction_cache_destroy(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+void prediction_cache_destroy(PredictionCache* cache) {
+    if (cache == NULL) return;
+    for (uint32_t s = 0; s < cache->num_shards; s++) {
+        pthread_mutex_destroy(&cache->shards[s].lock);
+        free(cache->shards[s].slots);
+    }
+    free(cache->shards);
+    free(cache);
+}
+
+/* High bits pick the shard, low bits the home slot. */
+static inline CacheShard* shard_for(PredictionCache* cache, uint64_t key) {
+    return &cache->shards[(key >> 40) & (cache->num_shards - 1)];
+}
+
+int prediction_cache_lookup(PredictionCache* cache, uint64_t key, int32_t* predicted, double* scores) {
+    CacheShard* shard = shard_for(cache, key);
+    int hit = 0;
+    pthread_mutex_lock(&shard->lock);
+    shard->lookups++;
+    for (uint32_t p = 0; p < cache->window; p++) {
+        CacheEntry* entry = &shard->slots[(key + p) & shard->mask];
+        if (entry->key == key) {
+            entry->referenced = 1;
+            *predicted = entry->predicted;
+            if (scores != NULL) {
+                memcpy(scores, entry->scores, sizeof(entry->scores));
+            }
+            shard->hits++;
+            hit = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return hit;
+}
+
+void prediction_cache_insert(PredictionCache* cache, uint64_t key, int32_t predicted, const double* scores) {
+    CacheShard* shard = shard_for(cache, key);
+    pthread_mutex_lock(&shard->lock);
+
+    CacheEntry* target = NULL;
+    for (uint32_t p = 0; p < cache->window; p++) {
+        CacheEntry* entry = &shard->slots[(key + p) & shard->mask];
+        if (entry->key == key) {
+            target = entry;             /* Another thread got here first */
+            break;
+        }
+        if (entry->key == 0 && target == NULL) {
+            target = entry;
+        }
+    }
+    if (target == NULL) {
+        /* CLOCK over the window: second chance for referenced entries. */
+        for (;;) {
+            CacheEntry* entry = &shard->slots[(key + shard->hand++ % cache->window) & shard->mask];
+            if (!entry->referenced) {
+                target = entry;
+                shard->evictions++;
+                break;
+            }
+            entry->referenced = 0;
+        }
+    }
+    if (target->key != key) {
+        target->referenced = 0;
+        shard->inserts++;
+    }
+    target->key = key;
+    target->predicted = predicted;
+    memcpy(target->scores, scores, sizeof(target->scores));
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void prediction_cache_stats(PredictionCache* cache, PredictionCacheStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (cache == NULL) return;
+    for (uint32_t s = 0; s < cache->num_shards; s++) {
+        CacheShard* shard = &cache->shards[s];
+        pthread_mutex_lock(&shard->lock);
+        stats->lookups += shard->lookups;
+        stats->hits += shard->hits;
+        stats->inserts += shard->inserts;
+        stats->evictions += shard->evictions;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    stats->capacity = cache->capacity;
+    stats->bytes = cache->capacity * sizeof(CacheEntry);
+}
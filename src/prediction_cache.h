@@ -0,0 +1,47 @@
+#ifndef PREDICTION_CACHE_H
+#define PREDICTION_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Prediction cache keyed by the XXH64 hash of an image's raw bytes.
+
+   The table is split into shards (one mutex each) selected by the high
+   bits of the key. Within a shard an entry may live in any of
+   CACHE_PROBE_WINDOW consecutive slots after its home slot; a lookup
+   scans that window and a full window evicts with CLOCK (a hit sets the
+   entry's reference bit, the shard's hand clears bits until it finds an
+   unreferenced entry). Entries are identified by the 64-bit hash alone,
+   so two different images collide with probability ~2^-64 per pair.
+   Safe to share between threads. */
+
+#define CACHE_NUM_CLASSES 10
+#define CACHE_PROBE_WINDOW 8
+
+typedef struct PredictionCache PredictionCache;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t evictions;
+    size_t capacity;            /* Entries */
+    size_t bytes;
+} PredictionCacheStats;
+
+uint64_t xxh64(const void* data, size_t length, uint64_t seed);
+
+/* capacity is rounded up to a power of two; NULL on failure. */
+PredictionCache* prediction_cache_create(size_t capacity);
+void prediction_cache_destroy(PredictionCache* cache);
+
+/* Key of an image's raw bytes (never 0, which marks an empty slot). */
+uint64_t prediction_cache_key(const uint8_t* pixels, size_t size);
+
+/* Returns 1 and fills predicted (and scores, if not NULL) on a hit. */
+int prediction_cache_lookup(PredictionCache* cache, uint64_t key, int32_t* predicted, double* scores);
+void prediction_cache_insert(PredictionCache* cache, uint64_t key, int32_t predicted, const double* scores);
+
+void prediction_cache_stats(PredictionCache* cache, PredictionCacheStats* stats);
+
+#endif
@@ -0,0 +1,129 @@
+#include "prediction_sink.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* "4294967295,9" plus ten ",0.000000" columns and a newline */
+#define CSV_MAX_LINE 128
+
+void prediction_buffer_init(PredictionBuffer* buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+int prediction_buffer_add(PredictionBuffer* buffer, uint32_t index, int predicted,
+                          const double* probabilities) {
+    if (buffer->count == 0) {
+        buffer->first = index;
+    } else if (index != buffer->first + buffer->count) {
+        fprintf(stderr, "Prediction for image %u out of order (expected %u)\n",
+                index, buffer->first + buffer->count);
+        return -1;
+    }
+    if (buffer->count == buffer->capacity) {
+        uint32_t capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        PredictionRecord* records = (PredictionRecord*)realloc(buffer->records,
+                                                               capacity * sizeof(PredictionRecord));
+        if (records == NULL) return -1;
+        buffer->records = records;
+        buffer->capacity = capacity;
+    }
+    PredictionRecord* record = &buffer->records[buffer->count++];
+    record->predicted = predicted;
+    for (int j = 0; j < PREDICTION_NUM_CLASSES; j++) {
+        record->probabilities[j] = (float)probabilities[j];
+    }
+    return 0;
+}
+
+void prediction_buffer_free(PredictionBuffer* buffer) {
+    free(buffer->records);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+int prediction_format_parse(const char* name, PredictionFormat* format) {
+    if (strcmp(name, "binary") == 0) {
+        *format = PREDICTION_FORMAT_BINARY;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = PREDICTION_FORMAT_CSV;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+PredictionFormat prediction_format_for_path(const char* path) {
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".csv") == 0) {
+        return PREDICTION_FORMAT_CSV;
+    }
+    return PREDICTION_FORMAT_BINARY;
+}
+
+const char* prediction_format_name(PredictionFormat format) {
+    return (format == PREDICTION_FORMAT_CSV) ? "csv" : "binary";
+}
+
+char* prediction_encode(PredictionFormat format, const PredictionBuffer* buffer, uint32_t num_images,
+                        int with_header, size_t* size) {
+    size_t capacity;
+    if (format == PREDICTION_FORMAT_BINARY) {
+        capacity = sizeof(PredictionFileHeader) + (size_t)buffer->count * sizeof(PredictionRecord);
+    } else {
+        capacity = (size_t)(buffer->count + 1) * CSV_MAX_LINE;
+    }
+    char* out = (char*)malloc(capacity > 0 ? capacity : 1);
+    if (out == NULL) return NULL;
+
+    size_t used = 0;
+    if (format == PREDICTION_FORMAT_BINARY) {
+        if (with_header) {
+            PredictionFileHeader header = {PREDICTION_MAGIC, PREDICTION_VERSION, num_images,
+                                           PREDICTION_NUM_CLASSES};
+            memcpy(out, &header, sizeof(header));
+            used = sizeof(header);
+        }
+        memcpy(out + used, buffer->records, (size_t)buffer->count * sizeof(PredictionRecord));
+        used += (size_t)buffer->count * sizeof(PredictionRecord);
+    } else {
+        if (with_header) {
+            used += (size_t)sprintf(out, "index,predicted");
+            for (int j = 0; j < PREDICTION_NUM_CLASSES; j++) {
+                used += (size_t)sprintf(out + used, ",p%d", j);
+            }
+            out[used++] = '\n';
+        }
+        for (uint32_t i = 0; i < buffer->count; i++) {
+            const PredictionRecord* record = &buffer->records[i];
+            used += (size_t)sprintf(out + used, "%u,%d", buffer->first + i, record->predicted);
+            for (int j = 0; j < PREDICTION_NUM_CLASSES; j++) {
+                used += (size_t)sprintf(out + used, ",%.6f", record->probabilities[j]);
+            }
+            out[used++] = '\n';
+        }
+    }
+    *size = used;
+    return out;
+}
+
+int predictions_write(const char* path, PredictionFormat format, const PredictionBuffer* buffer) {
+    size_t size;
+    char* data = prediction_encode(format, buffer, buffer->count, 1, &size);
+    if (data == NULL) {
+        fprintf(stderr, "Out of memory encoding predictions\n");
+        return -1;
+    }
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        free(data);
+        return -1;
+    }
+    int ok = fwrite(data, 1, size, fp) == size;
+    if (fclose(fp) != 0) ok = 0;
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "Failed to write predictions to %s\n", path);
+        return -1;
+    }
+    return 0;
+}
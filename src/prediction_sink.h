@@ -0,0 +1,65 @@
+#ifndef PREDICTION_SINK_H
+#define PREDICTION_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-image prediction output (--predictions <file>).
+
+   Binary (.bin, default): PredictionFileHeader, then one PredictionRecord
+   per image in dataset order, so record i sits at
+   sizeof(PredictionFileHeader) + i * sizeof(PredictionRecord).
+   CSV (.csv or --predictions-format csv): a header line, then
+   "index,predicted,p0,...,p9" per image. */
+
+#define PREDICTION_MAGIC 0x52504E43     /* "CNPR" */
+#define PREDICTION_VERSION 1
+#define PREDICTION_NUM_CLASSES 10
+
+typedef enum {
+    PREDICTION_FORMAT_BINARY,
+    PREDICTION_FORMAT_CSV
+} PredictionFormat;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_images;
+    uint32_t num_classes;
+} PredictionFileHeader;
+
+typedef struct {
+    int32_t predicted;
+    float probabilities[PREDICTION_NUM_CLASSES];   /* Softmax outputs */
+} PredictionRecord;
+
+/* Predictions for a contiguous range of images, first .. first+count-1. */
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+    uint32_t capacity;
+    PredictionRecord* records;
+} PredictionBuffer;
+
+void prediction_buffer_init(PredictionBuffer* buffer);
+/* index must follow the previous one; the first call sets buffer->first. */
+int prediction_buffer_add(PredictionBuffer* buffer, uint32_t index, int predicted,
+                          const double* probabilities);
+void prediction_buffer_free(PredictionBuffer* buffer);
+
+/* "binary" or "csv"; -1 if unknown. */
+int prediction_format_parse(const char* name, PredictionFormat* format);
+/* Format implied by a file name: .csv is CSV, anything else binary. */
+PredictionFormat prediction_format_for_path(const char* path);
+const char* prediction_format_name(PredictionFormat format);
+
+/* Serializes the buffer's records (plus the file header when with_header
+   is set) into a malloc'd byte array. Used by the POSIX and MPI-IO writers
+   so both produce identical files. */
+char* prediction_encode(PredictionFormat format, const PredictionBuffer* buffer, uint32_t num_images,
+                        int with_header, size_t* size);
+
+/* Writes a complete prediction file from a single process. */
+int predictions_write(const char* path, PredictionFormat format, const PredictionBuffer* buffer);
+
+#endif
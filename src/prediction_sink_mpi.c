@@ -0,0 +1,77 @@
+#include "prediction_sink_mpi.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Checks that the non-empty ranges tile 0 .. total-1 in rank order. */
+static int ranges_contiguous(const PredictionBuffer* buffer, MPI_Comm comm, uint32_t* total) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    uint32_t range[2] = {buffer->first, buffer->count};
+    uint32_t* ranges = (uint32_t*)malloc((size_t)size * 2 * sizeof(uint32_t));
+    MPI_Allgather(range, 2, MPI_UINT32_T, ranges, 2, MPI_UINT32_T, comm);
+
+    uint32_t next = 0;
+    int ok = 1;
+    for (int r = 0; r < size; r++) {
+        if (ranges[2 * r + 1] == 0) continue;
+        if (ranges[2 * r] != next) ok = 0;
+        next = ranges[2 * r] + ranges[2 * r + 1];
+    }
+    free(ranges);
+    *total = next;
+    return ok;
+}
+
+int predictions_write_mpi(const char* path, PredictionFormat format, const PredictionBuffer* buffer,
+                          MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    uint32_t total;
+    if (!ranges_contiguous(buffer, comm, &total)) {
+        if (rank == 0) {
+            fprintf(stderr, "Predictions are not in rank order; not writing %s\n", path);
+        }
+        return -1;
+    }
+
+    /* Rank 0 carries the file header in front of its own records. */
+    size_t size;
+    char* data = prediction_encode(format, buffer, total, rank == 0, &size);
+    int local_ok = (data != NULL && size <= INT_MAX);
+    int ok;
+    MPI_Allreduce(&local_ok, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok) {
+        if (rank == 0) {
+            fprintf(stderr, "Failed to encode predictions for %s\n", path);
+        }
+        free(data);
+        return -1;
+    }
+
+    unsigned long long local_size = size;
+    unsigned long long offset = 0;
+    MPI_Exscan(&local_size, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) offset = 0;     /* Exscan leaves rank 0's result undefined */
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) {
+            fprintf(stderr, "Failed to open %s for writing\n", path);
+        }
+        free(data);
+        return -1;
+    }
+    MPI_File_set_size(fh, 0);
+    int rc = MPI_File_write_at_all(fh, (MPI_Offset)offset, data, (int)size, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    free(data);
+
+    local_ok = (rc == MPI_SUCCESS);
+    MPI_Allreduce(&local_ok, &ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!ok && rank == 0) {
+        fprintf(stderr, "Failed to write predictions to %s\n", path);
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,16 @@
+#ifndef PREDICTION_SINK_MPI_H
+#define PREDICTION_SINK_MPI_H
+
+#include "prediction_sink.h"
+#include <mpi.h>
+
+/* Collective: every rank of comm calls it with its own buffer (possibly
+   empty). Ranks must hold consecutive image ranges in rank order. Each
+   rank's byte offset comes from an exclusive prefix sum of the encoded
+   sizes, and all ranks write their slice with one MPI_File_write_at_all,
+   so no rank gathers the records of the others. Returns 0 on every rank
+   on success. */
+int predictions_write_mpi(const char* path, PredictionFormat format, const PredictionBuffer* buffer,
+                          MPI_Comm comm);
+
+#endif
@@ -0,0 +1,94 @@
+#include "pruning.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+Pruner* pruner_create(Layer** layers, int num_layers) {
+    Pruner* pruner = (Pruner*)calloc(1, sizeof(Pruner));
+    if (pruner == NULL) return NULL;
+    for (int l = 0; l < num_layers; l++) {
+        Layer* layer = layers[l];
+        if (layer->ltype != LAYER_FULL || layer->lnext == NULL) continue;
+        if (pruner->num_layers == PRUNE_MAX_LAYERS) break;
+        unsigned char* keep = (unsigned char*)malloc(layer->nweights);
+        if (keep == NULL) {
+            pruner_destroy(pruner);
+            return NULL;
+        }
+        memset(keep, 1, layer->nweights);
+        pruner->layers[pruner->num_layers] = layer;
+        pruner->keep[pruner->num_layers] = keep;
+        pruner->num_layers++;
+    }
+    return pruner;
+}
+
+void pruner_destroy(Pruner* pruner) {
+    if (pruner == NULL) return;
+    for (int l = 0; l < pruner->num_layers; l++) {
+        free(pruner->keep[l]);
+    }
+    free(pruner);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void pruner_prune(Pruner* pruner, double sparsity) {
+    for (int l = 0; l < pruner->num_layers; l++) {
+        Layer* layer = pruner->layers[l];
+        unsigned char* keep = pruner->keep[l];
+        int n = layer->nweights;
+        int target = (int)(sparsity * n);
+        if (target <= 0) continue;
+
+        /* Pruned weights are zero, so they sort first and stay pruned. */
+        double* magnitudes = (double*)malloc(n * sizeof(double));
+        if (magnitudes == NULL) continue;
+        for (int k = 0; k < n; k++) {
+            magnitudes[k] = keep[k] ? fabs(layer->weights[k]) : 0.0;
+        }
+        qsort(magnitudes, n, sizeof(double), compare_double);
+        double threshold = magnitudes[target - 1];
+        free(magnitudes);
+
+        /* Ties at the threshold are pruned in index order up to target. */
+        int pruned = 0;
+        for (int k = 0; k < n; k++) {
+            if (!keep[k]) pruned++;
+        }
+        for (int k = 0; k < n && pruned < target; k++) {
+            if (keep[k] && fabs(layer->weights[k]) <= threshold) {
+                keep[k] = 0;
+                pruned++;
+            }
+        }
+    }
+    if (sparsity > pruner->sparsity) pruner->sparsity = sparsity;
+    pruner_apply(pruner);
+}
+
+void pruner_apply(const Pruner* pruner) {
+    for (int l = 0; l < pruner->num_layers; l++) {
+        Layer* layer = pruner->layers[l];
+        const unsigned char* keep = pruner->keep[l];
+        for (int k = 0; k < layer->nweights; k++) {
+            if (!keep[k]) layer->weights[k] = 0.0;
+        }
+    }
+}
+
+void pruner_finish(Pruner* pruner) {
+    pruner_apply(pruner);
+    for (int l = 0; l < pruner->num_layers; l++) {
+        Layer_sparsify(pruner->layers[l]);
+    }
+}
+
+double prune_schedule(double target, int epoch, int epochs) {
+    double remaining = 1.0 - (double)(epoch + 1) / epochs;
+    return target * (1.0 - remaining * remaining * remaining);
+}
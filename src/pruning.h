@@ -0,0 +1,37 @@
+#ifndef PRUNING_H
+#define PRUNING_H
+
+#include "cnn.h"
+
+/* Magnitude pruning of the hidden fully-connected layers (FC1, FC2; the
+   10-node output layer stays dense). Each layer keeps its own mask:
+   pruning to sparsity s zeroes the s * nweights smallest-magnitude
+   weights of every pruned layer, and pruner_apply re-zeroes them after
+   each optimizer step so fine-tuning cannot revive them. Weights pruned
+   once stay pruned as s grows. */
+
+#define PRUNE_MAX_LAYERS 8
+
+typedef struct {
+    Layer* layers[PRUNE_MAX_LAYERS];
+    unsigned char* keep[PRUNE_MAX_LAYERS];      /* 1: weight kept */
+    int num_layers;
+    double sparsity;
+} Pruner;
+
+Pruner* pruner_create(Layer** layers, int num_layers);
+void pruner_destroy(Pruner* pruner);
+
+/* Raises every pruned layer to the given sparsity (0 <= sparsity < 1). */
+void pruner_prune(Pruner* pruner, double sparsity);
+
+void pruner_apply(const Pruner* pruner);
+
+/* Builds the CSR weights used by the sparse kernels and by model_save. */
+void pruner_finish(Pruner* pruner);
+
+/* Gradual schedule (cubic, as in Zhu & Gupta): the sparsity to prune to
+   at the start of epoch (0-based) of epochs, reaching target in the last. */
+double prune_schedule(double target, int epoch, int epochs);
+
+#endif
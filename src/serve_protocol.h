@@ -0,0 +1,44 @@
+#ifndef SERVE_PROTOCOL_H
+#define SERVE_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wire format of cnn_server. Both ends run on the same host (Unix domain
+   socket), so fields are in native byte order. A client may keep any
+   number of requests in flight on one connection; responses carry the
+   request id and can come back in any order. */
+
+#define SERVE_REQUEST_MAGIC 0x51524E43   /* "CNRQ" */
+#define SERVE_RESPONSE_MAGIC 0x53524E43  /* "CNRS" */
+#define SERVE_IMAGE_SIZE 784
+#define SERVE_NUM_CLASSES 10
+#define SERVE_DEFAULT_SOCKET "/tmp/cnn_server.sock"
+
+#define SERVE_STATUS_OK 0
+#define SERVE_STATUS_BAD_REQUEST 1
+#define SERVE_STATUS_ERROR 2             /* Inference failed */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t id;
+    uint8_t pixels[SERVE_IMAGE_SIZE];   /* 28x28, row-major, 0-255 */
+} ServeRequest;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t id;
+    uint32_t status;
+    int32_t predicted;
+    double scores[SERVE_NUM_CLASSES];
+} ServeResponse;
+
+/* Read/write exactly `size` bytes, retrying short transfers and EINTR.
+   Return 0 on success, -1 on error or end of stream. */
+int serve_read_full(int fd, void* buffer, size_t size);
+int serve_write_full(int fd, const void* buffer, size_t size);
+
+/* Connects to the server's socket; returns the fd or -1. */
+int serve_connect(const char* socket_path);
+
+#endif
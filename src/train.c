@@ -1,83 +1,530 @@
+#include "async_eval.h"
+#include "checkpoint.h"
 #include "cnn.h"
+#include "cnn_batch.h"
+#include "data_loader.h"
+#include "early_exit.h"
 #include "mnist_loader.h"
 #include "model_io.h"
+#include "optimizer.h"
+#include "performance_metrics.h"
+#include "pruning.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 #define EPOCHS 5
 #define BATCH_SIZE 128
 #define IMAGE_SIZE 784
 #define LEARNING_RATE 0.1
+#define DEFAULT_CHECKPOINT_PATH "./models/cnn_checkpoint.bin"
+#define DEFAULT_MOMENTUM 0.9
+#define DEFAULT_SEED 1
+#define NUM_LAYERS MODEL_NUM_LAYERS
+#define DEFAULT_MODEL_PATH "./models/cnn_model.bin"
+#define DEFAULT_STUDENT_PATH "./models/cnn_student.bin"
+#define DEFAULT_STUDENT_TOPOLOGY "8,16,100,100"
+#define DEFAULT_TEMPERATURE 2.0
+#define DEFAULT_DISTILL_ALPHA 0.5
+#define EXIT_HEAD_EPOCHS 2
+#define PRUNE_EPOCHS 3
+#define DEFAULT_PRUNED_PATH "./models/cnn_pruned.bin"
+#define FINETUNE_EPOCHS 2
+#define DEFAULT_FINETUNED_PATH "./models/cnn_finetuned.bin"
+#define DEFAULT_EXIT_HEAD_PATH "./models/exit_head.bin"
 
-static void train_epoch(Layer* linput, Layer* loutput, 
-                       const MNISTImages* images, const MNISTLabels* labels,
-                       int epoch) {
-    uint8_t img_raw[IMAGE_SIZE];
-    double img_norm[IMAGE_SIZE];
-    double y[10];
-    
-    for (uint32_t i = 0; i < images->num_images; i++) {
-        mnist_get_image(images, i, img_raw);
-        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
-        
-        uint8_t label = mnist_get_label(labels, i);
+typedef struct {
+    int batched;
+    const char* checkpoint_path;
+    uint32_t checkpoint_every;      /* Samples between checkpoints (0: epoch ends only) */
+    const char* resume_path;
+    OptimizerKind optimizer;
+    double momentum;
+    int opt_threads;
+    int shuffle;
+    int max_shift;
+    uint64_t seed;
+    int seed_given;
+    uint32_t eval_every;            /* Samples between accuracy measurements (0: off) */
+    uint32_t eval_limit;            /* Test images per measurement (0: all) */
+    double targets[MAX_ACCURACY_TARGETS];
+    int num_targets;
+    const char* json_path;
+    const char* tag;
+    const char* exit_head_path;     /* Train an early-exit head into this file (NULL: off) */
+    int exit_head_only;             /* Reuse ./models/cnn_model.bin instead of training it */
+    ModelTopology topology;
+    int topology_given;
+    const char* output_path;        /* NULL: DEFAULT_MODEL_PATH, or DEFAULT_STUDENT_PATH when distilling */
+    const char* teacher_path;       /* Distill from this model (NULL: train on labels only) */
+    double temperature;
+    double alpha;                   /* Weight of the teacher's soft targets */
+    double prune_sparsity;          /* Prune FC1/FC2 to this fraction of zeros (0: off) */
+    const char* prune_from;         /* Trained model to prune and fine-tune */
+    const char* finetune_path;      /* Fine-tune this model (NULL: train from scratch) */
+} TrainOptions;
+
+/* Knowledge distillation: each target becomes
+   alpha * softmax(z_teacher / T) + (1 - alpha) * one-hot label.
+   The teacher's softmax outputs p give softmax(z / T) as p^(1/T)
+   renormalized, so its logits are never needed. The teacher runs
+   batched (read-only) on the same minibatch, just before the student's
+   step. */
+typedef struct {
+    Layer* layers[NUM_LAYERS];
+    LayerBatch* batches[NUM_LAYERS];
+    double temperature;
+    double alpha;
+    double* outputs;                /* BATCH_SIZE x 10 */
+    double* targets;                /* BATCH_SIZE x 10 */
+} Distiller;
+
+static Distiller* distiller_create(const char* teacher_path, double temperature, double alpha) {
+    Distiller* d = (Distiller*)calloc(1, sizeof(Distiller));
+    if (d == NULL) return NULL;
+    if (model_open_network(teacher_path, d->layers, NULL) != 0) {
+        free(d);
+        return NULL;
+    }
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        d->batches[l] = LayerBatch_create(d->layers[l], (l > 0) ? d->batches[l - 1] : NULL, BATCH_SIZE);
+    }
+    d->temperature = temperature;
+    d->alpha = alpha;
+    d->outputs = (double*)malloc(BATCH_SIZE * 10 * sizeof(double));
+    d->targets = (double*)malloc(BATCH_SIZE * 10 * sizeof(double));
+    return d;
+}
+
+static void distiller_destroy(Distiller* d) {
+    if (d == NULL) return;
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        LayerBatch_destroy(d->batches[l]);
+    }
+    model_destroy_network(d->layers);
+    free(d->outputs);
+    free(d->targets);
+    free(d);
+}
+
+/* The batch's targets, or the distilled ones when d is not NULL. */
+static const double* batch_targets(Distiller* d, const DataBatch* batch) {
+    if (d == NULL) return batch->targets;
+    LayerBatch_setInputs(d->batches[0], batch->inputs, batch->count);
+    LayerBatch_getOutputs(d->batches[NUM_LAYERS - 1], d->outputs, batch->count);
+    for (int s = 0; s < batch->count; s++) {
+        const double* p = &d->outputs[s * 10];
+        double soft[10];
+        double sum = 0.0;
         for (int j = 0; j < 10; j++) {
-            y[j] = (j == label) ? 1.0 : 0.0;
+            soft[j] = pow(p[j], 1.0 / d->temperature);
+            sum += soft[j];
         }
-        
-        Layer_setInputs(linput, img_norm);
-        Layer_learnOutputs(loutput, y);
-        
-        if ((i % BATCH_SIZE) == 0) {
-            Layer_update(loutput, LEARNING_RATE / BATCH_SIZE);
+        for (int j = 0; j < 10; j++) {
+            d->targets[s * 10 + j] = d->alpha * soft[j] / sum + (1.0 - d->alpha) * batch->targets[s * 10 + j];
         }
+    }
+    return d->targets;
+}
+
+/* What an epoch does besides the plain step on labelled data. */
+typedef struct {
+    int epochs;
+    Distiller* distiller;           /* Soft targets from a teacher (NULL: labels) */
+    Pruner* pruner;                 /* Re-zero pruned weights after each step (NULL: off) */
+    Layer* frozen[NUM_LAYERS];      /* CSR/low-rank layers: biases train, weights stay */
+    int num_frozen;
+} TrainPlan;
+
+/* Drops the frozen layers' weight updates before a step, so their CSR
+   or factors still describe the weights afterwards. */
+static void plan_freeze(const TrainPlan* plan) {
+    for (int f = 0; f < plan->num_frozen; f++) {
+        Layer* layer = plan->frozen[f];
+        memset(layer->u_weights, 0, layer->nweights * sizeof(double));
+    }
+}
+
+/* Periodic checkpoints: the writer is NULL when they are disabled. */
+typedef struct {
+    CheckpointWriter* writer;
+    uint32_t every;
+    uint64_t seed;              /* Data-order seed recorded in the cursor */
+} Checkpointing;
+
+static void checkpoint_maybe(Checkpointing* ckpt, int epoch, uint32_t done, uint32_t prev_done,
+                             uint32_t num_images) {
+    if (ckpt->writer == NULL) return;
+    int periodic = ckpt->every > 0 && (done / ckpt->every) != (prev_done / ckpt->every);
+    if (!periodic && done != num_images) return;
+
+    CheckpointCursor cursor = {0};
+    cursor.epoch = (done == num_images) ? (uint32_t)epoch + 1 : (uint32_t)epoch;
+    cursor.sample = (done == num_images) ? 0 : done;
+    cursor.rng_seed = ckpt->seed;
+    if (checkpoint_writer_request(ckpt->writer, &cursor) != 0) {
+        fprintf(stderr, "\nWarning: a previous checkpoint write failed\n");
+    }
+}
+
+static void checkpoint_settings(const TrainOptions* opts, CheckpointSettings* settings) {
+    memset(settings, 0, sizeof(*settings));
+    settings->shuffle = (uint32_t)opts->shuffle;
+    settings->max_shift = opts->max_shift;
+    settings->optimizer = (uint32_t)opts->optimizer;
+    settings->momentum = opts->momentum;
+}
+
+/* A resumed run must draw and step like the interrupted one. Returns the
+   number of settings that differ from the checkpoint (each is reported). */
+static int check_resume_settings(const CheckpointSettings* saved, const TrainOptions* opts) {
+    if (!saved->recorded) {
+        fprintf(stderr, "Warning: %s predates stored settings; shuffle, --shift, --optimizer and "
+                "--momentum are not checked\n", opts->resume_path);
+        return 0;
+    }
+    int mismatches = 0;
+    if ((int)saved->shuffle != opts->shuffle) {
+        fprintf(stderr, "Checkpoint was saved %s --no-shuffle\n", saved->shuffle ? "without" : "with");
+        mismatches++;
+    }
+    if (saved->max_shift != opts->max_shift) {
+        fprintf(stderr, "Checkpoint was saved with --shift %d, not %d\n", saved->max_shift, opts->max_shift);
+        mismatches++;
+    }
+    if (saved->optimizer != (uint32_t)opts->optimizer) {
+        fprintf(stderr, "Checkpoint was saved with --optimizer %s, not %s\n",
+                optimizer_kind_name((OptimizerKind)saved->optimizer), optimizer_kind_name(opts->optimizer));
+        mismatches++;
+    } else if (opts->optimizer != OPTIMIZER_SGD && saved->momentum != opts->momentum) {
+        fprintf(stderr, "Checkpoint was saved with --momentum %g, not %g\n", saved->momentum, opts->momentum);
+        mismatches++;
+    }
+    return mismatches;
+}
+
+/* Periodic accuracy measurements: eval is NULL when they are disabled. */
+typedef struct {
+    AsyncEvaluator* eval;
+    uint32_t every;
+    double start_time;
+} Evaluation;
+
+static void evaluation_maybe(Evaluation* evaluation, int epoch, uint32_t done, uint32_t prev_done,
+                             uint32_t num_images) {
+    if (evaluation->eval == NULL) return;
+    if ((done / evaluation->every) == (prev_done / evaluation->every)) return;
+    uint64_t samples = (uint64_t)epoch * num_images + done;
+    async_eval_request(evaluation->eval, get_current_time_sec() - evaluation->start_time, samples);
+}
+
+static void train_epoch(Layer* linput, Layer* loutput, Optimizer* opt, DataLoader* loader,
+                       uint32_t num_images, int epoch, uint32_t start, Checkpointing* ckpt,
+                       Evaluation* evaluation, const TrainPlan* plan) {
+    DataBatch batch;
+    
+    data_loader_start_epoch(loader, (uint32_t)epoch, start);
+    while (data_loader_next(loader, &batch)) {
+        const double* targets = batch_targets(plan->distiller, &batch);
+        for (int s = 0; s < batch.count; s++) {
+            uint32_t i = batch.first + s;
+            Layer_setInputs(linput, &batch.inputs[s * batch.image_size]);
+            Layer_learnOutputs(loutput, &targets[s * 10]);
+            
+            /* Step at the end of each batch, averaging over the samples it
+               actually holds (the last batch of an epoch may be short). */
+            if ((i + 1) % BATCH_SIZE == 0 || i + 1 == num_images) {
+                plan_freeze(plan);
+                optimizer_step(opt, LEARNING_RATE / (i % BATCH_SIZE + 1));
+                if (plan->pruner != NULL) pruner_apply(plan->pruner);
+            }
+            checkpoint_maybe(ckpt, epoch, i + 1, i, num_images);
+            evaluation_maybe(evaluation, epoch, i + 1, i, num_images);
+            
+            if ((i % 6000) == 0) {
+                printf("\r  Epoch %d/%d - Progress: %u/%u images (%.1f%%)", 
+                       epoch + 1, plan->epochs, i, num_images, (i * 100.0) / num_images);
+                fflush(stdout);
+            }
+        }
+    }
+    printf("\r  Epoch %d/%d - Completed                              \n", epoch + 1, plan->epochs);
+}
+
+/* Minibatch path: one GEMM-based forward/backward pass per batch. */
+static void train_epoch_batched(LayerBatch* binput, LayerBatch* boutput, Optimizer* opt,
+                                DataLoader* loader, uint32_t num_images,
+                                int epoch, uint32_t start, Checkpointing* ckpt,
+                                Evaluation* evaluation, const TrainPlan* plan) {
+    DataBatch batch;
+    
+    data_loader_start_epoch(loader, (uint32_t)epoch, start);
+    while (data_loader_next(loader, &batch)) {
+        uint32_t base = batch.first;
+        int n = batch.count;
+        
+        LayerBatch_setInputs(binput, batch.inputs, n);
+        LayerBatch_learnOutputs(boutput, batch_targets(plan->distiller, &batch), n);
+        plan_freeze(plan);
+        optimizer_step(opt, LEARNING_RATE / n);
+        if (plan->pruner != NULL) pruner_apply(plan->pruner);
+        checkpoint_maybe(ckpt, epoch, base + n, base, num_images);
+        evaluation_maybe(evaluation, epoch, base + n, base, num_images);
         
-        if ((i % 6000) == 0) {
+        if ((base % 6144) == 0) {
             printf("\r  Epoch %d/%d - Progress: %u/%u images (%.1f%%)", 
-                   epoch + 1, EPOCHS, i, images->num_images,
-                   (i * 100.0) / images->num_images);
+                   epoch + 1, plan->epochs, base, num_images, (base * 100.0) / num_images);
             fflush(stdout);
         }
     }
-    printf("\r  Epoch %d/%d - Completed                              \n", epoch + 1, EPOCHS);
+    printf("\r  Epoch %d/%d - Completed                              \n", epoch + 1, plan->epochs);
+}
+
+static void create_network(Layer** layers, const ModelTopology* topology) {
+    model_create_network(topology, layers, 0.1);
 }
 
-static double test_model(Layer* linput, Layer* loutput,
-                        const MNISTImages* images, const MNISTLabels* labels) {
+static void destroy_network(Layer** layers) {
+    model_destroy_network(layers);
+}
+
+/* Early-exit head: trained after the main network, on its frozen Conv2
+   activations, so the trunk's weights and the saved model are unchanged. */
+static double evaluate_exit_head(Layer** layers, ExitHead* head,
+                                 const MNISTImages* images, const MNISTLabels* labels) {
     uint8_t img_raw[IMAGE_SIZE];
     double img_norm[IMAGE_SIZE];
-    double y[10];
     int correct = 0;
-    
+
     for (uint32_t i = 0; i < images->num_images; i++) {
         mnist_get_image(images, i, img_raw);
         mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
-        
-        Layer_setInputs(linput, img_norm);
-        Layer_getOutputs(loutput, y);
-        
-        int predicted = 0;
-        for (int j = 1; j < 10; j++) {
-            if (y[j] > y[predicted]) {
-                predicted = j;
-            }
-        }
-        
-        uint8_t actual = mnist_get_label(labels, i);
-        if (predicted == actual) {
+        network_forward_until(layers, EXIT_TAP, img_norm);
+
+        int predicted;
+        exit_head_forward(head, layers[EXIT_TAP]->outputs, &predicted, NULL);
+        if (predicted == mnist_get_label(labels, i)) {
             correct++;
         }
     }
-    
     return (correct * 100.0) / images->num_images;
 }
 
+static int train_exit_head(Layer** layers, const char* path, const TrainOptions* opts,
+                           const MNISTImages* train_images, const MNISTLabels* train_labels,
+                           const MNISTImages* test_images, const MNISTLabels* test_labels) {
+    ExitHead head;
+    exit_head_create(&head, layers[EXIT_TAP], 0.1);
+
+    DataLoaderConfig loader_config = {BATCH_SIZE, opts->shuffle, opts->max_shift, opts->seed};
+    DataLoader* loader = data_loader_create(train_images, train_labels, &loader_config);
+    if (loader == NULL) {
+        exit_head_destroy(&head);
+        return -1;
+    }
+
+    printf("  Exit head: Conv2(%d×7×7) → Output(10), %d epochs\n", layers[EXIT_TAP]->depth, EXIT_HEAD_EPOCHS);
+    uint32_t num_images = train_images->num_images;
+    double start_time = get_current_time_sec();
+    DataBatch batch;
+    for (int epoch = 0; epoch < EXIT_HEAD_EPOCHS; epoch++) {
+        data_loader_start_epoch(loader, (uint32_t)epoch, 0);
+        while (data_loader_next(loader, &batch)) {
+            for (int s = 0; s < batch.count; s++) {
+                uint32_t i = batch.first + s;
+                network_forward_until(layers, EXIT_TAP, &batch.inputs[s * batch.image_size]);
+                exit_head_learn(&head, layers[EXIT_TAP]->outputs, &batch.targets[s * 10]);
+                if ((i + 1) % BATCH_SIZE == 0 || i + 1 == num_images) {
+                    exit_head_update(&head, LEARNING_RATE / (i % BATCH_SIZE + 1));
+                }
+            }
+        }
+        printf("  Exit head epoch %d/%d - Completed\n", epoch + 1, EXIT_HEAD_EPOCHS);
+    }
+    data_loader_destroy(loader, NULL);
+    double duration = get_current_time_sec() - start_time;
+
+    double accuracy = evaluate_exit_head(layers, &head, test_images, test_labels);
+    printf("  ✓ Exit head trained in %.2f seconds, test accuracy %.2f%%\n", duration, accuracy);
+
+    int rc = exit_head_save(path, &head);
+    if (rc != 0) {
+        fprintf(stderr, "Failed to save exit head to %s\n", path);
+    } else {
+        printf("  ✓ Exit head saved to: %s\n\n", path);
+    }
+    exit_head_destroy(&head);
+    return rc;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <train-images> <train-labels> <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --batched               Batched GEMM forward/backward pass\n");
+    fprintf(stderr, "  --checkpoint <file>     Checkpoint after every epoch (default %s)\n", DEFAULT_CHECKPOINT_PATH);
+    fprintf(stderr, "  --checkpoint-every <n>  Also checkpoint every n samples\n");
+    fprintf(stderr, "  --resume <file>         Resume from a checkpoint\n");
+    fprintf(stderr, "  --optimizer <name>      sgd (default), momentum or nesterov\n");
+    fprintf(stderr, "  --momentum <mu>         Momentum coefficient (default %.1f)\n", DEFAULT_MOMENTUM);
+    fprintf(stderr, "  --opt-threads <n>       Threads for the optimizer step (default 1)\n");
+    fprintf(stderr, "  --no-shuffle            Visit training images in file order\n");
+    fprintf(stderr, "  --shift <px>            Random shifts of up to +-px pixels (default 0)\n");
+    fprintf(stderr, "  --seed <n>              Data-order seed (default %d, or the resumed one)\n", DEFAULT_SEED);
+    fprintf(stderr, "  --eval-every <n>        Measure test accuracy every n samples, in the background\n");
+    fprintf(stderr, "  --eval-limit <n>        Test images per measurement (default: all)\n");
+    fprintf(stderr, "  --targets <a,b,...>     Accuracies (%%) to report time-to-target for (default 95,97)\n");
+    fprintf(stderr, "  --json <file>           Append a JSON training record to <file>\n");
+    fprintf(stderr, "  --tag <label>           Label stored in the JSON record\n");
+    fprintf(stderr, "  --exit-head <file>      Also train an early-exit head on Conv2 and save it to <file>\n");
+    fprintf(stderr, "  --exit-head-only        Train only the exit head (default file %s) on ./models/cnn_model.bin\n",
+            DEFAULT_EXIT_HEAD_PATH);
+    fprintf(stderr, "  --topology <c1,c2,f1,f2> Conv1/Conv2 channels and FC1/FC2 widths (default 16,32,200,200)\n");
+    fprintf(stderr, "  --output <file>         Where to save the model (default %s)\n", DEFAULT_MODEL_PATH);
+    fprintf(stderr, "  --distill <teacher>     Train a student on the teacher's softened outputs\n");
+    fprintf(stderr, "                          (topology %s, saved to %s unless given)\n",
+            DEFAULT_STUDENT_TOPOLOGY, DEFAULT_STUDENT_PATH);
+    fprintf(stderr, "  --temperature <T>       Distillation temperature (default %.1f)\n", DEFAULT_TEMPERATURE);
+    fprintf(stderr, "  --alpha <a>             Weight of the soft targets vs. the labels (default %.1f)\n",
+            DEFAULT_DISTILL_ALPHA);
+    fprintf(stderr, "  --prune <s>             Prune FC1/FC2 to sparsity s (e.g. 0.9) while fine-tuning %d epochs;\n",
+            PRUNE_EPOCHS);
+    fprintf(stderr, "                          saved with CSR layers to %s unless given\n", DEFAULT_PRUNED_PATH);
+    fprintf(stderr, "  --prune-from <file>     Model to prune (default %s)\n", DEFAULT_MODEL_PATH);
+    fprintf(stderr, "  --finetune <file>       Fine-tune a saved model for %d epochs (e.g. from factorize_model);\n",
+            FINETUNE_EPOCHS);
+    fprintf(stderr, "                          its CSR and low-rank layers keep their weights. Saved to %s\n",
+            DEFAULT_FINETUNED_PATH);
+    fprintf(stderr, "                          unless given\n");
+}
+
+static int parse_targets(const char* list, TrainOptions* opts) {
+    opts->num_targets = 0;
+    const char* p = list;
+    while (*p != '\0') {
+        char* end;
+        double target = strtod(p, &end);
+        if (end == p || target <= 0.0 || target > 100.0 || opts->num_targets == MAX_ACCURACY_TARGETS) {
+            return -1;
+        }
+        opts->targets[opts->num_targets++] = target;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return -1;
+    }
+    return opts->num_targets > 0 ? 0 : -1;
+}
+
+static int parse_args(int argc, char* argv[], TrainOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->optimizer = OPTIMIZER_SGD;
+    opts->momentum = DEFAULT_MOMENTUM;
+    opts->opt_threads = 1;
+    opts->shuffle = 1;
+    opts->seed = DEFAULT_SEED;
+    opts->targets[0] = 95.0;
+    opts->targets[1] = 97.0;
+    opts->num_targets = 2;
+    opts->topology = MODEL_TOPOLOGY_DEFAULT;
+    opts->temperature = DEFAULT_TEMPERATURE;
+    opts->alpha = DEFAULT_DISTILL_ALPHA;
+    if (argc < 5) return -1;
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "--batched") == 0) {
+            opts->batched = 1;
+        } else if (strcmp(argv[i], "--no-shuffle") == 0) {
+            opts->shuffle = 0;
+        } else if (strcmp(argv[i], "--exit-head-only") == 0) {
+            opts->exit_head_only = 1;
+        } else if (i + 1 >= argc) {
+            return -1;
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            opts->checkpoint_path = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0) {
+            long every = atol(argv[++i]);
+            if (every < 1) return -1;
+            opts->checkpoint_every = (uint32_t)every;
+            if (opts->checkpoint_path == NULL) opts->checkpoint_path = DEFAULT_CHECKPOINT_PATH;
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            opts->resume_path = argv[++i];
+        } else if (strcmp(argv[i], "--optimizer") == 0) {
+            if (optimizer_parse_kind(argv[++i], &opts->optimizer) != 0) return -1;
+        } else if (strcmp(argv[i], "--momentum") == 0) {
+            opts->momentum = atof(argv[++i]);
+            if (opts->momentum < 0.0 || opts->momentum >= 1.0) return -1;
+        } else if (strcmp(argv[i], "--opt-threads") == 0) {
+            opts->opt_threads = atoi(argv[++i]);
+            if (opts->opt_threads < 1) return -1;
+        } else if (strcmp(argv[i], "--shift") == 0) {
+            opts->max_shift = atoi(argv[++i]);
+            if (opts->max_shift < 0 || opts->max_shift > 8) return -1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            opts->seed = strtoull(argv[++i], NULL, 10);
+            opts->seed_given = 1;
+        } else if (strcmp(argv[i], "--eval-every") == 0) {
+            long every = atol(argv[++i]);
+            if (every < 1) return -1;
+            opts->eval_every = (uint32_t)every;
+        } else if (strcmp(argv[i], "--eval-limit") == 0) {
+            long limit = atol(argv[++i]);
+            if (limit < 1) return -1;
+            opts->eval_limit = (uint32_t)limit;
+        } else if (strcmp(argv[i], "--targets") == 0) {
+            if (parse_targets(argv[++i], opts) != 0) return -1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opts->json_path = argv[++i];
+        } else if (strcmp(argv[i], "--tag") == 0) {
+            opts->tag = argv[++i];
+        } else if (strcmp(argv[i], "--exit-head") == 0) {
+            opts->exit_head_path = argv[++i];
+        } else if (strcmp(argv[i], "--topology") == 0) {
+            if (model_topology_parse(argv[++i], &opts->topology) != 0) return -1;
+            opts->topology_given = 1;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            opts->output_path = argv[++i];
+        } else if (strcmp(argv[i], "--distill") == 0) {
+            opts->teacher_path = argv[++i];
+        } else if (strcmp(argv[i], "--temperature") == 0) {
+            opts->temperature = atof(argv[++i]);
+            if (opts->temperature <= 0.0) return -1;
+        } else if (strcmp(argv[i], "--prune") == 0) {
+            opts->prune_sparsity = atof(argv[++i]);
+            if (opts->prune_sparsity <= 0.0 || opts->prune_sparsity >= 1.0) return -1;
+        } else if (strcmp(argv[i], "--prune-from") == 0) {
+            opts->prune_from = argv[++i];
+        } else if (strcmp(argv[i], "--finetune") == 0) {
+            opts->finetune_path = argv[++i];
+        } else if (strcmp(argv[i], "--alpha") == 0) {
+            opts->alpha = atof(argv[++i]);
+            if (opts->alpha < 0.0 || opts->alpha > 1.0) return -1;
+        } else {
+            return -1;
+        }
+    }
+    if (opts->exit_head_only && opts->exit_head_path == NULL) {
+        opts->exit_head_path = DEFAULT_EXIT_HEAD_PATH;
+    }
+    if (opts->teacher_path != NULL) {
+        if (!opts->topology_given) model_topology_parse(DEFAULT_STUDENT_TOPOLOGY, &opts->topology);
+        if (opts->output_path == NULL) opts->output_path = DEFAULT_STUDENT_PATH;
+    }
+    if (opts->prune_sparsity > 0.0) {
+        if (opts->prune_from == NULL) opts->prune_from = DEFAULT_MODEL_PATH;
+        if (opts->output_path == NULL) opts->output_path = DEFAULT_PRUNED_PATH;
+    }
+    if (opts->finetune_path != NULL) {
+        if (opts->prune_sparsity > 0.0) return -1;
+        if (opts->output_path == NULL) opts->output_path = DEFAULT_FINETUNED_PATH;
+    }
+    if (opts->output_path == NULL) opts->output_path = DEFAULT_MODEL_PATH;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <train-images> <train-labels> <test-images> <test-labels>\n", argv[0]);
+    TrainOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        usage(argv[0]);
         return 1;
     }
+    int batched = opts.batched;
     
     printf("[1/6] Loading MNIST training dataset...\n");
     MNISTImages train_images;
@@ -118,64 +565,364 @@ int main(int argc, char* argv[]) {
     printf("  ✓ Loaded %u test images\n\n", test_images.num_images);
     
     printf("[3/6] Initializing CNN architecture...\n");
-    Layer* linput = Layer_create_input(1, 28, 28);
-    Layer* lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
-    Layer* lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
-    Layer* lfull1 = Layer_create_full(lconv2, 200, 0.1);
-    Layer* lfull2 = Layer_create_full(lfull1, 200, 0.1);
-    Layer* loutput = Layer_create_full(lfull2, 10, 0.1);
+    Layer* layers[NUM_LAYERS];
+    char network[192];
+    
+    if (opts.exit_head_only) {
+        int rc = 1;
+        ModelTopology trained;
+        if (model_open_network(DEFAULT_MODEL_PATH, layers, &trained) != 0) {
+            fprintf(stderr, "Failed to load %s\n", DEFAULT_MODEL_PATH);
+        } else {
+            model_topology_describe(&trained, network, sizeof(network));
+            printf("  ✓ Network: %s\n\n", network);
+            printf("[4/6] Training early-exit head on %s...\n", DEFAULT_MODEL_PATH);
+            rc = train_exit_head(layers, opts.exit_head_path, &opts, &train_images, &train_labels,
+                                 &test_images, &test_labels) != 0;
+            destroy_network(layers);
+        }
+        mnist_free_images(&train_images);
+        mnist_free_labels(&train_labels);
+        mnist_free_images(&test_images);
+        mnist_free_labels(&test_labels);
+        return rc;
+    }
+    
+    TrainPlan plan = {EPOCHS, NULL, NULL, {NULL}, 0};
+    if (opts.finetune_path != NULL) {
+        if (model_open_network(opts.finetune_path, layers, &opts.topology) != 0) {
+            fprintf(stderr, "Failed to load %s for fine-tuning\n", opts.finetune_path);
+            return 1;
+        }
+        for (int l = 0; l < NUM_LAYERS; l++) {
+            Layer* layer = layers[l];
+            if (layer->ltype == LAYER_FULL &&
+                (layer->data.full.rowptr != NULL || layer->data.full.rank > 0)) {
+                plan.frozen[plan.num_frozen++] = layer;
+            }
+        }
+        /* The optimizer bypasses Layer_update: train on the direct conv kernel. */
+        for (int l = 0; l < NUM_LAYERS; l++) {
+            if (layers[l]->ltype == LAYER_CONV) Layer_direct(layers[l]);
+        }
+        plan.epochs = FINETUNE_EPOCHS;
+    } else if (opts.prune_sparsity > 0.0) {
+        /* Fine-tune a trained model; its widths come from the file. */
+        if (model_open_network(opts.prune_from, layers, &opts.topology) != 0) {
+            fprintf(stderr, "Failed to load %s for pruning\n", opts.prune_from);
+            return 1;
+        }
+        for (int l = 0; l < NUM_LAYERS; l++) {
+            if (layers[l]->ltype == LAYER_FULL) Layer_densify(layers[l]);
+            if (layers[l]->ltype == LAYER_CONV) Layer_direct(layers[l]);
+        }
+        plan.epochs = PRUNE_EPOCHS;
+        plan.pruner = pruner_create(layers, NUM_LAYERS);
+        if (plan.pruner == NULL) {
+            fprintf(stderr, "Failed to create pruning masks\n");
+            return 1;
+        }
+    } else {
+        create_network(layers, &opts.topology);
+    }
+    Layer* linput = layers[0];
+    Layer* loutput = layers[NUM_LAYERS - 1];
+    
+    model_topology_describe(&opts.topology, network, sizeof(network));
+    printf("  ✓ Network: %s (%ld multiply-adds per image)\n", network, model_topology_macs(&opts.topology));
+    if (plan.pruner != NULL) {
+        printf("  ✓ Pruning %s: FC1/FC2 to %.0f%% sparsity over %d fine-tuning epochs\n", opts.prune_from,
+               opts.prune_sparsity * 100.0, plan.epochs);
+    }
+    if (opts.finetune_path != NULL) {
+        printf("  ✓ Fine-tuning %s for %d epochs\n", opts.finetune_path, plan.epochs);
+        for (int f = 0; f < plan.num_frozen; f++) {
+            const Layer* layer = plan.frozen[f];
+            if (layer->data.full.rank > 0) {
+                printf("    Layer %d: rank-%d factors fixed, biases trained\n", layer->lid, layer->data.full.rank);
+            } else {
+                printf("    Layer %d: CSR weights fixed, biases trained\n", layer->lid);
+            }
+        }
+    }
+    
+    if (opts.teacher_path != NULL) {
+        plan.distiller = distiller_create(opts.teacher_path, opts.temperature, opts.alpha);
+        if (plan.distiller == NULL) {
+            fprintf(stderr, "Failed to load teacher model %s\n", opts.teacher_path);
+            return 1;
+        }
+        ModelTopology teacher;
+        model_read_topology(opts.teacher_path, &teacher);
+        printf("  ✓ Teacher: %s (%ld multiply-adds), T=%.1f, alpha=%.2f\n", opts.teacher_path,
+               model_topology_macs(&teacher), opts.temperature, opts.alpha);
+    }
+    printf("\n");
+    
+    Optimizer* opt = optimizer_create(layers, NUM_LAYERS, opts.optimizer, opts.momentum, opts.opt_threads);
+    if (opt == NULL) {
+        fprintf(stderr, "Failed to create optimizer\n");
+        return 1;
+    }
+    size_t opt_state_count;
+    double* opt_state = optimizer_state(opt, &opt_state_count);
+    
+    CheckpointSettings settings;
+    checkpoint_settings(&opts, &settings);
+    CheckpointCursor cursor = {0};
+    if (opts.resume_path != NULL) {
+        CheckpointSettings saved;
+        if (checkpoint_read_settings(opts.resume_path, &saved) != 0) {
+            return 1;
+        }
+        if (check_resume_settings(&saved, &opts) != 0) {
+            fprintf(stderr, "Refusing to resume from %s with different settings\n", opts.resume_path);
+            return 1;
+        }
+        if (checkpoint_load(opts.resume_path, layers, NUM_LAYERS, opt_state, opt_state_count,
+                            &cursor, NULL) != 0) {
+            fprintf(stderr, "Failed to resume from %s\n", opts.resume_path);
+            return 1;
+        }
+        printf("  ✓ Resumed from %s (epoch %u, sample %u)\n\n",
+               opts.resume_path, cursor.epoch + 1, cursor.sample);
+        /* Keep the data order of the interrupted run. */
+        if (!opts.seed_given) opts.seed = cursor.rng_seed;
+    }
+    
+    DataLoaderConfig loader_config = {BATCH_SIZE, opts.shuffle, opts.max_shift, opts.seed};
+    DataLoader* loader = data_loader_create(&train_images, &train_labels, &loader_config);
+    if (loader == NULL) {
+        return 1;
+    }
     
-    printf("  ✓ Network: Input(1×28×28) → Conv1(16×14×14) → Conv2(32×7×7) → FC1(200) → FC2(200) → Output(10)\n\n");
+    Checkpointing ckpt = {NULL, opts.checkpoint_every, opts.seed};
+    if (opts.checkpoint_path != NULL) {
+        ckpt.writer = checkpoint_writer_create(opts.checkpoint_path, layers, NUM_LAYERS, opt_state, opt_state_count,
+                                               &settings);
+        if (ckpt.writer == NULL) {
+            return 1;
+        }
+    }
     
-    printf("[4/6] Training model (%d epochs, batch size %d)...\n", EPOCHS, BATCH_SIZE);
+    printf("[4/6] Training model (%d epochs, batch size %d%s)...\n", plan.epochs, BATCH_SIZE,
+           batched ? ", batched GEMM" : "");
+    if (opts.optimizer == OPTIMIZER_SGD) {
+        printf("  Optimizer: sgd (%d thread%s)\n", opts.opt_threads, opts.opt_threads > 1 ? "s" : "");
+    } else {
+        printf("  Optimizer: %s, mu=%.2f (%d thread%s)\n", optimizer_kind_name(opts.optimizer),
+               opts.momentum, opts.opt_threads, opts.opt_threads > 1 ? "s" : "");
+    }
+    if (opts.shuffle) {
+        printf("  Data: shuffled (seed %llu), shifts up to %d px\n", (unsigned long long)opts.seed, opts.max_shift);
+    } else {
+        printf("  Data: file order, shifts up to %d px\n", opts.max_shift);
+    }
+    if (ckpt.writer != NULL) {
+        if (ckpt.every > 0) {
+            printf("  Checkpoints: %s (every %u samples and epoch)\n", opts.checkpoint_path, ckpt.every);
+        } else {
+            printf("  Checkpoints: %s (every epoch)\n", opts.checkpoint_path);
+        }
+    }
     
-    time_t start_time = time(NULL);
+    LayerBatch* batches[NUM_LAYERS] = {NULL};
+    if (batched) {
+        for (int l = 0; l < NUM_LAYERS; l++) {
+            batches[l] = LayerBatch_create(layers[l], (l > 0) ? batches[l - 1] : NULL, BATCH_SIZE);
+        }
+    }
     
-    for (int epoch = 0; epoch < EPOCHS; epoch++) {
-        train_epoch(linput, loutput, &train_images, &train_labels, epoch);
+    Layer* eval_layers[NUM_LAYERS];
+    Evaluation evaluation = {NULL, opts.eval_every, 0.0};
+    if (opts.eval_every > 0) {
+        create_network(eval_layers, &opts.topology);
+        evaluation.eval = async_eval_create(layers, eval_layers, NUM_LAYERS,
+                                            &test_images, &test_labels, opts.eval_limit);
+        if (evaluation.eval == NULL) {
+            return 1;
+        }
+        printf("  Accuracy: every %u samples on %u test images (background)\n", opts.eval_every,
+               (opts.eval_limit > 0 && opts.eval_limit < test_images.num_images) ? opts.eval_limit
+                                                                                 : test_images.num_images);
     }
     
-    time_t end_time = time(NULL);
-    double training_duration = difftime(end_time, start_time);
+    double start_time = get_current_time_sec();
+    evaluation.start_time = start_time;
+    uint64_t samples_trained = 0;
+    
+    for (int epoch = (int)cursor.epoch; epoch < plan.epochs; epoch++) {
+        uint32_t start = (epoch == (int)cursor.epoch) ? cursor.sample : 0;
+        if (plan.pruner != NULL) {
+            pruner_prune(plan.pruner, prune_schedule(opts.prune_sparsity, epoch, plan.epochs));
+        }
+        if (batched) {
+            train_epoch_batched(batches[0], batches[NUM_LAYERS - 1], opt, loader, train_images.num_images,
+                                epoch, start, &ckpt, &evaluation, &plan);
+        } else {
+            train_epoch(linput, loutput, opt, loader, train_images.num_images, epoch, start, &ckpt,
+                        &evaluation, &plan);
+        }
+        samples_trained += train_images.num_images - start;
+    }
+    
+    double training_duration = get_current_time_sec() - start_time;
+    
+    DataLoaderStats loader_stats;
+    data_loader_destroy(loader, &loader_stats);
+    
+    CheckpointStats ckpt_stats = {0};
+    if (ckpt.writer != NULL && checkpoint_writer_destroy(ckpt.writer, &ckpt_stats) != 0) {
+        fprintf(stderr, "Warning: writing the last checkpoint failed\n");
+    }
+    
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        if (batches[l] != NULL) LayerBatch_destroy(batches[l]);
+    }
+    optimizer_destroy(opt);
+    distiller_destroy(plan.distiller);
+    
+    /* From here on FC1/FC2 run the sparse kernels. */
+    if (plan.pruner != NULL) {
+        pruner_finish(plan.pruner);
+    }
     
-    printf("  ✓ Training completed in %.0f seconds\n\n", training_duration);
+    printf("  ✓ Training completed in %.2f seconds (%.0f samples/s)\n\n", training_duration,
+           samples_trained / training_duration);
     
     printf("[5/6] Evaluating model on test set...\n");
-    double accuracy = test_model(linput, loutput, &test_images, &test_labels);
+    double accuracy = evaluate_accuracy(linput, loutput, &test_images, &test_labels, test_images.num_images);
     printf("  ✓ Test Accuracy: %.2f%%\n\n", accuracy);
     
+    /* The interval measurements, then a final one on the same first
+       eval_images test images; the full test-set accuracy is reported
+       separately and never decides a target. */
+    int eval_images = (opts.eval_limit > 0 && opts.eval_limit < test_images.num_images)
+                          ? (int)opts.eval_limit : (int)test_images.num_images;
+    double series_accuracy = (eval_images == (int)test_images.num_images)
+                                 ? accuracy
+                                 : evaluate_accuracy(linput, loutput, &test_images, &test_labels, eval_images);
+    TrainingMetrics training;
+    memset(&training, 0, sizeof(training));
+    int num_points = 0;
+    int dropped = 0;
+    AccuracyPoint* points = NULL;
+    if (evaluation.eval != NULL) {
+        points = async_eval_finish(evaluation.eval, &num_points, &dropped);
+        destroy_network(eval_layers);
+    }
+    points = (AccuracyPoint*)realloc(points, (num_points + 1) * sizeof(AccuracyPoint));
+    points[num_points].time = training_duration;
+    points[num_points].samples = (uint64_t)plan.epochs * train_images.num_images;
+    points[num_points].accuracy = series_accuracy;
+    num_points++;
+    
+    training.epochs = plan.epochs;
+    training.samples = samples_trained;
+    training.train_time = training_duration;
+    training.samples_per_sec = samples_trained / training_duration;
+    training.eval_images = eval_images;
+    training.final_accuracy = accuracy;
+    training.num_targets = opts.num_targets;
+    for (int t = 0; t < opts.num_targets; t++) {
+        training.targets[t].accuracy = opts.targets[t];
+    }
+    training.points = points;
+    training.num_points = num_points;
+    training_metrics_find_targets(&training);
+    
     printf("[6/6] Saving trained model...\n");
-    Layer* layers[] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
     
-    if (model_save("./models/cnn_model.bin", layers, 6) != 0) {
+    if (model_save(opts.output_path, layers, NUM_LAYERS) != 0) {
         fprintf(stderr, "Failed to save model\n");
         return 1;
     }
     
-    printf("  ✓ Model saved to: ./models/cnn_model.bin\n\n");
+    printf("  ✓ Model saved to: %s\n\n", opts.output_path);
+    
+    if (opts.exit_head_path != NULL &&
+        train_exit_head(layers, opts.exit_head_path, &opts, &train_images, &train_labels,
+                        &test_images, &test_labels) != 0) {
+        return 1;
+    }
     
     printf("==========================================================================\n");
     printf("                    TRAINING SUMMARY                                     \n");
     printf("==========================================================================\n");
     printf("  Training Images:   %u\n", train_images.num_images);
     printf("  Test Images:       %u\n", test_images.num_images);
-    printf("  Epochs:            %d\n", EPOCHS);
+    printf("  Epochs:            %d\n", plan.epochs);
     printf("  Batch Size:        %d\n", BATCH_SIZE);
-    printf("  Training Time:     %.0f seconds\n", training_duration);
+    printf("  Network:           %s\n", network);
+    if (opts.teacher_path != NULL) {
+        printf("  Distilled From:    %s (T=%.1f, alpha=%.2f)\n", opts.teacher_path, opts.temperature, opts.alpha);
+    }
+    if (opts.finetune_path != NULL) {
+        printf("  Fine-tuned From:   %s (%d layers with fixed weights)\n", opts.finetune_path, plan.num_frozen);
+    }
+    if (plan.pruner != NULL) {
+        for (int p = 0; p < plan.pruner->num_layers; p++) {
+            const Layer* layer = plan.pruner->layers[p];
+            printf("  Pruned FC%d:        %d of %d weights kept (%.1f%% sparse, CSR)\n", p + 1,
+                   layer->data.full.nnz, layer->nweights,
+                   100.0 * (layer->nweights - layer->data.full.nnz) / layer->nweights);
+        }
+    }
+    printf("  Optimizer:         %s\n", optimizer_kind_name(opts.optimizer));
+    printf("  Input Pipeline:    %d batches (prepared in background %.1f ms, stalled %.1f ms)\n",
+           loader_stats.batches, loader_stats.prepare_time * 1000.0, loader_stats.stall_time * 1000.0);
+    printf("  Training Time:     %.2f seconds (%.0f samples/s)\n", training_duration,
+           training.samples_per_sec);
     printf("  Final Accuracy:    %.2f%%\n", accuracy);
+    if (eval_images != (int)test_images.num_images) {
+        printf("  Final on First %d: %.2f%% (time-to-target images)\n", eval_images, series_accuracy);
+    }
+    for (int t = 0; t < training.num_targets; t++) {
+        const AccuracyTarget* target = &training.targets[t];
+        if (target->reached) {
+            printf("  Time to %.2f%%:    %.2f seconds (%llu samples)\n", target->accuracy, target->time,
+                   (unsigned long long)target->samples);
+        } else {
+            printf("  Time to %.2f%%:    not reached\n", target->accuracy);
+        }
+    }
+    if (evaluation.every > 0) {
+        printf("  Measurements:      %d (%d superseded before they ran)\n", num_points - 1, dropped);
+    }
+    if (opts.checkpoint_path != NULL) {
+        printf("  Checkpoints:       %d written (snapshot %.1f ms, stalled %.1f ms, background write %.1f ms)\n",
+               ckpt_stats.written, ckpt_stats.snapshot_time * 1000.0, ckpt_stats.stall_time * 1000.0,
+               ckpt_stats.write_time * 1000.0);
+    }
     printf("==========================================================================\n");
     
+    if (opts.json_path != NULL) {
+        RunConfig config;
+        if (opts.finetune_path != NULL) {
+            run_config_init(&config, batched ? "train_finetune_batched" : "train_finetune", 1);
+        } else if (plan.pruner != NULL) {
+            run_config_init(&config, batched ? "train_prune_batched" : "train_prune", 1);
+        } else if (opts.teacher_path != NULL) {
+            run_config_init(&config, batched ? "train_distill_batched" : "train_distill", 1);
+        } else {
+            run_config_init(&config, batched ? "train_serial_batched" : "train_serial", 1);
+        }
+        config.batch_size = BATCH_SIZE;
+        config.images_path = argv[1];
+        config.tag = opts.tag;
+        if (training_metrics_append_json(opts.json_path, &training, &config) == 0) {
+            printf("  ✓ Training record appended to %s\n", opts.json_path);
+        }
+    }
+    free(points);
+    
     mnist_free_images(&train_images);
     mnist_free_labels(&train_labels);
     mnist_free_images(&test_images);
     mnist_free_labels(&test_labels);
     
-    Layer_destroy(loutput);
-    Layer_destroy(lfull2);
-    Layer_destroy(lfull1);
-    Layer_destroy(lconv2);
-    Layer_destroy(lconv1);
-    Layer_destroy(linput);
+    pruner_destroy(plan.pruner);
+    destroy_network(layers);
     
     return 0;
 }
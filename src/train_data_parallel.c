@@ -0,0 +1,512 @@
+/*
+  train_data_parallel.c
+  Data-parallel MPI training.
+
+  Every rank holds a full replica of the network. Each minibatch is split
+  across the ranks, the accumulated u_weights/u_biases are summed with
+  MPI_Allreduce and every rank applies the same Layer_update, so the
+  replicas stay bit-for-bit identical (checked after every epoch).
+
+  With --overlap the reduction is bucketed and non-blocking: as soon as
+  the backward pass of the last layer in a bucket completes, the bucket
+  is packed and an MPI_Iallreduce is started, so communication of the
+  output/FC layers overlaps backprop of the conv layers. The trainer
+  only waits for the buckets before Layer_update.
+
+  Usage:
+  $ mpirun -np 4 ./train_data_parallel <train-images> <train-labels>
+                 <test-images> <test-labels> [options]
+*/
+
+#include "cnn.h"
+#include "mnist_loader.h"
+#include "model_io.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_LAYERS 6
+#define IMAGE_SIZE 784
+#define DEFAULT_EPOCHS 5
+#define DEFAULT_BATCH_SIZE 128
+#define DEFAULT_SEED 0
+#define DEFAULT_BUCKET_KB 512
+#define LEARNING_RATE 0.1
+
+typedef struct {
+    const char* train_images;
+    const char* train_labels;
+    const char* test_images;
+    const char* test_labels;
+    int epochs;
+    int batch_size;
+    unsigned int seed;
+    double target_accuracy;
+    const char* save_path;
+    int overlap;
+    int bucket_kb;
+} TrainOptions;
+
+/* A run of consecutive layers [first, last] reduced as one message.
+   Backprop visits last..first, so the bucket is ready after `first`. */
+typedef struct {
+    int first;
+    int last;
+    size_t count;
+    double* buffer;
+    MPI_Request request;
+} GradientBucket;
+
+typedef struct {
+    Layer** layers;
+    GradientBucket buckets[NUM_LAYERS];
+    int num_buckets;
+    int launched;
+    int armed;
+} OverlapState;
+
+typedef struct {
+    double compute_time;
+    double comm_time;
+} EpochTimes;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <train-images> <train-labels> <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --epochs <n>      Training epochs (default %d)\n", DEFAULT_EPOCHS);
+    fprintf(stderr, "  --batch <n>       Global minibatch size (default %d)\n", DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  --seed <n>        Weight initialisation seed (default %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "  --target <acc>    Report time to reach this test accuracy (%%)\n");
+    fprintf(stderr, "  --save <file>     Save the trained model (rank 0)\n");
+    fprintf(stderr, "  --overlap         Overlap bucketed MPI_Iallreduce with backprop\n");
+    fprintf(stderr, "  --bucket-kb <n>   Gradient bucket cap for --overlap (default %d)\n", DEFAULT_BUCKET_KB);
+}
+
+static int parse_args(int argc, char* argv[], TrainOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->epochs = DEFAULT_EPOCHS;
+    opts->batch_size = DEFAULT_BATCH_SIZE;
+    opts->seed = DEFAULT_SEED;
+    opts->target_accuracy = 97.0;
+    opts->bucket_kb = DEFAULT_BUCKET_KB;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--overlap") == 0) {
+            opts->overlap = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            if (i + 1 >= argc) return -1;
+            if (strcmp(argv[i], "--epochs") == 0) {
+                opts->epochs = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--batch") == 0) {
+                opts->batch_size = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--seed") == 0) {
+                opts->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--target") == 0) {
+                opts->target_accuracy = atof(argv[++i]);
+            } else if (strcmp(argv[i], "--save") == 0) {
+                opts->save_path = argv[++i];
+            } else if (strcmp(argv[i], "--bucket-kb") == 0) {
+                opts->bucket_kb = atoi(argv[++i]);
+            } else {
+                return -1;
+            }
+        } else {
+            const char** slots[] = {&opts->train_images, &opts->train_labels,
+                                    &opts->test_images, &opts->test_labels};
+            if (positional >= 4) return -1;
+            *slots[positional++] = argv[i];
+        }
+    }
+    if (positional != 4 || opts->epochs < 1 || opts->batch_size < 1 || opts->bucket_kb < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Sum the gradient accumulators of every layer across all ranks. */
+static void allreduce_gradients(Layer** layers, int num_layers) {
+    for (int l = 1; l < num_layers; l++) {
+        Layer* layer = layers[l];
+        MPI_Allreduce(MPI_IN_PLACE, layer->u_weights, layer->nweights,
+                      MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, layer->u_biases, layer->nbiases,
+                      MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+}
+
+/* Group layers into buckets in backprop order. A bucket is closed when
+   adding the next layer would exceed the cap; a layer larger than the
+   cap gets a bucket of its own. */
+static void overlap_init(OverlapState* state, Layer** layers, int num_layers, size_t cap_bytes) {
+    memset(state, 0, sizeof(*state));
+    state->layers = layers;
+
+    size_t bytes = 0;
+    int nb = -1;
+    for (int l = num_layers - 1; l >= 1; l--) {
+        size_t layer_bytes = (size_t)(layers[l]->nweights + layers[l]->nbiases) * sizeof(double);
+        if (nb < 0 || bytes + layer_bytes > cap_bytes) {
+            nb++;
+            state->buckets[nb].last = l;
+            bytes = 0;
+        }
+        state->buckets[nb].first = l;
+        state->buckets[nb].count += (size_t)(layers[l]->nweights + layers[l]->nbiases);
+        bytes += layer_bytes;
+    }
+    state->num_buckets = nb + 1;
+    for (int b = 0; b < state->num_buckets; b++) {
+        state->buckets[b].buffer = (double*)malloc(state->buckets[b].count * sizeof(double));
+        state->buckets[b].request = MPI_REQUEST_NULL;
+    }
+}
+
+static void overlap_free(OverlapState* state) {
+    for (int b = 0; b < state->num_buckets; b++) {
+        free(state->buckets[b].buffer);
+    }
+}
+
+static void overlap_launch(OverlapState* state, int b) {
+    GradientBucket* bucket = &state->buckets[b];
+    double* p = bucket->buffer;
+    for (int l = bucket->last; l >= bucket->first; l--) {
+        Layer* layer = state->layers[l];
+        memcpy(p, layer->u_weights, layer->nweights * sizeof(double));
+        p += layer->nweights;
+        memcpy(p, layer->u_biases, layer->nbiases * sizeof(double));
+        p += layer->nbiases;
+    }
+    MPI_Iallreduce(MPI_IN_PLACE, bucket->buffer, (int)bucket->count, MPI_DOUBLE,
+                   MPI_SUM, MPI_COMM_WORLD, &bucket->request);
+    state->launched++;
+}
+
+/* LayerHook: start the bucket whose last-visited layer just finished,
+   and give outstanding reductions a chance to progress. */
+static void overlap_hook(Layer* layer, void* ctx) {
+    OverlapState* state = (OverlapState*)ctx;
+    if (!state->armed) return;
+
+    for (int b = state->launched; b < state->num_buckets; b++) {
+        if (state->buckets[b].first == layer->lid) {
+            overlap_launch(state, b);
+            break;
+        }
+    }
+    for (int b = 0; b < state->launched; b++) {
+        int done;
+        MPI_Test(&state->buckets[b].request, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+/* Wait for every bucket and scatter the sums back into the layers. */
+static void overlap_finish(OverlapState* state) {
+    while (state->launched < state->num_buckets) {
+        overlap_launch(state, state->launched);
+    }
+    for (int b = 0; b < state->num_buckets; b++) {
+        GradientBucket* bucket = &state->buckets[b];
+        MPI_Wait(&bucket->request, MPI_STATUS_IGNORE);
+        const double* p = bucket->buffer;
+        for (int l = bucket->last; l >= bucket->first; l--) {
+            Layer* layer = state->layers[l];
+            memcpy(layer->u_weights, p, layer->nweights * sizeof(double));
+            p += layer->nweights;
+            memcpy(layer->u_biases, p, layer->nbiases * sizeof(double));
+            p += layer->nbiases;
+        }
+    }
+    state->launched = 0;
+    state->armed = 0;
+}
+
+static void broadcast_parameters(Layer** layers, int num_layers) {
+    for (int l = 1; l < num_layers; l++) {
+        MPI_Bcast(layers[l]->weights, layers[l]->nweights, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Bcast(layers[l]->biases, layers[l]->nbiases, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    }
+}
+
+/* FNV-1a over the raw parameter bytes: equal only if bit-for-bit equal. */
+static uint64_t parameters_hash(Layer** layers, int num_layers) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int l = 1; l < num_layers; l++) {
+        const unsigned char* w = (const unsigned char*)layers[l]->weights;
+        const unsigned char* b = (const unsigned char*)layers[l]->biases;
+        for (size_t i = 0; i < layers[l]->nweights * sizeof(double); i++) {
+            hash = (hash ^ w[i]) * 0x100000001b3ULL;
+        }
+        for (size_t i = 0; i < layers[l]->nbiases * sizeof(double); i++) {
+            hash = (hash ^ b[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+/* Returns 1 if all ranks hold identical parameters. */
+static int replicas_in_sync(Layer** layers, int num_layers) {
+    uint64_t hash = parameters_hash(layers, num_layers);
+    uint64_t min_hash, max_hash;
+    MPI_Allreduce(&hash, &min_hash, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&hash, &max_hash, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    return min_hash == max_hash;
+}
+
+static EpochTimes train_epoch(Layer** layers, const MNISTImages* images, const MNISTLabels* labels,
+                              int batch_size, int rank, int size, OverlapState* overlap) {
+    Layer* linput = layers[0];
+    Layer* loutput = layers[NUM_LAYERS - 1];
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    double y[10];
+    EpochTimes times = {0.0, 0.0};
+
+    for (uint32_t base = 0; base < images->num_images; base += (uint32_t)batch_size) {
+        uint32_t end = base + (uint32_t)batch_size;
+        if (end > images->num_images) end = images->num_images;
+
+        /* Each rank learns a strided shard of the minibatch. */
+        double t0 = MPI_Wtime();
+        for (uint32_t i = base + (uint32_t)rank; i < end; i += (uint32_t)size) {
+            mnist_get_image(images, i, img_raw);
+            mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+            uint8_t label = mnist_get_label(labels, i);
+            for (int j = 0; j < 10; j++) {
+                y[j] = (j == label) ? 1.0 : 0.0;
+            }
+
+            Layer_setInputs(linput, img_norm);
+            if (overlap != NULL) {
+                /* Accumulators are final only after the shard's last sample. */
+                overlap->armed = (i + (uint32_t)size >= end);
+                Layer_learnOutputs_withHook(loutput, y, overlap_hook, overlap);
+            } else {
+                Layer_learnOutputs(loutput, y);
+            }
+        }
+        double t1 = MPI_Wtime();
+
+        /* With --overlap only the exposed (waiting) time is counted. */
+        if (overlap != NULL) {
+            overlap_finish(overlap);
+        } else if (size > 1) {
+            allreduce_gradients(layers, NUM_LAYERS);
+        }
+        double t2 = MPI_Wtime();
+
+        Layer_update(loutput, LEARNING_RATE / (end - base));
+        double t3 = MPI_Wtime();
+
+        times.compute_time += (t1 - t0) + (t3 - t2);
+        times.comm_time += t2 - t1;
+    }
+
+    return times;
+}
+
+/* Each rank evaluates its contiguous shard of the test set. */
+static double test_model(Layer** layers, const MNISTImages* images, const MNISTLabels* labels) {
+    Layer* linput = layers[0];
+    Layer* loutput = layers[NUM_LAYERS - 1];
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    double y[10];
+    int correct = 0;
+
+    for (uint32_t i = 0; i < images->num_images; i++) {
+        mnist_get_image(images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+        Layer_setInputs(linput, img_norm);
+        Layer_getOutputs(loutput, y);
+
+        int predicted = 0;
+        for (int j = 1; j < 10; j++) {
+            if (y[j] > y[predicted]) {
+                predicted = j;
+            }
+        }
+        if (predicted == mnist_get_label(labels, i)) {
+            correct++;
+        }
+    }
+
+    int local[2] = {correct, (int)images->num_images};
+    int total[2];
+    MPI_Allreduce(local, total, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return (total[0] * 100.0) / total[1];
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    TrainOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        if (rank == 0) usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) {
+        printf("==========================================================================\n");
+        printf("              DATA PARALLEL TRAINING (MPI, %d processes)                  \n", size);
+        printf("==========================================================================\n\n");
+        printf("[1/5] Loading MNIST datasets...\n");
+    }
+
+    /* Every rank needs every minibatch; the test set is sharded. */
+    MNISTImages train_images, test_images;
+    MNISTLabels train_labels, test_labels;
+    MNISTImages test_header;
+    if (mnist_load_images(opts.train_images, &train_images) != 0 ||
+        mnist_load_labels(opts.train_labels, &train_labels) != 0 ||
+        mnist_read_header(opts.test_images, opts.test_labels, &test_header) != 0) {
+        fprintf(stderr, "Rank %d: failed to load datasets\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    uint32_t test_count = test_header.num_images;
+    uint32_t test_start = (uint32_t)((uint64_t)test_count * rank / size);
+    uint32_t test_end = (uint32_t)((uint64_t)test_count * (rank + 1) / size);
+    if (mnist_load_images_range(opts.test_images, test_start, test_end - test_start, &test_images) != 0 ||
+        mnist_load_labels_range(opts.test_labels, test_start, test_end - test_start, &test_labels) != 0) {
+        fprintf(stderr, "Rank %d: failed to load test shard\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (rank == 0) {
+        printf("  ✓ Loaded %u training images, %u test images\n\n", train_images.num_images, test_count);
+        printf("[2/5] Initializing CNN replicas (seed %u)...\n", opts.seed);
+    }
+
+    srand(opts.seed);
+    Layer* linput = Layer_create_input(1, 28, 28);
+    Layer* lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
+    Layer* lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
+    Layer* lfull1 = Layer_create_full(lconv2, 200, 0.1);
+    Layer* lfull2 = Layer_create_full(lfull1, 200, 0.1);
+    Layer* loutput = Layer_create_full(lfull2, 10, 0.1);
+    Layer* layers[NUM_LAYERS] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
+
+    /* rand() sequences are not guaranteed to match across hosts. */
+    broadcast_parameters(layers, NUM_LAYERS);
+
+    OverlapState overlap_state;
+    OverlapState* overlap = NULL;
+    if (opts.overlap && size > 1) {
+        overlap_init(&overlap_state, layers, NUM_LAYERS, (size_t)opts.bucket_kb * 1024);
+        overlap = &overlap_state;
+    }
+
+    if (rank == 0) {
+        printf("  ✓ Network: Input(1×28×28) → Conv1(16×14×14) → Conv2(32×7×7) → FC1(200) → FC2(200) → Output(10)\n\n");
+        printf("[3/5] Training (%d epochs, global batch %d, %d per rank)...\n",
+               opts.epochs, opts.batch_size, (opts.batch_size + size - 1) / size);
+        if (overlap != NULL) {
+            printf("  Overlapped allreduce, %d bucket(s) (cap %d KB):", overlap->num_buckets, opts.bucket_kb);
+            for (int b = 0; b < overlap->num_buckets; b++) {
+                printf(" [L%d-L%d %.0f KB]", overlap->buckets[b].last, overlap->buckets[b].first,
+                       overlap->buckets[b].count * sizeof(double) / 1024.0);
+            }
+            printf("\n");
+        }
+        printf("\n");
+        printf("  %-6s %12s %12s %12s %10s %10s %6s\n",
+               "Epoch", "Train(s)", "Total(s)", "Samples/s", "Comm(%)", "Accuracy", "Sync");
+        printf("  --------------------------------------------------------------------------\n");
+    }
+
+    double train_time = 0.0;
+    double comm_time = 0.0;
+    double time_to_target = -1.0;
+    int target_epoch = -1;
+    int resyncs = 0;
+    double accuracy = 0.0;
+
+    for (int epoch = 0; epoch < opts.epochs; epoch++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double epoch_start = MPI_Wtime();
+        EpochTimes times = train_epoch(layers, &train_images, &train_labels, opts.batch_size,
+                                       rank, size, overlap);
+        double epoch_time = MPI_Wtime() - epoch_start;
+
+        /* Report the slowest rank: it bounds the wall-clock time. */
+        MPI_Allreduce(MPI_IN_PLACE, &epoch_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &times.comm_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        train_time += epoch_time;
+        comm_time += times.comm_time;
+
+        int in_sync = replicas_in_sync(layers, NUM_LAYERS);
+        if (!in_sync) {
+            broadcast_parameters(layers, NUM_LAYERS);
+            resyncs++;
+        }
+
+        accuracy = test_model(layers, &test_images, &test_labels);
+        if (target_epoch < 0 && accuracy >= opts.target_accuracy) {
+            target_epoch = epoch + 1;
+            time_to_target = train_time;
+        }
+
+        if (rank == 0) {
+            printf("  %-6d %12.2f %12.2f %12.1f %9.1f%% %9.2f%% %6s\n",
+                   epoch + 1, epoch_time, train_time, train_images.num_images / epoch_time,
+                   times.comm_time / epoch_time * 100.0, accuracy, in_sync ? "ok" : "RESYNC");
+        }
+    }
+
+    if (rank == 0) {
+        printf("\n[4/5] Saving trained model...\n");
+        if (opts.save_path != NULL) {
+            if (model_save(opts.save_path, layers, NUM_LAYERS) != 0) {
+                fprintf(stderr, "Failed to save model\n");
+            } else {
+                printf("  ✓ Model saved to: %s\n\n", opts.save_path);
+            }
+        } else {
+            printf("  (skipped, no --save given)\n\n");
+        }
+
+        printf("[5/5] Summary\n");
+        printf("==========================================================================\n");
+        printf("                    DATA PARALLEL TRAINING SUMMARY                       \n");
+        printf("==========================================================================\n");
+        printf("  Processes:         %d\n", size);
+        printf("  Gradient Sync:     %s\n", overlap != NULL ? "bucketed MPI_Iallreduce (overlapped)" : "MPI_Allreduce");
+        printf("  Epochs:            %d\n", opts.epochs);
+        printf("  Global Batch:      %d\n", opts.batch_size);
+        printf("  Training Time:     %.2f seconds\n", train_time);
+        printf("  Communication:     %.2f seconds (%.1f%%)\n", comm_time, comm_time / train_time * 100.0);
+        printf("  Throughput:        %.1f samples/s\n",
+               (double)train_images.num_images * opts.epochs / train_time);
+        printf("  Final Accuracy:    %.2f%%\n", accuracy);
+        if (target_epoch > 0) {
+            printf("  Time to %.2f%%:    %.2f seconds (epoch %d)\n",
+                   opts.target_accuracy, time_to_target, target_epoch);
+        } else {
+            printf("  Time to %.2f%%:    not reached\n", opts.target_accuracy);
+        }
+        printf("  Replica Resyncs:   %d\n", resyncs);
+        printf("==========================================================================\n");
+    }
+
+    if (overlap != NULL) {
+        overlap_free(overlap);
+    }
+    mnist_free_images(&train_images);
+    mnist_free_labels(&train_labels);
+    mnist_free_images(&test_images);
+    mnist_free_labels(&test_labels);
+    for (int l = NUM_LAYERS - 1; l >= 0; l--) {
+        Layer_destroy(layers[l]);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,340 @@
+/*
+  train_hogwild.c
+  Multi-threaded shared-memory training.
+
+  The master network owns the parameters. Each thread builds a replica
+  with Layer_create_replica, which shares the master's weights/biases but
+  has private outputs, errors, gradients and u_weights/u_biases, so the
+  forward and backward passes never touch another thread's state. Every
+  --batch samples a thread applies its accumulated updates to the shared
+  parameters either lock-free (hogwild) or one layer at a time under a
+  per-layer mutex (striped).
+
+  Usage:
+  $ ./train_hogwild <train-images> <train-labels> <test-images> <test-labels>
+                    [--threads N] [--update hogwild|striped] [options]
+*/
+
+#include "cnn.h"
+#include "mnist_loader.h"
+#include "model_io.h"
+#include "performance_metrics.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_LAYERS 6
+#define IMAGE_SIZE 784
+#define DEFAULT_EPOCHS 5
+#define DEFAULT_BATCH_SIZE 128
+#define DEFAULT_SEED 0
+#define LEARNING_RATE 0.1
+#define MAX_THREADS 256
+
+typedef enum {
+    UPDATE_HOGWILD,
+    UPDATE_STRIPED
+} UpdateMode;
+
+typedef struct {
+    const char* train_images;
+    const char* train_labels;
+    const char* test_images;
+    const char* test_labels;
+    int threads;
+    UpdateMode update;
+    int epochs;
+    int batch_size;
+    unsigned int seed;
+    double target_accuracy;
+    const char* save_path;
+} TrainOptions;
+
+typedef struct {
+    Layer* layers[NUM_LAYERS];          /* replica of the master network */
+    const MNISTImages* images;
+    const MNISTLabels* labels;
+    const TrainOptions* opts;
+    pthread_mutex_t* layer_locks;       /* one per layer (striped mode) */
+    int thread_id;
+} TrainWorker;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <train-images> <train-labels> <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --threads <n>     Worker threads (default 1)\n");
+    fprintf(stderr, "  --update <mode>   hogwild (lock-free, default) or striped (per-layer locks)\n");
+    fprintf(stderr, "  --epochs <n>      Training epochs (default %d)\n", DEFAULT_EPOCHS);
+    fprintf(stderr, "  --batch <n>       Samples per thread between updates (default %d)\n", DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  --seed <n>        Weight initialisation seed (default %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "  --target <acc>    Report time to reach this test accuracy (%%)\n");
+    fprintf(stderr, "  --save <file>     Save the trained model\n");
+}
+
+static int parse_args(int argc, char* argv[], TrainOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->threads = 1;
+    opts->update = UPDATE_HOGWILD;
+    opts->epochs = DEFAULT_EPOCHS;
+    opts->batch_size = DEFAULT_BATCH_SIZE;
+    opts->seed = DEFAULT_SEED;
+    opts->target_accuracy = 97.0;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            if (i + 1 >= argc) return -1;
+            if (strcmp(argv[i], "--threads") == 0) {
+                opts->threads = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--update") == 0) {
+                i++;
+                if (strcmp(argv[i], "hogwild") == 0) opts->update = UPDATE_HOGWILD;
+                else if (strcmp(argv[i], "striped") == 0) opts->update = UPDATE_STRIPED;
+                else return -1;
+            } else if (strcmp(argv[i], "--epochs") == 0) {
+                opts->epochs = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--batch") == 0) {
+                opts->batch_size = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--seed") == 0) {
+                opts->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--target") == 0) {
+                opts->target_accuracy = atof(argv[++i]);
+            } else if (strcmp(argv[i], "--save") == 0) {
+                opts->save_path = argv[++i];
+            } else {
+                return -1;
+            }
+        } else {
+            const char** slots[] = {&opts->train_images, &opts->train_labels,
+                                    &opts->test_images, &opts->test_labels};
+            if (positional >= 4) return -1;
+            *slots[positional++] = argv[i];
+        }
+    }
+    if (positional != 4 || opts->threads < 1 || opts->threads > MAX_THREADS ||
+        opts->epochs < 1 || opts->batch_size < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Apply a replica's accumulated updates to the shared parameters. */
+static void apply_updates(TrainWorker* worker, double rate) {
+    if (worker->opts->update == UPDATE_HOGWILD) {
+        /* Lock-free: concurrent updates may interleave or overwrite. */
+        Layer_update(worker->layers[NUM_LAYERS - 1], rate);
+        return;
+    }
+    for (int l = NUM_LAYERS - 1; l >= 1; l--) {
+        pthread_mutex_lock(&worker->layer_locks[l]);
+        Layer_updateSingle(worker->layers[l], rate);
+        pthread_mutex_unlock(&worker->layer_locks[l]);
+    }
+}
+
+/* Thread t learns samples t, t+T, t+2T, ... of the epoch. */
+static void* train_worker(void* arg) {
+    TrainWorker* worker = (TrainWorker*)arg;
+    const TrainOptions* opts = worker->opts;
+    Layer* linput = worker->layers[0];
+    Layer* loutput = worker->layers[NUM_LAYERS - 1];
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    double y[10];
+    double rate = LEARNING_RATE / opts->batch_size;
+    int pending = 0;
+
+    for (uint32_t i = (uint32_t)worker->thread_id; i < worker->images->num_images;
+         i += (uint32_t)opts->threads) {
+        mnist_get_image(worker->images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+        uint8_t label = mnist_get_label(worker->labels, i);
+        for (int j = 0; j < 10; j++) {
+            y[j] = (j == label) ? 1.0 : 0.0;
+        }
+
+        Layer_setInputs(linput, img_norm);
+        Layer_learnOutputs(loutput, y);
+
+        if (++pending == opts->batch_size) {
+            apply_updates(worker, rate);
+            pending = 0;
+        }
+    }
+    if (pending > 0) {
+        apply_updates(worker, rate);
+    }
+    return NULL;
+}
+
+static double test_model(Layer* linput, Layer* loutput,
+                         const MNISTImages* images, const MNISTLabels* labels) {
+    uint8_t img_raw[IMAGE_SIZE];
+    double img_norm[IMAGE_SIZE];
+    double y[10];
+    int correct = 0;
+
+    for (uint32_t i = 0; i < images->num_images; i++) {
+        mnist_get_image(images, i, img_raw);
+        mnist_normalize_image(img_raw, img_norm, IMAGE_SIZE);
+
+        Layer_setInputs(linput, img_norm);
+        Layer_getOutputs(loutput, y);
+
+        int predicted = 0;
+        for (int j = 1; j < 10; j++) {
+            if (y[j] > y[predicted]) {
+                predicted = j;
+            }
+        }
+        if (predicted == mnist_get_label(labels, i)) {
+            correct++;
+        }
+    }
+
+    return (correct * 100.0) / images->num_images;
+}
+
+int main(int argc, char* argv[]) {
+    TrainOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* mode_name = (opts.update == UPDATE_HOGWILD) ? "hogwild" : "striped";
+
+    printf("==========================================================================\n");
+    printf("          SHARED-MEMORY TRAINING (%d threads, %s updates)                 \n",
+           opts.threads, mode_name);
+    printf("==========================================================================\n\n");
+
+    printf("[1/5] Loading MNIST datasets...\n");
+    MNISTImages train_images, test_images;
+    MNISTLabels train_labels, test_labels;
+    if (mnist_load_images(opts.train_images, &train_images) != 0 ||
+        mnist_load_labels(opts.train_labels, &train_labels) != 0 ||
+        mnist_load_images(opts.test_images, &test_images) != 0 ||
+        mnist_load_labels(opts.test_labels, &test_labels) != 0) {
+        fprintf(stderr, "Failed to load datasets\n");
+        return 1;
+    }
+    printf("  ✓ Loaded %u training images, %u test images\n\n",
+           train_images.num_images, test_images.num_images);
+
+    printf("[2/5] Initializing master network and %d replica(s) (seed %u)...\n", opts.threads, opts.seed);
+    srand(opts.seed);
+    Layer* linput = Layer_create_input(1, 28, 28);
+    Layer* lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
+    Layer* lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
+    Layer* lfull1 = Layer_create_full(lconv2, 200, 0.1);
+    Layer* lfull2 = Layer_create_full(lfull1, 200, 0.1);
+    Layer* loutput = Layer_create_full(lfull2, 10, 0.1);
+    Layer* layers[NUM_LAYERS] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
+
+    pthread_mutex_t layer_locks[NUM_LAYERS];
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        pthread_mutex_init(&layer_locks[l], NULL);
+    }
+
+    TrainWorker* workers = (TrainWorker*)calloc(opts.threads, sizeof(TrainWorker));
+    pthread_t* threads = (pthread_t*)calloc(opts.threads, sizeof(pthread_t));
+    for (int t = 0; t < opts.threads; t++) {
+        TrainWorker* worker = &workers[t];
+        worker->images = &train_images;
+        worker->labels = &train_labels;
+        worker->opts = &opts;
+        worker->layer_locks = layer_locks;
+        worker->thread_id = t;
+        Layer* lprev = NULL;
+        for (int l = 0; l < NUM_LAYERS; l++) {
+            worker->layers[l] = Layer_create_replica(lprev, layers[l]);
+            lprev = worker->layers[l];
+        }
+    }
+    printf("  ✓ Network: Input(1×28×28) → Conv1(16×14×14) → Conv2(32×7×7) → FC1(200) → FC2(200) → Output(10)\n\n");
+
+    printf("[3/5] Training (%d epochs, update every %d samples per thread)...\n\n",
+           opts.epochs, opts.batch_size);
+    printf("  %-6s %12s %12s %12s %10s\n", "Epoch", "Train(s)", "Total(s)", "Samples/s", "Accuracy");
+    printf("  ------------------------------------------------------------\n");
+
+    double train_time = 0.0;
+    double time_to_target = -1.0;
+    int target_epoch = -1;
+    double accuracy = 0.0;
+
+    for (int epoch = 0; epoch < opts.epochs; epoch++) {
+        double epoch_start = get_current_time_sec();
+        for (int t = 0; t < opts.threads; t++) {
+            if (pthread_create(&threads[t], NULL, train_worker, &workers[t]) != 0) {
+                fprintf(stderr, "Failed to start worker thread %d\n", t);
+                return 1;
+            }
+        }
+        for (int t = 0; t < opts.threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        double epoch_time = get_current_time_sec() - epoch_start;
+        train_time += epoch_time;
+
+        accuracy = test_model(linput, loutput, &test_images, &test_labels);
+        if (target_epoch < 0 && accuracy >= opts.target_accuracy) {
+            target_epoch = epoch + 1;
+            time_to_target = train_time;
+        }
+        printf("  %-6d %12.2f %12.2f %12.1f %9.2f%%\n", epoch + 1, epoch_time, train_time,
+               train_images.num_images / epoch_time, accuracy);
+    }
+
+    printf("\n[4/5] Saving trained model...\n");
+    if (opts.save_path != NULL) {
+        if (model_save(opts.save_path, layers, NUM_LAYERS) != 0) {
+            fprintf(stderr, "Failed to save model\n");
+        } else {
+            printf("  ✓ Model saved to: %s\n\n", opts.save_path);
+        }
+    } else {
+        printf("  (skipped, no --save given)\n\n");
+    }
+
+    printf("[5/5] Summary\n");
+    printf("==========================================================================\n");
+    printf("                    SHARED-MEMORY TRAINING SUMMARY                       \n");
+    printf("==========================================================================\n");
+    printf("  Threads:           %d\n", opts.threads);
+    printf("  Update Mode:       %s\n", mode_name);
+    printf("  Epochs:            %d\n", opts.epochs);
+    printf("  Batch Size:        %d (per thread)\n", opts.batch_size);
+    printf("  Training Time:     %.2f seconds\n", train_time);
+    printf("  Throughput:        %.1f samples/s\n",
+           (double)train_images.num_images * opts.epochs / train_time);
+    printf("  Final Accuracy:    %.2f%%\n", accuracy);
+    if (target_epoch > 0) {
+        printf("  Time to %.2f%%:    %.2f seconds (epoch %d)\n",
+               opts.target_accuracy, time_to_target, target_epoch);
+    } else {
+        printf("  Time to %.2f%%:    not reached\n", opts.target_accuracy);
+    }
+    printf("==========================================================================\n");
+
+    for (int t = 0; t < opts.threads; t++) {
+        for (int l = NUM_LAYERS - 1; l >= 0; l--) {
+            Layer_destroy(workers[t].layers[l]);
+        }
+    }
+    free(workers);
+    free(threads);
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        pthread_mutex_destroy(&layer_locks[l]);
+    }
+    for (int l = NUM_LAYERS - 1; l >= 0; l--) {
+        Layer_destroy(layers[l]);
+    }
+    mnist_free_images(&train_images);
+    mnist_free_labels(&train_labels);
+    mnist_free_images(&test_images);
+    mnist_free_labels(&test_labels);
+
+    return 0;
+}
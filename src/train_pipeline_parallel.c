@@ -0,0 +1,837 @@
+/*
+  train_pipeline_parallel.c
+  Pipeline-parallel (model-parallel) MPI training.
+
+  The compute layers are split into contiguous stages, one per rank. With
+  5 ranks this is the stage mapping of inference_pipeline_parallel.c:
+  rank 0 = input + conv1, 1 = conv2, 2 = fc1, 3 = fc2, 4 = output.
+
+  Every minibatch is cut into micro-batches. Activations flow down the
+  ranks, the errors of each stage's input layer flow back up, and every
+  stage keeps the per-sample state of a micro-batch (outputs, gradients,
+  im2col columns) in a stash slot until its backward pass has run:
+
+    gpipe  all forward passes, then all backward passes
+           (one stash slot per micro-batch)
+    1f1b   after a warmup of (stages - stage - 1) forward passes each
+           forward is followed by one backward pass
+           (at most stages - stage slots)
+
+  The weight updates of a minibatch are accumulated over all of its
+  micro-batches and applied once (a pipeline flush), so both schedules
+  compute the same model as a single process.
+
+  With --tp N the FC1 stage (which must hold FC1 alone) runs on N
+  consecutive ranks, each owning a block of FC1's output neurons
+  (Layer_create_full_rows). The stage leader broadcasts the incoming
+  activations, the shard outputs are gathered back into one activation
+  matrix, the incoming errors are scattered by row block and the
+  partial input errors are summed with MPI_Reduce.
+
+  Usage:
+  $ mpirun -np 5 ./train_pipeline_parallel <train-images> <train-labels>
+                 <test-images> <test-labels> [options]
+  $ mpirun -np 7 ./train_pipeline_parallel ... --tp 3
+*/
+
+#include "cnn.h"
+#include "cnn_batch.h"
+#include "mnist_loader.h"
+#include "model_io.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_LAYERS 6
+#define IMAGE_SIZE 784
+#define DEFAULT_EPOCHS 5
+#define DEFAULT_BATCH_SIZE 128
+#define DEFAULT_MICRO_BATCHES 4
+#define DEFAULT_SEED 0
+#define LEARNING_RATE 0.1
+#define FC1_LAYER 3
+
+#define TAG_ACTIVATIONS 0
+#define TAG_ERRORS 1
+#define TAG_PARAMETERS 2
+
+typedef enum {
+    SCHEDULE_GPIPE = 0,
+    SCHEDULE_1F1B
+} Schedule;
+
+typedef struct {
+    const char* train_images;
+    const char* train_labels;
+    const char* test_images;
+    const char* test_labels;
+    int epochs;
+    int batch_size;
+    int micro_batches;
+    Schedule schedule;
+    unsigned int seed;
+    double target_accuracy;
+    const char* save_path;
+    int tp;
+} TrainOptions;
+
+/* One stash slot: LayerBatch state for the stage's layers, plus the
+   boundary (the previous stage's last layer) that holds the received
+   activations and the errors sent back. */
+typedef struct {
+    LayerBatch* boundary;
+    LayerBatch* first;
+    LayerBatch* last;
+    double* gathered;           /* FC1 leader: outputs of all shards */
+    MPI_Request send_request;
+} StashSlot;
+
+/* Ranks sharing the FC1 stage (size 1 when not tensor-parallel). */
+typedef struct {
+    MPI_Comm comm;
+    int rank;
+    int size;
+    int row0;                   /* First FC1 output neuron owned */
+    int nrows;                  /* FC1 output neurons owned */
+    Layer* shard;               /* Owned rows of FC1 */
+    int* rows0;                 /* Leader: row0 of every rank */
+    int* nrows_all;             /* Leader: nrows of every rank */
+    int* counts;                /* Leader: Gatherv/Scatterv counts */
+    int* displs;
+    double* staging;            /* Leader: shard-major buffer */
+} TensorGroup;
+
+typedef struct {
+    int stage;                  /* Pipeline stage index */
+    int num_stages;
+    int prev_rank;              /* Previous stage's leader (-1: none) */
+    int next_rank;              /* Next stage's leader (-1: none) */
+    int tp_stage;               /* Stage split over several ranks (-1: none) */
+    TensorGroup tp;
+    int first_layer;            /* First layer owned by this stage */
+    int last_layer;             /* Last layer owned by this stage */
+    Layer** layers;
+    StashSlot* slots;
+    int num_slots;
+    int capacity;               /* Max. samples per micro-batch */
+    double* x;                  /* Stage 0: normalized images */
+    double* y;                  /* Last stage: one-hot targets */
+    double busy_time;
+    double idle_time;
+} Stage;
+
+typedef struct {
+    uint32_t start;
+    int count;
+} MicroBatch;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <train-images> <train-labels> <test-images> <test-labels> [options]\n", program);
+    fprintf(stderr, "  --epochs <n>           Training epochs (default %d)\n", DEFAULT_EPOCHS);
+    fprintf(stderr, "  --batch <n>            Minibatch size (default %d)\n", DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  --micro <n>            Micro-batches per minibatch (default %d)\n", DEFAULT_MICRO_BATCHES);
+    fprintf(stderr, "  --schedule <s>         gpipe | 1f1b (default 1f1b)\n");
+    fprintf(stderr, "  --seed <n>             Weight initialisation seed (default %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "  --target <acc>         Report time to reach this test accuracy (%%)\n");
+    fprintf(stderr, "  --save <file>          Save the trained model (rank 0)\n");
+    fprintf(stderr, "  --tp <n>               Split FC1's output neurons over n ranks (default 1)\n");
+    fprintf(stderr, "Runs with 1 to %d stages: np = stages + tp - 1.\n", NUM_LAYERS - 1);
+}
+
+static int parse_args(int argc, char* argv[], TrainOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->epochs = DEFAULT_EPOCHS;
+    opts->batch_size = DEFAULT_BATCH_SIZE;
+    opts->micro_batches = DEFAULT_MICRO_BATCHES;
+    opts->schedule = SCHEDULE_1F1B;
+    opts->seed = DEFAULT_SEED;
+    opts->target_accuracy = 97.0;
+    opts->tp = 1;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            if (i + 1 >= argc) return -1;
+            if (strcmp(argv[i], "--epochs") == 0) {
+                opts->epochs = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--batch") == 0) {
+                opts->batch_size = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--micro") == 0) {
+                opts->micro_batches = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--schedule") == 0) {
+                i++;
+                if (strcmp(argv[i], "gpipe") == 0) {
+                    opts->schedule = SCHEDULE_GPIPE;
+                } else if (strcmp(argv[i], "1f1b") == 0) {
+                    opts->schedule = SCHEDULE_1F1B;
+                } else {
+                    return -1;
+                }
+            } else if (strcmp(argv[i], "--seed") == 0) {
+                opts->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--target") == 0) {
+                opts->target_accuracy = atof(argv[++i]);
+            } else if (strcmp(argv[i], "--save") == 0) {
+                opts->save_path = argv[++i];
+            } else if (strcmp(argv[i], "--tp") == 0) {
+                opts->tp = atoi(argv[++i]);
+            } else {
+                return -1;
+            }
+        } else {
+            const char** slots[] = {&opts->train_images, &opts->train_labels,
+                                    &opts->test_images, &opts->test_labels};
+            if (positional >= 4) return -1;
+            *slots[positional++] = argv[i];
+        }
+    }
+    if (positional != 4 || opts->epochs < 1 || opts->batch_size < 1 ||
+        opts->micro_batches < 1 || opts->micro_batches > opts->batch_size ||
+        opts->tp < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Contiguous split of layers 1..NUM_LAYERS-1 over the stages; the input
+   layer always lives on stage 0. */
+static void stage_layers(int stage, int num_stages, int* first, int* last) {
+    int ncompute = NUM_LAYERS - 1;
+    *first = 1 + (ncompute * stage) / num_stages;
+    *last = (ncompute * (stage + 1)) / num_stages;
+}
+
+/* The ranks of the FC1 stage are consecutive; every other stage has
+   one rank. tp_stage < 0 when FC1 is not split. */
+static int stage_leader_rank(int stage, int tp_stage, int tp) {
+    return (tp_stage >= 0 && stage > tp_stage) ? stage + tp - 1 : stage;
+}
+
+static int rank_stage(int rank, int tp_stage, int tp) {
+    if (tp_stage < 0 || rank <= tp_stage) return rank;
+    if (rank < tp_stage + tp) return tp_stage;
+    return rank - tp + 1;
+}
+
+/* The stage that holds FC1 and nothing else, or -1. */
+static int fc1_stage(int num_stages) {
+    for (int s = 0; s < num_stages; s++) {
+        int first, last;
+        stage_layers(s, num_stages, &first, &last);
+        if (first == FC1_LAYER && last == FC1_LAYER) return s;
+    }
+    return -1;
+}
+
+/* Stash slots needed by a schedule: 1F1B keeps at most the warmup
+   micro-batches plus the one in its steady-state forward pass. */
+static int stash_slots(Schedule schedule, int stage, int num_stages, int micro_batches) {
+    if (schedule == SCHEDULE_GPIPE) return micro_batches;
+    int warmup = num_stages - stage - 1;
+    return (warmup < micro_batches) ? warmup + 1 : micro_batches;
+}
+
+/* Splits FC1's output neurons over the ranks of the FC1 stage. */
+static void tensor_group_init(TensorGroup* tp, MPI_Comm comm, Layer* full) {
+    MPI_Comm_rank(comm, &tp->rank);
+    MPI_Comm_size(comm, &tp->size);
+    tp->comm = comm;
+    tp->row0 = (full->nnodes * tp->rank) / tp->size;
+    tp->nrows = (full->nnodes * (tp->rank + 1)) / tp->size - tp->row0;
+    tp->shard = Layer_create_full_rows(full, tp->row0, tp->nrows);
+
+    if (tp->rank == 0) {
+        tp->rows0 = (int*)malloc(tp->size * sizeof(int));
+        tp->nrows_all = (int*)malloc(tp->size * sizeof(int));
+        tp->counts = (int*)malloc(tp->size * sizeof(int));
+        tp->displs = (int*)malloc(tp->size * sizeof(int));
+    }
+    MPI_Gather(&tp->row0, 1, MPI_INT, tp->rows0, 1, MPI_INT, 0, comm);
+    MPI_Gather(&tp->nrows, 1, MPI_INT, tp->nrows_all, 1, MPI_INT, 0, comm);
+}
+
+static void stage_init(Stage* stage, Layer** layers, int rank, int size, int tp,
+                       Schedule schedule, int micro_batches, int capacity) {
+    memset(stage, 0, sizeof(*stage));
+    stage->num_stages = size - tp + 1;
+    int tp_stage = (tp > 1) ? fc1_stage(stage->num_stages) : -1;
+    stage->tp_stage = tp_stage;
+    stage->stage = rank_stage(rank, tp_stage, tp);
+    stage->prev_rank = (stage->stage > 0) ? stage_leader_rank(stage->stage - 1, tp_stage, tp) : -1;
+    stage->next_rank = (stage->stage < stage->num_stages - 1) ?
+                       stage_leader_rank(stage->stage + 1, tp_stage, tp) : -1;
+    stage->layers = layers;
+    stage->num_slots = stash_slots(schedule, stage->stage, stage->num_stages, micro_batches);
+    stage->capacity = capacity;
+    stage_layers(stage->stage, stage->num_stages, &stage->first_layer, &stage->last_layer);
+
+    /* Split the FC1 ranks off; everyone else gets MPI_COMM_NULL. */
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, (stage->stage == tp_stage) ? 0 : MPI_UNDEFINED, rank, &comm);
+    stage->tp.size = 1;
+    stage->tp.comm = MPI_COMM_NULL;
+    if (comm != MPI_COMM_NULL) {
+        tensor_group_init(&stage->tp, comm, layers[FC1_LAYER]);
+    }
+
+    int nodes = layers[stage->last_layer]->nnodes;
+    stage->slots = (StashSlot*)calloc(stage->num_slots, sizeof(StashSlot));
+    for (int k = 0; k < stage->num_slots; k++) {
+        StashSlot* slot = &stage->slots[k];
+        slot->boundary = LayerBatch_create(layers[stage->first_layer - 1], NULL, capacity);
+        LayerBatch* prev = slot->boundary;
+        if (stage->tp.shard != NULL) {
+            prev = LayerBatch_create(stage->tp.shard, prev, capacity);
+            slot->first = prev;
+            if (stage->tp.rank == 0) {
+                slot->gathered = (double*)malloc((size_t)capacity * nodes * sizeof(double));
+            }
+        }
+        for (int l = stage->first_layer; stage->tp.shard == NULL && l <= stage->last_layer; l++) {
+            prev = LayerBatch_create(layers[l], prev, capacity);
+            if (l == stage->first_layer) slot->first = prev;
+        }
+        slot->last = prev;
+        slot->send_request = MPI_REQUEST_NULL;
+    }
+    if (stage->tp.shard != NULL && stage->tp.rank == 0) {
+        stage->tp.staging = (double*)malloc((size_t)capacity * nodes * sizeof(double));
+    }
+    if (stage->stage == 0) {
+        stage->x = (double*)malloc((size_t)capacity * IMAGE_SIZE * sizeof(double));
+    }
+    if (stage->stage == stage->num_stages - 1) {
+        stage->y = (double*)malloc((size_t)capacity * 10 * sizeof(double));
+    }
+}
+
+static void stage_free(Stage* stage) {
+    for (int k = 0; k < stage->num_slots; k++) {
+        LayerBatch* batch = stage->slots[k].last;
+        while (batch != NULL) {
+            LayerBatch* prev = batch->lprev;
+            LayerBatch_destroy(batch);
+            batch = prev;
+        }
+        free(stage->slots[k].gathered);
+    }
+    free(stage->slots);
+    free(stage->x);
+    free(stage->y);
+    if (stage->tp.shard != NULL) {
+        Layer_destroy(stage->tp.shard);
+        free(stage->tp.rows0);
+        free(stage->tp.nrows_all);
+        free(stage->tp.counts);
+        free(stage->tp.displs);
+        free(stage->tp.staging);
+        MPI_Comm_free(&stage->tp.comm);
+    }
+}
+
+/* Bytes of per-sample state held by one stash slot. */
+static size_t stash_slot_bytes(const Stage* stage) {
+    size_t bytes = 0;
+    for (LayerBatch* batch = stage->slots[0].boundary; batch != NULL; batch = batch->lnext) {
+        size_t n = (size_t)batch->capacity * batch->layer->nnodes;
+        bytes += 4 * n * sizeof(double);
+        if (batch->layer->ltype == LAYER_CONV && batch != stage->slots[0].boundary) {
+            int kk = batch->layer->data.conv.kernsize * batch->layer->data.conv.kernsize;
+            bytes += (size_t)batch->capacity * kk * batch->layer->width * batch->layer->height * sizeof(double);
+        }
+    }
+    return bytes;
+}
+
+static void wait_send(Stage* stage, StashSlot* slot) {
+    if (slot->send_request == MPI_REQUEST_NULL) return;
+    double t0 = MPI_Wtime();
+    MPI_Wait(&slot->send_request, MPI_STATUS_IGNORE);
+    stage->idle_time += MPI_Wtime() - t0;
+}
+
+/* Gathers the shard outputs (n x nrows each) into n x nnodes rows. */
+static void tensor_gather(Stage* stage, StashSlot* slot, int n) {
+    TensorGroup* tp = &stage->tp;
+    int nodes = stage->layers[FC1_LAYER]->nnodes;
+    double t0 = MPI_Wtime();
+    if (tp->rank == 0) {
+        for (int r = 0, off = 0; r < tp->size; off += tp->counts[r], r++) {
+            tp->counts[r] = n * tp->nrows_all[r];
+            tp->displs[r] = off;
+        }
+    }
+    MPI_Gatherv(slot->last->outputs, n * tp->nrows, MPI_DOUBLE,
+                tp->staging, tp->counts, tp->displs, MPI_DOUBLE, 0, tp->comm);
+    stage->idle_time += MPI_Wtime() - t0;
+    if (tp->rank == 0) {
+        for (int r = 0; r < tp->size; r++) {
+            for (int s = 0; s < n; s++) {
+                memcpy(&slot->gathered[s * nodes + tp->rows0[r]],
+                       &tp->staging[tp->displs[r] + s * tp->nrows_all[r]],
+                       tp->nrows_all[r] * sizeof(double));
+            }
+        }
+    }
+}
+
+/* Scatters n x nnodes errors (in the leader's staging buffer) by row block. */
+static void tensor_scatter(Stage* stage, StashSlot* slot, int n) {
+    TensorGroup* tp = &stage->tp;
+    int nodes = stage->layers[FC1_LAYER]->nnodes;
+    if (tp->rank == 0) {
+        for (int r = 0, off = 0; r < tp->size; off += tp->counts[r], r++) {
+            tp->counts[r] = n * tp->nrows_all[r];
+            tp->displs[r] = off;
+        }
+        /* The slot's gathered outputs were already sent: reuse them. */
+        double* packed = slot->gathered;
+        for (int r = 0; r < tp->size; r++) {
+            for (int s = 0; s < n; s++) {
+                memcpy(&packed[tp->displs[r] + s * tp->nrows_all[r]],
+                       &tp->staging[s * nodes + tp->rows0[r]],
+                       tp->nrows_all[r] * sizeof(double));
+            }
+        }
+    }
+    double t0 = MPI_Wtime();
+    MPI_Scatterv(slot->gathered, tp->counts, tp->displs, MPI_DOUBLE,
+                 slot->last->errors, n * tp->nrows, MPI_DOUBLE, 0, tp->comm);
+    stage->idle_time += MPI_Wtime() - t0;
+}
+
+/* F(i): receive (or load) the micro-batch, run the stage's layers
+   forward and pass the activations on. */
+static void forward_step(Stage* stage, StashSlot* slot, const MicroBatch* mb,
+                         const MNISTImages* images) {
+    int n = mb->count;
+    int leader = (stage->tp.rank == 0);
+    wait_send(stage, slot);
+
+    double t0 = MPI_Wtime();
+    if (stage->stage == 0) {
+        uint8_t img_raw[IMAGE_SIZE];
+        for (int s = 0; s < n; s++) {
+            mnist_get_image(images, mb->start + s, img_raw);
+            mnist_normalize_image(img_raw, &stage->x[s * IMAGE_SIZE], IMAGE_SIZE);
+        }
+        memcpy(slot->boundary->outputs, stage->x, (size_t)n * IMAGE_SIZE * sizeof(double));
+    } else if (leader) {
+        MPI_Recv(slot->boundary->outputs, n * slot->boundary->layer->nnodes, MPI_DOUBLE,
+                 stage->prev_rank, TAG_ACTIVATIONS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    if (stage->tp.size > 1) {
+        MPI_Bcast(slot->boundary->outputs, n * slot->boundary->layer->nnodes, MPI_DOUBLE,
+                  0, stage->tp.comm);
+    }
+    double t1 = MPI_Wtime();
+    if (stage->stage > 0) stage->idle_time += t1 - t0;
+
+    for (LayerBatch* batch = slot->first; batch != NULL; batch = batch->lnext) {
+        LayerBatch_feedForw(batch, n);
+    }
+    stage->busy_time += MPI_Wtime() - t1;
+
+    double* outputs = slot->last->outputs;
+    if (stage->tp.size > 1) {
+        tensor_gather(stage, slot, n);
+        outputs = slot->gathered;
+    }
+    if (leader && stage->next_rank >= 0) {
+        MPI_Isend(outputs, n * stage->layers[stage->last_layer]->nnodes, MPI_DOUBLE,
+                  stage->next_rank, TAG_ACTIVATIONS, MPI_COMM_WORLD, &slot->send_request);
+    }
+}
+
+/* B(i): receive the errors of the stage's last layer (or compute them
+   from the labels), backpropagate and send the boundary errors back. */
+static void backward_step(Stage* stage, StashSlot* slot, const MicroBatch* mb,
+                          const MNISTLabels* labels) {
+    int n = mb->count;
+    int leader = (stage->tp.rank == 0);
+    wait_send(stage, slot);
+
+    double t0;
+    if (stage->stage == stage->num_stages - 1) {
+        memset(stage->y, 0, (size_t)n * 10 * sizeof(double));
+        for (int s = 0; s < n; s++) {
+            stage->y[s * 10 + mnist_get_label(labels, mb->start + s)] = 1.0;
+        }
+        t0 = MPI_Wtime();
+        LayerBatch_learnOutputs(slot->last, stage->y, n);
+    } else {
+        t0 = MPI_Wtime();
+        double* errors = (stage->tp.size > 1) ? stage->tp.staging : slot->last->errors;
+        if (leader) {
+            MPI_Recv(errors, n * stage->layers[stage->last_layer]->nnodes, MPI_DOUBLE,
+                     stage->next_rank, TAG_ERRORS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+        stage->idle_time += MPI_Wtime() - t0;
+        if (stage->tp.size > 1) {
+            tensor_scatter(stage, slot, n);
+        }
+        t0 = MPI_Wtime();
+        for (LayerBatch* batch = slot->last; batch != slot->boundary; batch = batch->lprev) {
+            LayerBatch_feedBack(batch, n);
+        }
+    }
+    stage->busy_time += MPI_Wtime() - t0;
+
+    if (stage->tp.size > 1) {
+        /* Every shard contributes to every input error. */
+        t0 = MPI_Wtime();
+        double* errors = slot->boundary->errors;
+        MPI_Reduce(leader ? MPI_IN_PLACE : errors, errors, n * slot->boundary->layer->nnodes,
+                   MPI_DOUBLE, MPI_SUM, 0, stage->tp.comm);
+        stage->idle_time += MPI_Wtime() - t0;
+    }
+    if (leader && stage->prev_rank >= 0) {
+        MPI_Isend(slot->boundary->errors, n * slot->boundary->layer->nnodes, MPI_DOUBLE,
+                  stage->prev_rank, TAG_ERRORS, MPI_COMM_WORLD, &slot->send_request);
+    }
+}
+
+/* Runs one minibatch through the pipeline and applies the update. */
+static void train_minibatch(Stage* stage, Schedule schedule, const MicroBatch* mbs, int m,
+                            int batch_count, const MNISTImages* images, const MNISTLabels* labels) {
+    int f = 0, b = 0;
+    if (schedule == SCHEDULE_GPIPE) {
+        for (; f < m; f++) forward_step(stage, &stage->slots[f % stage->num_slots], &mbs[f], images);
+        for (; b < m; b++) backward_step(stage, &stage->slots[b % stage->num_slots], &mbs[b], labels);
+    } else {
+        int warmup = stage->num_stages - stage->stage - 1;
+        if (warmup > m) warmup = m;
+        for (; f < warmup; f++) {
+            forward_step(stage, &stage->slots[f % stage->num_slots], &mbs[f], images);
+        }
+        for (; f < m; f++, b++) {
+            forward_step(stage, &stage->slots[f % stage->num_slots], &mbs[f], images);
+            backward_step(stage, &stage->slots[b % stage->num_slots], &mbs[b], labels);
+        }
+        for (; b < m; b++) {
+            backward_step(stage, &stage->slots[b % stage->num_slots], &mbs[b], labels);
+        }
+    }
+
+    /* Flush: every micro-batch has been accumulated. */
+    for (int k = 0; k < stage->num_slots; k++) {
+        wait_send(stage, &stage->slots[k]);
+    }
+    double t0 = MPI_Wtime();
+    if (stage->tp.shard != NULL) {
+        Layer_updateSingle(stage->tp.shard, LEARNING_RATE / batch_count);
+    } else {
+        for (int l = stage->first_layer; l <= stage->last_layer; l++) {
+            Layer_updateSingle(stage->layers[l], LEARNING_RATE / batch_count);
+        }
+    }
+    stage->busy_time += MPI_Wtime() - t0;
+}
+
+static void train_epoch(Stage* stage, Schedule schedule, int batch_size, int micro_batches,
+                        uint32_t num_images, const MNISTImages* images, const MNISTLabels* labels) {
+    MicroBatch* mbs = (MicroBatch*)malloc(micro_batches * sizeof(MicroBatch));
+    for (uint32_t base = 0; base < num_images; base += (uint32_t)batch_size) {
+        uint32_t end = base + (uint32_t)batch_size;
+        if (end > num_images) end = num_images;
+        int n = (int)(end - base);
+        int m = (micro_batches < n) ? micro_batches : n;
+        for (int i = 0; i < m; i++) {
+            mbs[i].start = base + (uint32_t)((n * i) / m);
+            mbs[i].count = (n * (i + 1)) / m - (n * i) / m;
+        }
+        train_minibatch(stage, schedule, mbs, m, n, images, labels);
+    }
+    free(mbs);
+}
+
+/* Pipelined forward pass over the test set; the last stage scores. */
+static double test_model(Stage* stage, uint32_t num_images,
+                         const MNISTImages* images, const MNISTLabels* labels) {
+    StashSlot* slot = &stage->slots[0];
+    int correct = 0;
+    for (uint32_t base = 0; base < num_images; base += (uint32_t)stage->capacity) {
+        MicroBatch mb = {base, (int)((num_images - base < (uint32_t)stage->capacity) ?
+                                     num_images - base : (uint32_t)stage->capacity)};
+        forward_step(stage, slot, &mb, images);
+        if (stage->stage == stage->num_stages - 1) {
+            for (int s = 0; s < mb.count; s++) {
+                const double* y = &slot->last->outputs[s * 10];
+                int predicted = 0;
+                for (int j = 1; j < 10; j++) {
+                    if (y[j] > y[predicted]) {
+                        predicted = j;
+                    }
+                }
+                if (predicted == mnist_get_label(labels, base + s)) {
+                    correct++;
+                }
+            }
+        }
+    }
+    wait_send(stage, slot);
+    MPI_Allreduce(MPI_IN_PLACE, &correct, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return (correct * 100.0) / num_images;
+}
+
+/* Collect every stage's parameters on rank 0 (for saving). */
+static void gather_parameters(Stage* stage, int rank, int tp) {
+    Layer** layers = stage->layers;
+    if (stage->tp.shard != NULL) {
+        TensorGroup* group = &stage->tp;
+        int nin = layers[FC1_LAYER]->lprev->nnodes;
+        if (group->rank == 0) {
+            for (int r = 0; r < group->size; r++) {
+                group->counts[r] = group->nrows_all[r] * nin;
+                group->displs[r] = group->rows0[r] * nin;
+            }
+        }
+        MPI_Gatherv(group->shard->weights, group->shard->nweights, MPI_DOUBLE,
+                    layers[FC1_LAYER]->weights, group->counts, group->displs, MPI_DOUBLE, 0, group->comm);
+        MPI_Gatherv(group->shard->biases, group->shard->nbiases, MPI_DOUBLE,
+                    layers[FC1_LAYER]->biases, group->nrows_all, group->rows0, MPI_DOUBLE, 0, group->comm);
+    }
+    for (int s = 1; s < stage->num_stages; s++) {
+        int first, last;
+        int owner = stage_leader_rank(s, stage->tp_stage, tp);
+        stage_layers(s, stage->num_stages, &first, &last);
+        for (int l = first; l <= last; l++) {
+            if (rank == owner) {
+                MPI_Send(layers[l]->weights, layers[l]->nweights, MPI_DOUBLE, 0, TAG_PARAMETERS, MPI_COMM_WORLD);
+                MPI_Send(layers[l]->biases, layers[l]->nbiases, MPI_DOUBLE, 0, TAG_PARAMETERS, MPI_COMM_WORLD);
+            } else if (rank == 0) {
+                MPI_Recv(layers[l]->weights, layers[l]->nweights, MPI_DOUBLE, owner, TAG_PARAMETERS,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                MPI_Recv(layers[l]->biases, layers[l]->nbiases, MPI_DOUBLE, owner, TAG_PARAMETERS,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
+        }
+    }
+}
+
+static const char* layer_names[NUM_LAYERS] = {"input", "conv1", "conv2", "fc1", "fc2", "output"};
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    TrainOptions opts;
+    if (parse_args(argc, argv, &opts) != 0) {
+        if (rank == 0) usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    int num_stages = size - opts.tp + 1;
+    if (num_stages < 1 || num_stages > NUM_LAYERS - 1 ||
+        (opts.tp > 1 && fc1_stage(num_stages) < 0)) {
+        if (rank == 0) {
+            fprintf(stderr, "Cannot map %d processes with --tp %d: need 1-%d stages", size, opts.tp, NUM_LAYERS - 1);
+            fprintf(stderr, "%s\n", opts.tp > 1 ? " with FC1 alone in its stage (4 or 5 stages)" : "");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) {
+        printf("==========================================================================\n");
+        printf("            PIPELINE PARALLEL TRAINING (MPI, %d stages)                   \n", num_stages);
+        printf("==========================================================================\n\n");
+        printf("[1/5] Loading MNIST datasets...\n");
+    }
+
+    /* Images are only read by the first stage, labels by the last. */
+    MNISTImages train_images = {0}, test_images = {0};
+    MNISTLabels train_labels = {0}, test_labels = {0};
+    MNISTImages train_header, test_header;
+    int failed = mnist_read_header(opts.train_images, opts.train_labels, &train_header) != 0 ||
+                 mnist_read_header(opts.test_images, opts.test_labels, &test_header) != 0;
+    if (!failed && rank == 0) {
+        failed = mnist_load_images(opts.train_images, &train_images) != 0 ||
+                 mnist_load_images(opts.test_images, &test_images) != 0;
+    }
+    if (!failed && rank == size - 1) {
+        failed = mnist_load_labels(opts.train_labels, &train_labels) != 0 ||
+                 mnist_load_labels(opts.test_labels, &test_labels) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "Rank %d: failed to load datasets\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    uint32_t train_count = train_header.num_images;
+    uint32_t test_count = test_header.num_images;
+
+    if (rank == 0) {
+        printf("  ✓ Loaded %u training images, %u test images\n\n", train_count, test_count);
+        printf("[2/5] Initializing CNN stages (seed %u)...\n", opts.seed);
+    }
+
+    /* Every rank builds the whole chain (shapes, softmax placement) but
+       only trains and stashes its own layers. */
+    srand(opts.seed);
+    Layer* linput = Layer_create_input(1, 28, 28);
+    Layer* lconv1 = Layer_create_conv(linput, 16, 14, 14, 3, 1, 2, 0.1);
+    Layer* lconv2 = Layer_create_conv(lconv1, 32, 7, 7, 3, 1, 2, 0.1);
+    Layer* lfull1 = Layer_create_full(lconv2, 200, 0.1);
+    Layer* lfull2 = Layer_create_full(lfull1, 200, 0.1);
+    Layer* loutput = Layer_create_full(lfull2, 10, 0.1);
+    Layer* layers[NUM_LAYERS] = {linput, lconv1, lconv2, lfull1, lfull2, loutput};
+
+    /* Parameters of stage s are those rank 0 would have created. */
+    for (int l = 1; l < NUM_LAYERS; l++) {
+        MPI_Bcast(layers[l]->weights, layers[l]->nweights, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Bcast(layers[l]->biases, layers[l]->nbiases, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    }
+
+    int capacity = (opts.batch_size + opts.micro_batches - 1) / opts.micro_batches;
+    Stage stage;
+    stage_init(&stage, layers, rank, size, opts.tp, opts.schedule, opts.micro_batches, capacity);
+    double stash_mb = stage.num_slots * stash_slot_bytes(&stage) / (1024.0 * 1024.0);
+
+    /* Stage table, printed in rank order by rank 0. */
+    int info[5] = {stage.stage, stage.first_layer, stage.last_layer, stage.num_slots,
+                   (stage.tp.shard != NULL) ? stage.tp.row0 : -1};
+    int* all_info = (rank == 0) ? (int*)malloc(5 * size * sizeof(int)) : NULL;
+    double* all_stash = (rank == 0) ? (double*)malloc(size * sizeof(double)) : NULL;
+    MPI_Gather(info, 5, MPI_INT, all_info, 5, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&stash_mb, 1, MPI_DOUBLE, all_stash, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        printf("  ✓ Network: Input(1×28×28) → Conv1(16×14×14) → Conv2(32×7×7) → FC1(200) → FC2(200) → Output(10)\n");
+        for (int r = 0; r < size; r++) {
+            const int* ri = &all_info[5 * r];
+            printf("    Stage %d: %s", ri[0], ri[0] == 0 ? "input + " : "");
+            for (int l = ri[1]; l <= ri[2]; l++) {
+                printf("%s%s", layer_names[l], l < ri[2] ? " + " : "");
+            }
+            if (ri[4] >= 0) {
+                int row1 = (r + 1 < size && all_info[5 * (r + 1)] == ri[0]) ?
+                           all_info[5 * (r + 1) + 4] : layers[FC1_LAYER]->nnodes;
+                printf(" rows %d-%d (rank %d)", ri[4], row1 - 1, r);
+            }
+            printf("  (%d stash slot(s), %.2f MB)\n", ri[3], all_stash[r]);
+        }
+        printf("\n");
+        printf("[3/5] Training (%d epochs, batch %d, %d micro-batches of %d, %s schedule)...\n\n",
+               opts.epochs, opts.batch_size, opts.micro_batches, capacity,
+               opts.schedule == SCHEDULE_GPIPE ? "GPipe" : "1F1B");
+        printf("  %-6s %12s %12s %12s %10s %10s\n",
+               "Epoch", "Train(s)", "Total(s)", "Samples/s", "Bubble(%)", "Accuracy");
+        printf("  ----------------------------------------------------------------------\n");
+    }
+
+    double train_time = 0.0;
+    double train_busy = 0.0;
+    double train_idle = 0.0;
+    double time_to_target = -1.0;
+    int target_epoch = -1;
+    double accuracy = 0.0;
+
+    for (int epoch = 0; epoch < opts.epochs; epoch++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double busy_before = stage.busy_time;
+        double idle_before = stage.idle_time;
+        double epoch_start = MPI_Wtime();
+        train_epoch(&stage, opts.schedule, opts.batch_size, opts.micro_batches,
+                    train_count, &train_images, &train_labels);
+        double epoch_time = MPI_Wtime() - epoch_start;
+        train_busy += stage.busy_time - busy_before;
+        train_idle += stage.idle_time - idle_before;
+
+        /* Bubble: share of the slowest stage's wall time a stage is not
+           computing, averaged over the stages. */
+        MPI_Allreduce(MPI_IN_PLACE, &epoch_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        double bubble = 1.0 - (stage.busy_time - busy_before) / epoch_time;
+        MPI_Allreduce(MPI_IN_PLACE, &bubble, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        bubble /= size;
+        train_time += epoch_time;
+
+        accuracy = test_model(&stage, test_count, &test_images, &test_labels);
+        if (target_epoch < 0 && accuracy >= opts.target_accuracy) {
+            target_epoch = epoch + 1;
+            time_to_target = train_time;
+        }
+
+        if (rank == 0) {
+            printf("  %-6d %12.2f %12.2f %12.1f %9.1f%% %9.2f%%\n",
+                   epoch + 1, epoch_time, train_time, train_count / epoch_time,
+                   bubble * 100.0, accuracy);
+        }
+    }
+
+    double busy[2] = {train_busy, train_idle};
+    double* all_busy = (rank == 0) ? (double*)malloc(2 * size * sizeof(double)) : NULL;
+    MPI_Gather(busy, 2, MPI_DOUBLE, all_busy, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    gather_parameters(&stage, rank, opts.tp);
+
+    if (rank == 0) {
+        printf("\n[4/5] Saving trained model...\n");
+        if (opts.save_path != NULL) {
+            if (model_save(opts.save_path, layers, NUM_LAYERS) != 0) {
+                fprintf(stderr, "Failed to save model\n");
+            } else {
+                printf("  ✓ Model saved to: %s\n\n", opts.save_path);
+            }
+        } else {
+            printf("  (skipped, no --save given)\n\n");
+        }
+
+        /* Bubble of the fill/drain phases with equal stage times. */
+        double ideal_bubble = (double)(num_stages - 1) / (opts.micro_batches + num_stages - 1);
+        double mean_bubble = 0.0;
+        printf("[5/5] Summary\n");
+        printf("==========================================================================\n");
+        printf("                  PIPELINE PARALLEL TRAINING SUMMARY                      \n");
+        printf("==========================================================================\n");
+        printf("  %-6s %-6s %12s %12s %12s\n", "Rank", "Stage", "Compute(s)", "Waiting(s)", "Bubble(%)");
+        for (int r = 0; r < size; r++) {
+            double stage_bubble = 1.0 - all_busy[2 * r] / train_time;
+            mean_bubble += stage_bubble / size;
+            printf("  %-6d %-6d %12.2f %12.2f %11.1f%%\n", r, all_info[5 * r], all_busy[2 * r],
+                   all_busy[2 * r + 1], stage_bubble * 100.0);
+        }
+        printf("\n");
+        printf("  Stages:            %d\n", num_stages);
+        if (opts.tp > 1) {
+            printf("  FC1 Tensor Split:  %d ranks (output neurons)\n", opts.tp);
+        }
+        printf("  Schedule:          %s\n", opts.schedule == SCHEDULE_GPIPE ? "GPipe" : "1F1B");
+        printf("  Micro-batches:     %d per minibatch of %d\n", opts.micro_batches, opts.batch_size);
+        printf("  Epochs:            %d\n", opts.epochs);
+        printf("  Training Time:     %.2f seconds\n", train_time);
+        printf("  Throughput:        %.1f samples/s\n", (double)train_count * opts.epochs / train_time);
+        printf("  Bubble Fraction:   %.1f%% measured, %.1f%% ideal (S-1)/(M+S-1)\n",
+               mean_bubble * 100.0, ideal_bubble * 100.0);
+        printf("  Final Accuracy:    %.2f%%\n", accuracy);
+        if (target_epoch > 0) {
+            printf("  Time to %.2f%%:    %.2f seconds (epoch %d)\n",
+                   opts.target_accuracy, time_to_target, target_epoch);
+        } else {
+            printf("  Time to %.2f%%:    not reached\n", opts.target_accuracy);
+        }
+        printf("==========================================================================\n");
+    }
+
+    free(all_info);
+    free(all_stash);
+    free(all_busy);
+    stage_free(&stage);
+    if (rank == 0) {
+        mnist_free_images(&train_images);
+        mnist_free_images(&test_images);
+    }
+    if (rank == size - 1) {
+        mnist_free_labels(&train_labels);
+        mnist_free_labels(&test_labels);
+    }
+    for (int l = NUM_LAYERS - 1; l >= 0; l--) {
+        Layer_destroy(layers[l]);
+    }
+
+    MPI_Finalize();
+    return 0;
+}